@@ -4,6 +4,7 @@
 #include "detectorinfotablemodel.h"
 #include "deviceconnectionview.h"
 
+#include <lmrs/core/accessorystatecache.h>
 #include <lmrs/core/algorithms.h>
 #include <lmrs/core/logging.h>
 #include <lmrs/core/memory.h>
@@ -139,11 +140,13 @@ void AccessoryControlView::Private::onTurnoutInfoChanged(TurnoutInfo info)
 void AccessoryControlView::Private::onAddressChanged()
 {
     if (const auto accessoryControl = q()->accessoryControl()) {
-        accessoryControl->requestAccessoryInfo(addressBox->value(), [this](AccessoryInfo info) {
+        const auto stateCache = accessoryControl->stateCache();
+
+        stateCache->requestAccessoryInfo(addressBox->value(), [this](AccessoryInfo info) {
             onAccessoryInfoChanged(std::move(info));
         });
 
-        accessoryControl->requestTurnoutInfo(addressBox->value(), [this](TurnoutInfo info) {
+        stateCache->requestTurnoutInfo(addressBox->value(), [this](TurnoutInfo info) {
             onTurnoutInfoChanged(std::move(info));
         });
     }
@@ -166,7 +169,7 @@ void AccessoryControlView::Private::onAccessoryTypeToggled(int id, bool checked)
     };
 
     layout->setRowVisible(rowOf(directionsLayout), type != AccessoryType::AdvancedSignal);
-    layout->setRowVisible(rowOf(durationsLayout), type == AccessoryType::AdvancedTurnout);
+    layout->setRowVisible(rowOf(durationsLayout), type != AccessoryType::AdvancedSignal);
     layout->setRowVisible(rowOf(signalLayout), type == AccessoryType::AdvancedSignal);
 
     emergencyStopButton->setVisible(type != AccessoryType::SimpleTurnout);
@@ -182,7 +185,12 @@ void AccessoryControlView::Private::onDirectionClicked(int id)
     if (const auto accessoryControl = q()->accessoryControl()) {
         switch (static_cast<AccessoryType>(accessoryTypeGroup->checkedId())) {
         case AccessoryType::SimpleTurnout:
-            accessoryControl->setTurnoutState(addressBox->value(), state);
+            // switched like a route of one turnout, so that the output gets deactivated after the duration
+            if (duration.count() > 0)
+                accessoryControl->setTurnoutStates({{addressBox->value(), state}}, duration);
+            else
+                accessoryControl->setTurnoutState(addressBox->value(), state);
+
             break;
 
         case AccessoryType::AdvancedTurnout:
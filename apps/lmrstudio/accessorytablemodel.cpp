@@ -1,5 +1,6 @@
 #include "accessorytablemodel.h"
 
+#include <lmrs/core/accessorystatecache.h>
 #include <lmrs/core/algorithms.h>
 #include <lmrs/core/device.h>
 
@@ -125,13 +126,26 @@ void AccessoryTableModel::setAccessoryControl(core::AccessoryControl *newControl
         if (oldControl)
             oldControl->disconnect(this);
 
+        beginResetModel();
+        m_rows.clear();
+
         if (newControl) {
+            // start with the states the device already reported, the cache is sorted like the rows
+            const auto stateCache = newControl->stateCache();
+
+            for (const auto &info: stateCache->accessories())
+                m_rows.append(Row{info});
+            for (const auto &info: stateCache->turnouts())
+                m_rows.append(Row{info});
+
             connect(newControl, &core::AccessoryControl::accessoryInfoChanged,
                     this, &AccessoryTableModel::onAccessoryInfoChanged);
             connect(newControl, &core::AccessoryControl::turnoutInfoChanged,
                     this, &AccessoryTableModel::onTurnoutInfoChanged);
         }
 
+        endResetModel();
+
         emit accessoryControlChanged(newControl);
     }
 }
@@ -153,12 +167,13 @@ void AccessoryTableModel::onTurnoutInfoChanged(TurnoutInfo info)
 
 void AccessoryTableModel::onRowChanged(Row row)
 {
-    const auto it = std::find_if(m_rows.begin(), m_rows.end(), [newRow = row](const Row &oldRow) {
-        if (const auto typeOrder = core::value(oldRow.type()) <=> core::value(newRow.type());
+    // rows are sorted by type and address, so a binary search finds the place of the row
+    const auto it = std::lower_bound(m_rows.begin(), m_rows.end(), row, [](const Row &lhs, const Row &rhs) {
+        if (const auto typeOrder = core::value(lhs.type()) <=> core::value(rhs.type());
                 typeOrder != std::strong_ordering::equal)
-            return typeOrder == std::strong_ordering::greater;
+            return typeOrder == std::strong_ordering::less;
 
-        return oldRow.address().toInt() >= newRow.address().toInt();
+        return lhs.address().toInt() < rhs.address().toInt();
     });
 
     const auto rowNumber = static_cast<int>(it - m_rows.begin());
@@ -5,6 +5,7 @@
 #include <lmrs/core/logging.h>
 #include <lmrs/core/staticinit.h>
 #include <lmrs/core/symbolictrackplanmodel.h>
+#include <lmrs/core/tracing.h>
 #include <lmrs/core/userliterals.h>
 
 #include <lmrs/esu/lp2device.h>
@@ -42,6 +43,13 @@ void Application::staticConstructor()
 int Application::run()
 {
     const auto languages = std::make_unique<core::l10n::LanguageManager>(this);
+    const auto traceRecorder = std::make_unique<core::TraceRecorder>(this);
+
+    // protocol traces are decoded by the TraceDump tool
+    if (const auto fileName = qEnvironmentVariable("LMRS_TRACE"); !fileName.isEmpty()) {
+        if (!traceRecorder->start(fileName))
+            qCWarning(logger(this), "Could not start protocol trace: %ls", qUtf16Printable(traceRecorder->errorString()));
+    }
 
     core::DeviceFactory::addDeviceFactory(new esu::lp2::DeviceFactory{this});
     core::DeviceFactory::addDeviceFactory(new kpfzeller::DeviceFactory{this});
@@ -0,0 +1,247 @@
+#include "accessorystatecache.h"
+
+#include "continuation.h"
+#include "typetraits.h"
+
+#include <QPointer>
+#include <QTimer>
+#include <QTimerEvent>
+
+namespace lmrs::core {
+
+using namespace std::chrono_literals;
+
+AccessoryStateCache::AccessoryStateCache(AccessoryControl *control)
+    : QObject{control}
+{
+    for (auto address = 1; address <= DefaultWarmUpCount; ++address)
+        m_warmUpAddresses.append(static_cast<quint16>(address));
+
+    connect(control, &AccessoryControl::accessoryInfoChanged, this, &AccessoryStateCache::onAccessoryInfoChanged);
+    connect(control, &AccessoryControl::turnoutInfoChanged, this, &AccessoryStateCache::onTurnoutInfoChanged);
+
+    // the cache is created by the control's constructor, where device() cannot be called yet
+    QTimer::singleShot(0, this, &AccessoryStateCache::attachDevice);
+}
+
+AccessoryControl *AccessoryStateCache::accessoryControl() const
+{
+    return checked_cast<AccessoryControl *>(parent());
+}
+
+void AccessoryStateCache::setWarmUpAddresses(QList<dcc::AccessoryAddress> addresses)
+{
+    m_warmUpAddresses = std::move(addresses);
+}
+
+QList<dcc::AccessoryAddress> AccessoryStateCache::warmUpAddresses() const
+{
+    return m_warmUpAddresses;
+}
+
+void AccessoryStateCache::setWarmUpRate(int queriesPerSecond)
+{
+    m_warmUpRate = std::max(queriesPerSecond, 1);
+
+    if (m_warmUpTimerId) {
+        killTimer(m_warmUpTimerId);
+        m_warmUpTimerId = startTimer(std::chrono::milliseconds{1s} / m_warmUpRate);
+    }
+}
+
+int AccessoryStateCache::warmUpRate() const
+{
+    return m_warmUpRate;
+}
+
+void AccessoryStateCache::startWarmUp()
+{
+    if (!canQueryStates())
+        return;
+
+    m_warmUpQueue = m_warmUpAddresses;
+    std::sort(m_warmUpQueue.begin(), m_warmUpQueue.end());
+    m_warmUpQueue.erase(std::unique(m_warmUpQueue.begin(), m_warmUpQueue.end()), m_warmUpQueue.end());
+
+    if (m_warmUpQueue.isEmpty() || m_warmUpTimerId)
+        return;
+
+    m_warmUpTimerId = startTimer(std::chrono::milliseconds{1s} / m_warmUpRate);
+    emit warmingUpChanged(true);
+}
+
+void AccessoryStateCache::stopWarmUp()
+{
+    m_warmUpQueue.clear();
+
+    if (m_warmUpTimerId) {
+        killTimer(std::exchange(m_warmUpTimerId, 0));
+        emit warmingUpChanged(false);
+    }
+}
+
+bool AccessoryStateCache::isWarmingUp() const
+{
+    return m_warmUpTimerId != 0;
+}
+
+bool AccessoryStateCache::canQueryStates() const
+{
+    return accessoryControl()->features().testFlag(AccessoryControl::Feature::StateQueries);
+}
+
+std::optional<dcc::AccessoryState> AccessoryStateCache::accessoryState(dcc::AccessoryAddress address) const
+{
+    if (const auto it = m_accessories.constFind(address); it != m_accessories.constEnd())
+        return it.value();
+
+    return {};
+}
+
+std::optional<dcc::TurnoutState> AccessoryStateCache::turnoutState(dcc::AccessoryAddress address) const
+{
+    if (const auto it = m_turnouts.constFind(address); it != m_turnouts.constEnd())
+        return it.value();
+
+    return {};
+}
+
+QList<accessory::AccessoryInfo> AccessoryStateCache::accessories() const
+{
+    auto accessories = QList<accessory::AccessoryInfo>{};
+    accessories.reserve(m_accessories.size());
+
+    for (auto it = m_accessories.constBegin(); it != m_accessories.constEnd(); ++it)
+        accessories.append({it.key(), it.value()});
+
+    return accessories;
+}
+
+QList<accessory::TurnoutInfo> AccessoryStateCache::turnouts() const
+{
+    auto turnouts = QList<accessory::TurnoutInfo>{};
+    turnouts.reserve(m_turnouts.size());
+
+    for (auto it = m_turnouts.constBegin(); it != m_turnouts.constEnd(); ++it)
+        turnouts.append({it.key(), it.value()});
+
+    return turnouts;
+}
+
+void AccessoryStateCache::requestAccessoryInfo(dcc::AccessoryAddress address, AccessoryControl::AccessoryInfoCallback callback)
+{
+    if (const auto it = m_accessories.constFind(address); it != m_accessories.constEnd()) {
+        callIfDefined(callback, accessory::AccessoryInfo{address, it.value()});
+        return;
+    }
+
+    if (!canQueryStates())
+        return;
+
+    accessoryControl()->requestAccessoryInfo(address, [cache = QPointer{this}, callback](accessory::AccessoryInfo info) {
+        if (cache)
+            cache->onAccessoryInfoChanged(info);
+
+        callIfDefined(callback, std::move(info));
+    });
+}
+
+void AccessoryStateCache::requestTurnoutInfo(dcc::AccessoryAddress address, AccessoryControl::TurnoutInfoCallback callback)
+{
+    if (const auto it = m_turnouts.constFind(address); it != m_turnouts.constEnd()) {
+        callIfDefined(callback, accessory::TurnoutInfo{address, it.value()});
+        return;
+    }
+
+    if (!canQueryStates()) {
+        callIfDefined(callback, accessory::TurnoutInfo{address, dcc::TurnoutState::Unknown});
+        return;
+    }
+
+    accessoryControl()->requestTurnoutInfo(address, [cache = QPointer{this}, callback](accessory::TurnoutInfo info) {
+        // an unknown state tells nothing, e.g. when the query timed out
+        if (cache && info.state() != dcc::TurnoutState::Unknown && info.state() != dcc::TurnoutState::Invalid)
+            cache->onTurnoutInfoChanged(info);
+
+        callIfDefined(callback, std::move(info));
+    });
+}
+
+void AccessoryStateCache::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_warmUpTimerId) {
+        runWarmUp();
+        return;
+    }
+
+    QObject::timerEvent(event);
+}
+
+void AccessoryStateCache::attachDevice()
+{
+    if (const auto device = accessoryControl()->device()) {
+        connect(device, &Device::stateChanged, this, &AccessoryStateCache::onDeviceStateChanged);
+
+        if (device->state() == Device::State::Connected)
+            startWarmUp();
+    }
+}
+
+void AccessoryStateCache::onDeviceStateChanged(Device::State state)
+{
+    switch (state) {
+    case Device::State::Connected:
+        startWarmUp();
+        break;
+
+    case Device::State::Disconnected:
+        clear();
+        break;
+
+    case Device::State::Connecting:
+        break;
+    }
+}
+
+void AccessoryStateCache::onAccessoryInfoChanged(accessory::AccessoryInfo info)
+{
+    m_accessories.insert(info.address(), info.state());
+}
+
+void AccessoryStateCache::onTurnoutInfoChanged(accessory::TurnoutInfo info)
+{
+    const auto it = m_turnouts.constFind(info.address());
+    const auto hasChanged = (it == m_turnouts.constEnd() || it.value() != info.state());
+
+    m_turnouts.insert(info.address(), info.state());
+
+    if (hasChanged)
+        emit turnoutInfoChanged(std::move(info));
+}
+
+void AccessoryStateCache::runWarmUp()
+{
+    // one query per timer event, skipping addresses reported by broadcasts in the meantime
+    while (!m_warmUpQueue.isEmpty()) {
+        const auto address = m_warmUpQueue.takeFirst();
+
+        if (!m_turnouts.contains(address)) {
+            requestTurnoutInfo(address, {});
+            break;
+        }
+    }
+
+    if (m_warmUpQueue.isEmpty())
+        stopWarmUp();
+}
+
+void AccessoryStateCache::clear()
+{
+    stopWarmUp();
+
+    // the layout might change while disconnected
+    m_accessories.clear();
+    m_turnouts.clear();
+}
+
+} // namespace lmrs::core
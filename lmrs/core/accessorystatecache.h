@@ -0,0 +1,90 @@
+#ifndef LMRS_CORE_ACCESSORYSTATECACHE_H
+#define LMRS_CORE_ACCESSORYSTATECACHE_H
+
+#include "accessories.h"
+#include "device.h"
+
+#include <QMap>
+
+#include <optional>
+
+namespace lmrs::core {
+
+///
+/// The AccessoryStateCache class remembers the turnout and accessory states reported by an AccessoryControl.
+/// Once the device is connected, the configured turnouts get queried in the background at a limited rate,
+/// so that user interfaces and automation can be answered from memory. The cache is cleared on disconnect.
+/// Devices that cannot report states on request, which is told by AccessoryControl::Feature::StateQueries,
+/// only feed the cache by broadcasts.
+///
+class AccessoryStateCache : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool warmingUp READ isWarmingUp NOTIFY warmingUpChanged FINAL)
+
+public:
+    static constexpr auto DefaultWarmUpRate = 10;
+    static constexpr auto DefaultWarmUpCount = 64;
+
+    explicit AccessoryStateCache(AccessoryControl *control);
+
+    [[nodiscard]] AccessoryControl *accessoryControl() const;
+
+    /// The turnouts queried after connecting.
+    void setWarmUpAddresses(QList<dcc::AccessoryAddress> addresses);
+    [[nodiscard]] QList<dcc::AccessoryAddress> warmUpAddresses() const;
+
+    /// The maximum number of queries per second while warming up.
+    void setWarmUpRate(int queriesPerSecond);
+    [[nodiscard]] int warmUpRate() const;
+
+    /// Queries the configured turnouts not reported yet. This happens automatically when the device connects.
+    void startWarmUp();
+    void stopWarmUp();
+
+    [[nodiscard]] bool isWarmingUp() const;
+
+    [[nodiscard]] std::optional<dcc::AccessoryState> accessoryState(dcc::AccessoryAddress address) const;
+    [[nodiscard]] std::optional<dcc::TurnoutState> turnoutState(dcc::AccessoryAddress address) const;
+
+    /// The states the device reported since connecting.
+    [[nodiscard]] QList<accessory::AccessoryInfo> accessories() const;
+    [[nodiscard]] QList<accessory::TurnoutInfo> turnouts() const;
+
+    /// Reports the cached state if the device reported it since connecting, and queries the device otherwise.
+    /// Devices that cannot be queried report unknown turnout states, and nothing for accessories.
+    /// Queries answered with an unknown turnout state, like after a timeout, are not cached.
+    void requestAccessoryInfo(dcc::AccessoryAddress address, AccessoryControl::AccessoryInfoCallback callback);
+    void requestTurnoutInfo(dcc::AccessoryAddress address, AccessoryControl::TurnoutInfoCallback callback);
+
+signals:
+    /// Unlike AccessoryControl::turnoutInfoChanged(), this is only emitted when the state actually changed.
+    void turnoutInfoChanged(lmrs::core::accessory::TurnoutInfo turnoutInfo);
+    void warmingUpChanged(bool warmingUp);
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private:
+    [[nodiscard]] bool canQueryStates() const;
+
+    void attachDevice();
+    void onDeviceStateChanged(Device::State state);
+    void onAccessoryInfoChanged(accessory::AccessoryInfo info);
+    void onTurnoutInfoChanged(accessory::TurnoutInfo info);
+
+    void runWarmUp();
+    void clear();
+
+    QMap<dcc::AccessoryAddress, dcc::AccessoryState> m_accessories;
+    QMap<dcc::AccessoryAddress, dcc::TurnoutState> m_turnouts;
+
+    QList<dcc::AccessoryAddress> m_warmUpAddresses;
+    QList<dcc::AccessoryAddress> m_warmUpQueue;
+    int m_warmUpRate = DefaultWarmUpRate;
+    int m_warmUpTimerId = 0;
+};
+
+} // namespace lmrs::core
+
+#endif // LMRS_CORE_ACCESSORYSTATECACHE_H
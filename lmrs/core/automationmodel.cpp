@@ -1,6 +1,7 @@
 #include "automationmodel.h"
 
 #include "accessories.h"
+#include "accessorystatecache.h"
 #include "device.h"
 #include "logging.h"
 #include "parameters.h"
@@ -300,8 +301,9 @@ bool TurnoutEvent::hasSecondaryState() const
 
 void TurnoutEvent::setControl(AccessoryControl *newControl)
 {
+    // the state cache drops repeated reports of the same state
     if (newControl) {
-        connect(newControl, &AccessoryControl::turnoutInfoChanged,
+        connect(newControl->stateCache(), &AccessoryStateCache::turnoutInfoChanged,
                 this, &TurnoutEvent::onTurnoutInfoChanged);
     }
 }
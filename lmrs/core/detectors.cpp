@@ -282,43 +282,43 @@ DetectorAddress DetectorAddress::forRBusPort(rbus::ModuleId module, rbus::PortIn
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-template<typename T>
-bool DetectorAddress::equals(const DetectorAddress &rhs) const
+quint64 DetectorAddress::key() const noexcept
 {
-    return std::get<T>(m_value) == std::get<T>(rhs.m_value);
-}
-
-bool DetectorAddress::operator==(const DetectorAddress &rhs) const noexcept
-{
-    if (type() != rhs.type())
-        return false;
+    // the type goes to the most significant byte, the fields of the address below
+    const auto typeKey = static_cast<quint64>(type()) << 56;
 
     switch (type()) {
     case Type::Invalid:
-        return equals<std::monostate>(rhs);
+    case Type::LoconetSIC:
+        return typeKey;
 
     case Type::CanNetwork:
-        return equals<can::NetworkId>(rhs);
-    case Type::CanModule:
-        return equals<can::ModuleAddress>(rhs);
-    case Type::CanPort:
-        return equals<can::PortAddress>(rhs);
+        return typeKey | (quint64{std::get<can::NetworkId>(m_value)} << 24);
 
-    case Type::LissyModule:
-        return equals<lissy::FeedbackAddress>(rhs);
+    case Type::CanModule: {
+        const auto address = std::get<can::ModuleAddress>(m_value);
+        return typeKey | (quint64{address.network} << 24) | (quint64{address.module} << 8);
+    }
 
-    case Type::LoconetSIC:
-        return equals<loconet::StationaryInterrogate>(rhs);
+    case Type::CanPort: {
+        const auto address = std::get<can::PortAddress>(m_value);
+        return typeKey | (quint64{address.network} << 24) | (quint64{address.module} << 8) | address.port;
+    }
+
+    case Type::LissyModule:
+        return typeKey | std::get<lissy::FeedbackAddress>(m_value);
     case Type::LoconetModule:
-        return equals<loconet::ReportAddress>(rhs);
+        return typeKey | std::get<loconet::ReportAddress>(m_value);
 
     case Type::RBusGroup:
-        return equals<rbus::GroupId>(rhs);
+        return typeKey | std::get<rbus::GroupId>(m_value);
     case Type::RBusModule:
-        return equals<rbus::ModuleId>(rhs);
-    case Type::RBusPort:
-        return equals<rbus::PortAddress>(rhs);
+        return typeKey | std::get<rbus::ModuleId>(m_value);
 
+    case Type::RBusPort: {
+        const auto address = std::get<rbus::PortAddress>(m_value);
+        return typeKey | (quint64{address.module} << 8) | address.port;
+    }
     }
 
     Q_UNREACHABLE();
@@ -380,6 +380,77 @@ QDebug operator<<(QDebug debug, const DetectorAddress &address)
     return debug;
 }
 
+DetectorInfo::DetectorInfo(DetectorAddress module,
+                           Occupancy occupancy, PowerState powerState,
+                           QList<dcc::VehicleAddress> vehicles,
+                           QList<dcc::Direction> directions)
+    : DetectorInfo{std::move(module), occupancy, powerState}
+{
+    for (auto i = 0; i < vehicles.size(); ++i)
+        addVehicle(vehicles[i], directions.value(i, dcc::Direction::Unknown));
+}
+
+dcc::VehicleAddress DetectorInfo::vehicle(qsizetype index) const noexcept
+{
+    if (index < m_vehicleCount)
+        return m_vehicles[static_cast<size_t>(index)];
+
+    return m_moreVehicles[index - m_vehicleCount].first;
+}
+
+dcc::Direction DetectorInfo::direction(qsizetype index) const noexcept
+{
+    if (index < m_vehicleCount)
+        return dcc::Direction{m_directions[static_cast<size_t>(index)]};
+
+    return m_moreVehicles[index - m_vehicleCount].second;
+}
+
+QList<dcc::VehicleAddress> DetectorInfo::vehicles() const
+{
+    auto vehicles = QList<dcc::VehicleAddress>{m_vehicles.begin(), m_vehicles.begin() + m_vehicleCount};
+    vehicles.reserve(vehicleCount());
+
+    for (const auto &entry : m_moreVehicles)
+        vehicles.append(entry.first);
+
+    return vehicles;
+}
+
+QList<dcc::Direction> DetectorInfo::directions() const
+{
+    auto directions = QList<dcc::Direction>{};
+    directions.reserve(vehicleCount());
+
+    for (auto i = 0; i < vehicleCount(); ++i)
+        directions.append(direction(i));
+
+    return directions;
+}
+
+void DetectorInfo::addVehicle(dcc::VehicleAddress vehicle, dcc::Direction direction)
+{
+    if (m_vehicleCount < InlineVehicleCount) {
+        m_vehicles[m_vehicleCount] = vehicle;
+        m_directions[m_vehicleCount] = static_cast<quint8>(direction);
+        ++m_vehicleCount;
+    } else {
+        m_moreVehicles.emplaceBack(vehicle, direction);
+    }
+}
+
+bool DetectorInfo::operator==(const DetectorInfo &rhs) const noexcept
+{
+    // only compare the vehicle slots in use
+    return m_address == rhs.m_address
+            && m_occupancy == rhs.m_occupancy
+            && m_powerState == rhs.m_powerState
+            && m_vehicleCount == rhs.m_vehicleCount
+            && std::equal(m_vehicles.begin(), m_vehicles.begin() + m_vehicleCount, rhs.m_vehicles.begin())
+            && std::equal(m_directions.begin(), m_directions.begin() + m_vehicleCount, rhs.m_directions.begin())
+            && m_moreVehicles == rhs.m_moreVehicles;
+}
+
 QDebug operator<<(QDebug debug, const DetectorInfo &info)
 {
     const auto prettyPrinter = PrettyPrinter<decltype(info)>{debug};
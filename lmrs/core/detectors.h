@@ -5,6 +5,8 @@
 
 #include <QVariant>
 
+#include <array>
+
 namespace lmrs::core::accessory {
 
 namespace can {
@@ -161,7 +163,10 @@ public slots:
     [[nodiscard]] static DetectorAddress forRBusPort(rbus::ModuleId module, rbus::PortIndex port);
 
 public:
-    bool operator==(const DetectorAddress &rhs) const noexcept;
+    /// The type and all fields of this address packed into one integer, for cheap hashing and comparison.
+    [[nodiscard]] quint64 key() const noexcept;
+
+    bool operator==(const DetectorAddress &rhs) const noexcept { return key() == rhs.key(); }
     bool operator!=(const DetectorAddress &rhs) const noexcept = default;
     operator QVariant() const { return QVariant::fromValue(*this); }
 
@@ -170,8 +175,6 @@ private:
         : m_value{std::move(value)}
     {}
 
-    template<typename T> bool equals(const DetectorAddress &rhs) const;
-
     static auto &logger();
 
     value_type m_value;
@@ -181,37 +184,9 @@ static_assert(DetectorAddress{}.type() == DetectorAddress::Type::Invalid);
 
 QDebug operator<<(QDebug debug, const DetectorAddress &address);
 
-constexpr size_t qHash(const DetectorAddress &address, size_t seed = 0) noexcept
+inline size_t qHash(const DetectorAddress &address, size_t seed = 0) noexcept
 {
-    using Type = lmrs::core::accessory::DetectorAddress::Type;
-
-    switch (address.type()) {
-    case Type::CanNetwork:
-        return qHashMulti(seed, value(address.type()), address.canNetwork());
-    case Type::CanModule:
-        return qHashMulti(seed, value(address.type()), address.canModuleAddress());
-    case Type::CanPort:
-        return qHashMulti(seed, value(address.type()), address.canPortAddress());
-
-    case Type::LissyModule:
-        return qHashMulti(seed, value(address.type()), address.lissyModule());
-
-    case Type::LoconetModule:
-        return qHashMulti(seed, value(address.type()), address.loconetModule());
-
-    case Type::RBusGroup:
-        return qHashMulti(seed, value(address.type()), address.rbusGroup());
-    case Type::RBusModule:
-        return qHashMulti(seed, value(address.type()), address.rbusModule());
-    case Type::RBusPort:
-        return qHashMulti(seed, value(address.type()), address.rbusPortAddress());
-
-    case Type::LoconetSIC:
-    case Type::Invalid:
-        break;
-    }
-
-    return qHashMulti(seed, value(address.type()));
+    return qHashMulti(seed, address.key());
 }
 
 struct DetectorInfo
@@ -219,7 +194,7 @@ struct DetectorInfo
     Q_GADGET
 
 public:
-    enum class Occupancy {
+    enum class Occupancy : quint8 {
         Unknown,
         Free,
         Occupied,
@@ -228,7 +203,7 @@ public:
 
     Q_ENUM(Occupancy)
 
-    enum class PowerState {
+    enum class PowerState : quint8 {
         Unknown,
         Off,
         On,
@@ -237,49 +212,63 @@ public:
 
     Q_ENUM(PowerState)
 
-    DetectorInfo() = default;
+    /// Detectors rarely report more than a few vehicles per section, so these are stored inline.
+    /// Additional vehicles, like from CAN detectors reporting many sets, go to the heap.
+    static constexpr qsizetype InlineVehicleCount = 4;
 
-    DetectorInfo(DetectorAddress module)
+    DetectorInfo() noexcept = default;
+
+    DetectorInfo(DetectorAddress module) noexcept
         : m_address{std::move(module)}
     {}
 
     DetectorInfo(DetectorAddress module, Occupancy occupancy, PowerState powerState) noexcept
-        : DetectorInfo{std::move(module), occupancy, powerState, {}, {}}
+        : m_address{std::move(module)}
+        , m_occupancy{occupancy}
+        , m_powerState{powerState}
     {}
 
     DetectorInfo(DetectorAddress module,
                  Occupancy occupancy, PowerState powerState,
                  QList<dcc::VehicleAddress> vehicles,
-                 QList<dcc::Direction> directions) noexcept
-        : m_address{std::move(module)}
-        , m_occupancy{occupancy}
-        , m_powerState{powerState}
-        , m_vehicles{std::move(vehicles)}
-        , m_directions{std::move(directions)}
-    {}
+                 QList<dcc::Direction> directions);
 
     [[nodiscard]] constexpr auto address() const noexcept { return m_address; }
     [[nodiscard]] constexpr auto occupancy() const noexcept { return m_occupancy;}
     [[nodiscard]] constexpr auto powerState() const noexcept { return m_powerState;}
-    [[nodiscard]] auto vehicles() const noexcept { return m_vehicles; }
-    [[nodiscard]] auto directions() const noexcept { return m_directions; }
+
+    [[nodiscard]] qsizetype vehicleCount() const noexcept { return m_vehicleCount + m_moreVehicles.size(); }
+    [[nodiscard]] dcc::VehicleAddress vehicle(qsizetype index) const noexcept;
+    [[nodiscard]] dcc::Direction direction(qsizetype index) const noexcept;
+
+    [[nodiscard]] QList<dcc::VehicleAddress> vehicles() const;
+    [[nodiscard]] QList<dcc::Direction> directions() const;
 
     void setOccupancy(Occupancy occupancy) { m_occupancy = occupancy; }
     void setPowerState(PowerState powerState) { m_powerState = powerState; }
-    void addVehicles(QList<dcc::VehicleAddress> vehicles) { m_vehicles += std::move(vehicles); }
-    void addDirections(QList<dcc::Direction> directions) { m_directions += std::move(directions); }
 
-    [[nodiscard]] bool operator==(const DetectorInfo &rhs) const noexcept = default;
+    void addVehicle(dcc::VehicleAddress vehicle, dcc::Direction direction = dcc::Direction::Unknown);
+    void clearVehicles() noexcept { m_vehicleCount = 0; m_moreVehicles.clear(); }
+
+    [[nodiscard]] bool operator==(const DetectorInfo &rhs) const noexcept;
 
 private:
     DetectorAddress m_address = {};
 
     Occupancy m_occupancy = Occupancy::Unknown;
     PowerState m_powerState = PowerState::Unknown;
-    QList<dcc::VehicleAddress> m_vehicles;
-    QList<dcc::Direction> m_directions;
+    quint8 m_vehicleCount = 0;
+
+    std::array<dcc::VehicleAddress, InlineVehicleCount> m_vehicles = {};
+    std::array<quint8, InlineVehicleCount> m_directions = {};
+
+    // only allocated when more than InlineVehicleCount vehicles are reported
+    QList<std::pair<dcc::VehicleAddress, dcc::Direction>> m_moreVehicles;
 };
 
+// detector floods get copied around a lot, e.g. through queued connections and caches
+static_assert(std::is_trivially_copyable_v<DetectorAddress>);
+
 QDebug operator<<(QDebug debug, const DetectorInfo &info);
 
 } // namespace lmrs::core::accessory
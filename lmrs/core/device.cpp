@@ -1,23 +1,28 @@
 #include "decoderinfo.h"
 
 #include "accessories.h"
+#include "accessorystatecache.h"
 #include "algorithms.h"
 #include "detectors.h"
 #include "device.h"
 #include "logging.h"
 #include "quantities.h"
+#include "railcomstatisticsmodel.h"
 #include "userliterals.h"
 #include "vehicleinfomodel.h"
 
 #include <QDateTime>
 #include <QLocale>
 #include <QPointer>
+#include <QTimerEvent>
 #include <QVersionNumber>
 
 namespace lmrs::core {
 
 namespace {
 
+using namespace std::chrono_literals;
+
 auto deviceFactoriesGlobal()
 {
     static QList<QPointer<DeviceFactory>> s_deviceFactories;
@@ -84,34 +89,81 @@ QString displayText(DeviceInfo id, QVariant info, QString text)
     return text;
 }
 
+// Writing these variables changes the decoder's address, its selected pages, or resets the decoder.
+bool invalidatesPageCache(dcc::VariableIndex variable)
+{
+    using dcc::VehicleVariable;
+
+    for (const auto invalidatingVariable: {VehicleVariable::BasicAddress, VehicleVariable::Manufacturer,
+                                           VehicleVariable::ExtendedAddressHigh, VehicleVariable::ExtendedAddressLow,
+                                           VehicleVariable::Configuration, VehicleVariable::ExtendedPageIndexHigh,
+                                           VehicleVariable::ExtendedPageIndexLow, VehicleVariable::SusiBankIndex}) {
+        if (variable == dcc::variableIndex(invalidatingVariable))
+            return true;
+    }
+
+    return false;
+}
+
+// Identifies the page that must be selected before accessing a variable, or 0 for basic variables.
+quint32 pageSelectKey(dcc::ExtendedVariableIndex variable)
+{
+    const auto basicVariable = dcc::variableIndex(variable);
+
+    if (dcc::range(dcc::VariableSpace::Extended).contains(basicVariable))
+        return (1U << 24) | dcc::extendedPage(variable).value;
+    if (dcc::range(dcc::VariableSpace::Susi).contains(basicVariable))
+        return (2U << 24) | dcc::susiPage(variable).value;
+
+    return 0;
+}
+
 } // namespace
 
 // =====================================================================================================================
 
+AccessoryControl::AccessoryControl(QObject *parent)
+    : Control{parent}
+    , m_stateCache{new AccessoryStateCache{this}}
+{}
+
+void AccessoryControl::setTurnoutStates(QList<TurnoutCommand> commands, std::chrono::milliseconds duration)
+{
+    for (const auto &command: commands)
+        setTurnoutState(command.address, command.state, duration);
+}
+
+AccessoryStateCache *AccessoryControl::stateCache() const
+{
+    return m_stateCache;
+}
+
+// =====================================================================================================================
+
 void VariableControl::readExtendedVariable(dcc::VehicleAddress address, dcc::ExtendedVariableIndex variable,
                                            ContinuationCallback<VariableValueResult> callback)
 {
-    const auto basicVariable = dcc::variableIndex(variable);
+    const auto started = metrics::startTime();
 
-    if (dcc::range(dcc::VariableSpace::Extended).contains(basicVariable)) {
-        selectPage(address, dcc::extendedPage(variable), [this, address, basicVariable, callback](Error error) {
-            if (error != Error::NoError)
-                return Continuation::Retry;
+    const auto failedSelections = std::make_shared<int>(0);
 
-            readVariable(address, basicVariable, std::move(callback));
-            return Continuation::Proceed;
-        });
-    } else if (dcc::range(dcc::VariableSpace::Susi).contains(basicVariable)) {
-        selectPage(address, dcc::susiPage(variable), [this, address, basicVariable, callback](Error error) {
-            if (error != Error::NoError)
-                return Continuation::Retry;
+    selectPage(address, variable, [this, address, variable, callback, started, failedSelections](Error error) {
+        if (error != Error::NoError)
+            return reportPageSelectionError(error, ++*failedSelections, callback);
 
-            readVariable(address, basicVariable, std::move(callback));
-            return Continuation::Proceed;
+        readVariable(address, dcc::variableIndex(variable), [this, address, callback, started](VariableValueResult result) {
+            m_readTime.recordSince(started);
+
+            if (result.failed()) {
+                m_failures.increment();
+                resetPageCache(address);
+            }
+
+            return core::callIfDefined(Continuation::Proceed, callback, std::move(result));
         });
-    } else {
-        readVariable(address, basicVariable, std::move(callback));
-    }
+
+        return Continuation::Proceed;
+    });
 }
 
 void VariableControl::readExtendedVariables(dcc::VehicleAddress address, ExtendedVariableList variableList,
@@ -120,14 +172,25 @@ void VariableControl::readExtendedVariables(dcc::VehicleAddress address, Extende
     if (variableList.isEmpty())
         return;
 
-    // FIXME: sort reads to minimize CV31/CV32, CV1021 writes; or this is too expensive here?
+    // sort reads by page, so that the page cache lets CV31/CV32 and CV1021 only get written once per page
+    std::stable_sort(variableList.begin(), variableList.end(), [](auto lhs, auto rhs) {
+        return pageSelectKey(lhs) < pageSelectKey(rhs);
+    });
+
+    readSortedVariables(address, std::move(variableList), std::move(callback));
+}
+
+void VariableControl::readSortedVariables(dcc::VehicleAddress address, ExtendedVariableList variableList,
+                                          ContinuationCallback<dcc::ExtendedVariableIndex, VariableValueResult> callback)
+{
     const auto variable = variableList.takeFirst();
 
+    // the next read is issued right from the result callback to keep the programming track busy
     readExtendedVariable(address, variable, [=, this](auto result) {
         switch (core::callIfDefined(Continuation::Proceed, callback, variable, result)) {
         case Continuation::Proceed:
             if (!variableList.isEmpty())
-                readExtendedVariables(address, variableList, callback);
+                readSortedVariables(address, variableList, callback);
 
             break;
 
@@ -175,27 +238,66 @@ void VariableControl::writeExtendedVariable(dcc::VehicleAddress address,
                                             dcc::ExtendedVariableIndex variable, dcc::VariableValue value,
                                             ContinuationCallback<VariableValueResult> callback)
 {
-    const auto basicVariable = dcc::variableIndex(variable);
+    const auto started = metrics::startTime();
 
-    if (dcc::range(dcc::VariableSpace::Extended).contains(basicVariable)) {
-        selectPage(address, dcc::extendedPage(variable), [this, address, basicVariable, value, callback](Error error) {
-            if (error != Error::NoError)
-                return Continuation::Retry;
+    const auto failedSelections = std::make_shared<int>(0);
 
-            writeVariable(address, basicVariable, value, std::move(callback));
-            return Continuation::Proceed;
-        });
-    } else if (dcc::range(dcc::VariableSpace::Susi).contains(basicVariable)) {
-        selectPage(address, dcc::susiPage(variable), [this, address, basicVariable, value, callback](Error error) {
-            if (error != Error::NoError)
-                return Continuation::Retry;
+    selectPage(address, variable, [this, address, variable, value, callback, started, failedSelections](Error error) {
+        if (error != Error::NoError)
+            return reportPageSelectionError(error, ++*failedSelections, callback);
 
-            writeVariable(address, basicVariable, value, std::move(callback));
-            return Continuation::Proceed;
+        const auto basicVariable = dcc::variableIndex(variable);
+
+        writeVariable(address, basicVariable, value, [this, address, basicVariable, callback, started](VariableValueResult result) {
+            m_writeTime.recordSince(started);
+
+            if (result.failed())
+                m_failures.increment();
+            if (result.failed() || invalidatesPageCache(basicVariable))
+                resetPageCache(address);
+
+            return core::callIfDefined(Continuation::Proceed, callback, std::move(result));
         });
-    } else {
-        writeVariable(address, basicVariable, value, std::move(callback));
-    }
+
+        return Continuation::Proceed;
+    });
+}
+
+Continuation VariableControl::reportPageSelectionError(Error error, int failureCount,
+                                                       const ContinuationCallback<VariableValueResult> &callback)
+{
+    if (failureCount < ContinuationCallback<Error>::DefaultRetryLimit)
+        return Continuation::Retry;
+
+    m_failures.increment();
+    core::callIfDefined(Continuation::Abort, callback, {error, {}});
+    return Continuation::Abort;
+}
+
+void VariableControl::resetPageCache()
+{
+    m_selectedPages.clear();
+}
+
+void VariableControl::resetPageCache(dcc::VehicleAddress address)
+{
+    m_selectedPages.remove(address);
+}
+
+void VariableControl::invalidatePageCache(dcc::VehicleAddress address, dcc::VariableIndex variable)
+{
+    const auto it = m_selectedPages.find(address);
+
+    if (it == m_selectedPages.end())
+        return;
+
+    if (variable == variableIndex(dcc::VehicleVariable::ExtendedPageIndexHigh)
+            || variable == variableIndex(dcc::VehicleVariable::ExtendedPageIndexLow))
+        it->extendedPage.reset();
+    else if (variable == variableIndex(dcc::VehicleVariable::SusiBankIndex))
+        it->susiPage.reset();
+    else if (invalidatesPageCache(variable))
+        m_selectedPages.erase(it);
 }
 
 void VariableControl::selectPage(dcc::VehicleAddress address, dcc::ExtendedPageIndex page,
@@ -205,20 +307,106 @@ void VariableControl::selectPage(dcc::VehicleAddress address, dcc::ExtendedPageI
     writeVariable(address, variableIndex(dcc::VehicleVariable::ExtendedPageIndexHigh),
                   dcc::cv31(page), [this, address, page, callback](VariableValueResult result) {
         qInfo().verbosity(QDebug::MinimumVerbosity) << Q_FUNC_INFO << __LINE__ << result;
-        const auto continuation = core::callIfDefined(retryOnError(result.error), callback, result.error);
-
-        if (continuation == Continuation::Proceed) {
-            writeVariable(address, variableIndex(dcc::VehicleVariable::ExtendedPageIndexLow),
-                          dcc::cv32(page), [callback](VariableValueResult result) {
-                qInfo().verbosity(QDebug::MinimumVerbosity) << Q_FUNC_INFO << __LINE__ << result;
-                return core::callIfDefined(retryOnError(result.error), callback, result.error);
-            });
-        }
 
-        return continuation;
+        // only report errors here, the page is not selected before CV32 got written
+        if (result.failed())
+            return core::callIfDefined(retryOnError(result.error), callback, result.error);
+
+        writeVariable(address, variableIndex(dcc::VehicleVariable::ExtendedPageIndexLow),
+                      dcc::cv32(page), [callback](VariableValueResult result) {
+            qInfo().verbosity(QDebug::MinimumVerbosity) << Q_FUNC_INFO << __LINE__ << result;
+            return core::callIfDefined(retryOnError(result.error), callback, result.error);
+        });
+
+        return Continuation::Proceed;
     });
 }
 
+void VariableControl::selectPage(dcc::VehicleAddress address, dcc::ExtendedVariableIndex variable,
+                                 ContinuationCallback<Error> callback)
+{
+    const auto basicVariable = dcc::variableIndex(variable);
+
+    if (dcc::range(dcc::VariableSpace::Extended).contains(basicVariable)) {
+        const auto page = dcc::extendedPage(variable);
+
+        if (m_selectedPages.value(address).extendedPage == page) {
+            m_pageCacheHits.increment();
+            core::callIfDefined(Continuation::Proceed, callback, Error::NoError);
+            return;
+        }
+
+        watchPowerControl();
+        m_pageSelections.increment();
+        m_selectedPages[address].extendedPage.reset();
+
+        selectPage(address, page, [this, address, page, callback](Error error) {
+            if (error == Error::NoError)
+                m_selectedPages[address].extendedPage = page;
+            else
+                resetPageCache(address);
+
+            return core::callIfDefined(retryOnError(error), callback, error);
+        });
+    } else if (dcc::range(dcc::VariableSpace::Susi).contains(basicVariable)) {
+        const auto page = dcc::susiPage(variable);
+
+        if (m_selectedPages.value(address).susiPage == page) {
+            m_pageCacheHits.increment();
+            core::callIfDefined(Continuation::Proceed, callback, Error::NoError);
+            return;
+        }
+
+        watchPowerControl();
+        m_pageSelections.increment();
+        m_selectedPages[address].susiPage.reset();
+
+        selectPage(address, page, [this, address, page, callback](Error error) {
+            if (error == Error::NoError)
+                m_selectedPages[address].susiPage = page;
+            else
+                resetPageCache(address);
+
+            return core::callIfDefined(retryOnError(error), callback, error);
+        });
+    } else {
+        core::callIfDefined(Continuation::Proceed, callback, Error::NoError);
+    }
+}
+
+void VariableControl::watchPowerControl()
+{
+    // decoders forget their selected pages when losing power
+    if (m_powerControl)
+        return;
+
+    if (const auto device = this->device())
+        m_powerControl = device->powerControl();
+
+    if (m_powerControl) {
+        connect(m_powerControl, &PowerControl::stateChanged, this,
+                [this, previousState = m_powerControl->state()](PowerControl::State state) mutable {
+            // the programming track loses power when leaving service mode
+            if (std::exchange(previousState, state) == PowerControl::State::ServiceMode) {
+                resetPageCache();
+                return;
+            }
+
+            switch (state) {
+            case PowerControl::State::PowerOff:
+            case PowerControl::State::EmergencyStop:
+            case PowerControl::State::ShortCircuit:
+                resetPageCache();
+                break;
+
+            case PowerControl::State::PowerOn:
+            case PowerControl::State::ServiceMode:
+                break;
+            }
+        });
+    }
+}
+
 void VariableControl::selectPage(dcc::VehicleAddress address, dcc::SusiPageIndex page,
                                  ContinuationCallback<Error> callback)
 {
@@ -230,6 +418,46 @@ void VariableControl::selectPage(dcc::VehicleAddress address, dcc::SusiPageIndex
 
 // =====================================================================================================================
 
+VehicleControl::VehicleControl(QObject *parent)
+    : Control{parent}
+    , m_railcomStatistics{new RailcomStatisticsModel{this}}
+{
+    connect(this, &VehicleControl::railcomSampleReceived, this, [this](RailcomSample sample) {
+        watchDevice();
+        m_railcomStatistics->addSample(std::move(sample));
+    });
+}
+
+void VehicleControl::watchDevice()
+{
+    // the statistics of a previous connection must not mix with the next one
+    if (m_device)
+        return;
+
+    m_device = device();
+
+    if (m_device) {
+        connect(m_device, &Device::stateChanged, m_railcomStatistics, [this](Device::State state) {
+            switch (state) {
+            case Device::State::Disconnected:
+                m_railcomStatistics->clear();
+                break;
+
+            case Device::State::Connecting:
+            case Device::State::Connected:
+                break;
+            }
+        });
+    }
+}
+
+RailcomStatisticsModel *VehicleControl::railcomStatistics() const
+{
+    return m_railcomStatistics;
+}
+
+// =====================================================================================================================
+
 QString Device::deviceInfoText(DeviceInfo id) const
 {
     return deviceInfo(id, Qt::DisplayRole).toString();
@@ -240,6 +468,14 @@ QString Device::deviceInfoDisplayText(DeviceInfo id) const
     return displayText(id, deviceInfo(id), deviceInfoText(id));
 }
 
+QList<const metrics::Registry *> Device::metrics() const
+{
+    if (const auto control = variableControl())
+        return {&control->metrics()};
+
+    return {};
+}
+
 // =====================================================================================================================
 
 QString DeviceFactory::uniqueId(QVariantMap parameters)
@@ -277,6 +513,7 @@ void DeviceInfoModel::setDevice(Device *device)
 
         beginResetModel();
         m_rows.clear();
+        m_metricRows.clear();
 
         if (m_device) {
             for (const auto &id: QMetaTypeId<DeviceInfo>()) {
@@ -291,6 +528,16 @@ void DeviceInfoModel::setDevice(Device *device)
         }
 
         endResetModel();
+
+        // the timer also runs while metrics are disabled, so that the rows follow metrics::setEnabled()
+        if (m_device) {
+            updateMetricRows();
+
+            if (!m_metricsTimerId)
+                m_metricsTimerId = startTimer(1s);
+        } else if (m_metricsTimerId) {
+            killTimer(std::exchange(m_metricsTimerId, 0));
+        }
     }
 }
 
@@ -304,7 +551,7 @@ int DeviceInfoModel::rowCount(const QModelIndex &parent) const
     if (Q_UNLIKELY(parent.isValid()))
         return 0;
 
-    return static_cast<int>(m_rows.size());
+    return static_cast<int>(m_rows.size() + m_metricRows.size());
 }
 
 int DeviceInfoModel::columnCount(const QModelIndex &parent) const
@@ -318,6 +565,33 @@ int DeviceInfoModel::columnCount(const QModelIndex &parent) const
 QVariant DeviceInfoModel::data(const QModelIndex &index, int role) const
 {
     if (hasIndex(index.row(), index.column(), index.parent())) {
+        if (index.row() >= m_rows.size()) {
+            if (!m_device) // the metrics are owned by the device
+                return {};
+
+            const auto &metricRow = m_metricRows[index.row() - m_rows.size()];
+
+            switch (static_cast<Column>(index.column())) {
+            case Column::Name:
+                if (role == Qt::DisplayRole)
+                    return metricRow.name;
+
+                break;
+
+            case Column::Value:
+                if (role == Qt::DisplayRole || role == Qt::ToolTipRole)
+                    return metricRow.metric->toString();
+                else if (role == Qt::EditRole)
+                    return metricRow.metric->toJson().toVariantMap();
+                else if (role == Qt::TextAlignmentRole)
+                    return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+
+                break;
+            }
+
+            return {};
+        }
+
         static const auto deviceInfo = QMetaEnum::fromType<DeviceInfo>();
         const auto row = std::next(m_rows.begin(), index.row());
 
@@ -384,6 +658,55 @@ void DeviceInfoModel::onDeviceInfoChanged(QList<DeviceInfo> changedIds)
     }
 }
 
+void DeviceInfoModel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_metricsTimerId) {
+        updateMetricRows();
+        return;
+    }
+
+    QAbstractTableModel::timerEvent(event);
+}
+
+void DeviceInfoModel::updateMetricRows()
+{
+    auto metricRows = QList<MetricRow>{};
+
+    if (m_device && metrics::isEnabled()) {
+        for (const auto registry: m_device->metrics()) {
+            for (const auto metric: registry->metrics())
+                metricRows.append({registry->name() + '/'_L1 + metric->name(), metric});
+        }
+    }
+
+    const auto sameMetrics = std::equal(metricRows.begin(), metricRows.end(),
+                                        m_metricRows.begin(), m_metricRows.end(),
+                                        [](const auto &lhs, const auto &rhs) {
+        return lhs.metric == rhs.metric;
+    });
+
+    if (!sameMetrics) {
+        const auto first = static_cast<int>(m_rows.size());
+
+        if (!m_metricRows.isEmpty()) {
+            beginRemoveRows({}, first, first + static_cast<int>(m_metricRows.size()) - 1);
+            m_metricRows.clear();
+            endRemoveRows();
+        }
+
+        if (!metricRows.isEmpty()) {
+            beginInsertRows({}, first, first + static_cast<int>(metricRows.size()) - 1);
+            m_metricRows = std::move(metricRows);
+            endInsertRows();
+        }
+    } else if (!m_metricRows.isEmpty()) {
+        static const QList<int> roles = {Qt::EditRole, Qt::DisplayRole};
+        const auto first = static_cast<int>(m_rows.size());
+        const auto last = first + static_cast<int>(m_metricRows.size()) - 1;
+        emit dataChanged(index(first, core::value(Column::Value)), index(last, core::value(Column::Value)), roles);
+    }
+}
+
 Continuation retryOnError(Error error)
 {
     if (error != Error::NoError)
@@ -3,10 +3,13 @@
 
 #include "continuation.h"
 #include "dccconstants.h"
+#include "metrics.h"
 
 #include <QAbstractTableModel>
 #include <QPointer>
 
+#include <optional>
+
 namespace lmrs::core {
 
 namespace accessory {
@@ -19,9 +22,12 @@ namespace parameters {
 struct Parameter;
 }
 
+class AccessoryStateCache;
 class Device;
 class DeviceFactory;
+class RailcomStatisticsModel;
 
+struct RailcomSample;
 struct VehicleInfo;
 
 using parameters::Parameter;
@@ -92,6 +98,7 @@ public:
         Signals = (1 << 1),
         Durations = (1 << 2),
         EmergencyStop = (1 << 3),
+        StateQueries = (1 << 4),
     };
 
     Q_FLAG(Feature)
@@ -100,7 +107,13 @@ public:
     using AccessoryInfoCallback = std::function<void(accessory::AccessoryInfo)>;
     using TurnoutInfoCallback = std::function<void(accessory::TurnoutInfo)>;
 
-    using Control::Control;
+    struct TurnoutCommand
+    {
+        dcc::AccessoryAddress address;
+        dcc::TurnoutState state;
+    };
+
+    explicit AccessoryControl(QObject *parent = nullptr);
 
     virtual Features features() const = 0;
 
@@ -108,16 +121,26 @@ public:
     virtual void setTurnoutState(dcc::AccessoryAddress address, dcc::TurnoutState state, bool enabled = true) = 0;
     virtual void setTurnoutState(dcc::AccessoryAddress address, dcc::TurnoutState state, std::chrono::milliseconds duration) = 0;
 
+    /// Switches multiple turnouts at once, like for setting a route. Devices might
+    /// merge the commands and stagger them to limit the current drawn by solenoids.
+    virtual void setTurnoutStates(QList<TurnoutCommand> commands, std::chrono::milliseconds duration);
+
     virtual void requestAccessoryInfo(dcc::AccessoryAddress address, AccessoryInfoCallback callback) = 0;
     virtual void requestTurnoutInfo(dcc::AccessoryAddress address, TurnoutInfoCallback callback) = 0;
     virtual void requestEmergencyStop() = 0;
 
+    /// Remembers turnout and accessory states, and refreshes them in the background after connecting.
+    [[nodiscard]] AccessoryStateCache *stateCache() const;
+
 signals:
     void accessoryInfoChanged(lmrs::core::accessory::AccessoryInfo accessoryInfo, QPrivateSignal);
     void turnoutInfoChanged(lmrs::core::accessory::TurnoutInfo turnoutInfo, QPrivateSignal);
 
 protected:
     using QProtectedSignal = QPrivateSignal;
+
+private:
+    AccessoryStateCache *const m_stateCache;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(AccessoryControl::Features)
@@ -306,6 +329,14 @@ public:
                                        dcc::ExtendedVariableIndex variable, dcc::VariableValue value,
                                        ContinuationCallback<VariableValueResult> callback);
 
+    /// Forgets which extended and SUSI pages were selected, e.g. when a different decoder got placed
+    /// on the programming track. This happens automatically on errors, power loss and address changes.
+    void resetPageCache();
+    void resetPageCache(dcc::VehicleAddress address);
+
+    /// Duration and outcome of extended variable accesses, and how often pages had to be selected.
+    [[nodiscard]] const core::metrics::Registry &metrics() const { return m_metrics; }
+
 protected:
     using QProtectedSignal = QPrivateSignal;
 
@@ -313,6 +344,40 @@ protected:
                             ContinuationCallback<Error> callback);
     virtual void selectPage(dcc::VehicleAddress address, dcc::SusiPageIndex page,
                             ContinuationCallback<Error> callback);
+
+    /// Selects the extended or SUSI page needed for accessing @p variable, unless it is selected already.
+    void selectPage(dcc::VehicleAddress address, dcc::ExtendedVariableIndex variable,
+                    ContinuationCallback<Error> callback);
+
+    /// Forgets the pages that writing @p variable might have changed. Implementations of writeVariable()
+    /// call this before reporting the result, so that writing CV31, CV32 or CV1021 directly is noticed.
+    void invalidatePageCache(dcc::VehicleAddress address, dcc::VariableIndex variable);
+
+private:
+    void readSortedVariables(dcc::VehicleAddress address, ExtendedVariableList variableList,
+                             ContinuationCallback<dcc::ExtendedVariableIndex, VariableValueResult> callback);
+    void watchPowerControl();
+
+    /// Retries selecting a page a few times, then reports @p error through @p callback.
+    Continuation reportPageSelectionError(Error error, int failureCount,
+                                          const ContinuationCallback<VariableValueResult> &callback);
+
+    struct SelectedPages
+    {
+        std::optional<dcc::ExtendedPageIndex> extendedPage;
+        std::optional<dcc::SusiPageIndex> susiPage;
+    };
+
+    QHash<dcc::VehicleAddress, SelectedPages> m_selectedPages;
+    QPointer<PowerControl> m_powerControl;
+
+    core::metrics::Histogram m_readTime{"readTime"};
+    core::metrics::Histogram m_writeTime{"writeTime"};
+    core::metrics::Counter m_failures{"failures"};
+    core::metrics::Counter m_pageSelections{"pageSelections"};
+    core::metrics::Counter m_pageCacheHits{"pageCacheHits"};
+    core::metrics::Registry m_metrics{"VariableControl", {&m_readTime, &m_writeTime, &m_failures,
+                                                          &m_pageSelections, &m_pageCacheHits}};
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(VariableControl::Features)
@@ -325,7 +390,7 @@ class VehicleControl : public Control
     Q_OBJECT
 
 public:
-    using Control::Control;
+    explicit VehicleControl(QObject *parent = nullptr);
 
     enum SubscriptionType { NormalSubscription, PrimarySubscription, CancelSubscription };
     Q_ENUM(SubscriptionType)
@@ -336,12 +401,22 @@ public:
     virtual void setSpeed(dcc::VehicleAddress address, dcc::Speed speed, dcc::Direction direction) = 0;
     virtual void setFunction(dcc::VehicleAddress address, dcc::Function function, bool enabled = true) = 0;
 
+    /// Rolling statistics of the RailCom samples reported by railcomSampleReceived().
+    [[nodiscard]] RailcomStatisticsModel *railcomStatistics() const;
+
 signals:
     void vehicleNameChanged(lmrs::core::dcc::VehicleAddress, QString name, QPrivateSignal);
     void vehicleInfoChanged(lmrs::core::VehicleInfo vehicleInfo, QPrivateSignal);
+    void railcomSampleReceived(lmrs::core::RailcomSample sample, QPrivateSignal);
 
 protected:
     using QProtectedSignal = QPrivateSignal;
+
+private:
+    void watchDevice();
+
+    RailcomStatisticsModel *const m_railcomStatistics;
+    QPointer<Device> m_device;
 };
 
 namespace internal {
@@ -432,8 +507,12 @@ public: // QAbstractItemModel interface
 signals:
     void deviceChanged(lmrs::core::Device *device, QPrivateSignal);
 
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
 private:
     void onDeviceInfoChanged(QList<DeviceInfo> changedIds);
+    void updateMetricRows();
 
     struct Row
     {
@@ -441,8 +520,17 @@ private:
         QString text;
     };
 
+    // while metrics are enabled they follow the device information, and get refreshed periodically
+    struct MetricRow
+    {
+        QString name;
+        const metrics::Metric *metric;
+    };
+
     QMap<DeviceInfo, Row> m_rows;
+    QList<MetricRow> m_metricRows;
     QPointer<Device> m_device;
+    int m_metricsTimerId = 0;
 };
 
 ///
@@ -500,6 +588,9 @@ public:
 
     virtual void updateDeviceInfo() = 0;
 
+    /// The metrics of this Device and its controls, like the VariableControl's.
+    [[nodiscard]] virtual QList<const core::metrics::Registry *> metrics() const;
+
 signals:
     void stateChanged(lmrs::core::Device::State state, QPrivateSignal);
     void deviceInfoChanged(QList<lmrs::core::DeviceInfo> changedIds, QPrivateSignal);
@@ -0,0 +1,401 @@
+#include "framekernels.h"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__)
+#define LMRS_FRAMEKERNELS_SSE2 1
+#include <immintrin.h>
+#if defined(Q_CC_GNU)
+#define LMRS_FRAMEKERNELS_AVX2 1
+#define LMRS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace lmrs::core::framekernels {
+
+namespace {
+
+// ---------------------------------------------------------------------------------------------------------------------
+// scalar kernels, also used for the tail of vectorized kernels
+// ---------------------------------------------------------------------------------------------------------------------
+
+qsizetype countEscapesScalar(const FrameFormat &format, const char *data, const char *end)
+{
+    auto count = qsizetype{0};
+
+    for (; data != end; ++data) {
+        if (format.escapeNeeded(*data))
+            ++count;
+    }
+
+    return count;
+}
+
+char *escapeScalar(const FrameFormat &format, const char *data, const char *end, char *output)
+{
+    for (; data != end; ++data) {
+        if (format.escapeNeeded(*data)) {
+            *output++ = static_cast<char>(format.escape);
+            *output++ = format.escaped(*data);
+        } else {
+            *output++ = *data;
+        }
+    }
+
+    return output;
+}
+
+// The output may alias the input, as long as it doesn't start behind it.
+char *unescapeScalar(const FrameFormat &format, const char *data, const char *end, char *output)
+{
+    for (; data != end; ++data) {
+        if (format.isEscapeMarker(*data) && data + 1 != end)
+            *output++ = format.unescaped(*++data);
+        else
+            *output++ = *data;
+    }
+
+    return output;
+}
+
+// Copies a vector sized block, escaping the bytes flagged in `mask`.
+[[maybe_unused]] char *escapeBlock(const FrameFormat &format, const char *data, quint32 mask, int blockSize, char *output)
+{
+    auto offset = 0;
+
+    for (; mask; mask &= mask - 1) {
+        const auto position = std::countr_zero(mask);
+
+        std::memcpy(output, data + offset, static_cast<size_t>(position - offset));
+        output += position - offset;
+
+        *output++ = static_cast<char>(format.escape);
+        *output++ = format.escaped(data[position]);
+
+        offset = position + 1;
+    }
+
+    std::memcpy(output, data + offset, static_cast<size_t>(blockSize - offset));
+    return output + (blockSize - offset);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// SSE2 kernels
+// ---------------------------------------------------------------------------------------------------------------------
+
+#if defined(LMRS_FRAMEKERNELS_SSE2)
+
+struct Sse2Markers
+{
+    static constexpr auto BlockSize = 16;
+
+    explicit Sse2Markers(const FrameFormat &format)
+        : start{_mm_set1_epi8(static_cast<char>(format.start))}
+        , stop{_mm_set1_epi8(static_cast<char>(format.stop))}
+        , escape{_mm_set1_epi8(static_cast<char>(format.escape))}
+    {}
+
+    quint32 escapeNeeded(const char *data) const
+    {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        const auto matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, start),
+                                                       _mm_cmpeq_epi8(block, stop)),
+                                          _mm_cmpeq_epi8(block, escape));
+
+        return static_cast<quint32>(_mm_movemask_epi8(matches));
+    }
+
+    quint32 escapeMarkers(const char *data) const
+    {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        return static_cast<quint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, escape)));
+    }
+
+    const __m128i start;
+    const __m128i stop;
+    const __m128i escape;
+};
+
+qsizetype countEscapesSse2(const FrameFormat &format, const char *data, const char *end)
+{
+    const auto markers = Sse2Markers{format};
+    auto count = qsizetype{0};
+
+    for (; end - data >= markers.BlockSize; data += markers.BlockSize)
+        count += std::popcount(markers.escapeNeeded(data));
+
+    return count + countEscapesScalar(format, data, end);
+}
+
+char *escapeSse2(const FrameFormat &format, const char *data, const char *end, char *output)
+{
+    const auto markers = Sse2Markers{format};
+
+    for (; end - data >= markers.BlockSize; data += markers.BlockSize) {
+        if (const auto mask = markers.escapeNeeded(data)) {
+            output = escapeBlock(format, data, mask, markers.BlockSize, output);
+        } else {
+            std::memcpy(output, data, markers.BlockSize);
+            output += markers.BlockSize;
+        }
+    }
+
+    return escapeScalar(format, data, end, output);
+}
+
+char *unescapeSse2(const FrameFormat &format, const char *data, const char *end, char *output)
+{
+    const auto markers = Sse2Markers{format};
+
+    while (end - data >= markers.BlockSize) {
+        const auto mask = markers.escapeMarkers(data);
+        const auto length = mask ? std::countr_zero(mask) : markers.BlockSize;
+
+        if (output != data)
+            std::memmove(output, data, static_cast<size_t>(length));
+
+        output += length;
+        data += length;
+
+        if (mask) {
+            if (data + 1 == end)
+                break;
+
+            *output++ = format.unescaped(data[1]);
+            data += 2;
+        }
+    }
+
+    return unescapeScalar(format, data, end, output);
+}
+
+#endif // LMRS_FRAMEKERNELS_SSE2
+
+// ---------------------------------------------------------------------------------------------------------------------
+// AVX2 kernels, only used after checking the CPU at runtime
+// ---------------------------------------------------------------------------------------------------------------------
+
+#if defined(LMRS_FRAMEKERNELS_AVX2)
+
+struct Avx2Markers
+{
+    static constexpr auto BlockSize = 32;
+
+    LMRS_TARGET_AVX2 explicit Avx2Markers(const FrameFormat &format)
+        : start{_mm256_set1_epi8(static_cast<char>(format.start))}
+        , stop{_mm256_set1_epi8(static_cast<char>(format.stop))}
+        , escape{_mm256_set1_epi8(static_cast<char>(format.escape))}
+    {}
+
+    LMRS_TARGET_AVX2 quint32 escapeNeeded(const char *data) const
+    {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        const auto matches = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, start),
+                                                             _mm256_cmpeq_epi8(block, stop)),
+                                             _mm256_cmpeq_epi8(block, escape));
+
+        return static_cast<quint32>(_mm256_movemask_epi8(matches));
+    }
+
+    LMRS_TARGET_AVX2 quint32 escapeMarkers(const char *data) const
+    {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        return static_cast<quint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, escape)));
+    }
+
+    const __m256i start;
+    const __m256i stop;
+    const __m256i escape;
+};
+
+LMRS_TARGET_AVX2 qsizetype countEscapesAvx2(const FrameFormat &format, const char *data, const char *end)
+{
+    const auto markers = Avx2Markers{format};
+    auto count = qsizetype{0};
+
+    for (; end - data >= markers.BlockSize; data += markers.BlockSize)
+        count += std::popcount(markers.escapeNeeded(data));
+
+    return count + countEscapesScalar(format, data, end);
+}
+
+LMRS_TARGET_AVX2 char *escapeAvx2(const FrameFormat &format, const char *data, const char *end, char *output)
+{
+    const auto markers = Avx2Markers{format};
+
+    for (; end - data >= markers.BlockSize; data += markers.BlockSize) {
+        if (const auto mask = markers.escapeNeeded(data)) {
+            output = escapeBlock(format, data, mask, markers.BlockSize, output);
+        } else {
+            std::memcpy(output, data, markers.BlockSize);
+            output += markers.BlockSize;
+        }
+    }
+
+    return escapeScalar(format, data, end, output);
+}
+
+LMRS_TARGET_AVX2 char *unescapeAvx2(const FrameFormat &format, const char *data, const char *end, char *output)
+{
+    const auto markers = Avx2Markers{format};
+
+    while (end - data >= markers.BlockSize) {
+        const auto mask = markers.escapeMarkers(data);
+        const auto length = mask ? std::countr_zero(mask) : markers.BlockSize;
+
+        if (output != data)
+            std::memmove(output, data, static_cast<size_t>(length));
+
+        output += length;
+        data += length;
+
+        if (mask) {
+            if (data + 1 == end)
+                break;
+
+            *output++ = format.unescaped(data[1]);
+            data += 2;
+        }
+    }
+
+    return unescapeScalar(format, data, end, output);
+}
+
+#endif // LMRS_FRAMEKERNELS_AVX2
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+Kernel supportedKernel(Kernel kernel)
+{
+    return isSupported(kernel) ? kernel : Kernel::Scalar;
+}
+
+} // namespace
+
+// =====================================================================================================================
+
+bool isSupported(Kernel kernel)
+{
+    switch (kernel) {
+    case Kernel::Scalar:
+        return true;
+
+    case Kernel::SSE2:
+#if defined(LMRS_FRAMEKERNELS_SSE2)
+        return true;
+#else
+        return false;
+#endif
+
+    case Kernel::AVX2:
+#if defined(LMRS_FRAMEKERNELS_AVX2)
+        return __builtin_cpu_supports("avx2") != 0;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+Kernel bestKernel()
+{
+    static const auto kernel = [] {
+        for (const auto kernel: {Kernel::AVX2, Kernel::SSE2}) {
+            if (isSupported(kernel))
+                return kernel;
+        }
+
+        return Kernel::Scalar;
+    }();
+
+    return kernel;
+}
+
+qsizetype countEscapes(Kernel kernel, const FrameFormat &format, QByteArrayView data)
+{
+    const auto end = data.data() + data.size();
+
+    switch (supportedKernel(kernel)) {
+    case Kernel::AVX2:
+#if defined(LMRS_FRAMEKERNELS_AVX2)
+        return countEscapesAvx2(format, data.data(), end);
+#endif
+        [[fallthrough]];
+
+    case Kernel::SSE2:
+#if defined(LMRS_FRAMEKERNELS_SSE2)
+        return countEscapesSse2(format, data.data(), end);
+#endif
+        [[fallthrough]];
+
+    case Kernel::Scalar:
+        break;
+    }
+
+    return countEscapesScalar(format, data.data(), end);
+}
+
+qsizetype countEscapes(const FrameFormat &format, QByteArrayView data)
+{
+    return countEscapes(bestKernel(), format, std::move(data));
+}
+
+qsizetype escape(Kernel kernel, const FrameFormat &format, QByteArrayView data, char *output)
+{
+    const auto end = data.data() + data.size();
+
+    switch (supportedKernel(kernel)) {
+    case Kernel::AVX2:
+#if defined(LMRS_FRAMEKERNELS_AVX2)
+        return escapeAvx2(format, data.data(), end, output) - output;
+#endif
+        [[fallthrough]];
+
+    case Kernel::SSE2:
+#if defined(LMRS_FRAMEKERNELS_SSE2)
+        return escapeSse2(format, data.data(), end, output) - output;
+#endif
+        [[fallthrough]];
+
+    case Kernel::Scalar:
+        break;
+    }
+
+    return escapeScalar(format, data.data(), end, output) - output;
+}
+
+qsizetype escape(const FrameFormat &format, QByteArrayView data, char *output)
+{
+    return escape(bestKernel(), format, std::move(data), output);
+}
+
+qsizetype unescape(Kernel kernel, const FrameFormat &format, char *data, qsizetype size)
+{
+    switch (supportedKernel(kernel)) {
+    case Kernel::AVX2:
+#if defined(LMRS_FRAMEKERNELS_AVX2)
+        return unescapeAvx2(format, data, data + size, data) - data;
+#endif
+        [[fallthrough]];
+
+    case Kernel::SSE2:
+#if defined(LMRS_FRAMEKERNELS_SSE2)
+        return unescapeSse2(format, data, data + size, data) - data;
+#endif
+        [[fallthrough]];
+
+    case Kernel::Scalar:
+        break;
+    }
+
+    return unescapeScalar(format, data, data + size, data) - data;
+}
+
+qsizetype unescape(const FrameFormat &format, char *data, qsizetype size)
+{
+    return unescape(bestKernel(), format, data, size);
+}
+
+} // namespace lmrs::core::framekernels
@@ -0,0 +1,37 @@
+#ifndef LMRS_CORE_FRAMEKERNELS_H
+#define LMRS_CORE_FRAMEKERNELS_H
+
+#include "framestream.h"
+
+namespace lmrs::core::framekernels {
+
+enum class Kernel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+/// Returns true if this build and the current CPU support `kernel`.
+bool isSupported(Kernel kernel);
+
+/// Returns the fastest kernel supported by this build and the current CPU.
+Kernel bestKernel();
+
+/// Counts the bytes of `data` which must be escaped when being framed by `format`.
+qsizetype countEscapes(Kernel kernel, const FrameFormat &format, QByteArrayView data);
+qsizetype countEscapes(const FrameFormat &format, QByteArrayView data);
+
+/// Writes `data` with all markers of `format` escaped to `output` in one pass,
+/// and returns the number of bytes written. The `output` buffer must have room
+/// for `2 * data.size()` bytes, and must not overlap with `data`.
+qsizetype escape(Kernel kernel, const FrameFormat &format, QByteArrayView data, char *output);
+qsizetype escape(const FrameFormat &format, QByteArrayView data, char *output);
+
+/// Resolves the escape sequences of `format` within `data` in place, and returns the new size.
+/// The `data` must not end within an escape sequence.
+qsizetype unescape(Kernel kernel, const FrameFormat &format, char *data, qsizetype size);
+qsizetype unescape(const FrameFormat &format, char *data, qsizetype size);
+
+} // namespace lmrs::core::framekernels
+
+#endif // LMRS_CORE_FRAMEKERNELS_H
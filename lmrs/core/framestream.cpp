@@ -1,8 +1,13 @@
 #include "framestream.h"
 
+#include "framekernels.h"
+
 #include <QIODevice>
 #include <QPointer>
 
+#include <algorithm>
+#include <cstring>
+
 namespace lmrs::core {
 
 // =====================================================================================================================
@@ -38,6 +43,18 @@ QByteArray FrameFormat::escaped(QByteArrayView data) const noexcept
     return result;
 }
 
+qsizetype FrameFormat::frameLength(QByteArrayView data) const noexcept
+{
+    for (auto i = startLength; i < data.size(); ++i) {
+        if (isEscapeMarker(data[i]))
+            ++i; // the escaped character never terminates a frame
+        else if (isStopMarker(data[i]))
+            return i + stopLength <= data.size() ? i + stopLength : 0;
+    }
+
+    return 0;
+}
+
 // =====================================================================================================================
 
 class FrameStreamReader::Private
@@ -46,22 +63,37 @@ public:
     const FrameFormat format;
     QPointer<QIODevice> device;
 
+    // Received data is appended to the buffer, and consumed by moving the read position.
+    // The consumed prefix only gets dropped once it dominates the buffer, so that frames
+    // stay contiguous for frameView(), while data is moved only rarely.
     QByteArray buffer;
-    QByteArray frame;
+    qsizetype readPosition = 0;
+
+    qsizetype frameOffset = 0;
+    qsizetype frameLength = 0;
 
     bool readNext(int minimumSize);
+
+private:
+    enum class ScanResult { Complete, Incomplete, Corrupted };
+
+    void readFromDevice();
+    void compact();
+
+    qsizetype find(quint8 marker, qsizetype from, qsizetype to) const;
+    ScanResult scanFrame(qsizetype payloadOffset, qsizetype *stopOffset, qsizetype *restartOffset) const;
 };
 
 // ---------------------------------------------------------------------------------------------------------------------
 
 FrameStreamReader::FrameStreamReader(FrameFormat format, QByteArrayView data)
-    : d{new Private{std::move(format), nullptr, QByteArray{}, QByteArray{}}}
+    : d{new Private{std::move(format), nullptr, QByteArray{}}}
 {
     d->buffer.append(std::move(data));
 }
 
 FrameStreamReader::FrameStreamReader(FrameFormat format, QIODevice *device)
-    : d{new Private{std::move(format), device, QByteArray{}, QByteArray{}}}
+    : d{new Private{std::move(format), device, QByteArray{}}}
 {}
 
 FrameStreamReader::~FrameStreamReader()
@@ -88,6 +120,9 @@ void FrameStreamReader::addData(QByteArrayView data)
 void FrameStreamReader::clear()
 {
     d->buffer.clear();
+    d->readPosition = 0;
+    d->frameOffset = 0;
+    d->frameLength = 0;
 }
 
 bool FrameStreamReader::isAtEnd() const
@@ -95,58 +130,130 @@ bool FrameStreamReader::isAtEnd() const
     if (d->device)
         return d->device->atEnd();
 
-    return d->buffer.isEmpty();
+    return d->readPosition >= d->buffer.size();
 }
 
-bool FrameStreamReader::Private::readNext(int minimumSize)
+void FrameStreamReader::Private::readFromDevice()
 {
     if (device) {
-        if (const auto available = device->bytesAvailable(); available > 0)
-            buffer.append(device->read(available));
+        if (const auto available = device->bytesAvailable(); available > 0) {
+            const auto oldSize = buffer.size();
+            buffer.resize(oldSize + available);
+
+            const auto bytesRead = device->read(buffer.data() + oldSize, available);
+            buffer.resize(oldSize + std::max(bytesRead, qint64{0}));
+        }
+    }
+}
+
+void FrameStreamReader::Private::compact()
+{
+    if (readPosition >= buffer.size()) {
+        buffer.resize(0); // keeps the allocated capacity
+        readPosition = 0;
+    } else if (readPosition > buffer.size() / 2) {
+        buffer.remove(0, readPosition);
+        readPosition = 0;
+    }
+}
+
+qsizetype FrameStreamReader::Private::find(quint8 marker, qsizetype from, qsizetype to) const
+{
+    if (from >= to)
+        return -1;
+
+    const auto data = buffer.constData();
+
+    if (const auto match = std::memchr(data + from, marker, static_cast<size_t>(to - from)))
+        return static_cast<const char *>(match) - data;
+
+    return -1;
+}
+
+FrameStreamReader::Private::ScanResult
+FrameStreamReader::Private::scanFrame(qsizetype payloadOffset, qsizetype *stopOffset, qsizetype *restartOffset) const
+{
+    // First search the stop marker, then only look for escape and start markers in front of it.
+    // This way each byte is checked by memchr(), instead of comparing it with each marker.
+    auto offset = payloadOffset;
+    auto stop = find(format.stop, offset, buffer.size());
+
+    while (stop >= 0) {
+        const auto escape = find(format.escape, offset, stop);
+
+        // a start marker within the frame means that the previous frame got truncated
+        if (const auto start = find(format.start, offset, escape >= 0 ? escape : stop); start >= 0) {
+            *restartOffset = start;
+            return ScanResult::Corrupted;
+        }
+
+        if (escape < 0) {
+            *stopOffset = stop;
+            return ScanResult::Complete;
+        }
+
+        if (escape + 1 >= buffer.size())
+            return ScanResult::Incomplete; // buffer ends within escape sequence
+
+        offset = escape + 2;
+
+        if (offset > stop) // the stop marker found was escaped
+            stop = find(format.stop, offset, buffer.size());
     }
 
-    frame.clear();
+    return ScanResult::Incomplete;
+}
+
+bool FrameStreamReader::Private::readNext(int minimumSize)
+{
+    compact();
+    readFromDevice();
+
+    frameOffset = 0;
+    frameLength = 0;
 
-    for (auto offset = qsizetype{0}; offset < buffer.size(); ) {
-        const auto start = buffer.indexOf(static_cast<char>(format.start), offset);
+    while (readPosition < buffer.size()) {
+        const auto start = find(format.start, readPosition, buffer.size());
 
         if (start < 0) {
-            buffer.clear(); // This buffer cannot contain any message. Therefore just cleanup already.
+            readPosition = buffer.size(); // This buffer cannot contain any message. Therefore just cleanup already.
             return false;
         }
 
+        readPosition = start;
+
         const auto minimumFrameSize = format.startLength + minimumSize + format.stopLength;
 
         if (start + minimumFrameSize > buffer.size())
             return false; // This buffer is too short to contain a full message. Therefore abort for now.
 
         // Skip over start markers in case there are more than the expected number
-        for (offset = start + 1; offset < buffer.size(); ++offset) {
-             if (!format.isStartMarker(buffer[offset]))
-                 break;
+        auto offset = start + 1;
+
+        while (offset < buffer.size() && format.isStartMarker(buffer[offset]))
+            ++offset;
+
+        if (offset - start < format.startLength) {
+            readPosition = offset; // Insufficent number of start markers. This is garbage data, skip it.
+            continue;
         }
 
-        if (offset - start < format.startLength)
-            continue; // Insufficent number of start markers. This is garbage data, skip it.
-
-        auto nextFrame = QByteArray{};
-
-        while (offset < buffer.size()) {
-            const auto ch = buffer[offset++];
-
-            if (format.isStopMarker(ch)) {
-                buffer.remove(0, offset);               // Remove all data up to the end of this frame from buffer.
-                std::exchange(frame, nextFrame);        // Next frame found. Store it.
-                return true;                            // Report success.
-            } else if (format.isStartMarker(ch)) {
-                continue;                               // Invalid character found. Skip corrupted frame.
-            } else if (!format.isEscapeMarker(ch)) {
-                nextFrame.append(ch);                   // Regular byte found that doesn't need escaping.
-            } else if (offset + 1 < buffer.size()) {
-                nextFrame.append(format.unescaped(buffer[offset++]));  // Store escaped byte.
-            } else {
-                return false;                           // Buffer ends within escape sequence. Abort for now.
-            }
+        auto stopOffset = qsizetype{};
+        auto restartOffset = qsizetype{};
+
+        switch (scanFrame(offset, &stopOffset, &restartOffset)) {
+        case ScanResult::Incomplete:
+            return false;
+
+        case ScanResult::Corrupted:
+            readPosition = restartOffset;
+            continue;
+
+        case ScanResult::Complete:
+            frameOffset = offset;
+            frameLength = framekernels::unescape(format, buffer.data() + offset, stopOffset - offset);
+            readPosition = stopOffset + 1;
+            return true;
         }
     }
 
@@ -160,12 +267,17 @@ bool FrameStreamReader::readNext(int minimumSize)
 
 QByteArray FrameStreamReader::frame() const
 {
-    return d->frame;
+    return frameView().toByteArray();
+}
+
+QByteArrayView FrameStreamReader::frameView() const
+{
+    return {d->buffer.constData() + d->frameOffset, d->frameLength};
 }
 
 qsizetype FrameStreamReader::bufferedBytes() const
 {
-    return d->buffer.size();
+    return d->buffer.size() - d->readPosition;
 }
 
 // =====================================================================================================================
@@ -177,13 +289,17 @@ public:
     QPointer<QIODevice> device;
     QString errorString;
 
-    bool writeFrame(QByteArrayView data);
+    QByteArray buffer;
+    QList<qsizetype> frameEnds;
+
+    void addFrame(QByteArrayView data);
+    qsizetype flush();
 };
 
 // ---------------------------------------------------------------------------------------------------------------------
 
 FrameStreamWriter::FrameStreamWriter(FrameFormat format, QIODevice *device)
-    : d{new Private{std::move(format), device, QString{}}}
+    : d{new Private{std::move(format), device, QString{}, QByteArray{}, QList<qsizetype>{}}}
 {}
 
 FrameStreamWriter::~FrameStreamWriter()
@@ -201,39 +317,80 @@ QIODevice *FrameStreamWriter::device() const
     return d->device;
 }
 
-bool FrameStreamWriter::Private::writeFrame(QByteArrayView data)
+void FrameStreamWriter::Private::addFrame(QByteArrayView data)
 {
-    if (device.isNull()) {
-        errorString = tr("Cannot write without device attached");
-        return false;
-    }
+    // Reserve for the worst case, so that escaping needs only one pass over the data
+    const auto offset = buffer.size();
+    buffer.resize(offset + format.startLength + 2 * data.size() + format.stopLength);
 
-    const auto frameSize = format.escapedLength(data);
-    auto frame = QByteArray{frameSize, Qt::Uninitialized};
-    auto it = frame.begin();
+    auto it = buffer.data() + offset;
 
     for (auto i = 0; i < format.startLength; ++i)
         *it++ = static_cast<char>(format.start);
 
-    for (const auto ch: data) {
-        if (format.escapeNeeded(ch)) {
-            *it++ = static_cast<char>(format.escape);
-            *it++ = format.escaped(ch);
-        } else {
-            *it++ = ch;
-        }
-    }
+    it += framekernels::escape(format, data, it);
 
     for (auto i = 0; i < format.stopLength; ++i)
         *it++ = static_cast<char>(format.stop);
 
-    const auto bytesToWrite = frame.size();
-    return device->write(std::move(frame)) == bytesToWrite;
+    buffer.resize(it - buffer.constData());
+    frameEnds.append(buffer.size());
+}
+
+qsizetype FrameStreamWriter::Private::flush()
+{
+    if (frameEnds.isEmpty())
+        return 0;
+
+    auto bytesWritten = qint64{-1};
+
+    if (device.isNull()) {
+        errorString = tr("Cannot write without device attached");
+    } else {
+        bytesWritten = device->write(buffer.constData(), buffer.size());
+
+        // keep the device's error, it might get replaced before errorString() is called
+        if (bytesWritten == buffer.size())
+            errorString.clear();
+        else
+            errorString = device->errorString();
+    }
+
+    const auto framesWritten = std::upper_bound(frameEnds.cbegin(), frameEnds.cend(), bytesWritten) - frameEnds.cbegin();
+
+    // resizing instead of clearing keeps the allocated memory for the next batch
+    buffer.resize(0);
+    frameEnds.resize(0);
+
+    return framesWritten;
 }
 
 bool FrameStreamWriter::writeFrame(QByteArrayView data)
 {
-    return d->writeFrame(std::move(data));
+    if (d->device.isNull()) {
+        d->errorString = tr("Cannot write without device attached");
+        return false;
+    }
+
+    d->addFrame(std::move(data));
+
+    const auto frameCount = d->frameEnds.size();
+    return d->flush() == frameCount;
+}
+
+void FrameStreamWriter::addFrame(QByteArrayView data)
+{
+    d->addFrame(std::move(data));
+}
+
+qsizetype FrameStreamWriter::pendingFrames() const
+{
+    return d->frameEnds.size();
+}
+
+qsizetype FrameStreamWriter::flush()
+{
+    return d->flush();
 }
 
 QString FrameStreamWriter::errorString() const
@@ -66,6 +66,9 @@ struct FrameFormat
     QByteArray stopSequence() const noexcept;
 
     QByteArray escaped(QByteArrayView data) const noexcept;
+
+    /// Length of the first complete, still escaped frame in `data`, or 0 if that frame is incomplete.
+    qsizetype frameLength(QByteArrayView data) const noexcept;
 };
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -94,6 +97,7 @@ struct StaticFrameFormat
     }
 
     static auto escaped(QByteArrayView data) noexcept { return instance().escaped(std::move(data)); }
+    static auto frameLength(QByteArrayView data) noexcept { return instance().frameLength(std::move(data)); }
 };
 
 static_assert(StaticFrameFormat<0x7f, 0x81, 0x80>::start() == 0x7f);
@@ -141,6 +145,11 @@ public:
     bool readNext(int minimumSize = 0);
 
     QByteArray frame() const;
+
+    /// The current frame without copying it. The view is only valid until the next call
+    /// of readNext(), addData() or clear(), use frame() for keeping the frame.
+    QByteArrayView frameView() const;
+
     qsizetype bufferedBytes() const;
 
 private:
@@ -166,6 +175,15 @@ public:
 
     bool writeFrame(QByteArrayView data);
 
+    /// Escapes `data` into the batch buffer, to be written by the next flush() or writeFrame().
+    void addFrame(QByteArrayView data);
+    qsizetype pendingFrames() const;
+
+    /// Writes all pending frames with a single call of QIODevice::write(), and
+    /// returns how many of them got written completely. The batch buffer gets
+    /// reused for the next batch, so that no allocation is needed per frame.
+    qsizetype flush();
+
 private:
     class Private;
     ConstPointer<Private> d;
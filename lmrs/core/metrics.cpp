@@ -0,0 +1,281 @@
+#include "metrics.h"
+
+#include "userliterals.h"
+
+#include <QDateTime>
+#include <QJsonArray>
+#include <QMutex>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace lmrs::core::metrics {
+
+namespace {
+
+using namespace std::chrono_literals;
+using std::chrono::microseconds;
+
+struct RegistryList
+{
+    QMutex mutex;
+    QList<const Registry *> registries;
+};
+
+RegistryList *registryList()
+{
+    static auto s_registryList = RegistryList{};
+    return &s_registryList;
+}
+
+QString toString(microseconds duration)
+{
+    if (duration < 1ms)
+        return QString::number(duration.count()) + " us"_L1;
+    if (duration < 1s)
+        return QString::number(static_cast<double>(duration.count()) / 1e3, 'f', 1) + " ms"_L1;
+
+    return QString::number(static_cast<double>(duration.count()) / 1e6, 'f', 1) + " s"_L1;
+}
+
+void raise(std::atomic<qint64> &maximum, qint64 value) noexcept
+{
+    auto current = maximum.load(std::memory_order_relaxed);
+    while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+} // namespace
+
+std::atomic<bool> internal::s_enabled = qEnvironmentVariableIntValue("LMRS_METRICS") != 0;
+
+void setEnabled(bool enabled) noexcept
+{
+    internal::s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+
+QString Counter::toString() const
+{
+    return QString::number(value());
+}
+
+QJsonObject Counter::toJson() const
+{
+    return {
+        {"type"_L1, "counter"_L1},
+        {"value"_L1, static_cast<qint64>(value())},
+    };
+}
+
+void Counter::reset() noexcept
+{
+    m_value.store(0, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+
+void Gauge::update(qint64 value) noexcept
+{
+    m_value.store(value, std::memory_order_relaxed);
+    raise(m_peak, value);
+}
+
+QString Gauge::toString() const
+{
+    return QString::number(value()) + " (peak: "_L1 + QString::number(peak()) + ')'_L1;
+}
+
+QJsonObject Gauge::toJson() const
+{
+    return {
+        {"type"_L1, "gauge"_L1},
+        {"value"_L1, value()},
+        {"peak"_L1, peak()},
+    };
+}
+
+void Gauge::reset() noexcept
+{
+    // the current level is still valid, only the peak starts over
+    m_peak.store(value(), std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+
+void Histogram::addSample(microseconds duration) noexcept
+{
+    const auto value = std::max<qint64>(duration.count(), 0);
+    const auto index = std::min(static_cast<int>(std::bit_width(static_cast<quint64>(value))), BucketCount - 1);
+
+    m_buckets[static_cast<size_t>(index)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(value, std::memory_order_relaxed);
+    raise(m_maximum, value);
+}
+
+quint64 Histogram::bucket(int index) const noexcept
+{
+    if (index < 0 || index >= BucketCount)
+        return 0;
+
+    return m_buckets[static_cast<size_t>(index)].load(std::memory_order_relaxed);
+}
+
+microseconds Histogram::total() const noexcept
+{
+    return microseconds{m_total.load(std::memory_order_relaxed)};
+}
+
+microseconds Histogram::maximum() const noexcept
+{
+    return microseconds{m_maximum.load(std::memory_order_relaxed)};
+}
+
+microseconds Histogram::mean() const noexcept
+{
+    if (const auto count = this->count())
+        return total() / static_cast<qint64>(count);
+
+    return {};
+}
+
+microseconds Histogram::percentile(double share) const noexcept
+{
+    const auto count = this->count();
+
+    if (count == 0)
+        return {};
+
+    const auto threshold = static_cast<quint64>(std::ceil(std::clamp(share, 0.0, 1.0) * static_cast<double>(count)));
+    auto seen = quint64{0};
+
+    for (auto i = 0; i < BucketCount - 1; ++i) {
+        seen += bucket(i);
+
+        if (seen >= threshold) // the maximum is a better bound when it lies within this bucket
+            return std::min(microseconds{qint64{1} << i}, maximum());
+    }
+
+    return maximum();
+}
+
+QString Histogram::toString() const
+{
+    if (count() == 0)
+        return "0"_L1;
+
+    return QString::number(count())
+            + " (median: "_L1 + metrics::toString(percentile(0.5))
+            + ", 99%: "_L1 + metrics::toString(percentile(0.99))
+            + ", max: "_L1 + metrics::toString(maximum()) + ')'_L1;
+}
+
+QJsonObject Histogram::toJson() const
+{
+    auto buckets = QJsonArray{};
+
+    // trailing empty buckets are left out
+    for (auto i = 0, last = 0; i < BucketCount; ++i) {
+        if (const auto value = bucket(i)) {
+            while (last++ < i)
+                buckets.append(0);
+
+            buckets.append(static_cast<qint64>(value));
+        }
+    }
+
+    return {
+        {"type"_L1, "histogram"_L1},
+        {"count"_L1, static_cast<qint64>(count())},
+        {"totalUs"_L1, total().count()},
+        {"meanUs"_L1, mean().count()},
+        {"p50Us"_L1, percentile(0.5).count()},
+        {"p90Us"_L1, percentile(0.9).count()},
+        {"p99Us"_L1, percentile(0.99).count()},
+        {"maxUs"_L1, maximum().count()},
+        {"buckets"_L1, buckets},
+    };
+}
+
+void Histogram::reset() noexcept
+{
+    for (auto &bucket: m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    m_count.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+    m_maximum.store(0, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+
+Registry::Registry(QAnyStringView name, std::initializer_list<Metric *> metrics)
+    : m_name{name.toString()}
+    , m_metrics{metrics.begin(), metrics.end()}
+{
+    const auto list = registryList();
+    const auto locker = QMutexLocker{&list->mutex};
+    list->registries.append(this);
+}
+
+Registry::~Registry()
+{
+    const auto list = registryList();
+    const auto locker = QMutexLocker{&list->mutex};
+    list->registries.removeOne(this);
+}
+
+QJsonObject Registry::toJson() const
+{
+    auto json = QJsonObject{};
+
+    for (const auto metric: m_metrics)
+        json.insert(metric->name(), metric->toJson());
+
+    return json;
+}
+
+QList<const Metric *> Registry::metrics() const
+{
+    return {m_metrics.begin(), m_metrics.end()};
+}
+
+void Registry::reset() noexcept
+{
+    for (const auto metric: m_metrics)
+        metric->reset();
+}
+
+QList<const Registry *> Registry::registries()
+{
+    const auto list = registryList();
+    const auto locker = QMutexLocker{&list->mutex};
+    return list->registries;
+}
+
+// =====================================================================================================================
+
+QJsonObject snapshot()
+{
+    auto registries = QJsonObject{};
+
+    for (const auto registry: Registry::registries()) {
+        auto name = registry->name();
+
+        // several devices of the same kind can be alive at the same time
+        for (auto i = 2; registries.contains(name); ++i)
+            name = registry->name() + '#'_L1 + QString::number(i);
+
+        registries.insert(name, registry->toJson());
+    }
+
+    return {
+        {"enabled"_L1, isEnabled()},
+        {"timestamp"_L1, QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs)},
+        {"registries"_L1, registries},
+    };
+}
+
+} // namespace lmrs::core::metrics
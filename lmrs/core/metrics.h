@@ -0,0 +1,190 @@
+#ifndef LMRS_CORE_METRICS_H
+#define LMRS_CORE_METRICS_H
+
+#include <QAnyStringView>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace lmrs::core::metrics {
+
+/// Metrics are counters, gauges and latency histograms that instrumented objects keep as members.
+/// They only get updated while collection is enabled, until then each update costs a single relaxed
+/// load. Collection gets enabled by setEnabled(), or by setting the LMRS_METRICS environment variable.
+
+namespace internal {
+extern std::atomic<bool> s_enabled;
+} // namespace internal
+
+[[nodiscard]] inline bool isEnabled() noexcept { return internal::s_enabled.load(std::memory_order_relaxed); }
+void setEnabled(bool enabled) noexcept;
+
+using Clock = std::chrono::steady_clock;
+
+/// The current time for starting a measurement, or nothing if metrics are disabled,
+/// so that disabled metrics don't even read the clock.
+[[nodiscard]] inline Clock::time_point startTime() noexcept { return isEnabled() ? Clock::now() : Clock::time_point{}; }
+
+class Metric
+{
+public:
+    enum class Type {
+        Counter,
+        Gauge,
+        Histogram,
+    };
+
+    Metric(const Metric &) = delete;
+    Metric &operator=(const Metric &) = delete;
+    virtual ~Metric() = default;
+
+    [[nodiscard]] Type type() const noexcept { return m_type; }
+    [[nodiscard]] QString name() const { return m_name; }
+
+    [[nodiscard]] virtual QString toString() const = 0;
+    [[nodiscard]] virtual QJsonObject toJson() const = 0;
+    virtual void reset() noexcept = 0;
+
+protected:
+    explicit Metric(Type type, QAnyStringView name)
+        : m_type{type}
+        , m_name{name.toString()}
+    {}
+
+private:
+    Type m_type;
+    QString m_name;
+};
+
+/// Counts events, like sent requests or resends.
+class Counter final : public Metric
+{
+public:
+    explicit Counter(QAnyStringView name)
+        : Metric{Type::Counter, name}
+    {}
+
+    void increment(quint64 amount = 1) noexcept
+    {
+        if (isEnabled())
+            m_value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] quint64 value() const noexcept { return m_value.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] QString toString() const override;
+    [[nodiscard]] QJsonObject toJson() const override;
+    void reset() noexcept override;
+
+private:
+    std::atomic<quint64> m_value = 0;
+};
+
+/// Follows a level, like the depth of a queue, and remembers the highest value seen.
+class Gauge final : public Metric
+{
+public:
+    explicit Gauge(QAnyStringView name)
+        : Metric{Type::Gauge, name}
+    {}
+
+    void set(qint64 value) noexcept
+    {
+        if (isEnabled())
+            update(value);
+    }
+
+    [[nodiscard]] qint64 value() const noexcept { return m_value.load(std::memory_order_relaxed); }
+    [[nodiscard]] qint64 peak() const noexcept { return m_peak.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] QString toString() const override;
+    [[nodiscard]] QJsonObject toJson() const override;
+    void reset() noexcept override;
+
+private:
+    void update(qint64 value) noexcept;
+
+    std::atomic<qint64> m_value = 0;
+    std::atomic<qint64> m_peak = 0;
+};
+
+/// Collects durations in buckets of doubling width: bucket `i` counts durations
+/// below 2^i microseconds, the last bucket also counts everything longer.
+class Histogram final : public Metric
+{
+public:
+    static constexpr auto BucketCount = 32;
+
+    explicit Histogram(QAnyStringView name)
+        : Metric{Type::Histogram, name}
+    {}
+
+    template<class Rep, class Period>
+    void record(std::chrono::duration<Rep, Period> duration) noexcept
+    {
+        if (isEnabled())
+            addSample(std::chrono::duration_cast<std::chrono::microseconds>(duration));
+    }
+
+    /// Records the time passed since `started`, which was obtained from startTime().
+    void recordSince(Clock::time_point started) noexcept
+    {
+        if (isEnabled() && started != Clock::time_point{})
+            addSample(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started));
+    }
+
+    [[nodiscard]] quint64 count() const noexcept { return m_count.load(std::memory_order_relaxed); }
+    [[nodiscard]] quint64 bucket(int index) const noexcept;
+    [[nodiscard]] std::chrono::microseconds total() const noexcept;
+    [[nodiscard]] std::chrono::microseconds maximum() const noexcept;
+    [[nodiscard]] std::chrono::microseconds mean() const noexcept;
+
+    /// The upper bound of the bucket containing the given share of all samples, e.g. 0.99.
+    [[nodiscard]] std::chrono::microseconds percentile(double share) const noexcept;
+
+    [[nodiscard]] QString toString() const override;
+    [[nodiscard]] QJsonObject toJson() const override;
+    void reset() noexcept override;
+
+private:
+    void addSample(std::chrono::microseconds duration) noexcept;
+
+    std::array<std::atomic<quint64>, BucketCount> m_buckets = {};
+    std::atomic<quint64> m_count = 0;
+    std::atomic<qint64> m_total = 0;
+    std::atomic<qint64> m_maximum = 0;
+};
+
+/// Names the metrics of one instrumented object, like a Device or a z21::Client. The registry
+/// doesn't own its metrics. All registries currently alive are listed by registries().
+class Registry
+{
+public:
+    explicit Registry(QAnyStringView name, std::initializer_list<Metric *> metrics = {});
+    Registry(const Registry &) = delete;
+    Registry &operator=(const Registry &) = delete;
+    ~Registry();
+
+    [[nodiscard]] QString name() const { return m_name; }
+    [[nodiscard]] QList<const Metric *> metrics() const;
+
+    [[nodiscard]] QJsonObject toJson() const;
+    void reset() noexcept;
+
+    [[nodiscard]] static QList<const Registry *> registries();
+
+private:
+    QString m_name;
+    QList<Metric *> m_metrics;
+};
+
+/// The metrics of all registries, grouped by registry name.
+[[nodiscard]] QJsonObject snapshot();
+
+} // namespace lmrs::core::metrics
+
+#endif // LMRS_CORE_METRICS_H
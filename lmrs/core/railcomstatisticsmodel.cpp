@@ -0,0 +1,268 @@
+#include "railcomstatisticsmodel.h"
+
+#include "algorithms.h"
+#include "userliterals.h"
+
+namespace lmrs::core {
+
+namespace {
+
+template<size_t N>
+std::optional<int> percentile(const std::array<int, N> &histogram, int count, int percent)
+{
+    if (count <= 0)
+        return {};
+
+    // the rank of the requested percentile, using the nearest-rank method
+    const auto rank = std::max(1, (std::clamp(percent, 0, 100) * count + 99) / 100);
+
+    for (auto value = 0, sum = 0; value < static_cast<int>(N); ++value) {
+        sum += histogram[static_cast<size_t>(value)];
+
+        if (sum >= rank)
+            return value;
+    }
+
+    return {};
+}
+
+} // namespace
+
+void RailcomStatistics::addSample(const RailcomSample &sample)
+{
+    // counters that went backwards tell that the command station was restarted
+    if (m_count > 0 && sample.receiveCounter < newest().receiveCounter)
+        clear();
+    if (m_count == Capacity)
+        evictOldest();
+
+    const auto qos = sample.qos.has_value() ? static_cast<qint16>(*sample.qos) : qint16{-1};
+    const auto speed = sample.speed.has_value() ? static_cast<qint16>(*sample.speed) : qint16{-1};
+
+    m_entries[static_cast<size_t>(m_head)] = {sample.receiveCounter, sample.errorCounter, qos, speed};
+    m_head = (m_head + 1) % Capacity;
+    ++m_count;
+
+    if (qos >= 0) {
+        ++m_qosHistogram[static_cast<size_t>(qos)];
+        ++m_qosCount;
+    }
+
+    if (speed >= 0) {
+        ++m_speedHistogram[static_cast<size_t>(speed)];
+        ++m_speedCount;
+    }
+}
+
+void RailcomStatistics::evictOldest()
+{
+    const auto &entry = oldest();
+
+    if (entry.qos >= 0) {
+        --m_qosHistogram[static_cast<size_t>(entry.qos)];
+        --m_qosCount;
+    }
+
+    if (entry.speed >= 0) {
+        --m_speedHistogram[static_cast<size_t>(entry.speed)];
+        --m_speedCount;
+    }
+
+    --m_count;
+}
+
+void RailcomStatistics::clear()
+{
+    m_head = m_count = 0;
+    m_qosHistogram = {};
+    m_speedHistogram = {};
+    m_qosCount = m_speedCount = 0;
+}
+
+double RailcomStatistics::errorRate() const noexcept
+{
+    if (m_count < 2)
+        return 0;
+
+    const auto received = newest().receiveCounter - oldest().receiveCounter;
+    const auto errors = static_cast<quint16>(newest().errorCounter - oldest().errorCounter); // wraps around
+
+    if (received + errors == 0)
+        return 0;
+
+    return static_cast<double>(errors) / static_cast<double>(received + errors);
+}
+
+std::optional<int> RailcomStatistics::qosPercentile(int percent) const noexcept
+{
+    return percentile(m_qosHistogram, m_qosCount, percent);
+}
+
+std::optional<int> RailcomStatistics::speedPercentile(int percent) const noexcept
+{
+    return percentile(m_speedHistogram, m_speedCount, percent);
+}
+
+RailcomStatistics::SpeedHistogram RailcomStatistics::speedHistogram() const noexcept
+{
+    auto histogram = SpeedHistogram{};
+
+    for (auto speed = 0; speed < static_cast<int>(m_speedHistogram.size()); ++speed)
+        histogram[static_cast<size_t>(speed / SpeedBinWidth)] += m_speedHistogram[static_cast<size_t>(speed)];
+
+    return histogram;
+}
+
+// =====================================================================================================================
+
+void RailcomStatisticsModel::clear()
+{
+    beginResetModel();
+    m_rows.clear();
+    endResetModel();
+}
+
+int RailcomStatisticsModel::addSample(const RailcomSample &sample)
+{
+    // rows are sorted by address
+    const auto it = std::lower_bound(m_rows.begin(), m_rows.end(), sample.address, [](const auto &row, auto value) {
+        return row.address < value;
+    });
+
+    const auto row = static_cast<int>(it - m_rows.begin());
+
+    if (it != m_rows.end() && it->address == sample.address) {
+        it->statistics.addSample(sample);
+        emit dataChanged(index(row, 0), index(row, columnCount() - 1));
+    } else {
+        beginInsertRows({}, row, row);
+        m_rows.emplace(it, sample.address)->statistics.addSample(sample);
+        endInsertRows();
+    }
+
+    return row;
+}
+
+const RailcomStatistics *RailcomStatisticsModel::statistics(dcc::VehicleAddress address) const
+{
+    if (const auto index = findVehicle(address); index.isValid())
+        return &m_rows[index.row()].statistics;
+
+    return nullptr;
+}
+
+QModelIndex RailcomStatisticsModel::findVehicle(dcc::VehicleAddress address) const
+{
+    const auto it = std::lower_bound(m_rows.begin(), m_rows.end(), address, [](const auto &row, auto value) {
+        return row.address < value;
+    });
+
+    if (Q_UNLIKELY(it == m_rows.end() || it->address != address))
+        return {};
+
+    return index(static_cast<int>(it - m_rows.begin()), 0);
+}
+
+int RailcomStatisticsModel::rowCount(const QModelIndex &parent) const
+{
+    if (Q_UNLIKELY(parent.isValid()))
+        return 0;
+
+    return static_cast<int>(m_rows.size());
+}
+
+int RailcomStatisticsModel::columnCount(const QModelIndex &parent) const
+{
+    if (Q_UNLIKELY(parent.isValid()))
+        return 0;
+
+    return keyCount<Column>();
+}
+
+QVariant RailcomStatisticsModel::data(const QModelIndex &index, int role) const
+{
+    if (!hasIndex(index.row(), index.column(), index.parent()))
+        return {};
+
+    const auto &row = m_rows[index.row()];
+
+    if (role == SpeedHistogramRole) {
+        const auto histogram = row.statistics.speedHistogram();
+        return QVariant::fromValue(QList<int>(histogram.begin(), histogram.end()));
+    }
+
+    if (role == Qt::TextAlignmentRole)
+        return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+
+    const auto percentileData = [role](std::optional<int> value) -> QVariant {
+        if (!value.has_value())
+            return {};
+        if (role == Qt::DisplayRole)
+            return QString::number(*value);
+        if (role == DataRole)
+            return *value;
+
+        return {};
+    };
+
+    switch (static_cast<Column>(index.column())) {
+    case Column::Address:
+        if (role == Qt::DisplayRole)
+            return QString::number(row.address);
+        else if (role == DataRole)
+            return QVariant::fromValue(row.address);
+
+        break;
+
+    case Column::Samples:
+        if (role == Qt::DisplayRole || role == DataRole)
+            return row.statistics.sampleCount();
+
+        break;
+
+    case Column::ErrorRate:
+        if (role == Qt::DisplayRole)
+            return QString::number(row.statistics.errorRate() * 100, 'f', 1) + u"\u202f%"_qs;
+        else if (role == DataRole)
+            return row.statistics.errorRate();
+
+        break;
+
+    case Column::QosLow:
+        return percentileData(row.statistics.qosPercentile(10));
+    case Column::QosMedian:
+        return percentileData(row.statistics.qosPercentile(50));
+    case Column::QosHigh:
+        return percentileData(row.statistics.qosPercentile(90));
+    case Column::Speed:
+        return percentileData(row.statistics.speedPercentile(50));
+    }
+
+    return {};
+}
+
+QVariant RailcomStatisticsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (static_cast<Column>(section)) {
+        case Column::Address:
+            return tr("Address");
+        case Column::Samples:
+            return tr("Samples");
+        case Column::ErrorRate:
+            return tr("Errors");
+        case Column::QosLow:
+            return tr("QoS (10%)");
+        case Column::QosMedian:
+            return tr("QoS (median)");
+        case Column::QosHigh:
+            return tr("QoS (90%)");
+        case Column::Speed:
+            return tr("Speed");
+        }
+    }
+
+    return {};
+}
+
+} // namespace lmrs::core
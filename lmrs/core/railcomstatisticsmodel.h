@@ -0,0 +1,129 @@
+#ifndef LMRS_CORE_RAILCOMSTATISTICSMODEL_H
+#define LMRS_CORE_RAILCOMSTATISTICSMODEL_H
+
+#include "dccconstants.h"
+
+#include <QAbstractTableModel>
+
+#include <array>
+#include <optional>
+
+namespace lmrs::core {
+
+/// A single RailCom report of a vehicle, with the receive counters of the command station.
+struct RailcomSample
+{
+    Q_GADGET
+
+public:
+    dcc::VehicleAddress address = 0;
+    quint32 receiveCounter = 0;
+    quint16 errorCounter = 0;
+    std::optional<quint8> qos = {};
+    std::optional<quint8> speed = {};
+};
+
+/// Rolling RailCom statistics of a single vehicle, computed from the most recent samples.
+/// Histograms are maintained while adding samples, so that none of the results needs sorting.
+class RailcomStatistics
+{
+public:
+    static constexpr auto Capacity = 256;
+    static constexpr auto SpeedBinWidth = 16;
+    static constexpr auto SpeedBinCount = 256 / SpeedBinWidth;
+
+    using SpeedHistogram = std::array<int, SpeedBinCount>;
+
+    void addSample(const RailcomSample &sample);
+    void clear();
+
+    [[nodiscard]] int sampleCount() const noexcept { return m_count; }
+
+    /// The share of failed receptions among all receptions of the recent samples.
+    [[nodiscard]] double errorRate() const noexcept;
+
+    [[nodiscard]] std::optional<int> qosPercentile(int percent) const noexcept;
+    [[nodiscard]] std::optional<int> speedPercentile(int percent) const noexcept;
+    [[nodiscard]] SpeedHistogram speedHistogram() const noexcept;
+
+private:
+    using ValueHistogram = std::array<int, 256>;
+
+    struct Entry
+    {
+        quint32 receiveCounter;
+        quint16 errorCounter;
+        qint16 qos;     // -1 if not reported
+        qint16 speed;   // -1 if not reported
+    };
+
+    void evictOldest();
+
+    [[nodiscard]] const Entry &oldest() const noexcept { return m_entries[static_cast<size_t>((m_head + Capacity - m_count) % Capacity)]; }
+    [[nodiscard]] const Entry &newest() const noexcept { return m_entries[static_cast<size_t>((m_head + Capacity - 1) % Capacity)]; }
+
+    std::array<Entry, Capacity> m_entries = {};
+    int m_head = 0;
+    int m_count = 0;
+
+    ValueHistogram m_qosHistogram = {};
+    ValueHistogram m_speedHistogram = {};
+    int m_qosCount = 0;
+    int m_speedCount = 0;
+};
+
+class RailcomStatisticsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        DataRole = Qt::UserRole,
+        SpeedHistogramRole,
+    };
+
+    Q_ENUM(Role)
+
+    enum class Column {
+        Address,
+        Samples,
+        ErrorRate,
+        QosLow,
+        QosMedian,
+        QosHigh,
+        Speed,
+    };
+
+    Q_ENUM(Column)
+
+    using QAbstractTableModel::QAbstractTableModel;
+
+    void clear();
+
+    int addSample(const RailcomSample &sample);
+    [[nodiscard]] const RailcomStatistics *statistics(dcc::VehicleAddress address) const;
+
+    [[nodiscard]] QModelIndex findVehicle(dcc::VehicleAddress address) const;
+
+public: // QAbstractItemModel interface
+    int rowCount(const QModelIndex &parent = {}) const override;
+    int columnCount(const QModelIndex &parent = {}) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    struct Row {
+        explicit Row(dcc::VehicleAddress address) noexcept
+            : address{address}
+        {}
+
+        dcc::VehicleAddress address;
+        RailcomStatistics statistics;
+    };
+
+    QList<Row> m_rows;
+};
+
+} // namespace lmrs::core
+
+#endif // LMRS_CORE_RAILCOMSTATISTICSMODEL_H
@@ -0,0 +1,397 @@
+#include "tracing.h"
+
+#include "logging.h"
+#include "typetraits.h"
+#include "userliterals.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QTimeZone>
+#include <QWaitCondition>
+
+#include <QtEndian>
+
+#include <array>
+#include <cstring>
+
+namespace lmrs::core {
+
+namespace {
+
+// A trace starts with the magic, followed by the start time in milliseconds since epoch.
+// Each record consists of a header and its payload, all numbers are little endian:
+//
+//   0: timestamp in nanoseconds since start (64 bit)
+//   8: channel id (16 bit)
+//  10: kind of record (8 bit), followed by one reserved byte
+//  12: length of the payload (32 bit)
+//
+// Channels announce their name by a ChannelName record before their first frame.
+
+constexpr auto s_fileMagic = "LMRSTRC1"_BV;
+constexpr auto FileHeaderSize = s_fileMagic.size() + 8;
+constexpr auto RecordHeaderSize = qsizetype{16};
+constexpr auto MinimumCapacity = qsizetype{4096};
+constexpr auto FlushInterval = std::chrono::milliseconds{250};
+
+enum class RecordKind : quint8 {
+    Received = 0,
+    Sent = 1,
+    ChannelName = 2,
+};
+
+constexpr RecordKind recordKind(TransportEvent::Direction direction)
+{
+    switch (direction) {
+    case TransportEvent::Direction::Received:
+        return RecordKind::Received;
+    case TransportEvent::Direction::Sent:
+        return RecordKind::Sent;
+    }
+
+    return RecordKind::Received;
+}
+
+std::atomic<quint16> s_nextChannelId = 1;
+std::atomic<quint64> s_sessionCount = 0;
+
+} // namespace
+
+std::atomic<TraceRecorder *> internal::s_activeTraceRecorder = nullptr;
+
+// =====================================================================================================================
+
+TraceChannel::TraceChannel(QAnyStringView name)
+    : m_name{name.toString()}
+    , m_id{s_nextChannelId.fetch_add(1, std::memory_order_relaxed)}
+{}
+
+// =====================================================================================================================
+
+class TraceRecorder::Private : public PrivateObject<TraceRecorder>
+{
+public:
+    using PrivateObject::PrivateObject;
+
+    // must be called with the mutex locked
+    [[nodiscard]] bool append(quint16 channelId, RecordKind kind, QByteArrayView data);
+    void copyIn(QByteArrayView data);
+
+    void runWriter();
+    bool writeOut(qint64 begin, qint64 end);
+
+    QMutex mutex;
+    QWaitCondition dataAvailable;
+
+    // the ring buffer; head and tail only grow, the writer owns the range from tail to head
+    std::vector<char> buffer;
+    qint64 head = 0;
+    qint64 tail = 0;
+
+    bool recording = false;
+    bool stopping = false;
+    quint64 session = 0;
+    quint64 recordedFrames = 0;
+    quint64 droppedFrames = 0;
+    QString errorString;
+
+    QFile file;
+    QElapsedTimer clock;
+    std::unique_ptr<QThread> writer;
+};
+
+bool TraceRecorder::Private::append(quint16 channelId, RecordKind kind, QByteArrayView data)
+{
+    const auto capacity = static_cast<qint64>(buffer.size());
+
+    if (RecordHeaderSize + data.size() > capacity - (head - tail))
+        return false;
+
+    auto header = std::array<char, RecordHeaderSize>{};
+
+    qToLittleEndian<quint64>(static_cast<quint64>(clock.nsecsElapsed()), header.data());
+    qToLittleEndian<quint16>(channelId, header.data() + 8);
+    header[10] = static_cast<char>(kind);
+    qToLittleEndian<quint32>(static_cast<quint32>(data.size()), header.data() + 12);
+
+    copyIn({header.data(), RecordHeaderSize});
+    copyIn(data);
+
+    return true;
+}
+
+void TraceRecorder::Private::copyIn(QByteArrayView data)
+{
+    const auto capacity = static_cast<qint64>(buffer.size());
+    const auto offset = head % capacity;
+    const auto first = std::min(data.size(), capacity - offset);
+
+    std::memcpy(buffer.data() + offset, data.data(), static_cast<size_t>(first));
+    std::memcpy(buffer.data(), data.data() + first, static_cast<size_t>(data.size() - first));
+
+    head += data.size();
+}
+
+void TraceRecorder::Private::runWriter()
+{
+    auto locker = QMutexLocker{&mutex};
+
+    for (auto finished = false; !finished; ) {
+        if (!stopping && head - tail < static_cast<qint64>(buffer.size()) / 2)
+            dataAvailable.wait(&mutex, QDeadlineTimer{FlushInterval});
+
+        finished = stopping;
+
+        const auto begin = tail;
+        const auto end = head;
+
+        // the producers only touch the free part of the buffer, so it can be written without lock
+        locker.unlock();
+        const auto succeeded = writeOut(begin, end);
+        locker.relock();
+
+        tail = end;
+
+        if (!succeeded && errorString.isEmpty())
+            errorString = file.errorString();
+    }
+}
+
+bool TraceRecorder::Private::writeOut(qint64 begin, qint64 end)
+{
+    if (begin == end)
+        return true;
+
+    const auto capacity = static_cast<qint64>(buffer.size());
+    const auto offset = begin % capacity;
+    const auto first = std::min(end - begin, capacity - offset);
+
+    if (file.write(buffer.data() + offset, first) != first)
+        return false;
+    if (first < end - begin && file.write(buffer.data(), end - begin - first) != end - begin - first)
+        return false;
+
+    return file.flush();
+}
+
+// =====================================================================================================================
+
+TraceRecorder::TraceRecorder(QObject *parent)
+    : QObject{parent}
+    , d{new Private{this}}
+{}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+}
+
+bool TraceRecorder::start(QString fileName, qsizetype capacity)
+{
+    stop();
+
+    d->file.setFileName(std::move(fileName));
+
+    if (!d->file.open(QFile::WriteOnly | QFile::Truncate)) {
+        d->errorString = d->file.errorString();
+        return false;
+    }
+
+    auto header = s_fileMagic.toByteArray();
+    header.resize(FileHeaderSize);
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), header.data() + s_fileMagic.size());
+
+    if (d->file.write(header) != header.size()) {
+        d->errorString = d->file.errorString();
+        d->file.close();
+        return false;
+    }
+
+    d->buffer.assign(static_cast<size_t>(std::max(capacity, MinimumCapacity)), '\0');
+    d->head = d->tail = 0;
+    d->recording = true;
+    d->stopping = false;
+    d->session = s_sessionCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    d->recordedFrames = d->droppedFrames = 0;
+    d->errorString.clear();
+    d->clock.start();
+
+    d->writer.reset(QThread::create(&Private::runWriter, d));
+    d->writer->setObjectName("TraceWriter"_L1);
+    d->writer->start(QThread::LowPriority);
+
+    if (const auto previous = internal::s_activeTraceRecorder.exchange(this, std::memory_order_acq_rel))
+        previous->stop();
+
+    return true;
+}
+
+void TraceRecorder::stop()
+{
+    auto expected = this;
+    internal::s_activeTraceRecorder.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+
+    if (!d->writer)
+        return;
+
+    {
+        const auto locker = QMutexLocker{&d->mutex};
+        d->recording = false;
+        d->stopping = true;
+        d->dataAvailable.wakeOne();
+    }
+
+    d->writer->wait();
+    d->writer.reset();
+    d->file.close();
+
+    if (d->droppedFrames > 0) {
+        qCWarning(logger(this), "%llu of %llu frames were dropped while writing %ls",
+                  d->droppedFrames, d->recordedFrames + d->droppedFrames, qUtf16Printable(d->file.fileName()));
+    }
+}
+
+bool TraceRecorder::isActive() const
+{
+    return d->writer != nullptr;
+}
+
+QString TraceRecorder::fileName() const
+{
+    return d->file.fileName();
+}
+
+QString TraceRecorder::errorString() const
+{
+    const auto locker = QMutexLocker{&d->mutex};
+    return d->errorString;
+}
+
+quint64 TraceRecorder::recordedFrames() const
+{
+    const auto locker = QMutexLocker{&d->mutex};
+    return d->recordedFrames;
+}
+
+quint64 TraceRecorder::droppedFrames() const
+{
+    const auto locker = QMutexLocker{&d->mutex};
+    return d->droppedFrames;
+}
+
+void TraceRecorder::record(TraceChannel *channel, TransportEvent::Direction direction, QByteArrayView data) noexcept
+{
+    if (data.isEmpty())
+        return;
+
+    const auto locker = QMutexLocker{&d->mutex};
+
+    if (!d->recording)
+        return;
+
+    // the name of a channel is written once per session, right before its first frame
+    if (channel->m_session != d->session) {
+        if (!d->append(channel->m_id, RecordKind::ChannelName, channel->m_name.toUtf8())) {
+            ++d->droppedFrames;
+            return;
+        }
+
+        channel->m_session = d->session;
+    }
+
+    if (!d->append(channel->m_id, recordKind(direction), data)) {
+        ++d->droppedFrames;
+        return;
+    }
+
+    ++d->recordedFrames;
+
+    if (d->head - d->tail >= static_cast<qint64>(d->buffer.size()) / 2)
+        d->dataAvailable.wakeOne();
+}
+
+// =====================================================================================================================
+
+TransportEvent TraceRecord::toTransportEvent() const
+{
+    return {std::chrono::duration_cast<std::chrono::microseconds>(timestamp), direction, data};
+}
+
+TraceReader::TraceReader(QIODevice *device)
+    : m_device{device}
+{}
+
+bool TraceReader::readHeader()
+{
+    const auto header = m_device->read(FileHeaderSize);
+
+    if (header.size() != FileHeaderSize || !header.startsWith(s_fileMagic))
+        return fail("Not a protocol trace"_L1);
+
+    const auto startTime = qFromLittleEndian<qint64>(header.constData() + s_fileMagic.size());
+    m_startTime = QDateTime::fromMSecsSinceEpoch(startTime, QTimeZone::UTC);
+    m_headerRead = true;
+
+    return true;
+}
+
+bool TraceReader::readNext()
+{
+    if (hasError() || (!m_headerRead && !readHeader()))
+        return false;
+
+    while (true) {
+        const auto header = m_device->read(RecordHeaderSize);
+
+        if (header.isEmpty())
+            return false;
+        if (header.size() != RecordHeaderSize)
+            return fail("Truncated record header"_L1);
+
+        const auto timestamp = qFromLittleEndian<quint64>(header.constData());
+        const auto channelId = qFromLittleEndian<quint16>(header.constData() + 8);
+        const auto kind = static_cast<RecordKind>(header[10]);
+        const auto length = static_cast<qint64>(qFromLittleEndian<quint32>(header.constData() + 12));
+
+        auto data = m_device->read(length);
+
+        if (data.size() != length)
+            return fail("Truncated record data"_L1);
+
+        switch (kind) {
+        case RecordKind::ChannelName:
+            m_channels.insert(channelId, QString::fromUtf8(data));
+            continue;
+
+        case RecordKind::Received:
+        case RecordKind::Sent:
+            m_record.timestamp = std::chrono::nanoseconds{static_cast<qint64>(timestamp)};
+            m_record.channel = m_channels.value(channelId, '#'_L1 + QString::number(channelId));
+            m_record.direction = (kind == RecordKind::Sent ? TransportEvent::Direction::Sent
+                                                           : TransportEvent::Direction::Received);
+            m_record.data = std::move(data);
+            return true;
+        }
+
+        return fail("Unknown kind of record: "_L1 + QString::number(static_cast<int>(kind)));
+    }
+}
+
+bool TraceReader::fail(QString errorString)
+{
+    m_errorString = std::move(errorString);
+    return false;
+}
+
+QByteArray TraceReader::toText(const TraceRecord &record)
+{
+    const auto seconds = std::chrono::duration<double>{record.timestamp}.count();
+    const auto tag = (record.direction == TransportEvent::Direction::Sent ? ">W"_BV : "<R"_BV);
+
+    return QByteArray::number(seconds, 'f', 6).rightJustified(12) + " [" + record.channel.toUtf8() + "] "
+            + tag.toByteArray() + ' ' + record.data.toHex(' ');
+}
+
+} // namespace lmrs::core
@@ -0,0 +1,137 @@
+#ifndef LMRS_CORE_TRACING_H
+#define LMRS_CORE_TRACING_H
+
+#include "transport.h"
+
+#include <QDateTime>
+#include <QHash>
+
+#include <atomic>
+
+namespace lmrs::core {
+
+/// Protocol traces are binary records of the raw frames exchanged by device drivers. While a
+/// TraceRecorder is active, drivers copy each frame into its ring buffer without formatting
+/// anything, and a background thread writes that buffer to disk. TraceReader renders such
+/// traces in the familiar ">W" and "<R" log format afterwards.
+
+class TraceRecorder;
+
+namespace internal {
+extern std::atomic<TraceRecorder *> s_activeTraceRecorder;
+} // namespace internal
+
+/// The source of traced frames, usually one per driver instance. Recording costs
+/// a single atomic load while no TraceRecorder is active.
+class TraceChannel
+{
+public:
+    explicit TraceChannel(QAnyStringView name);
+    TraceChannel(const TraceChannel &) = delete;
+    TraceChannel &operator=(const TraceChannel &) = delete;
+
+    [[nodiscard]] QString name() const { return m_name; }
+    [[nodiscard]] quint16 id() const noexcept { return m_id; }
+
+    void record(TransportEvent::Direction direction, QByteArrayView data) noexcept;
+    void recordReceived(QByteArrayView data) noexcept { record(TransportEvent::Direction::Received, data); }
+    void recordSent(QByteArrayView data) noexcept { record(TransportEvent::Direction::Sent, data); }
+
+private:
+    friend class TraceRecorder;
+
+    QString m_name;
+    quint16 m_id;
+    quint64 m_session = 0; // the recording session which already got told the name of this channel
+};
+
+// =====================================================================================================================
+
+/// Collects the frames of all trace channels in a ring buffer of fixed capacity, which gets
+/// written to a file by a background thread. Frames are dropped if the buffer is full, so that
+/// a slow disk never blocks the event loop. Only one recorder is active at any time, and it
+/// must live in the thread of the drivers it traces.
+class TraceRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr qsizetype DefaultCapacity = 4 * 1024 * 1024;
+
+    explicit TraceRecorder(QObject *parent = nullptr);
+    ~TraceRecorder() override;
+
+    /// Starts writing the frames of all trace channels to `fileName`, stopping any other active recorder.
+    bool start(QString fileName, qsizetype capacity = DefaultCapacity);
+    void stop();
+
+    [[nodiscard]] bool isActive() const;
+    [[nodiscard]] QString fileName() const;
+    [[nodiscard]] QString errorString() const;
+
+    [[nodiscard]] quint64 recordedFrames() const;
+    [[nodiscard]] quint64 droppedFrames() const;
+
+    [[nodiscard]] static TraceRecorder *active() noexcept { return internal::s_activeTraceRecorder.load(std::memory_order_acquire); }
+
+    void record(TraceChannel *channel, TransportEvent::Direction direction, QByteArrayView data) noexcept;
+
+private:
+    class Private;
+    Private *const d;
+};
+
+// =====================================================================================================================
+
+struct TraceRecord
+{
+    std::chrono::nanoseconds timestamp = {}; ///< relative to the start of the trace
+    QString channel = {};
+    TransportEvent::Direction direction = TransportEvent::Direction::Received;
+    QByteArray data = {};
+
+    /// Converts into an event for TransportReplay, which only is meaningful for the frames of a single channel.
+    [[nodiscard]] TransportEvent toTransportEvent() const;
+};
+
+/// Reads traces written by TraceRecorder.
+class TraceReader
+{
+public:
+    explicit TraceReader(QIODevice *device);
+
+    [[nodiscard]] bool readNext();
+    [[nodiscard]] const TraceRecord &record() const { return m_record; }
+
+    [[nodiscard]] QDateTime startTime() const { return m_startTime; }
+    [[nodiscard]] QList<QString> channels() const { return m_channels.values(); }
+
+    [[nodiscard]] bool hasError() const { return !m_errorString.isEmpty(); }
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+
+    /// Renders a record like log messages: seconds since start, channel name, and the frame as hex dump.
+    [[nodiscard]] static QByteArray toText(const TraceRecord &record);
+
+private:
+    bool readHeader();
+    bool fail(QString errorString);
+
+    QIODevice *const m_device;
+    QHash<quint16, QString> m_channels;
+    TraceRecord m_record;
+    QDateTime m_startTime;
+    QString m_errorString;
+    bool m_headerRead = false;
+};
+
+// =====================================================================================================================
+
+inline void TraceChannel::record(TransportEvent::Direction direction, QByteArrayView data) noexcept
+{
+    if (const auto recorder = TraceRecorder::active(); Q_UNLIKELY(recorder != nullptr))
+        recorder->record(this, direction, data);
+}
+
+} // namespace lmrs::core
+
+#endif // LMRS_CORE_TRACING_H
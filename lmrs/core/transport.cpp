@@ -0,0 +1,554 @@
+#include "transport.h"
+
+#include "logging.h"
+#include "typetraits.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPointer>
+#include <QTimer>
+
+#include <algorithm>
+
+namespace lmrs::core {
+
+namespace {
+
+constexpr auto s_receivedTag = QByteArrayView{"<R"};
+constexpr auto s_sentTag = QByteArrayView{">W"};
+
+constexpr bool isDigit(char ch) { return ch >= '0' && ch <= '9'; }
+constexpr bool isHexDigit(char ch) { return isDigit(ch) || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F'); }
+
+std::chrono::microseconds elapsed(const QElapsedTimer &clock)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds{clock.nsecsElapsed()});
+}
+
+} // namespace
+
+// =====================================================================================================================
+
+std::optional<TransportRecording> TransportRecording::read(QIODevice *device)
+{
+    auto recording = TransportRecording{};
+
+    for (auto lineNumber = 1; !device->atEnd(); ++lineNumber) {
+        const auto line = device->readLine().trimmed();
+
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        if (auto event = fromText(line)) {
+            recording.events.append(std::move(event).value());
+        } else {
+            qCWarning(logger<TransportRecording>(), "Invalid event at line %d: %s", lineNumber, line.constData());
+            return {};
+        }
+    }
+
+    return recording;
+}
+
+std::optional<TransportRecording> TransportRecording::read(QString fileName)
+{
+    auto file = QFile{std::move(fileName)};
+
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        qCWarning(logger<TransportRecording>(), "Could not read %ls: %ls",
+                  qUtf16Printable(file.fileName()), qUtf16Printable(file.errorString()));
+        return {};
+    }
+
+    return read(&file);
+}
+
+bool TransportRecording::write(QIODevice *device) const
+{
+    for (const auto &event: events) {
+        if (device->write(toText(event) + '\n') < 0)
+            return false;
+    }
+
+    return true;
+}
+
+QByteArray TransportRecording::toText(const TransportEvent &event)
+{
+    const auto tag = event.direction == TransportEvent::Direction::Sent ? s_sentTag : s_receivedTag;
+    return QByteArray::number(event.timestamp.count()) + ' ' + tag.toByteArray() + ' ' + event.data.toHex(' ');
+}
+
+std::optional<TransportEvent> TransportRecording::fromText(QByteArrayView line)
+{
+    auto event = TransportEvent{};
+    line = line.trimmed();
+
+    // the timestamp is optional to also accept the traces of the ESU programmer
+    if (const auto length = std::find_if_not(line.begin(), line.end(), isDigit) - line.begin(); length > 0) {
+        event.timestamp = std::chrono::microseconds{line.first(length).toLongLong()};
+        line = line.sliced(length).trimmed();
+    }
+
+    if (line.startsWith(s_sentTag))
+        event.direction = TransportEvent::Direction::Sent;
+    else if (line.startsWith(s_receivedTag))
+        event.direction = TransportEvent::Direction::Received;
+    else
+        return {};
+
+    line = line.sliced(2);
+
+    if (!std::all_of(line.begin(), line.end(), [](char ch) { return isHexDigit(ch) || ch == ' '; }))
+        return {};
+
+    event.data = QByteArray::fromHex(line.toByteArray());
+    return event;
+}
+
+// =====================================================================================================================
+
+class TransportRecorder::Private : public PrivateObject<TransportRecorder>
+{
+public:
+    explicit Private(QIODevice *transport, TransportRecorder *parent)
+        : PrivateObject{parent}
+        , transport{transport}
+    {}
+
+    void record(TransportEvent::Direction direction, QByteArrayView data);
+
+    QPointer<QIODevice> transport;
+    QPointer<QIODevice> output;
+    QElapsedTimer clock;
+    TransportRecording recording;
+};
+
+void TransportRecorder::Private::record(TransportEvent::Direction direction, QByteArrayView data)
+{
+    if (data.isEmpty())
+        return;
+
+    if (!clock.isValid())
+        clock.start();
+
+    auto event = TransportEvent{elapsed(clock), direction, data.toByteArray()};
+
+    if (output)
+        output->write(TransportRecording::toText(event) + '\n');
+    else
+        recording.events.append(std::move(event));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+TransportRecorder::TransportRecorder(QIODevice *transport, QObject *parent)
+    : QIODevice{parent}
+    , d{new Private{transport, this}}
+{
+    if (transport) {
+        connect(transport, &QIODevice::readyRead, this, &QIODevice::readyRead);
+        connect(transport, &QIODevice::bytesWritten, this, &QIODevice::bytesWritten);
+        connect(transport, &QIODevice::aboutToClose, this, [this] { QIODevice::close(); });
+    }
+}
+
+QIODevice *TransportRecorder::transport() const
+{
+    return d->transport;
+}
+
+void TransportRecorder::setOutput(QIODevice *output)
+{
+    d->output = output;
+}
+
+QIODevice *TransportRecorder::output() const
+{
+    return d->output;
+}
+
+TransportRecording TransportRecorder::recording() const
+{
+    return d->recording;
+}
+
+void TransportRecorder::recordReceived(QByteArrayView data)
+{
+    d->record(TransportEvent::Direction::Received, std::move(data));
+}
+
+void TransportRecorder::recordSent(QByteArrayView data)
+{
+    d->record(TransportEvent::Direction::Sent, std::move(data));
+}
+
+bool TransportRecorder::isSequential() const
+{
+    return true;
+}
+
+bool TransportRecorder::open(OpenMode mode)
+{
+    if (d->transport && !d->transport->isOpen() && !d->transport->open(mode)) {
+        setErrorString(d->transport->errorString());
+        return false;
+    }
+
+    d->clock.start();
+
+    // the wrapped transport already buffers, there is no point in buffering twice
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void TransportRecorder::close()
+{
+    if (!isOpen())
+        return;
+
+    QIODevice::close();
+
+    if (d->transport)
+        d->transport->close();
+}
+
+qint64 TransportRecorder::bytesAvailable() const
+{
+    return QIODevice::bytesAvailable() + (d->transport ? d->transport->bytesAvailable() : 0);
+}
+
+qint64 TransportRecorder::bytesToWrite() const
+{
+    return QIODevice::bytesToWrite() + (d->transport ? d->transport->bytesToWrite() : 0);
+}
+
+bool TransportRecorder::canReadLine() const
+{
+    return QIODevice::canReadLine() || (d->transport && d->transport->canReadLine());
+}
+
+qint64 TransportRecorder::readData(char *data, qint64 maxSize)
+{
+    if (!d->transport)
+        return -1;
+
+    const auto bytesRead = d->transport->read(data, maxSize);
+
+    if (bytesRead > 0)
+        recordReceived({data, bytesRead});
+    else if (bytesRead < 0)
+        setErrorString(d->transport->errorString());
+
+    return bytesRead;
+}
+
+qint64 TransportRecorder::readLineData(char *data, qint64 maxSize)
+{
+    if (!d->transport)
+        return -1;
+
+    // forward to the transport, instead of reading byte by byte
+    const auto bytesRead = d->transport->readLine(data, maxSize + 1);
+
+    if (bytesRead > 0)
+        recordReceived({data, bytesRead});
+    else if (bytesRead < 0)
+        setErrorString(d->transport->errorString());
+
+    return bytesRead;
+}
+
+qint64 TransportRecorder::writeData(const char *data, qint64 maxSize)
+{
+    if (!d->transport)
+        return -1;
+
+    const auto bytesWritten = d->transport->write(data, maxSize);
+
+    if (bytesWritten > 0)
+        recordSent({data, bytesWritten});
+    else if (bytesWritten < 0)
+        setErrorString(d->transport->errorString());
+
+    return bytesWritten;
+}
+
+// =====================================================================================================================
+
+class TransportReplay::Private : public PrivateObject<TransportReplay>
+{
+public:
+    explicit Private(TransportRecording recording, Speed speed, TransportReplay *parent)
+        : PrivateObject{parent}
+        , recording{std::move(recording)}
+        , speed{speed}
+    {
+        timer.setSingleShot(true);
+        timer.setTimerType(Qt::PreciseTimer);
+        connect(&timer, &QTimer::timeout, this, &Private::replay);
+    }
+
+    void write(QByteArrayView data);
+    void writeBytes(QByteArrayView data);
+    void writeFrames(QByteArrayView data);
+    bool expectsWrite() const;
+    void reportUnexpectedWrite(QByteArrayView data);
+    void scheduleReplay();
+    void replay();
+    void completeEvent();
+    void checkFinished();
+
+    const TransportRecording recording;
+    const Speed speed;
+
+    std::unique_ptr<Adapter> adapter;
+
+    qsizetype position = 0;
+    qsizetype mismatchCount = 0;
+    bool finished = false;
+    QByteArray pendingWrite;          // data written so far for the current event, or frame when using an adapter
+    qsizetype recordedOffset = 0;     // length of the current event's frames already matched by the adapter
+    QByteArray readBuffer;
+
+    QTimer timer;
+    QElapsedTimer clock;              // time since the previous event completed
+};
+
+void TransportReplay::Private::write(QByteArrayView data)
+{
+    if (adapter)
+        writeFrames(data);
+    else
+        writeBytes(data);
+
+    scheduleReplay();
+}
+
+void TransportReplay::Private::writeBytes(QByteArrayView data)
+{
+    while (!data.isEmpty()) {
+        if (!expectsWrite()) {
+            reportUnexpectedWrite(data);
+            return;
+        }
+
+        const auto &expected = recording.events[position].data;
+        const auto length = std::min(data.size(), expected.size() - pendingWrite.size());
+
+        pendingWrite.append(data.first(length));
+        data = data.sliced(length);
+
+        if (pendingWrite.size() == expected.size()) {
+            if (pendingWrite != expected) {
+                qCDebug(logger(), "Written data differs from recording at event %d: %s instead of %s",
+                        static_cast<int>(position), pendingWrite.toHex(' ').constData(), expected.toHex(' ').constData());
+                ++mismatchCount;
+            }
+
+            pendingWrite.clear();
+            completeEvent();
+        }
+    }
+}
+
+void TransportReplay::Private::writeFrames(QByteArrayView data)
+{
+    pendingWrite.append(data);
+
+    // the adapter might change the length of frames, like by escaping sequence numbers,
+    // therefore each written frame is matched with the next frame of the recorded event
+    while (const auto actualLength = adapter->frameLength(pendingWrite)) {
+        const auto actual = QByteArrayView{pendingWrite}.first(actualLength);
+
+        if (!expectsWrite()) {
+            reportUnexpectedWrite(actual);
+        } else {
+            const auto expected = QByteArrayView{recording.events[position].data}.sliced(recordedOffset);
+            const auto recordedLength = adapter->frameLength(expected);
+            const auto recorded = recordedLength > 0 ? expected.first(recordedLength) : expected;
+
+            if (!adapter->sent(recorded, actual)) {
+                qCDebug(logger(), "Written frame differs from recording at event %d: %s instead of %s",
+                        static_cast<int>(position), actual.toByteArray().toHex(' ').constData(),
+                        recorded.toByteArray().toHex(' ').constData());
+                ++mismatchCount;
+            }
+
+            recordedOffset += recorded.size();
+
+            if (recordedOffset == recording.events[position].data.size()) {
+                recordedOffset = 0;
+                completeEvent();
+            }
+        }
+
+        pendingWrite.remove(0, actualLength);
+    }
+}
+
+bool TransportReplay::Private::expectsWrite() const
+{
+    return position < recording.events.size()
+            && recording.events[position].direction == TransportEvent::Direction::Sent;
+}
+
+void TransportReplay::Private::reportUnexpectedWrite(QByteArrayView data)
+{
+    qCWarning(logger(), "Unexpected data written at event %d: %s",
+              static_cast<int>(position), data.toByteArray().toHex(' ').constData());
+    ++mismatchCount;
+}
+
+void TransportReplay::Private::scheduleReplay()
+{
+    // never deliver data synchronously from within write(),
+    // drivers might not be ready yet for the response
+    if (!timer.isActive())
+        timer.start(0);
+}
+
+void TransportReplay::Private::replay()
+{
+    using namespace std::chrono;
+
+    if (!q()->isOpen())
+        return;
+
+    auto bytesReceived = qsizetype{0};
+
+    while (position < recording.events.size()) {
+        const auto &event = recording.events[position];
+
+        if (event.direction == TransportEvent::Direction::Sent)
+            break; // wait until the driver writes this data
+
+        if (speed == Speed::Original && position > 0) {
+            const auto interval = event.timestamp - recording.events[position - 1].timestamp;
+
+            if (const auto remaining = interval - elapsed(clock);
+                    remaining > remaining.zero()) {
+                timer.start(ceil<milliseconds>(remaining));
+                break;
+            }
+        }
+
+        auto data = adapter ? adapter->received(event.data) : event.data;
+        bytesReceived += data.size();
+        readBuffer.append(std::move(data));
+        completeEvent();
+    }
+
+    if (bytesReceived > 0)
+        emit q()->readyRead();
+
+    checkFinished();
+}
+
+void TransportReplay::Private::completeEvent()
+{
+    ++position;
+    clock.start();
+}
+
+void TransportReplay::Private::checkFinished()
+{
+    // finish once the driver has read everything
+    if (!finished && q()->isFinished()) {
+        finished = true;
+        emit q()->finished();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+TransportReplay::TransportReplay(TransportRecording recording, Speed speed, QObject *parent)
+    : QIODevice{parent}
+    , d{new Private{std::move(recording), speed, this}}
+{}
+
+void TransportReplay::setAdapter(std::unique_ptr<Adapter> adapter)
+{
+    d->adapter = std::move(adapter);
+}
+
+TransportReplay::Adapter *TransportReplay::adapter() const
+{
+    return d->adapter.get();
+}
+
+TransportReplay::Speed TransportReplay::speed() const
+{
+    return d->speed;
+}
+
+qsizetype TransportReplay::position() const
+{
+    return d->position;
+}
+
+qsizetype TransportReplay::mismatchCount() const
+{
+    return d->mismatchCount;
+}
+
+bool TransportReplay::isFinished() const
+{
+    return d->position == d->recording.events.size() && d->readBuffer.isEmpty();
+}
+
+bool TransportReplay::isSequential() const
+{
+    return true;
+}
+
+bool TransportReplay::open(OpenMode mode)
+{
+    if (!QIODevice::open(mode | Unbuffered))
+        return false;
+
+    d->position = 0;
+    d->mismatchCount = 0;
+    d->finished = false;
+    d->pendingWrite.clear();
+    d->recordedOffset = 0;
+    d->readBuffer.clear();
+    d->clock.start();
+    d->scheduleReplay();
+
+    return true;
+}
+
+void TransportReplay::close()
+{
+    d->timer.stop();
+    QIODevice::close();
+}
+
+qint64 TransportReplay::bytesAvailable() const
+{
+    return QIODevice::bytesAvailable() + d->readBuffer.size();
+}
+
+bool TransportReplay::canReadLine() const
+{
+    return QIODevice::canReadLine() || d->readBuffer.contains('\n');
+}
+
+qint64 TransportReplay::readData(char *data, qint64 maxSize)
+{
+    const auto length = std::min(maxSize, qint64{d->readBuffer.size()});
+
+    std::copy_n(d->readBuffer.constData(), length, data);
+    d->readBuffer.remove(0, length);
+
+    d->checkFinished();
+    return length;
+}
+
+qint64 TransportReplay::writeData(const char *data, qint64 maxSize)
+{
+    d->write({data, maxSize});
+    return maxSize;
+}
+
+} // namespace lmrs::core
@@ -0,0 +1,156 @@
+#ifndef LMRS_CORE_TRANSPORT_H
+#define LMRS_CORE_TRANSPORT_H
+
+#include <QIODevice>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+
+namespace lmrs::core {
+
+/// The transport of a device is the QIODevice through which its driver exchanges raw
+/// bytes with the hardware. Recording and replay are provided by transports that wrap,
+/// or that replace the real one.
+
+struct TransportEvent
+{
+    Q_GADGET
+
+public:
+    enum class Direction {
+        Received,
+        Sent,
+    };
+
+    Q_ENUM(Direction)
+
+    std::chrono::microseconds timestamp = {}; ///< relative to the start of the recording
+    Direction direction = Direction::Received;
+    QByteArray data = {};
+};
+
+// =====================================================================================================================
+
+class TransportRecording
+{
+public:
+    QList<TransportEvent> events;
+
+    /// Reads a recording in text form. Each line describes one event by an optional timestamp
+    /// in microseconds, followed by the ">W" and "<R" traces also used by the ESU programmer.
+    static std::optional<TransportRecording> read(QIODevice *device);
+    static std::optional<TransportRecording> read(QString fileName);
+
+    bool write(QIODevice *device) const;
+
+    static QByteArray toText(const TransportEvent &event);
+    static std::optional<TransportEvent> fromText(QByteArrayView line);
+};
+
+// =====================================================================================================================
+
+/// Records all data exchanged through the wrapped transport.
+class TransportRecorder : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit TransportRecorder(QIODevice *transport = nullptr, QObject *parent = nullptr);
+
+    QIODevice *transport() const;
+
+    /// Writes each event to `output` as soon as it happens, instead of keeping it in memory.
+    void setOutput(QIODevice *output);
+    QIODevice *output() const;
+
+    TransportRecording recording() const;
+
+    /// Datagram based transports cannot be wrapped, their drivers report the data exchanged instead.
+    void recordReceived(QByteArrayView data);
+    void recordSent(QByteArrayView data);
+
+public: // QIODevice interface
+    bool isSequential() const override;
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+    bool canReadLine() const override;
+
+protected: // QIODevice interface
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 readLineData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    class Private;
+    Private *const d;
+};
+
+// =====================================================================================================================
+
+/// Plays back a recording in place of the real transport. Recorded data is received
+/// only after the data recorded before got written, at original speed or as fast as possible.
+class TransportReplay : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    enum class Speed {
+        Original,
+        Unlimited,
+    };
+
+    Q_ENUM(Speed)
+
+    /// Protocols with sequence numbers, or similar, adapt the recorded responses
+    /// to the requests actually written during replay. Written data is compared
+    /// one protocol frame at a time, since adapted frames can differ in length.
+    class Adapter
+    {
+    public:
+        virtual ~Adapter() = default;
+
+        /// Length of the first complete frame in `data`, or 0 if that frame is incomplete.
+        virtual qsizetype frameLength(QByteArrayView data) const = 0;
+        /// Reports if the frame written during replay is equivalent to the recorded frame.
+        virtual bool sent(QByteArrayView recorded, QByteArrayView actual) = 0;
+        virtual QByteArray received(QByteArray recorded) = 0;
+    };
+
+    explicit TransportReplay(TransportRecording recording, Speed speed = Speed::Original, QObject *parent = nullptr);
+
+    void setAdapter(std::unique_ptr<Adapter> adapter);
+    Adapter *adapter() const;
+
+    Speed speed() const;
+
+    qsizetype position() const;
+    qsizetype mismatchCount() const;
+    bool isFinished() const;
+
+public: // QIODevice interface
+    bool isSequential() const override;
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    qint64 bytesAvailable() const override;
+    bool canReadLine() const override;
+
+signals:
+    void finished();
+
+protected: // QIODevice interface
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    class Private;
+    Private *const d;
+};
+
+} // namespace lmrs::core
+
+#endif // LMRS_CORE_TRANSPORT_H
@@ -36,6 +36,8 @@ public:
     constexpr bool functionState(dcc::Function function) const noexcept { return m_functionState[function]; }
     constexpr auto functionState() const noexcept { return m_functionState; }
 
+    [[nodiscard]] bool operator==(const VehicleInfo &rhs) const noexcept = default;
+
 private:
     dcc::VehicleAddress m_address = 0;
     dcc::Direction m_direction = dcc::Direction::Forward;
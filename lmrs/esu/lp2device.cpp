@@ -8,16 +8,22 @@
 #include <lmrs/core/logging.h>
 #include <lmrs/core/parameters.h>
 #include <lmrs/core/propertyguard.h>
+#include <lmrs/core/tracing.h>
+#include <lmrs/core/transport.h>
 #include <lmrs/core/typetraits.h>
 #include <lmrs/core/userliterals.h>
 #include <lmrs/core/validatingvariantmap.h>
 
 #include <lmrs/serial/serialportmodel.h>
 
+#include <QBuffer>
 #include <QEvent>
+#include <QPointer>
 #include <QSerialPort>
 #include <QSerialPortInfo>
 
+#include <bit>
+
 namespace lmrs::esu::lp2 {
 
 namespace {
@@ -86,6 +92,97 @@ DccSettings dccSettings(core::DebugControl::DccFeedbackMode feedbackMode)
     return DccSettings::nack();
 }
 
+dcc::FunctionGroup functionGroupId(dcc::Function function)
+{
+    for (const auto &groupId: QMetaTypeId<dcc::FunctionGroup>()) {
+        if (groupId.value() != dcc::FunctionGroup::None
+                && dcc::functionRange(groupId.value()).contains(function))
+            return groupId.value();
+    }
+
+    return dcc::FunctionGroup::None;
+}
+
+// Estimates how long the LokProgrammer needs for putting this packet on the track,
+// with one bit taking two short pulses, and a zero bit taking two long pulses.
+std::chrono::microseconds transmissionTime(const DccRequest &request)
+{
+    const auto settings = request.settings();
+    const auto data = request.data();
+
+    auto oneBits = settings.preambleBits() + settings.stopBits();
+    auto zeroBits = 0;
+
+    for (const auto byte: data) {
+        const auto ones = std::popcount(static_cast<quint8>(byte));
+        oneBits += ones;
+        zeroBits += 9 - ones; // each byte is preceded by a zero start bit
+    }
+
+    const auto packetTime = 2 * (oneBits * std::chrono::microseconds{settings.shortPulse()}
+                                 + zeroBits * std::chrono::microseconds{settings.longPulse()});
+
+    return packetTime * std::max(1, static_cast<int>(settings.repeatCount()));
+}
+
+// Responses are matched by sequence number, but the sequence numbers written during replay
+// differ from the recorded ones. Therefore recorded responses get the actual sequence numbers.
+class ReplayAdapter : public core::TransportReplay::Adapter
+{
+public:
+    qsizetype frameLength(QByteArrayView data) const override
+    {
+        return FrameFormat::frameLength(data);
+    }
+
+    bool sent(QByteArrayView recorded, QByteArrayView actual) override
+    {
+        auto recordedFrame = unescaped(recorded);
+        const auto actualFrame = unescaped(actual);
+
+        if (recordedFrame.size() > 1 && actualFrame.size() > 1) {
+            m_sequences.insert(recordedFrame[1], actualFrame[1]);
+            recordedFrame[1] = actualFrame[1];
+        }
+
+        return recordedFrame == actualFrame;
+    }
+
+    QByteArray received(QByteArray recorded) override
+    {
+        m_responses.addData(recorded);
+
+        while (m_responses.readNext()) {
+            auto frame = m_responses.frame();
+
+            if (frame.size() > 1)
+                frame[1] = m_sequences.value(frame[1], frame[1]);
+
+            m_writer.addFrame(frame);
+        }
+
+        auto buffer = QBuffer{};
+        buffer.open(QBuffer::WriteOnly);
+        m_writer.setDevice(&buffer);
+        m_writer.flush();
+        m_writer.setDevice(nullptr);
+
+        return buffer.data();
+    }
+
+private:
+    static QByteArray unescaped(QByteArrayView data)
+    {
+        auto reader = StreamReader{data};
+        return reader.readNext() ? reader.frame() : data.toByteArray();
+    }
+
+    StreamReader m_responses;
+    StreamWriter m_writer;
+
+    QHash<char, char> m_sequences;
+};
+
 } // namespace
 
 // =====================================================================================================================
@@ -137,8 +234,20 @@ public:
     void writeVariable(dcc::VehicleAddress address, dcc::VariableIndex variable, dcc::VariableValue value,
                        core::ContinuationCallback<VariableValueResult> callback) override;
 
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
 private:
+    class VariableReader;
+
+    void leaveServiceModeLater();
+
     Private *d() const;
+
+    int serviceModeTimerId = 0;
+
+    // the value last read for each variable is verified first when reading that variable again
+    QHash<dcc::VariableIndex, dcc::VariableValue> knownValues;
 };
 
 // =====================================================================================================================
@@ -160,21 +269,45 @@ protected:
     void timerEvent(QTimerEvent *event) override;
 
 private:
+    // identifies a refresh packet; FunctionGroup::None stands for the speed packet
+    struct Packet
+    {
+        dcc::VehicleAddress address;
+        dcc::FunctionGroup group = dcc::FunctionGroup::None;
+
+        [[nodiscard]] constexpr bool operator==(const Packet &rhs) const noexcept = default;
+    };
+
     void onPowerStateChanged(PowerControl::State state);
 
+    void markChanged(Packet packet);
+    std::optional<Packet> nextPacket();
+    std::chrono::microseconds sendPacket(Packet packet);
+    void startRefreshCycle();
+
     Private *d() const;
 
-    int dccRequestTimerId = 0;
+    static constexpr auto TickInterval = 20ms;
+    static constexpr auto MaximumBacklog = 2 * TickInterval;
+    static constexpr auto RareRefreshInterval = 8; // refresh cycles between refreshing functions above F4
 
-    dcc::VehicleAddress currentAddress = 0;
+    int dccRequestTimerId = 0;
+    std::chrono::steady_clock::time_point lastTick;
+    std::chrono::microseconds trackTimeBudget = {};
 
     struct VehicleState {
         dcc::Speed speed;
         dcc::Direction direction = dcc::Direction::Forward;
         dcc::FunctionState functions;
+        std::bitset<static_cast<size_t>(dcc::FunctionGroup::Group10) + 1> usedGroups;
     };
 
     QHash<dcc::VehicleAddress, VehicleState> vehicles;
+
+    QList<Packet> changedPackets; // sent with priority, before continuing the refresh cycle
+    QList<Packet> refreshCycle;
+    qsizetype refreshPosition = 0;
+    int refreshCycleCount = 0;
 };
 
 // =====================================================================================================================
@@ -190,6 +323,7 @@ public:
 
     using ResponseCallback = std::function<void(Response)>;
     void sendRequest(Request request, ResponseCallback callback);
+    void flushRequests();
 
     void reportError(QString message);
     void parseMessage(QByteArray data);
@@ -203,6 +337,7 @@ public:
     StreamWriter streamWriter;
 
     core::ConstPointer<QSerialPort> serialPort;
+    QPointer<QIODevice> transport;
     core::ConstPointer<DeviceFactory> factory;
 
     core::ConstPointer<DebugControl> debugControl{this};
@@ -221,10 +356,22 @@ public:
 
         Request request;
         ResponseCallback callback;
+        core::metrics::Clock::time_point started = core::metrics::startTime();
     };
 
     QHash<core::DeviceInfo, QVariant> deviceInfo;
     QHash<Request::Sequence, PendingRequest> pendingRequests;
+    core::TraceChannel trace{logger().categoryName()};
+
+    // while batching, requests are collected and written with one call by flushRequests()
+    bool batchingRequests = false;
+    QList<Request::Sequence> unflushedRequests;
+
+    core::metrics::Gauge pendingRequestCount{"pendingRequests"};
+    core::metrics::Histogram responseTime{"responseTime"};
+    core::metrics::Counter unexpectedResponses{"unexpectedResponses"};
+    core::metrics::Counter writeErrors{"writeErrors"};
+    core::metrics::Registry metrics{"lp2.Device", {&pendingRequestCount, &responseTime, &unexpectedResponses, &writeErrors}};
 };
 
 // =====================================================================================================================
@@ -383,125 +530,206 @@ Device::VariableControl::VariableControl(Private *d)
     : core::VariableControl{d->q()}
 {}
 
-void Device::VariableControl::readVariable(dcc::VehicleAddress address, dcc::VariableIndex variable,
-                                           core::ContinuationCallback<VariableValueResult> callback)
+///
+/// Reads a variable on the programming track. A known value is checked with a single VerifyByte packet first,
+/// only if that fails the value is determined bit by bit. All packets of each step are sent at once, so that
+/// the LokProgrammer can process them back to back without waiting for the host in between.
+///
+class Device::VariableControl::VariableReader : public std::enable_shared_from_this<VariableReader>
 {
-    if (address != 0) {
-        qCWarning(core::logger<Device>(), "POM mode is not supported for ESU LokProgrammer");
-        core::callIfDefined(core::Continuation::Abort, callback, {core::Error::InvalidRequest, {}});
-        return;
-    }
+public:
+    explicit VariableReader(VariableControl *control, dcc::VariableIndex variable,
+                            std::optional<dcc::VariableValue> knownValue,
+                            core::ContinuationCallback<VariableValueResult> callback)
+        : m_control{control}
+        , m_variable{variable}
+        , m_knownValue{std::move(knownValue)}
+        , m_callback{std::move(callback)}
+    {}
 
-    // FIXME: also work with track power enabled, and maybe also restore track power
+    void start();
 
-    d()->powerControl->enterServiceMode([this, variable, callback](core::Error error) {
-        if (error != core::Error::NoError)
-            return core::Continuation::Retry;
+private:
+    using DccResponseHandler = std::function<void(const DccResponse &)>;
 
-        struct Closure
-        {
-            VariableControl *const control;
+    void sendDcc(DccRequest request, const char *description, DccResponseHandler handler);
+    std::optional<DccResponse> checkResponse(const Response &response, const char *description) const;
+    void verifyByte(quint8 value, std::function<void(bool matches)> next);
+    void verifyBits();
 
-            decltype(variable) variable;
-            decltype(callback) callback;
+    void reportResult(core::Error error, quint8 value = 0);
 
-            enum State { Reset, VerifyBit, VerifyByte } state = Reset;
+    VariableControl *const m_control;
+    const dcc::VariableIndex m_variable;
+    const std::optional<dcc::VariableValue> m_knownValue;
+    core::ContinuationCallback<VariableValueResult> m_callback;
 
-            quint8 currentBit = 0;
-            quint8 currentValue = 0;
+    int m_attempt = 0; // responses from previous attempts get ignored
+    quint8 m_bitsReceived = 0;
+    quint8 m_bitValue = 0;
+};
+
+void Device::VariableControl::VariableReader::start()
+{
+    ++m_attempt;
 
-            void start()
-            {
-                currentBit = 0;
-                currentValue = 0;
-                proceed(Reset);
+    if (m_knownValue) {
+        verifyByte(m_knownValue->value, [this](bool matches) {
+            if (matches) {
+                reportResult(core::Error::NoError, m_knownValue->value);
+            } else {
+                qCDebug(logger(m_control), "Variable %d has changed, reading bits", m_variable.value);
+                verifyBits();
             }
+        });
+    } else {
+        verifyBits();
+    }
+}
 
-            void proceed(State newState)
-            {
-                switch (state = newState) {
-                case Reset:
-                    control->d()->sendRequest(Request::sendDcc(DccRequest::reset(5)), *this);
-                    break;
+void Device::VariableControl::VariableReader::sendDcc(DccRequest request, const char *description,
+                                                      DccResponseHandler handler)
+{
+    // service mode packets must be preceded by a reset packet, its response only matters on failure
+    m_control->d()->sendRequest(Request::sendDcc(DccRequest::reset(5)),
+                                [self = shared_from_this(), attempt = m_attempt](Response response) {
+        if (self->m_attempt == attempt && !self->checkResponse(response, "reset"))
+            self->reportResult(core::Error::RequestFailed);
+    });
 
-                case VerifyBit:
-                    control->d()->sendRequest(Request::sendDcc(DccRequest::verifyBit(variable, false, currentBit)), *this);
-                    break;
+    m_control->d()->sendRequest(Request::sendDcc(std::move(request)),
+                                [self = shared_from_this(), attempt = m_attempt,
+                                description, handler = std::move(handler)](Response response) {
+        if (self->m_attempt != attempt)
+            return;
 
-                case VerifyByte:
-                    control->d()->sendRequest(Request::sendDcc(DccRequest::verifyByte(variable, currentValue)), *this);
-                    break;
-                }
-            }
+        if (const auto dcc = self->checkResponse(response, description))
+            handler(*dcc);
+        else
+            self->reportResult(core::Error::RequestFailed);
+    });
+}
 
-            void operator()(Response response)
-            {
-                switch (state) {
-                case Reset:
-                    if (const auto dcc = response.get<DccResponse>(); !dcc
-                            || dcc->status() != Response::Status::Success) {
-                        qCWarning(logger(control), "Bad response to reset request");
-                        reportResult(core::Error::RequestFailed);
-                    } else {
-                        proceed(VerifyBit);
-                    }
+std::optional<DccResponse> Device::VariableControl::VariableReader::checkResponse(const Response &response,
+                                                                                   const char *description) const
+{
+    if (auto dcc = response.get<DccResponse>(); dcc && dcc->status() == Response::Status::Success)
+        return dcc;
 
-                    return;
+    qCWarning(logger(m_control), "Bad response to %s request", description);
+    return {};
+}
 
-                case VerifyBit:
-                    if (const auto dcc = response.get<DccResponse>(); !dcc
-                            || dcc->status() != Response::Status::Success) {
-                        qCWarning(logger(control), "Bad response to verify bit request");
-                        reportResult(core::Error::RequestFailed);
-                    } else {
-                        if (dcc->acknowledge() == DccResponse::Acknowledge::Negative)
-                            currentValue |= static_cast<quint8>(1 << currentBit);
+void Device::VariableControl::VariableReader::verifyByte(quint8 value, std::function<void(bool)> next)
+{
+    sendDcc(DccRequest::verifyByte(m_variable, value), "verify byte", [next](const DccResponse &response) {
+        next(response.acknowledge() == DccResponse::Acknowledge::Positive);
+    });
+}
 
-                        proceed(++currentBit < 8 ? Reset : VerifyByte);
-                    }
+void Device::VariableControl::VariableReader::verifyBits()
+{
+    m_bitsReceived = 0;
+    m_bitValue = 0;
 
-                    return;
+    for (quint8 bit = 0; bit < 8; ++bit) {
+        sendDcc(DccRequest::verifyBit(m_variable, false, bit), "verify bit", [this, bit](const DccResponse &response) {
+            if (response.acknowledge() == DccResponse::Acknowledge::Negative)
+                m_bitValue |= static_cast<quint8>(1 << bit);
 
-                case VerifyByte:
-                    if (const auto dcc = response.get<DccResponse>(); !dcc
-                            || dcc->status() != Response::Status::Success
-                            || dcc->acknowledge() != DccResponse::Acknowledge::Positive) {
-                        qCWarning(logger(control), "Bad response to verify byte request");
-                        reportResult(core::Error::RequestFailed);
-                    } else {
-                        control->d()->powerControl->disableTrackPower({});
-                        reportResult(core::Error::NoError);
-                    }
+            if (++m_bitsReceived < 8)
+                return;
 
-                    return;
+            verifyByte(m_bitValue, [this](bool matches) {
+                if (matches) {
+                    reportResult(core::Error::NoError, m_bitValue);
+                } else {
+                    qCWarning(logger(m_control), "Could not verify the value read bit by bit");
+                    reportResult(core::Error::RequestFailed);
                 }
-            }
+            });
+        });
+    }
+}
 
-            void reportResult(core::Error error)
-            {
-                switch (core::callIfDefined(core::Continuation::Proceed, callback, {error, currentValue})) {
-                case core::Continuation::Retry:
-                    if (callback = callback.retry(); callback)
-                        proceed(state == VerifyBit ? Reset : state);
+void Device::VariableControl::VariableReader::reportResult(core::Error error, quint8 value)
+{
+    ++m_attempt; // ignore any further responses for this attempt
 
-                    break;
+    if (error == core::Error::NoError) {
+        m_control->knownValues.insert(m_variable, value);
+        m_control->leaveServiceModeLater();
+    } else {
+        m_control->knownValues.remove(m_variable);
+    }
 
-                case core::Continuation::Proceed:
-                case core::Continuation::Abort:
-                    break;
-                }
-            }
-        };
+    switch (core::callIfDefined(core::Continuation::Proceed, m_callback, {error, value})) {
+    case core::Continuation::Retry:
+        if (m_callback = m_callback.retry(); m_callback)
+            start();
+
+        break;
+
+    case core::Continuation::Proceed:
+    case core::Continuation::Abort:
+        break;
+    }
+}
 
-        Closure{this, variable, callback}.start();
+void Device::VariableControl::readVariable(dcc::VehicleAddress address, dcc::VariableIndex variable,
+                                           core::ContinuationCallback<VariableValueResult> callback)
+{
+    if (address != 0) {
+        qCWarning(core::logger<Device>(), "POM mode is not supported for ESU LokProgrammer");
+        core::callIfDefined(core::Continuation::Abort, callback, {core::Error::InvalidRequest, {}});
+        return;
+    }
+
+    // FIXME: also work with track power enabled, and maybe also restore track power
+
+    if (const auto timerId = std::exchange(serviceModeTimerId, 0))
+        killTimer(timerId);
+
+    const auto knownValue = knownValues.contains(variable) ? std::make_optional(knownValues.value(variable)) : std::nullopt;
+    const auto reader = std::make_shared<VariableReader>(this, variable, knownValue, std::move(callback));
+
+    // consecutive reads stay in service mode, instead of leaving and entering it again for each variable
+    if (d()->powerControl->state() == PowerControl::State::ServiceMode) {
+        reader->start();
+        return;
+    }
+
+    d()->powerControl->enterServiceMode([reader](core::Error error) {
+        if (error != core::Error::NoError)
+            return core::Continuation::Retry;
+
+        reader->start();
         return core::Continuation::Proceed;
     });
 }
 
-void Device::VariableControl::writeVariable(dcc::VehicleAddress /*address*/, dcc::VariableIndex /*variable*/,
-                                            dcc::VariableValue /*value*/, core::ContinuationCallback<VariableValueResult> /*callback*/)
+void Device::VariableControl::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == serviceModeTimerId) {
+        killTimer(std::exchange(serviceModeTimerId, 0));
+        d()->powerControl->disableTrackPower({});
+    }
+}
+
+void Device::VariableControl::leaveServiceModeLater()
+{
+    if (serviceModeTimerId == 0)
+        serviceModeTimerId = startTimer(250ms);
+}
+
+void Device::VariableControl::writeVariable(dcc::VehicleAddress address, dcc::VariableIndex variable,
+                                            dcc::VariableValue /*value*/, core::ContinuationCallback<VariableValueResult> callback)
 {
     LMRS_UNIMPLEMENTED();
+
+    // nothing got written, but once this is implemented, a partial write might have changed the page
+    invalidatePageCache(address, variable);
+    core::callIfDefined(core::Continuation::Abort, callback, {core::Error::NotImplemented, {}});
 }
 
 Device::Private *Device::VariableControl::d() const
@@ -519,61 +747,143 @@ Device::VehicleControl::VehicleControl(Private *d)
 
 void Device::VehicleControl::setSpeed(dcc::VehicleAddress address, dcc::Speed speed, dcc::Direction direction)
 {
-    currentAddress = address;
-    vehicles[address].speed = speed;
-    vehicles[address].direction = direction;
+    auto &vehicle = vehicles[address];
+
+    vehicle.speed = speed;
+    vehicle.direction = direction;
+
+    markChanged({address, dcc::FunctionGroup::None});
 }
 
 void Device::VehicleControl::setFunction(dcc::VehicleAddress address, dcc::Function function, bool enabled)
 {
-    currentAddress = address;
-    vehicles[address].functions[value(function)] = enabled;
+    auto &vehicle = vehicles[address];
+    vehicle.functions[value(function)] = enabled;
+
+    if (const auto group = functionGroupId(function); group != dcc::FunctionGroup::None) {
+        vehicle.usedGroups.set(static_cast<size_t>(group));
+        markChanged({address, group});
+    }
+
+    // with 14 speed steps the headlight is controlled by the speed packet
+    if (function == 0 && std::holds_alternative<dcc::Speed14>(vehicle.speed))
+        markChanged({address, dcc::FunctionGroup::None});
 }
 
 void Device::VehicleControl::timerEvent(QTimerEvent *event)
 {
+    using namespace std::chrono;
+
     if (event->timerId() == dccRequestTimerId) {
-        if (currentAddress != 0) {
-            const auto current = vehicles.value(currentAddress);
-
-            if (std::holds_alternative<dcc::Speed14>(current.speed)) {
-                const auto speed = std::get<dcc::Speed14>(current.speed);
-                auto request = DccRequest::setSpeed14(currentAddress, speed.count(), current.direction, current.functions[0]);
-                d()->sendRequest(Request::sendDcc(std::move(request)), {}); // FIXME callback?
-            } else if (std::holds_alternative<dcc::Speed28>(current.speed)) {
-                const auto speed = std::get<dcc::Speed28>(current.speed);
-                auto request = DccRequest::setSpeed28(currentAddress, speed.count(), current.direction);
-                d()->sendRequest(Request::sendDcc(std::move(request)), {}); // FIXME callback?
-            } else {
-                const auto speed = speedCast<dcc::Speed126>(current.speed);
-                auto request = DccRequest::setSpeed126(currentAddress, speed.count(), current.direction);
-                d()->sendRequest(Request::sendDcc(std::move(request)), {}); // FIXME callback?
-            }
+        // only send as many packets as the track can carry since the last tick,
+        // the backlog limit prevents bursts after the event loop got stalled
+        const auto now = steady_clock::now();
+        trackTimeBudget = std::min(trackTimeBudget + duration_cast<microseconds>(now - lastTick),
+                                   duration_cast<microseconds>(MaximumBacklog));
+        lastTick = now;
+
+        // all packets of this tick get written to the serial port at once
+        d()->batchingRequests = true;
+
+        while (trackTimeBudget > trackTimeBudget.zero()) {
+            if (const auto packet = nextPacket())
+                trackTimeBudget -= sendPacket(packet.value());
+            else
+                break;
+        }
 
-            for (auto groupId: QMetaTypeId<dcc::FunctionGroup>()) {
-                if (groupId.value() == dcc::FunctionGroup::None)
-                    continue;
+        d()->batchingRequests = false;
+        d()->flushRequests();
+    }
+}
 
-                const auto mask = functionMask(dcc::functionRange(groupId.value()), current.functions);
-                auto request = DccRequest::setFunctions(currentAddress, groupId.value(), mask);
-                d()->sendRequest(Request::sendDcc(std::move(request)), {}); // FIXME callback?
+void Device::VehicleControl::markChanged(Packet packet)
+{
+    if (dccRequestTimerId != 0 && !changedPackets.contains(packet))
+        changedPackets.append(std::move(packet));
+}
+
+std::optional<Device::VehicleControl::Packet> Device::VehicleControl::nextPacket()
+{
+    if (!changedPackets.isEmpty())
+        return changedPackets.takeFirst();
+
+    if (refreshPosition >= refreshCycle.size())
+        startRefreshCycle();
+    if (refreshCycle.isEmpty())
+        return {};
+
+    return refreshCycle[refreshPosition++];
+}
+
+void Device::VehicleControl::startRefreshCycle()
+{
+    auto addresses = vehicles.keys();
+    std::sort(addresses.begin(), addresses.end());
+
+    refreshCycle.clear();
+    refreshPosition = 0;
+
+    // speed and F0-F4 get refreshed for all vehicles first; other functions rarely change,
+    // therefore they only get refreshed every few cycles, and only if ever used
+    for (const auto &address: addresses)
+        refreshCycle.append({address, dcc::FunctionGroup::None});
+    for (const auto &address: addresses)
+        refreshCycle.append({address, dcc::FunctionGroup::Group1});
+
+    if (++refreshCycleCount % RareRefreshInterval == 0) {
+        for (const auto &address: addresses) {
+            for (const auto &groupId: QMetaTypeId<dcc::FunctionGroup>()) {
+                if (groupId.value() != dcc::FunctionGroup::None
+                        && groupId.value() != dcc::FunctionGroup::Group1
+                        && vehicles[address].usedGroups.test(static_cast<size_t>(groupId.value())))
+                    refreshCycle.append({address, groupId.value()});
             }
         }
     }
 }
 
+std::chrono::microseconds Device::VehicleControl::sendPacket(Packet packet)
+{
+    const auto &vehicle = vehicles[packet.address];
+
+    auto request = [&vehicle, packet] {
+        if (packet.group != dcc::FunctionGroup::None) {
+            const auto mask = functionMask(dcc::functionRange(packet.group), vehicle.functions);
+            return DccRequest::setFunctions(packet.address, packet.group, mask);
+        } else if (std::holds_alternative<dcc::Speed14>(vehicle.speed)) {
+            const auto speed = std::get<dcc::Speed14>(vehicle.speed);
+            return DccRequest::setSpeed14(packet.address, speed.count(), vehicle.direction, vehicle.functions[0]);
+        } else if (std::holds_alternative<dcc::Speed28>(vehicle.speed)) {
+            const auto speed = std::get<dcc::Speed28>(vehicle.speed);
+            return DccRequest::setSpeed28(packet.address, speed.count(), vehicle.direction);
+        } else {
+            const auto speed = speedCast<dcc::Speed126>(vehicle.speed);
+            return DccRequest::setSpeed126(packet.address, speed.count(), vehicle.direction);
+        }
+    }();
+
+    const auto duration = transmissionTime(request);
+    d()->sendRequest(Request::sendDcc(std::move(request)), {}); // FIXME callback?
+    return duration;
+}
+
 void Device::VehicleControl::onPowerStateChanged(PowerControl::State state)
 {
     if (state == PowerControl::State::PowerOn) {
         if (dccRequestTimerId == 0) {
             qCInfo(logger(this), "starting DCC request timer");
-            dccRequestTimerId = startTimer(100ms);
+            dccRequestTimerId = startTimer(TickInterval, Qt::PreciseTimer);
+            lastTick = std::chrono::steady_clock::now();
+            trackTimeBudget = {};
         }
     } else {
         if (const auto timerId = std::exchange(dccRequestTimerId, 0); timerId != 0) {
             qCInfo(logger(this), "stopping DCC request timer");
             killTimer(timerId);
         }
+
+        changedPackets.clear();
     }
 }
 
@@ -589,24 +899,49 @@ void Device::Private::sendRequest(Request request, std::function<void (Response)
     const auto guard = core::propertyGuard(q(), &Device::state, &Device::stateChanged,
                                            core::Device::QProtectedSignal{});
 
-    if (!serialPort->isOpen()) {
+    if (!transport || !transport->isOpen()) {
         reportError(tr("Cannot send to disconnected device"));
         core::callIfDefined(callback, Response{});
         return;
     }
 
     auto data = request.toByteArray();
-    qCDebug(logger(), ">W %s", data.toHex(' ').constData());
+    trace.recordSent(data);
     // qCDebug(lcProgrammer) << ">>" << request;
 
-    if (!streamWriter.writeFrame(std::move(data))) {
-        reportError(streamWriter.errorString());
-        core::callIfDefined(callback, Response{});
-        return;
-    }
+    streamWriter.addFrame(data);
 
     const auto sequence = request.sequence(); // store before moving away the request
     pendingRequests.insert(sequence, {std::move(request), std::move(callback)});
+    pendingRequestCount.set(pendingRequests.size());
+    unflushedRequests.append(sequence);
+
+    if (!batchingRequests)
+        flushRequests();
+}
+
+void Device::Private::flushRequests()
+{
+    const auto requests = std::exchange(unflushedRequests, {});
+    const auto framesWritten = streamWriter.flush();
+
+    if (framesWritten < requests.size()) {
+        auto callbacks = QList<ResponseCallback>{};
+
+        for (auto i = framesWritten; i < requests.size(); ++i) {
+            if (const auto it = pendingRequests.find(requests[i]); it != pendingRequests.end()) {
+                callbacks.append(std::move(it->callback));
+                pendingRequests.erase(it);
+            }
+        }
+
+        writeErrors.increment();
+        pendingRequestCount.set(pendingRequests.size());
+        reportError(streamWriter.errorString());
+
+        for (const auto &callback: callbacks)
+            core::callIfDefined(callback, Response{});
+    }
 }
 
 void Device::Private::reportError(QString message)
@@ -622,11 +957,14 @@ void Device::Private::parseMessage(QByteArray data)
             if (auto response = Response{it->request, std::move(message)}; response.isValid()) {
 //                    qCDebug(lcProgrammer) << "<<" << response;
                 const auto callback = std::move(it->callback);
+                responseTime.recordSince(it->started);
                 pendingRequests.erase(it);
+                pendingRequestCount.set(pendingRequests.size());
 
                 core::callIfDefined(callback, std::move(response));
             }
         } else {
+            unexpectedResponses.increment();
             qCWarning(logger(), "Unexpected response for request #%d (0x%02x)",
                       message.sequence(), message.sequence());
             qInfo() << pendingRequests.keys();
@@ -641,7 +979,7 @@ void Device::Private::onReadyRead()
     // FIXME: do not expect start and end marker in message
     while (streamReader.readNext()) {
         auto frame = streamReader.frame();
-        qCDebug(logger(), "<R %s", frame.toHex(' ').constData());
+        trace.recordReceived(frame);
         parseMessage(std::move(frame));
     }
 }
@@ -677,12 +1015,36 @@ Device::Device(QString portName, DeviceFactory *factory, QObject *parent)
             static_cast<core::PowerControl *>(d->powerControl.get()),
             &core::PowerControl::state, &core::PowerControl::stateChanged);
 
-    connect(d->serialPort, &QSerialPort::readyRead, d, &Private::onReadyRead);
+    setTransport(nullptr);
+}
+
+void Device::setTransport(QIODevice *transport)
+{
+    if (!transport)
+        transport = d->serialPort;
+
+    if (d->transport)
+        d->transport->disconnect(d);
+
+    d->transport = transport;
+    connect(d->transport, &QIODevice::readyRead, d, &Private::onReadyRead);
+
+    // fall back to the serial port if the transport's owner deletes it
+    if (transport != d->serialPort.get())
+        connect(transport, &QObject::destroyed, d, [this] { setTransport(nullptr); });
+
+    if (const auto replay = qobject_cast<core::TransportReplay *>(transport); replay && !replay->adapter())
+        replay->setAdapter(std::make_unique<ReplayAdapter>());
+}
+
+QIODevice *Device::transport() const
+{
+    return d->transport;
 }
 
 core::Device::State Device::state() const
 {
-    if (!d->serialPort->isOpen())
+    if (!d->transport || !d->transport->isOpen())
         return State::Disconnected;
     if (d->deviceInfo.isEmpty())
         return State::Connecting;
@@ -734,20 +1096,20 @@ bool Device::connectToDevice()
     }
 
 
-    if (!d->serialPort->open(QSerialPort::ReadWrite)) {
-        d->reportError(d->serialPort->errorString());
+    if (!d->transport->open(QIODevice::ReadWrite)) {
+        d->reportError(d->transport->errorString());
         return false;
     }
 
-    if (!d->serialPort->setDataTerminalReady(false))  {
+    if (d->serialPort->isOpen() && !d->serialPort->setDataTerminalReady(false))  {
         d->reportError(d->serialPort->errorString());
         return false;
     }
 
     d->connectTimeoutId = d->startTimer(5s);
 
-    d->streamReader.setDevice(d->serialPort);
-    d->streamWriter.setDevice(d->serialPort);
+    d->streamReader.setDevice(d->transport);
+    d->streamWriter.setDevice(d->transport);
 
     updateDeviceInfo();
 
@@ -762,7 +1124,9 @@ void Device::disconnectFromDevice()
     d->cancelConnectTimeout();
     d->streamReader.setDevice(nullptr);
     d->streamWriter.setDevice(nullptr);
-    d->serialPort->close();
+
+    if (d->transport)
+        d->transport->close();
 }
 
 core::DeviceFactory *Device::factory() { return d->factory; }
@@ -828,6 +1192,11 @@ void Device::updateDeviceInfo()
     });
 }
 
+QList<const core::metrics::Registry *> Device::metrics() const
+{
+    return core::Device::metrics() << &d->metrics;
+}
+
 void Device::setDeviceInfo(core::DeviceInfo id, QVariant value)
 {
     if (auto it = d->deviceInfo.find(id); it == d->deviceInfo.end()) {
@@ -6,6 +6,8 @@
 #include <lmrs/core/device.h>
 #include <lmrs/core/memory.h>
 
+class QIODevice;
+
 namespace lmrs::esu::lp2 {
 
 class DeviceFactory : public core::DeviceFactory
@@ -33,6 +35,11 @@ public:
     using ReadDeviceInfoCallback = std::function<void(Result result, QHash<lp2::InterfaceInfo, QVariant>)>;
     void readDeviceInformation(QList<lp2::InterfaceInfo> ids, ReadDeviceInfoCallback callback);
 
+    /// Exchanges data through `transport` instead of the serial port, like a core::TransportRecorder
+    /// wrapping transport(), or a core::TransportReplay. Passing `nullptr` restores the serial port.
+    void setTransport(QIODevice *transport);
+    QIODevice *transport() const;
+
 public: // Device interface
     State state() const override;
     QString name() const override;
@@ -51,6 +58,8 @@ public: // Device interface
     QVariant deviceInfo(core::DeviceInfo id, int role = Qt::EditRole) const override;
     void updateDeviceInfo() override;
 
+    QList<const core::metrics::Registry *> metrics() const override;
+
 protected:
     void setDeviceInfo(core::DeviceInfo id, QVariant value) override;
 
@@ -8,6 +8,7 @@
 
 #include <lmrs/serial/serialportmodel.h>
 
+#include <QPointer>
 #include <QSerialPort>
 #include <QSerialPortInfo>
 #include <QTimerEvent>
@@ -270,6 +271,7 @@ public:
     int connectTimeoutId = 0;
 
     core::ConstPointer<QSerialPort> serialPort;
+    QPointer<QIODevice> transport;
     core::ConstPointer<SpeedMeter> speedMeter;
     core::ConstPointer<DeviceFactory> factory;
 };
@@ -282,8 +284,8 @@ void SpeedCatDevice::Private::reportError(QString message)
 
 void SpeedCatDevice::Private::onReadyRead()
 {
-    while (serialPort->canReadLine()) {
-        const auto line = serialPort->readLine().trimmed();
+    while (transport && transport->canReadLine()) {
+        const auto line = transport->readLine().trimmed();
 
         if (line.startsWith('*') && line.endsWith(";V3.0%")) {
             cancelConnectTimeout();
@@ -325,12 +327,33 @@ SpeedCatDevice::SpeedCatDevice(QString portName, Scale scale, RubberType rubberT
     : Device{parent}
     , d{new Private{std::move(portName), scale, rubberType, this, factory}}
 {
-    connect(d->serialPort, &QSerialPort::readyRead, d, &Private::onReadyRead);
+    setTransport(nullptr);
+}
+
+void SpeedCatDevice::setTransport(QIODevice *transport)
+{
+    if (!transport)
+        transport = d->serialPort;
+
+    if (d->transport)
+        d->transport->disconnect(d);
+
+    d->transport = transport;
+    connect(d->transport, &QIODevice::readyRead, d, &Private::onReadyRead);
+
+    // fall back to the serial port if the transport's owner deletes it
+    if (transport != d->serialPort.get())
+        connect(transport, &QObject::destroyed, d, [this] { setTransport(nullptr); });
+}
+
+QIODevice *SpeedCatDevice::transport() const
+{
+    return d->transport;
 }
 
 core::Device::State SpeedCatDevice::state() const
 {
-    if (!d->serialPort->isOpen())
+    if (!d->transport || !d->transport->isOpen())
         return State::Disconnected;
     if (d->speedMeter->sampleCount == 0)
         return State::Connecting;
@@ -380,8 +403,8 @@ bool SpeedCatDevice::connectToDevice()
         return false;
     }
 
-    if (!d->serialPort->open(QSerialPort::ReadWrite)) {
-        d->reportError(d->serialPort->errorString());
+    if (!d->transport->open(QIODevice::ReadWrite)) {
+        d->reportError(d->transport->errorString());
         return false;
     }
 
@@ -395,7 +418,9 @@ void SpeedCatDevice::disconnectFromDevice()
     const auto guard = core::propertyGuard(this, &Device::state, &Device::stateChanged, Device::QProtectedSignal{});
 
     d->speedMeter->sampleCount = 0;
-    d->serialPort->close();
+
+    if (d->transport)
+        d->transport->close();
 }
 
 core::DeviceFactory *SpeedCatDevice::factory() { return d->factory; }
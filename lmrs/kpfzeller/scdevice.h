@@ -4,6 +4,8 @@
 #include <lmrs/core/device.h>
 #include <lmrs/core/parameters.h>
 
+class QIODevice;
+
 namespace lmrs::kpfzeller {
 
 class DeviceFactory : public core::DeviceFactory
@@ -43,6 +45,10 @@ public:
     explicit SpeedCatDevice(QString portName, Scale scale, RubberType rubber,
                             QObject *parent = {}, DeviceFactory *factory = {});
 
+    /// Reads measurements from `transport` instead of the serial port, or from the serial port again for `nullptr`.
+    void setTransport(QIODevice *transport);
+    QIODevice *transport() const;
+
 public: // Device interface
     State state() const override;
     QString name() const override;
@@ -4,6 +4,8 @@
 #include <lmrs/core/continuation.h>
 #include <lmrs/core/logging.h>
 #include <lmrs/core/propertyguard.h>
+#include <lmrs/core/tracing.h>
+#include <lmrs/core/transport.h>
 #include <lmrs/core/userliterals.h>
 
 #include <QBitArray>
@@ -11,6 +13,7 @@
 #include <QLoggingCategory>
 #include <QMetaEnum>
 #include <QPointer>
+#include <QSet>
 #include <QTimer>
 #include <QTimerEvent>
 #include <QUdpSocket>
@@ -18,6 +21,10 @@
 
 #include <QtEndian>
 
+#include <algorithm>
+#include <array>
+#include <bitset>
+
 namespace lmrs::roco::z21 {
 
 namespace {
@@ -30,6 +37,9 @@ auto &lcRequests() { struct Requests {}; return core::logger<Client, Requests>()
 auto &lcStream() { struct Stream {}; return core::logger<Client, Stream>(); }
 auto &lcCanDetector() { struct CanDetector {}; return core::logger<Client, CanDetector>(); }
 
+// accessory addresses are transmitted with 11 bits, in requests and in replies
+constexpr auto AccessoryAddressMask = quint16{0x07ff};
+
 auto makeKey(LoconetDetectorInfo::Query type, quint16 address)
 {
     return (static_cast<quint32>(type) << 16) | address;
@@ -40,6 +50,129 @@ struct ConfigurationVariable {
     quint8 value;
 };
 
+struct DispatchKey
+{
+    static constexpr qint32 AnyAddress = -1;
+
+    constexpr DispatchKey(LanMessageId lanMessageId, qint32 address = AnyAddress) noexcept
+        : lanMessageId{lanMessageId}
+        , address{address}
+    {}
+
+    constexpr DispatchKey(XBusMessageId xbusMessageId, qint32 address = AnyAddress) noexcept
+        : lanMessageId{LanMessageId::XNetMessage}
+        , xbusMessageId{xbusMessageId}
+        , address{address}
+    {}
+
+    [[nodiscard]] constexpr bool hasAddress() const noexcept { return address != AnyAddress; }
+    [[nodiscard]] constexpr DispatchKey withAnyAddress() const noexcept { auto key = *this; key.address = AnyAddress; return key; }
+    [[nodiscard]] constexpr bool operator==(const DispatchKey &rhs) const noexcept = default;
+
+    LanMessageId lanMessageId;
+    XBusMessageId xbusMessageId = XBusMessageId::Invalid;
+    qint32 address = AnyAddress;
+};
+
+size_t qHash(const DispatchKey &key, size_t seed = 0) noexcept
+{
+    return qHashMulti(seed, core::value(key.lanMessageId), core::value(key.xbusMessageId), key.address);
+}
+
+// Identifies queued vehicle commands that get superseded by newer commands of the same kind.
+// Returns 0 for requests that must be sent unmodified, like toggle requests.
+quint32 coalescingKey(QByteArrayView request)
+{
+    enum Kind : quint32 { Drive = 1, Function = 2 };
+
+    if (request.size() != 10 || request[2] != 0x40 || static_cast<quint8>(request[4]) != 0xe4)
+        return 0;
+
+    const auto address = static_cast<quint32>(qFromBigEndian<quint16>(request.data() + 6) & 0x3fff);
+    const auto command = static_cast<quint8>(request[5]);
+
+    if ((command & 0xf0) == 0x10) // LAN_X_SET_LOCO_DRIVE
+        return (Drive << 28) | address;
+
+    if (command == 0xf8) { // LAN_X_SET_LOCO_FUNCTION
+        const auto mode = static_cast<quint8>(request[8]) >> 6;
+        const auto function = static_cast<quint32>(request[8] & 63);
+
+        if (mode != Client::ToggleFunction)
+            return (Function << 28) | (function << 14) | address;
+    }
+
+    return 0;
+}
+
+// Sorts requests into send lanes, so that safety-critical commands
+// never wait behind vehicle commands, and vehicle commands never wait behind polling.
+Client::SendPriority sendPriority(QByteArrayView request)
+{
+    if (request.size() < 6 || request[2] != 0x40 || request[3] != 0x00)
+        return Client::SendPriority::Normal;
+
+    const auto header = static_cast<quint8>(request[4]);
+    const auto command = static_cast<quint8>(request[5]);
+
+    if (header == 0x21 && (command == 0x80 || command == 0x81)) // LAN_X_SET_TRACK_POWER_OFF/ON
+        return Client::SendPriority::Safety;
+    if (header == 0x80 || header == 0x92) // LAN_X_SET_STOP, LAN_X_SET_LOCO_E_STOP
+        return Client::SendPriority::Safety;
+    if (header == 0x54 && request.size() >= 7 && command == 0x07 && static_cast<quint8>(request[6]) == 0xff) // accessory stop
+        return Client::SendPriority::Safety;
+
+    if (header == 0xe4 && ((command & 0xf0) == 0x10 || command == 0xf8)) // LAN_X_SET_LOCO_DRIVE/FUNCTION
+        return Client::SendPriority::Control;
+    if (header == 0x53 || header == 0x54) // LAN_X_SET_TURNOUT, LAN_X_SET_EXT_ACCESSORY
+        return Client::SendPriority::Control;
+
+    return Client::SendPriority::Normal;
+}
+
+// Tells if the safety-critical `stop` makes the queued vehicle command `request` obsolete:
+// sending such command after the stop would restart the vehicle that just got stopped.
+bool supersedes(QByteArrayView stop, QByteArrayView request)
+{
+    if (request.size() < 8 || request[2] != 0x40 || static_cast<quint8>(request[4]) != 0xe4) // LAN_X_SET_LOCO_DRIVE/FUNCTION
+        return false;
+
+    const auto header = static_cast<quint8>(stop[4]);
+    const auto command = static_cast<quint8>(stop[5]);
+
+    if (header == 0x80 || (header == 0x21 && command == 0x80)) // LAN_X_SET_STOP, LAN_X_SET_TRACK_POWER_OFF
+        return true;
+    if (header == 0x92 && stop.size() >= 7) // LAN_X_SET_LOCO_E_STOP
+        return (qFromBigEndian<quint16>(stop.data() + 5) & 0x3fff) == (qFromBigEndian<quint16>(request.data() + 6) & 0x3fff);
+
+    return false;
+}
+
+DispatchKey dispatchKey(const Message &message)
+{
+    const auto lanMessageId = message.lanMessageId();
+
+    if (lanMessageId == LanMessageId::XNetMessage) {
+        const auto xbusMessageId = message.xbusMessageId();
+
+        if (message.xbusMessageLength() >= 2) {
+            if (xbusMessageId == XBusMessageId::VehicleInfo)
+                return {xbusMessageId, qFromBigEndian<quint16>(message.xbusData()) & 0x3fff};
+            if (xbusMessageId == XBusMessageId::AccessoryInfo || xbusMessageId == XBusMessageId::TurnoutInfo)
+                return {xbusMessageId, (qFromBigEndian<quint16>(message.xbusData()) & AccessoryAddressMask) + 1};
+        }
+
+        return {xbusMessageId};
+    }
+
+    if (lanMessageId == LanMessageId::RBusDetectorDataChanged && message.lanMessageLength() >= 1)
+        return {lanMessageId, message.lanData()[0]};
+    if (lanMessageId == LanMessageId::RailcomDataChanged && message.lanMessageLength() >= 2)
+        return {lanMessageId, qFromLittleEndian<quint16>(message.lanData())};
+
+    return {lanMessageId};
+}
+
 class Timer
 {
 public:
@@ -93,7 +226,8 @@ void updateChecksum(QByteArray *message)
         return;
     }
 
-    const auto first = message->begin() + 5;
+    // the checksum covers the X-header and the data bytes
+    const auto first = message->begin() + 4;
     const auto last = message->end() - 1;
 
     auto checksum = quint8{};
@@ -104,6 +238,19 @@ void updateChecksum(QByteArray *message)
     message->back() = static_cast<char>(checksum);
 }
 
+QByteArray turnoutRequest(dcc::AccessoryAddress address, Client::TurnoutDirection direction, bool enabled)
+{
+    const auto directionFlag = static_cast<quint8>(direction == Client::Straight ? 1 : 0);
+    const auto enableFlag = static_cast<quint8>(enabled ? 8 : 0);
+
+    auto request = "09 00 40 00 53 00 00 00 00"_hex;
+    qToBigEndian<quint16>((address - 1) & AccessoryAddressMask, request.data() + 5);
+    qToBigEndian<quint8>(0xA0 | directionFlag | enableFlag, request.data() + 7);
+
+    updateChecksum(&request);
+    return request;
+}
+
 } // namespace
 
 VehicleInfo::VehicleInfo(QByteArray data)
@@ -177,7 +324,7 @@ bool AccessoryInfo::isValid() const
 
 dcc::AccessoryAddress AccessoryInfo::address() const
 {
-    return (qFromBigEndian<quint16>(m_data.constData()) & 0x7ff) + 1;
+    return (qFromBigEndian<quint16>(m_data.constData()) & AccessoryAddressMask) + 1;
 }
 
 dcc::AccessoryState AccessoryInfo::state() const
@@ -204,25 +351,51 @@ QBitArray RBusDetectorInfo::occupancy() const
     return QBitArray::fromBits(m_data.constData() + 1, rbus::PortsPerGroup);
 }
 
-RBusDetectorInfo::operator QList<DetectorInfo>() const
+RBusDetectorInfo::Occupancy RBusDetectorInfo::occupancyBits() const
+{
+    if (!isValid())
+        return {};
+
+    // the ten bytes of occupancy are read as one little endian 80 bit number
+    const auto bytes = m_data.constData() + 1;
+    const auto lowBits = qFromLittleEndian<quint64>(bytes);
+    const auto highBits = qFromLittleEndian<quint16>(bytes + 8);
+
+    return Occupancy{lowBits} | (Occupancy{highBits} << 64);
+}
+
+QList<DetectorInfo> RBusDetectorInfo::detectorInfo(const Occupancy &ports) const
 {
     auto result = QList<DetectorInfo>{};
-    result.reserve(rbus::PortsPerGroup);
 
-    auto address = DetectorAddress::forRBusGroup(group());
-    const auto powerState = DetectorInfo::PowerState::Unknown;
-    const auto occupancyState = occupancy();
+    if (!isValid() || ports.none())
+        return result;
+
+    result.reserve(static_cast<qsizetype>(ports.count()));
 
-    for (auto port = 0; port < occupancyState.size(); ++port) {
-        const auto occupancy = occupancyState[port] ? DetectorInfo::Occupancy::Occupied
-                                                    : DetectorInfo::Occupancy::Free;
+    const auto firstModule = group() * rbus::ModulesPerGroup + 1;
+    const auto occupancyState = occupancyBits();
 
-        result.emplaceBack(std::move(address), occupancy, powerState);
+    for (auto i = 0; i < rbus::PortsPerGroup; ++i) {
+        if (!ports[static_cast<size_t>(i)])
+            continue;
+
+        const auto module = static_cast<quint8>(firstModule + i / rbus::PortsPerModule);
+        const auto port = static_cast<quint8>(i % rbus::PortsPerModule + 1);
+        const auto occupancy = occupancyState[static_cast<size_t>(i)] ? DetectorInfo::Occupancy::Occupied
+                                                                      : DetectorInfo::Occupancy::Free;
+
+        result.emplaceBack(DetectorAddress::forRBusPort(module, port), occupancy, DetectorInfo::PowerState::Unknown);
     }
 
     return result;
 }
 
+RBusDetectorInfo::operator QList<DetectorInfo>() const
+{
+    return detectorInfo(Occupancy{}.set());
+}
+
 LoconetDetectorInfo::LoconetDetectorInfo(QByteArray data)
     : m_data{std::move(data)}
 {}
@@ -454,33 +627,24 @@ QList<dcc::Direction> CanDetectorInfo::directions() const
 
 QList<DetectorInfo> CanDetectorInfo::merge(QList<CanDetectorInfo> infoList)
 {
-    struct GenericInfoChunk {
-        GenericInfoChunk(CanDetectorInfo::Key key, DetectorAddress address)
-            : key{std::move(key)}
-            , info{std::move(address)}
-        {}
-
-        CanDetectorInfo::Key key;
-        DetectorInfo info;
-    };
-
-    auto genericInfoList = QList<GenericInfoChunk>{};
+    auto result = QList<DetectorInfo>{};
+    auto indices = QHash<CanDetectorInfo::Key, qsizetype>{};
 
     for (const auto &info: infoList) {
-        auto it = std::find_if(genericInfoList.begin(), genericInfoList.end(),
-                               [key = info.key()](const auto &chunk) {
-            return chunk.key == key;
-        });
+        auto index = indices.value(info.key(), -1);
 
-        if (it == genericInfoList.end()) {
-            auto address = DetectorAddress::forCanPort(info.networkId(), info.module(), info.port());
-            it = genericInfoList.emplace(genericInfoList.end(), info.key(), std::move(address));
+        if (index < 0) {
+            index = result.size();
+            result.emplaceBack(DetectorAddress::forCanPort(info.networkId(), info.module(), info.port()));
+            indices.insert(info.key(), index);
         }
 
+        auto &genericInfo = result[index];
+
         switch (info.type()) {
         case CanDetectorInfo::Type::Occupancy:
-            it->info.setOccupancy(info.occupancy());
-            it->info.setPowerState(info.powerState());
+            genericInfo.setOccupancy(info.occupancy());
+            genericInfo.setPowerState(info.powerState());
             continue;
 
         case CanDetectorInfo::Type::VehicleSet1:
@@ -498,22 +662,19 @@ QList<DetectorInfo> CanDetectorInfo::merge(QList<CanDetectorInfo> infoList)
         case CanDetectorInfo::Type::VehicleSet13:
         case CanDetectorInfo::Type::VehicleSet14:
         case CanDetectorInfo::Type::VehicleSet15:
-            it->info.addVehicles(info.vehicles());
-            it->info.addDirections(info.directions());
+            if (info.value1() != 0) {
+                genericInfo.addVehicle(info.vehicle1(), info.direction1());
+
+                if (info.value2() != 0)
+                    genericInfo.addVehicle(info.vehicle2(), info.direction2());
+            }
+
             continue;
         }
 
         qCWarning(core::logger<CanDetectorInfo>(), "Unsupported CAN info type: %d", core::value(info.type()));
     }
 
-    auto result = QList<DetectorInfo>{};
-    result.reserve(genericInfoList.size());
-
-    std::transform(genericInfoList.constBegin(), genericInfoList.constEnd(),
-                   std::back_inserter(result), [](const auto &chunk) {
-        return chunk.info;
-    });
-
     return result;
 }
 
@@ -546,7 +707,7 @@ bool TurnoutInfo::isValid() const
 
 dcc::AccessoryAddress TurnoutInfo::address() const
 {
-    return (qFromBigEndian<quint16>(m_data.constData()) & 0x7ff) + 1;
+    return (qFromBigEndian<quint16>(m_data.constData()) & AccessoryAddressMask) + 1;
 }
 
 dcc::TurnoutState TurnoutInfo::state() const
@@ -627,7 +788,7 @@ public:
     explicit Private(Client *parent);
 
     // attributes
-    auto isConnected() const { return m_socket != nullptr; }
+    auto isConnected() const { return m_socket != nullptr || (m_transport && m_transport->isOpen()); }
     auto hostAddress() const { return m_hostAddress; }
     auto hostPort() const { return m_hostPort; }
 
@@ -679,17 +840,35 @@ public:
     auto lockState() const { return m_deviceInfo.lockState; }
     void setLockState(LockState lockState);
 
+    auto sendRateLimit() const { return m_sendRateLimit; }
+    void setSendRateLimit(int datagramsPerSecond);
+
+    auto switchingGroupSize() const { return m_switchingGroupSize; }
+    void setSwitchingGroupSize(int groupSize) { m_switchingGroupSize = std::max(groupSize, 0); }
+
+    auto switchingStagger() const { return m_switchingStagger; }
+    void setSwitchingStagger(std::chrono::milliseconds stagger) { m_switchingStagger = std::max(stagger, std::chrono::milliseconds{}); }
+
+    QList<QByteArray> pendingTurnoutRequests() const;
+
+    const auto &metrics() const { return m_metrics; }
+
     // operations
     void connectToHost(QHostAddress host, quint16 port);
     void disconnectFromHost();
 
     using Observer = std::function<bool(Message message)>;
     void sendRequest(QByteArray request, Observer observer);
+    void sendRequest(QByteArray request, QList<DispatchKey> replyKeys, Observer observer);
 
     void startFeedbackModuleProgramming(rbus::ModuleId module);
     void stopFeedbackModuleProgramming();
     void runFeedbackModuleProgramming();
 
+    void scheduleTurnoutStates(QList<TurnoutCommand> commands, std::chrono::milliseconds duration);
+    void runSwitchingSchedule();
+    void cancelScheduledActivations();
+
     // parsers
     bool parseXStatusChanged(Message message);
     bool parseSystemStateDataChanged(Message message);
@@ -711,6 +890,10 @@ public:
 
     void startProgrammingTimeout(std::function<void()> callback);
     void stopProgrammingTimeout();
+
+    void restoreTrackPowerLater();
+    void restoreTrackPower();
+    void cancelTrackPowerRestore();
     void stopConnectTimeout();
 
     void reportError(Error error);
@@ -726,42 +909,56 @@ protected:
     void timerEvent(QTimerEvent *event) override;
 
 private:
+    struct PendingRequest;
+    using PendingRequestPointer = std::shared_ptr<PendingRequest>;
+    using PendingRequestList = QList<PendingRequestPointer>;
+
     void resetObservers();
     void parseBroadcasts(Message message);
     void parseDatagrams();
+    void receiveDatagram(QByteArrayView datagram);
+
+    QByteArrayView dispatchMessages(QByteArrayView data);
+    void dispatchMessage(const Message &message);
+    void dispatchMessage(const DispatchKey &key, const Message &message);
+    void dispatchMessage(PendingRequestList *observers, const Message &message);
+    void forgetRequest(const PendingRequestPointer &request);
 
+    void queueRequest(QByteArray request, std::weak_ptr<PendingRequest> pendingRequest = {});
     void resendStarvedRequests();
 
     void emitSignalsOnIdle();
-    void sendRequestsOnIdle();
 
+    void scheduleSendRequests(SendPriority priority);
+    void sendQueuedRequests();
+    void sendDatagram();
+
+    // the merged state of a single CAN detector port, which gets updated in place by each message
     struct CanDetectorState
     {
-        CanDetectorState() noexcept = default;
+        explicit CanDetectorState(const CanDetectorInfo &message);
 
-        CanDetectorInfo occupancy;
-        QList<CanDetectorInfo> vehicleSets;
+        void apply(CanDetectorInfo message);
 
         bool isComplete() const noexcept;
-        bool hasVehicles() const noexcept;
-
-        const CanDetectorInfo &info() const noexcept;
+        QList<CanDetectorInfo> messages() const;
 
-        auto networkId() const noexcept { return info().networkId(); }
-        auto module() const noexcept { return info().module(); }
-        auto port() const noexcept { return info().port(); }
-        auto key() const noexcept { return info().key(); }
-    };
+        CanDetectorInfo::Key key;
+        DetectorInfo info;
+        DetectorInfo reportedInfo;
 
-    struct CanNetworkState
-    {
-        QHash<CanDetectorInfo::Key, CanDetectorState> detectors;
+        // vehicles are reported in consecutive sets, which only replace the current vehicles once complete
+        DetectorInfo pendingVehicles;
 
-        bool isComplete() const noexcept;
+        CanDetectorInfo occupancy;
+        QList<CanDetectorInfo> vehicleSets;
+        QList<CanDetectorInfo> pendingVehicleSets;
     };
 
     void mergeCanDetectorInfo(CanDetectorInfo info);
-    void maybeEmitCanDetectorInfo(can::NetworkId networkId, const CanNetworkState &networkState);
+    void emitPendingCanDetectorInfo();
+
+    void mergeRBusDetectorInfo(const RBusDetectorInfo &info);
 
     void mergeLoconetDetectorInfo(LoconetDetectorInfo info);
     void emitPendingLoconetDetectorInfo();
@@ -798,38 +995,121 @@ private:
         using Timestamp = std::chrono::time_point<std::chrono::steady_clock>;
 
         PendingRequest() = default;
-        PendingRequest(QByteArray data, Observer observer, Timestamp timestamp = Timestamp::clock::now()) noexcept
+        PendingRequest(QByteArray data, QList<DispatchKey> keys, Observer observer,
+                       Timestamp timestamp = Timestamp::clock::now()) noexcept
             : data{std::move(data)}
+            , keys{std::move(keys)}
             , observe{std::move(observer)}
             , timestamp{std::move(timestamp)}
         {}
 
         QByteArray data;
+        QList<DispatchKey> keys;
         Observer observe;
-        Timestamp timestamp = Timestamp::clock::now();
+        Timestamp timestamp = Timestamp::clock::now();  // when the request was queued last
+        std::optional<Timestamp> sentTime;              // when the request was sent last
+        bool finished = false;
     };
 
-    QList<PendingRequest> m_pendingRequests;
+    // observers without reply key, like parseBroadcasts(), are offered every message;
+    // all other observers only get offered messages matching one of their reply keys
+    PendingRequestList m_fallbackObservers;
+    QHash<DispatchKey, PendingRequestList> m_dispatchTable;
+    QList<quint16> m_railcomQueries; // addresses of pending RailCom queries, oldest first
 
     QUdpSocket *m_socket = nullptr;
-    QList<QByteArray> m_sendBuffer;
+    QPointer<QIODevice> m_transport;            // replaces the socket, e.g. for replaying a recording
+    QPointer<core::TransportRecorder> m_recorder;
+    core::TraceChannel m_trace{lcStream().categoryName()};
+    struct QueuedRequest
+    {
+        QByteArray data;
+        quint32 coalescingKey = 0;
+        std::chrono::steady_clock::time_point timestamp;
+        std::weak_ptr<PendingRequest> pendingRequest;   // the request waiting for a reply, if any
+    };
+
+    struct SendQueue
+    {
+        QList<QueuedRequest> requests;
+        qsizetype sequence = 0; // sequence number of the first request in this queue
+        QHash<quint32, qsizetype> coalescableRequests; // maps coalescing keys to sequence numbers
+        SendQueueStatistics statistics;
+
+        [[nodiscard]] QueuedRequest takeFirst();
+    };
+
+    static constexpr auto SendQueueCount = static_cast<size_t>(SendPriority::Normal) + 1;
+
+    auto &sendQueue(SendPriority priority) { return m_sendQueues[static_cast<size_t>(priority)]; }
+    auto &sendQueue(SendPriority priority) const { return m_sendQueues[static_cast<size_t>(priority)]; }
+    bool hasQueuedRequests() const;
+    void dropSupersededRequests(QByteArrayView stop);
+    void resetSendQueueStatistics();
+    void updateQueueDepthMetric();
+
+    std::array<SendQueue, SendQueueCount> m_sendQueues;
     QByteArray m_receiveBuffer;
 
     Timer m_programmingTimeout{this};
     std::function<void()> m_programmingCallback;
 
+    // leaving the programming track mode after each variable is expensive, so wait for further requests first
+    Timer m_trackPowerRestoreTimer{this};
+    std::optional<TrackStatus> m_trackStatusBeforeProgramming;
+
     Timer m_connectTimeout{this};
     Timer m_resendTimer{this};
     Timer m_idleTimer{this};
+    Timer m_sendTimer{this};
+
+    // datagrams are rate limited using the generic cell rate algorithm:
+    // up to SendBurstSize datagrams are sent back to back, then sending follows the configured rate
+    static constexpr auto DefaultSendRateLimit = 50;
+    static constexpr auto SendBurstSize = 4;
+
+    int m_sendRateLimit = DefaultSendRateLimit;
+    std::chrono::steady_clock::time_point m_theoreticalSendTime;
 
     Timer m_feedbackProgrammingTimer{this};
     QByteArray m_feedbackProgrammingRequest;
 
-    QHash<can::NetworkId, CanNetworkState> m_canDetectorStates;
+    // turnout requests of routes, ordered by the time they are due; requests due
+    // at the same time are queued together, so that they share datagrams
+    struct ScheduledRequest
+    {
+        std::chrono::steady_clock::time_point dueTime;
+        QByteArray data;
+        quint64 command;    // shared by the activation and deactivation of a turnout
+        bool activates;
+    };
+
+    static constexpr auto DefaultSwitchingGroupSize = 4;
+    static constexpr auto DefaultSwitchingStagger = std::chrono::milliseconds{100};
+
+    QList<ScheduledRequest> m_switchingSchedule;
+    quint64 m_switchingCommandCount = 0;
+    Timer m_switchingTimer{this};
+    int m_switchingGroupSize = DefaultSwitchingGroupSize;
+    std::chrono::milliseconds m_switchingStagger = DefaultSwitchingStagger;
+
+    // the last reported occupancy of both RBus groups, to only emit ports that have changed
+    std::array<RBusDetectorInfo::Occupancy, rbus::GroupId::Maximum + 1> m_rbusOccupancy;
+    std::bitset<rbus::GroupId::Maximum + 1> m_rbusGroupsReceived;
+
+    // detector states are kept in order of discovery, which also is the order of reporting them
+    QList<CanDetectorState> m_canDetectorStates;
+    QHash<CanDetectorInfo::Key, qsizetype> m_canDetectorIndex;
     QHash<can::NetworkId, QList<CanDetectorInfoCallback>> m_canDetectorCallbacks;
 
     QHash<quint32, QList<LoconetDetectorInfo>> m_pendingLoconetDetectorInfo;
     QHash<quint32, QList<LoconetDetectorInfoCallback>> m_loconetDetectorInfoCallbacks;
+
+    core::metrics::Gauge m_queueDepth{"queueDepth"};
+    core::metrics::Histogram m_roundTripTime{"roundTripTime"};
+    core::metrics::Counter m_sentDatagrams{"sentDatagrams"};
+    core::metrics::Counter m_resentRequests{"resentRequests"};
+    core::metrics::Registry m_metrics{"z21.Client", {&m_queueDepth, &m_roundTripTime, &m_sentDatagrams, &m_resentRequests}};
 };
 
 int Message::length() const
@@ -845,9 +1125,19 @@ LanMessageId Message::lanMessageId() const
 XBusMessageId Message::xbusMessageId() const
 {
     if (length() >= 5 && lanMessageId() == LanMessageId::XNetMessage) {
-        static const auto metaEnum = QMetaEnum::fromType<XBusMessageId>();
+        static const auto shortIds = [] {
+            const auto metaEnum = QMetaEnum::fromType<XBusMessageId>();
+            auto shortIds = std::bitset<256>{};
+
+            for (auto i = 0; i < metaEnum.keyCount(); ++i) {
+                if (const auto value = metaEnum.value(i); value >= 0 && value < 256)
+                    shortIds.set(static_cast<size_t>(value));
+            }
 
-        if (const auto shortId = static_cast<quint8>(m_data[4]); metaEnum.valueToKey(shortId))
+            return shortIds;
+        }();
+
+        if (const auto shortId = static_cast<quint8>(m_data[4]); shortIds.test(shortId))
             return static_cast<XBusMessageId>(shortId);
         if (length() >= 6)
             return static_cast<XBusMessageId>(qFromBigEndian<quint16>(m_data.constData() + 4));
@@ -864,6 +1154,19 @@ Client::Private::Private(Client *parent)
 
 void Client::Private::setTrackStatus(TrackStatus trackStatus)
 {
+    switch (trackStatus) {
+    case TrackStatus::EmergencyStop:
+    case TrackStatus::PowerOff:
+    case TrackStatus::ShortCircuit:
+        // also when stopped by another client, scheduled turnouts must not switch once power returns
+        cancelScheduledActivations();
+        break;
+
+    case TrackStatus::PowerOn:
+    case TrackStatus::ProgrammingMode:
+        break;
+    }
+
     if (std::exchange(m_deviceInfo.trackStatus, trackStatus) != trackStatus)
         emit q()->trackStatusChanged(m_deviceInfo.trackStatus, Client::QPrivateSignal{});
 }
@@ -958,6 +1261,16 @@ void Client::Private::setLockState(LockState lockState)
         emit q()->lockStateChanged(m_deviceInfo.lockState, Client::QPrivateSignal{});
 }
 
+void Client::Private::setSendRateLimit(int datagramsPerSecond)
+{
+    m_sendRateLimit = std::max(datagramsPerSecond, 0);
+
+    if (hasQueuedRequests()) {
+        m_sendTimer.stop();
+        scheduleSendRequests(SendPriority::Normal);
+    }
+}
+
 void Client::Private::connectToHost(QHostAddress host, quint16 port)
 {
     const auto isConnectedGuard = core::propertyGuard(q(), &Client::isConnected, &Client::isConnectedChanged, Client::QPrivateSignal{});
@@ -966,14 +1279,24 @@ void Client::Private::connectToHost(QHostAddress host, quint16 port)
 
     disconnectFromHost();
 
-    m_socket = new QUdpSocket{this};
+    if (m_transport) {
+        if (!m_transport->isOpen() && !m_transport->open(QIODevice::ReadWrite)) {
+            qCWarning(lcStream, "Could not open transport: %ls", qUtf16Printable(m_transport->errorString()));
+            return;
+        }
+
+        connect(m_transport, &QIODevice::readyRead, this, &Private::parseDatagrams);
+    } else {
+        m_socket = new QUdpSocket{this};
+        connect(m_socket, &QUdpSocket::readyRead, this, &Private::parseDatagrams);
+    }
+
     m_connectTimeout.start(2s);
     m_resendTimer.start(1s);
     m_idleTimer.start(50ms);
+    m_theoreticalSendTime = {};
     m_hostAddress = std::move(host);
     m_hostPort = port;
-
-    connect(m_socket, &QUdpSocket::readyRead, this, &Private::parseDatagrams);
 }
 
 void Client::Private::disconnectFromHost()
@@ -985,12 +1308,32 @@ void Client::Private::disconnectFromHost()
         socket->deleteLater();
     }
 
+    if (m_transport && m_transport->isOpen()) {
+        m_transport->disconnect(this);
+        m_transport->close();
+    }
+
     stopProgrammingTimeout();
     m_connectTimeout.stop();
     m_resendTimer.stop();
+    m_sendTimer.stop();
+    m_switchingTimer.stop();
+    m_trackPowerRestoreTimer.stop();
+    m_trackStatusBeforeProgramming.reset();
 
     m_receiveBuffer.clear();
-    m_sendBuffer.clear();
+    m_switchingSchedule.clear();
+    for (auto &queue: m_sendQueues) {
+        queue.sequence += queue.requests.size();
+        queue.requests.clear();
+        queue.coalescableRequests.clear();
+        queue.statistics.depth = 0;
+    }
+
+    m_queueDepth.set(0);
+    m_rbusGroupsReceived.reset();
+    m_canDetectorStates.clear();
+    m_canDetectorIndex.clear();
     resetObservers();
 
     if (isConnectedGuard.hasChanged())
@@ -998,16 +1341,64 @@ void Client::Private::disconnectFromHost()
 }
 
 void Client::Private::sendRequest(QByteArray request, Observer observer)
+{
+    sendRequest(std::move(request), {}, std::move(observer));
+}
+
+void Client::Private::sendRequest(QByteArray request, QList<DispatchKey> replyKeys, Observer observer)
 {
     if (m_feedbackProgrammingTimer.isActive()
             && request != m_feedbackProgrammingRequest)
         stopFeedbackModuleProgramming();
 
-    if (observer)
-        m_pendingRequests.emplaceBack(request, std::move(observer));
+    auto weakPendingRequest = std::weak_ptr<PendingRequest>{};
+
+    if (observer) {
+        auto pendingRequest = std::make_shared<PendingRequest>(request, std::move(replyKeys), std::move(observer));
+        weakPendingRequest = pendingRequest;
+
+        if (pendingRequest->keys.isEmpty()) {
+            m_fallbackObservers.append(std::move(pendingRequest));
+        } else {
+            for (const auto &replyKey: std::as_const(pendingRequest->keys))
+                m_dispatchTable[replyKey].append(pendingRequest);
+        }
+    }
+
+    queueRequest(std::move(request), std::move(weakPendingRequest));
+}
+
+void Client::Private::queueRequest(QByteArray request, std::weak_ptr<PendingRequest> pendingRequest)
+{
+    // only the most recent speed or function state is relevant for a vehicle,
+    // therefore replace still queued requests instead of sending outdated commands
+    const auto key = pendingRequest.expired() ? coalescingKey(request) : 0U;
+
+    const auto priority = sendPriority(request);
+    auto &queue = sendQueue(priority);
+
+    if (priority == SendPriority::Safety)
+        dropSupersededRequests(request);
+
+    if (key) {
+        if (const auto it = queue.coalescableRequests.constFind(key); it != queue.coalescableRequests.constEnd()) {
+            // the newer command keeps the queue slot of the replaced one, preserving the vehicle's place in line
+            auto &queuedRequest = queue.requests[*it - queue.sequence];
+            qCDebug(lcStream, "replacing %s by %s", queuedRequest.data.toHex(' ').constData(), request.toHex(' ').constData());
+            queuedRequest.data = std::move(request);
+            return;
+        }
+
+        queue.coalescableRequests.insert(key, queue.sequence + queue.requests.size());
+    }
 
-    qCDebug(lcStream, "queuing %s", request.toHex(' ').constData());
-    m_sendBuffer.append(std::move(request));
+    qCDebug(lcStream) << "queuing" << request.toHex(' ') << "with" << priority;
+    queue.requests.append(QueuedRequest{std::move(request), key, std::chrono::steady_clock::now(),
+                                        std::move(pendingRequest)});
+    queue.statistics.depth = queue.requests.size();
+    queue.statistics.peakDepth = std::max(queue.statistics.peakDepth, queue.statistics.depth);
+    updateQueueDepthMetric();
+    scheduleSendRequests(priority);
 }
 
 void Client::Private::startFeedbackModuleProgramming(rbus::ModuleId module)
@@ -1031,6 +1422,76 @@ void Client::Private::runFeedbackModuleProgramming()
         sendRequest(m_feedbackProgrammingRequest, {});
 }
 
+void Client::Private::scheduleTurnoutStates(QList<TurnoutCommand> commands, std::chrono::milliseconds duration)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto groupSize = m_switchingGroupSize > 0 ? m_switchingGroupSize : std::max(1, static_cast<int>(commands.size()));
+
+    // never activate a group before the previous group got deactivated
+    const auto groupInterval = std::max(m_switchingStagger, duration);
+
+    const auto schedule = [this](std::chrono::steady_clock::time_point dueTime, QByteArray data, bool activates) {
+        const auto it = std::upper_bound(m_switchingSchedule.begin(), m_switchingSchedule.end(), dueTime,
+                                         [](auto time, const auto &request) { return time < request.dueTime; });
+
+        m_switchingSchedule.insert(it, {dueTime, std::move(data), m_switchingCommandCount, activates});
+    };
+
+    for (auto i = 0; i < static_cast<int>(commands.size()); ++i) {
+        const auto &command = commands[i];
+        const auto activationTime = now + (i / groupSize) * groupInterval;
+
+        schedule(activationTime, turnoutRequest(command.address, command.direction, true), true);
+        schedule(activationTime + duration, turnoutRequest(command.address, command.direction, false), false);
+        ++m_switchingCommandCount;
+    }
+
+    runSwitchingSchedule();
+}
+
+void Client::Private::runSwitchingSchedule()
+{
+    using namespace std::chrono;
+
+    m_switchingTimer.stop();
+
+    const auto now = steady_clock::now();
+
+    while (!m_switchingSchedule.isEmpty() && m_switchingSchedule.constFirst().dueTime <= now)
+        sendRequest(m_switchingSchedule.takeFirst().data, {});
+
+    if (!m_switchingSchedule.isEmpty()) {
+        const auto delay = ceil<milliseconds>(m_switchingSchedule.constFirst().dueTime - now);
+        m_switchingTimer.start(delay, Qt::PreciseTimer);
+    }
+}
+
+QList<QByteArray> Client::Private::pendingTurnoutRequests() const
+{
+    auto requests = QList<QByteArray>{};
+    requests.reserve(m_switchingSchedule.size());
+
+    for (const auto &request: m_switchingSchedule)
+        requests.append(request.data);
+
+    return requests;
+}
+
+void Client::Private::cancelScheduledActivations()
+{
+    auto cancelledCommands = QSet<quint64>{};
+
+    for (const auto &request: std::as_const(m_switchingSchedule)) {
+        if (request.activates)
+            cancelledCommands.insert(request.command);
+    }
+
+    // deactivations of turnouts already activated still get sent, to not leave any solenoid powered
+    m_switchingSchedule.removeIf([&cancelledCommands](const auto &request) {
+        return cancelledCommands.contains(request.command);
+    });
+}
+
 bool Client::Private::parseXStatusChanged(Message message)
 {
     if (message.xbusMessageId() == XBusMessageId::StatusChanged && message.length() >= 8) {
@@ -1062,7 +1523,7 @@ bool Client::Private::parseSystemStateDataChanged(Message message)
 std::optional<VehicleInfo> Client::Private::parseVehicleInfo(Message message)
 {
     if (message.xbusMessageId() == XBusMessageId::VehicleInfo && message.length() >= 11)
-        return VehicleInfo{message.rawData().mid(5)};
+        return VehicleInfo{message.copyData(5)};
 
     return {};
 }
@@ -1070,7 +1531,7 @@ std::optional<VehicleInfo> Client::Private::parseVehicleInfo(Message message)
 std::optional<AccessoryInfo> Client::Private::parseAccessoryInfo(Message message)
 {
     if (message.xbusMessageId() == XBusMessageId::AccessoryInfo && message.length() >= 10)
-        return AccessoryInfo{message.rawData().mid(5)};
+        return AccessoryInfo{message.copyData(5)};
 
     return {};
 }
@@ -1078,7 +1539,7 @@ std::optional<AccessoryInfo> Client::Private::parseAccessoryInfo(Message message
 std::optional<TurnoutInfo> Client::Private::parseTurnoutInfo(Message message)
 {
     if (message.xbusMessageId() == XBusMessageId::TurnoutInfo && message.length() >= 9)
-        return TurnoutInfo{message.rawData().mid(5)};
+        return TurnoutInfo{message.copyData(5)};
 
     return {};
 }
@@ -1086,7 +1547,7 @@ std::optional<TurnoutInfo> Client::Private::parseTurnoutInfo(Message message)
 std::optional<RBusDetectorInfo> Client::Private::parseRBusDetectorInfo(Message message)
 {
     if (message.lanMessageId() == LanMessageId::RBusDetectorDataChanged && message.length() >= 11)
-        return RBusDetectorInfo{message.rawData().mid(4)};
+        return RBusDetectorInfo{message.copyData(4)};
 
     return {};
 }
@@ -1094,7 +1555,7 @@ std::optional<RBusDetectorInfo> Client::Private::parseRBusDetectorInfo(Message m
 std::optional<LoconetDetectorInfo> Client::Private::parseLoconetDetectorInfo(Message message)
 {
     if (message.lanMessageId() == LanMessageId::LoconetDetectorDataChanged && message.length() >= 7)
-        return LoconetDetectorInfo{message.rawData().mid(4)};
+        return LoconetDetectorInfo{message.copyData(4)};
 
     return {};
 }
@@ -1102,7 +1563,7 @@ std::optional<LoconetDetectorInfo> Client::Private::parseLoconetDetectorInfo(Mes
 std::optional<CanDetectorInfo> Client::Private::parseCanDetectorInfo(Message message)
 {
     if (message.lanMessageId() == LanMessageId::CanDetectorDataChanged && message.length() >= 7)
-        return CanDetectorInfo{message.rawData().mid(4)};
+        return CanDetectorInfo{message.copyData(4)};
 
     return {};
 }
@@ -1111,7 +1572,7 @@ std::optional<RailcomInfo> Client::Private::parseRailcomInfo(Message message)
 {
     if (message.lanMessageId() == LanMessageId::RailcomDataChanged) {
         if (message.length() >= 11)
-            return RailcomInfo{message.rawData().mid(4)};
+            return RailcomInfo{message.copyData(4)};
 
         return RailcomInfo{};
     }
@@ -1122,7 +1583,7 @@ std::optional<RailcomInfo> Client::Private::parseRailcomInfo(Message message)
 std::optional<LibraryInfo> Client::Private::parseLibraryInfo(Message message)
 {
     if (message.xbusMessageId() == XBusMessageId::LibraryInfo && message.length() >= 16)
-        return LibraryInfo{message.rawData().mid(6)};
+        return LibraryInfo{message.copyData(6)};
 
     return {};
 }
@@ -1187,6 +1648,40 @@ void Client::Private::stopProgrammingTimeout()
     m_programmingTimeout.stop();
 }
 
+void Client::Private::restoreTrackPowerLater()
+{
+    m_trackPowerRestoreTimer.stop();
+    m_trackPowerRestoreTimer.start(250ms);
+}
+
+void Client::Private::cancelTrackPowerRestore()
+{
+    m_trackPowerRestoreTimer.stop();
+
+    // consecutive programming requests must not take the programming mode for the status to restore
+    if (!m_trackStatusBeforeProgramming)
+        m_trackStatusBeforeProgramming = m_deviceInfo.trackStatus;
+}
+
+void Client::Private::restoreTrackPower()
+{
+    m_trackPowerRestoreTimer.stop();
+
+    switch (std::exchange(m_trackStatusBeforeProgramming, {}).value_or(TrackStatus::PowerOff)) {
+    case TrackStatus::PowerOn:
+        q()->enableTrackPower();
+        break;
+
+    case TrackStatus::EmergencyStop:
+    case TrackStatus::PowerOff:
+    case TrackStatus::ShortCircuit:
+    case TrackStatus::ProgrammingMode:
+        // leave the programming mode, but don't power the main track if it was off before
+        q()->disableTrackPower();
+        break;
+    }
+}
+
 void Client::Private::stopConnectTimeout()
 {
     m_connectTimeout.stop();
@@ -1224,22 +1719,27 @@ void Client::Private::timerEvent(QTimerEvent *event)
         resendStarvedRequests();
     } else if (m_idleTimer.matches(event)) {
         emitSignalsOnIdle();
-        sendRequestsOnIdle();
+    } else if (m_sendTimer.matches(event)) {
+        sendQueuedRequests();
     } else if (m_feedbackProgrammingTimer.matches(event)) {
         runFeedbackModuleProgramming();
+    } else if (m_switchingTimer.matches(event)) {
+        runSwitchingSchedule();
+    } else if (m_trackPowerRestoreTimer.matches(event)) {
+        restoreTrackPower();
     }
 }
 
 void Client::Private::resetObservers()
 {
-    m_pendingRequests = {
-        {
-            {}, [this](auto message) {
-                parseBroadcasts(std::move(message));
-                return false;
-            }
-        }
+    const auto broadcastObserver = [this](auto message) {
+        parseBroadcasts(std::move(message));
+        return false;
     };
+
+    m_dispatchTable.clear();
+    m_railcomQueries.clear();
+    m_fallbackObservers = {std::make_shared<PendingRequest>(QByteArray{}, QList<DispatchKey>{}, broadcastObserver)};
 }
 
 void Client::Private::parseDatagrams()
@@ -1248,7 +1748,14 @@ void Client::Private::parseDatagrams()
     QHostAddress host;
     quint16 port;
 
-    while (m_socket->hasPendingDatagrams()) {
+    if (m_transport) {
+        while (m_transport && m_transport->bytesAvailable() > 0)
+            receiveDatagram(m_transport->readAll());
+
+        return;
+    }
+
+    while (m_socket && m_socket->hasPendingDatagrams()) {
         if (const auto bytesReceived = m_socket->readDatagram(buffer, sizeof buffer, &host, &port); bytesReceived > 0) {
             if (port != m_hostPort) {
                 qCWarning(lcStream, "Ignoring datagram from unknown port: %d", port);
@@ -1269,40 +1776,125 @@ void Client::Private::parseDatagrams()
                 break;
             }
 
-            m_receiveBuffer.append(buffer, bytesReceived);
-
-            while (!m_receiveBuffer.isEmpty()) {
-                if (const auto messageLen = m_receiveBuffer.at(0); messageLen <= m_receiveBuffer.size()) {
-                    const auto message = Message{m_receiveBuffer.left(messageLen)};
-                    m_receiveBuffer.remove(0, messageLen);
-
-                    qCDebug(lcStream, "received %s", message.rawData().toHex(' ').constData());
-
-                    // move observers aside in case one of the callbacks adds more observers, invalidating the list
-                    decltype(m_pendingRequests) pendingRequests;
-                    std::swap(pendingRequests, m_pendingRequests);
-
-                    for (auto it = pendingRequests.begin(); it != pendingRequests.end(); ) {
-                        if (it->observe(message))
-                            it = pendingRequests.erase(it);
-                        else
-                            ++it;
-                    }
-
-                    // restore observers
-                    std::swap(pendingRequests, m_pendingRequests);
-
-                    // add new observers added from callbacks while processing the current list
-                    if (!pendingRequests.empty()) {
-                        qCDebug(lcStream, "Adding %d observers from callbacks", static_cast<int>(pendingRequests.size()));
-                        m_pendingRequests.reserve(m_pendingRequests.size() + pendingRequests.size());
-                        std::copy(pendingRequests.begin(), pendingRequests.end(), std::back_inserter(m_pendingRequests));
-                    }
-                } else {
-                    qCDebug(lcStream, "ignoring incomplete data %s", m_receiveBuffer.toHex(' ').constData());
-                    break;
-                }
-            }
+            receiveDatagram({buffer, bytesReceived});
+        }
+    }
+}
+
+void Client::Private::receiveDatagram(QByteArrayView datagram)
+{
+    if (m_recorder)
+        m_recorder->recordReceived(datagram);
+
+    m_trace.recordReceived(datagram);
+
+    auto pendingData = std::exchange(m_receiveBuffer, {});
+
+    // messages are parsed in place; data only gets copied if the previous datagram was incomplete
+    if (!pendingData.isEmpty()) {
+        pendingData.append(datagram);
+        datagram = pendingData;
+    }
+
+    if (const auto incompleteData = dispatchMessages(datagram); !incompleteData.isEmpty()) {
+        qCDebug(lcStream, "keeping incomplete data %s", incompleteData.toByteArray().toHex(' ').constData());
+        m_receiveBuffer = incompleteData.toByteArray();
+    }
+}
+
+QByteArrayView Client::Private::dispatchMessages(QByteArrayView data)
+{
+    const auto totalSize = data.size();
+
+    while (data.size() >= 2) {
+        const auto messageLength = Message{data}.length();
+
+        // without a valid length the following messages cannot be found anymore, so drop the rest
+        if (Q_UNLIKELY(messageLength < 4)) {
+            qCWarning(lcStream, "Ignoring malformed data at offset %d of %d bytes: %s",
+                      static_cast<int>(totalSize - data.size()), static_cast<int>(totalSize),
+                      data.toByteArray().toHex(' ').constData());
+            return {};
+        }
+
+        if (messageLength > data.size())
+            break;
+
+        const auto message = Message{data.first(messageLength)};
+        data = data.sliced(messageLength);
+
+        dispatchMessage(message);
+    }
+
+    return data;
+}
+
+void Client::Private::dispatchMessage(const Message &message)
+{
+    // move observers aside in case one of the callbacks adds more observers, invalidating the list
+    auto fallbackObservers = std::exchange(m_fallbackObservers, {});
+    dispatchMessage(&fallbackObservers, message);
+
+    // restore observers, followed by the observers added from callbacks while processing the current list
+    fallbackObservers += std::exchange(m_fallbackObservers, {});
+    m_fallbackObservers = std::move(fallbackObservers);
+
+    // now notify the observers waiting for exactly this message
+    const auto key = dispatchKey(message);
+    dispatchMessage(key, message);
+
+    if (key.hasAddress())
+        dispatchMessage(key.withAnyAddress(), message);
+    else if (key.lanMessageId == LanMessageId::RailcomDataChanged && !m_railcomQueries.isEmpty())
+        dispatchMessage({key.lanMessageId, m_railcomQueries.first()}, message); // no RailCom data for the oldest query
+}
+
+void Client::Private::dispatchMessage(const DispatchKey &key, const Message &message)
+{
+    if (const auto it = m_dispatchTable.find(key); it != m_dispatchTable.end()) {
+        // move observers aside in case one of the callbacks adds more observers, invalidating the table
+        auto observers = std::exchange(*it, {});
+        dispatchMessage(&observers, message);
+
+        // restore observers, followed by the observers added from callbacks while processing the current list
+        observers += m_dispatchTable.take(key);
+
+        if (!observers.isEmpty())
+            m_dispatchTable.insert(key, std::move(observers));
+    }
+}
+
+void Client::Private::dispatchMessage(PendingRequestList *observers, const Message &message)
+{
+    for (auto it = observers->begin(); it != observers->end(); ) {
+        // keep the request alive while its observer runs
+        const auto request = *it;
+
+        if (request->finished) {
+            it = observers->erase(it);
+        } else if (request->observe(message)) {
+            // broadcast observers never sent a request
+            if (request->sentTime && core::metrics::isEnabled())
+                m_roundTripTime.record(PendingRequest::Timestamp::clock::now() - *request->sentTime);
+
+            request->finished = true;
+            forgetRequest(request);
+            it = observers->erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Client::Private::forgetRequest(const PendingRequestPointer &request)
+{
+    // requests waiting for different kinds of reply also must be removed from their other table entries
+    for (const auto &key: std::as_const(request->keys)) {
+        if (const auto it = m_dispatchTable.find(key); it != m_dispatchTable.end()) {
+            it->removeOne(request);
+
+            if (it->isEmpty())
+                m_dispatchTable.erase(it);
         }
     }
 }
@@ -1312,78 +1904,295 @@ void Client::Private::resendStarvedRequests()
     const auto now = PendingRequest::Timestamp::clock::now();
     auto first = true;
 
-    for (auto &request: m_pendingRequests) {
-        if (request.data.isEmpty())
-            continue;
+    const auto resendIfStarved = [this, now, &first](const PendingRequestPointer &request) {
+        if (request->data.isEmpty() || request->finished)
+            return;
 
-        if (const auto age = now - request.timestamp; age >= 2s) {
+        // requests with multiple reply keys are seen multiple times, but the updated timestamp prevents resending
+        if (const auto age = now - request->timestamp; age >= 2s) {
             if (std::exchange(first, false))
                 qInfo() << "starved requests:";
 
             qInfo() << std::chrono::duration_cast<std::chrono::milliseconds>(age)
-                    << request.data.toHex(' ') << "resending";
+                    << request->data.toHex(' ') << "resending";
+
+            queueRequest(request->data, request);
+            request->timestamp = now;
+            m_resentRequests.increment();
+        }
+    };
+
+    for (const auto &request: std::as_const(m_fallbackObservers))
+        resendIfStarved(request);
+
+    for (const auto &observers: std::as_const(m_dispatchTable)) {
+        for (const auto &request: observers)
+            resendIfStarved(request);
+    }
+}
+
+void Client::Private::scheduleSendRequests(SendPriority priority)
+{
+    if (!isConnected())
+        return;
+
+    // safety-critical requests must not wait until the rate limit allows the next datagram
+    if (priority == SendPriority::Safety)
+        m_sendTimer.stop();
+
+    // a zero timer merges all requests queued within the current event loop iteration into one datagram
+    if (!m_sendTimer.isActive())
+        m_sendTimer.start(0ms, Qt::PreciseTimer);
+}
 
-            sendRequest(request.data, {});
-            request.timestamp = now;
+void Client::Private::sendQueuedRequests()
+{
+    using namespace std::chrono;
+
+    m_sendTimer.stop();
+
+    if (!isConnected())
+        return;
+
+    while (hasQueuedRequests()) {
+        const auto now = steady_clock::now();
+
+        if (m_sendRateLimit > 0) {
+            const auto interval = duration_cast<steady_clock::duration>(1s) / m_sendRateLimit;
+            const auto tolerance = interval * (SendBurstSize - 1);
+
+            // under load let requests accumulate until the rate limit allows the next datagram;
+            // safety-critical requests are sent immediately, but still get accounted for
+            if (const auto delay = m_theoreticalSendTime - tolerance - now;
+                    delay > delay.zero() && sendQueue(SendPriority::Safety).requests.isEmpty()) {
+                m_sendTimer.start(ceil<milliseconds>(delay), Qt::PreciseTimer);
+                return;
+            }
+
+            m_theoreticalSendTime = std::max(m_theoreticalSendTime, now) + interval;
         }
+
+        sendDatagram();
     }
 }
 
-void Client::Private::sendRequestsOnIdle()
+void Client::Private::sendDatagram()
 {
-    if (m_socket && !m_sendBuffer.isEmpty()) {
-        constexpr auto MaximumDatagramSize = 1472;
+    constexpr auto MaximumDatagramSize = 1472;
 
-        auto requestCount = 0;
-        auto datagram = QByteArray{};
+    auto requestCount = 0;
+    auto datagram = QByteArray{};
+    const auto now = PendingRequest::Timestamp::clock::now();
 
-        while (!m_sendBuffer.isEmpty()
-               && (datagram.size() + m_sendBuffer.first().size()) <= MaximumDatagramSize) {
-            datagram.append(m_sendBuffer.takeFirst());
+    // fill the datagram lane by lane, so that lower priority requests only use the remaining space
+    for (auto &queue: m_sendQueues) {
+        while (!queue.requests.isEmpty()
+               && (datagram.size() + queue.requests.first().data.size()) <= MaximumDatagramSize) {
+            const auto request = queue.takeFirst();
+
+            // the round-trip time gets measured from the datagram actually sent, not from queuing
+            if (const auto pendingRequest = request.pendingRequest.lock())
+                pendingRequest->sentTime = now;
+
+            datagram.append(request.data);
             ++requestCount;
         }
+    }
+
+    updateQueueDepthMetric();
 
-        if (!datagram.isEmpty()) {
-            qCDebug(lcStream, "sending %d request(s) in a datagram of %d bytes",
-                    requestCount, static_cast<int>(datagram.size()));
-            qCDebug(lcStream) << datagram.toHex(' ');
-            m_socket->writeDatagram(std::move(datagram), m_hostAddress, m_hostPort);
+    if (Q_UNLIKELY(datagram.isEmpty())) {
+        for (auto &queue: m_sendQueues) {
+            if (!queue.requests.isEmpty()) {
+                qCWarning(lcStream, "Dropping oversized request: %s", queue.takeFirst().data.toHex(' ').constData());
+                break;
+            }
         }
+
+        updateQueueDepthMetric();
+        return;
     }
+
+    m_sentDatagrams.increment();
+
+    qCDebug(lcStream, "sending %d request(s) in a datagram of %d bytes",
+            requestCount, static_cast<int>(datagram.size()));
+
+    if (m_recorder)
+        m_recorder->recordSent(datagram);
+
+    m_trace.recordSent(datagram);
+
+    if (m_transport)
+        m_transport->write(datagram);
+    else
+        m_socket->writeDatagram(std::move(datagram), m_hostAddress, m_hostPort);
+}
+
+bool Client::Private::hasQueuedRequests() const
+{
+    return std::any_of(m_sendQueues.begin(), m_sendQueues.end(), [](const SendQueue &queue) {
+        return !queue.requests.isEmpty();
+    });
+}
+
+void Client::Private::resetSendQueueStatistics()
+{
+    for (auto &queue: m_sendQueues)
+        queue.statistics = {queue.requests.size(), queue.requests.size()};
+}
+
+void Client::Private::updateQueueDepthMetric()
+{
+    if (!core::metrics::isEnabled())
+        return;
+
+    auto depth = qsizetype{0};
+
+    for (const auto &queue: m_sendQueues)
+        depth += queue.requests.size();
+
+    m_queueDepth.set(depth);
+}
+
+void Client::Private::dropSupersededRequests(QByteArrayView stop)
+{
+    auto &queue = sendQueue(SendPriority::Control);
+
+    const auto count = queue.requests.removeIf([stop](const auto &request) {
+        return supersedes(stop, request.data);
+    });
+
+    if (count == 0)
+        return;
+
+    qCDebug(lcStream, "dropping %d vehicle command(s) superseded by %s",
+            static_cast<int>(count), stop.toByteArray().toHex(' ').constData());
+
+    // the remaining requests moved, so their sequence numbers must be updated
+    queue.coalescableRequests.clear();
+
+    for (auto i = qsizetype{0}; i < queue.requests.size(); ++i) {
+        if (const auto key = queue.requests[i].coalescingKey)
+            queue.coalescableRequests.insert(key, queue.sequence + i);
+    }
+
+    queue.statistics.depth = queue.requests.size();
+    updateQueueDepthMetric();
+}
+
+Client::Private::QueuedRequest Client::Private::SendQueue::takeFirst()
+{
+    using namespace std::chrono;
+
+    auto request = requests.takeFirst();
+
+    if (request.coalescingKey)
+        coalescableRequests.remove(request.coalescingKey);
+
+    ++sequence;
+
+    const auto waitTime = duration_cast<microseconds>(steady_clock::now() - request.timestamp);
+
+    statistics.depth = requests.size();
+    statistics.sentCount += 1;
+    statistics.lastWaitTime = waitTime;
+    statistics.peakWaitTime = std::max(statistics.peakWaitTime, waitTime);
+    statistics.totalWaitTime += waitTime;
+
+    return request;
 }
 
 void Client::Private::emitSignalsOnIdle()
 {
+    emitPendingCanDetectorInfo();
     emitPendingLoconetDetectorInfo();
 }
 
 void Client::Private::mergeCanDetectorInfo(CanDetectorInfo info)
 {
-    qInfo() << Q_FUNC_INFO << info << Qt::hex << info.value1() << info.value2() << info.data().toHex(' ');
+    qCDebug(lcCanDetector) << info << Qt::hex << info.value1() << info.value2() << info.data().toHex(' ');
 
-    const auto networkId = info.networkId();
-    auto networkState = m_canDetectorStates.find(networkId);
+    const auto key = info.key();
+    auto index = m_canDetectorIndex.value(key, -1);
 
-    if (networkState == m_canDetectorStates.end()) {
-        qCInfo(lcCanDetector, "New CAN detector network found (network id: 0x%04x)", networkId.value);
-        networkState = m_canDetectorStates.insert(networkId, {});
+    if (index < 0) {
+        qCInfo(lcCanDetector, "New CAN detector found (network id: 0x%04x, module: %d, port: %d)",
+               info.networkId().value, info.module().value, info.port().value);
+
+        index = m_canDetectorStates.size();
+        m_canDetectorStates.emplaceBack(info);
+        m_canDetectorIndex.insert(key, index);
     }
 
-    auto detectorState = networkState->detectors.find(info.key());
+    auto &state = m_canDetectorStates[index];
+    state.apply(std::move(info));
 
-    if (detectorState == networkState->detectors.end()) {
-        qCInfo(lcCanDetector, "New CAN detector found (network id: 0x%04x, module: %d, port: %d)",
-               networkId.value, info.module().value, info.port().value);
-        detectorState = networkState->detectors.insert(info.key(), {});
-    }
+    if (!state.isComplete() || state.info == state.reportedInfo)
+        return;
 
-    switch (info.type()) {
-    case CanDetectorInfo::Type::Occupancy:
-        detectorState->occupancy = std::move(info);
-        break;
+    state.reportedInfo = state.info;
+
+    emit q()->canDetectorInfoReceived(state.messages(), Client::QPrivateSignal{});
+    emit q()->detectorInfoReceived({state.info}, Client::QPrivateSignal{});
+}
+
+void Client::Private::mergeRBusDetectorInfo(const RBusDetectorInfo &info)
+{
+    emit q()->rbusDetectorInfoReceived(info, Client::QPrivateSignal{});
+
+    const auto group = static_cast<size_t>(info.group());
+
+    if (LMRS_FAILED_COMPARE(logger(), group, <, m_rbusOccupancy.size()))
+        return;
+
+    // the Z21 broadcasts the entire group whenever a single port changes,
+    // so report the ports whose bit has flipped since the previous broadcast
+    const auto occupancy = info.occupancyBits();
+    auto changedPorts = RBusDetectorInfo::Occupancy{}.set();
+
+    if (m_rbusGroupsReceived.test(group))
+        changedPorts = m_rbusOccupancy[group] ^ occupancy;
+
+    m_rbusOccupancy[group] = occupancy;
+    m_rbusGroupsReceived.set(group);
+
+    if (changedPorts.any())
+        emit q()->detectorInfoReceived(info.detectorInfo(changedPorts), Client::QPrivateSignal{});
+}
+
+Client::Private::CanDetectorState::CanDetectorState(const CanDetectorInfo &message)
+    : key{message.key()}
+    , info{DetectorAddress::forCanPort(message.networkId(), message.module(), message.port())}
+{}
+
+void Client::Private::CanDetectorState::apply(CanDetectorInfo message)
+{
+    switch (message.type()) {
+    case CanDetectorInfo::Type::Occupancy: {
+        const auto wasOccupied = (occupancy.isValid() && info.occupancy() == DetectorInfo::Occupancy::Occupied);
+
+        info.setOccupancy(message.occupancy());
+        info.setPowerState(message.powerState());
+        occupancy = std::move(message);
+
+        // free detectors see no vehicles, and newly occupied ones must report their current vehicles first
+        if (info.occupancy() != DetectorInfo::Occupancy::Occupied) {
+            info.clearVehicles();
+            vehicleSets.clear();
+            pendingVehicles.clearVehicles();
+            pendingVehicleSets.clear();
+        } else if (!wasOccupied) {
+            info.clearVehicles();
+            vehicleSets.clear();
+        }
+
+        return;
+    }
 
     case CanDetectorInfo::Type::VehicleSet1:
-        detectorState->vehicleSets = {std::move(info)};
+        pendingVehicles.clearVehicles();
+        pendingVehicleSets.clear();
         break;
 
     case CanDetectorInfo::Type::VehicleSet2:
@@ -1400,98 +2209,101 @@ void Client::Private::mergeCanDetectorInfo(CanDetectorInfo info)
     case CanDetectorInfo::Type::VehicleSet13:
     case CanDetectorInfo::Type::VehicleSet14:
     case CanDetectorInfo::Type::VehicleSet15:
-        detectorState->vehicleSets += std::move(info);
+        // a set that doesn't continue the current sequence means we have missed some message
+        if (pendingVehicleSets.isEmpty()
+                || core::value(pendingVehicleSets.constLast().type()) + 1 != core::value(message.type())) {
+            qCDebug(lcCanDetector) << "Ignoring out of sequence vehicle set" << message.type();
+            pendingVehicleSets.clear();
+            return;
+        }
+
         break;
     }
 
-    maybeEmitCanDetectorInfo(networkId, *networkState);
-}
+    if (!message.isVehicleSet()) {
+        qCWarning(lcCanDetector, "Unsupported CAN info type: %d", core::value(message.type()));
+        return;
+    }
 
-bool Client::Private::CanDetectorState::isComplete() const noexcept
-{
-    if (!occupancy.isValid()
-            || vehicleSets.isEmpty()
-            || !vehicleSets.last().isLastVehicleSet())
-        return false;
+    if (message.value1() != 0) {
+        pendingVehicles.addVehicle(message.vehicle1(), message.direction1());
 
-    return hasVehicles() == (occupancy.occupancy() == CanDetectorInfo::Occupancy::Occupied);
-}
+        if (message.value2() != 0)
+            pendingVehicles.addVehicle(message.vehicle2(), message.direction2());
+    }
 
-bool Client::Private::CanDetectorState::hasVehicles() const noexcept
-{
-    if (vehicleSets.isEmpty())
-        return false;
+    const auto isLastVehicleSet = message.isLastVehicleSet();
+    pendingVehicleSets += std::move(message);
 
-    const auto &last = vehicleSets.last();
-    return last.type() != CanDetectorInfo::Type::VehicleSet1
-            || last.vehicle1() != 0;
-}
+    if (isLastVehicleSet) {
+        info.clearVehicles();
 
-const CanDetectorInfo &Client::Private::CanDetectorState::info() const noexcept
-{
-    if (occupancy.isValid())
-        return occupancy;
-    if (!vehicleSets.isEmpty())
-        return vehicleSets.first();
+        for (auto i = 0; i < pendingVehicles.vehicleCount(); ++i)
+            info.addVehicle(pendingVehicles.vehicle(i), pendingVehicles.direction(i));
 
-    static const auto invalid = CanDetectorInfo{};
-    return invalid;
+        vehicleSets = std::exchange(pendingVehicleSets, {});
+    }
 }
 
-bool Client::Private::CanNetworkState::isComplete() const noexcept
+bool Client::Private::CanDetectorState::isComplete() const noexcept
 {
-    for (const auto &state: detectors) {
-        if (!state.isComplete())
-            return false;
-    }
+    if (!occupancy.isValid())
+        return false;
 
-    return true;
+    // free detectors don't report vehicles, occupied ones must have told which vehicles they see
+    // since getting occupied, which is ensured by apply() dropping older vehicle sets
+    return info.occupancy() != DetectorInfo::Occupancy::Occupied || !vehicleSets.isEmpty();
 }
 
-void Client::Private::maybeEmitCanDetectorInfo(can::NetworkId networkId, const CanNetworkState &networkState)
+QList<CanDetectorInfo> Client::Private::CanDetectorState::messages() const
 {
-    //    Q_ASSERT(!infoList.isEmpty()); // FIXME: soft assert
-
-    //    const auto isOccupancy = [](const CanDetectorInfo &info) {
-//        return info.type() == CanDetectorInfo::Type::Occupancy;
-//    };
+    return QList{occupancy} + vehicleSets;
+}
 
-//    const auto isLastVehicleInfo = [](const CanDetectorInfo &info) {
-//        qCInfo(lcCanDetector) << "isLastVehicleInfo" << info.type() << info.vehicle2();
-//        return CanDetectorInfo::VehicleSetRange.contains(info.type()) && info.vehicle2() == 0;
-//    };
+void Client::Private::emitPendingCanDetectorInfo()
+{
+    if (m_canDetectorCallbacks.isEmpty())
+        return;
 
-//    const auto begin = infoList.constBegin();
-//    const auto end = infoList.constEnd();
-//    const auto networkId = begin->networkId();
-//    const auto baseInfo = std::find_if(begin, end, isOccupancy);
-//    const auto lastVehicleSet = std::find_if(begin, end, isLastVehicleInfo);
+    const auto isReady = [this](can::NetworkId networkId) {
+        auto detectorCount = 0;
 
-    if (!networkState.isComplete())
-        return;
+        for (const auto &state: std::as_const(m_canDetectorStates)) {
+            if (networkId != can::NetworkIdAny && std::get<can::NetworkId>(state.key) != networkId)
+                continue;
+            if (!state.isComplete())
+                return false;
 
-    const auto networkAndWildcardCallbacks = std::exchange(m_canDetectorCallbacks[networkId], {})
-            + std::exchange(m_canDetectorCallbacks[can::NetworkIdAny], {});
+            ++detectorCount;
+        }
 
-    for (const auto &state: networkState.detectors) {
-        qCInfo(lcCanDetector, "Emitting CAN detector info (network id: 0x%04x, module: %d, port: %d)",
-               state.networkId().value, state.module().value, state.port().value);
+        return detectorCount > 0;
+    };
 
-        auto infoList = QList{state.occupancy} + state.vehicleSets;
-        auto genericInfo = CanDetectorInfo::merge(infoList);
+    // callbacks are taken out first, since they might queue further callbacks
+    auto readyCallbacks = QList<std::pair<can::NetworkId, QList<CanDetectorInfoCallback>>>{};
 
-        for (const auto &verifiedInfo: infoList)
-            Q_ASSERT(verifiedInfo.key() == state.key());
+    for (auto it = m_canDetectorCallbacks.begin(); it != m_canDetectorCallbacks.end(); ) {
+        if (isReady(it.key())) {
+            readyCallbacks.emplaceBack(it.key(), std::move(it.value()));
+            it = m_canDetectorCallbacks.erase(it);
+        } else {
+            ++it;
+        }
+    }
 
-        for (const auto &callback: networkAndWildcardCallbacks)
-            callback(infoList);
+    for (const auto &[networkId, callbacks]: readyCallbacks) {
+        auto messages = QList<QList<CanDetectorInfo>>{};
 
-        qCInfo(lcCanDetector).verbosity(QDebug::MinimumVerbosity)
-                << Qt::endl << "FOO:CAN:" << infoList
-                << Qt::endl << "FOO:generic:" << genericInfo;
+        for (const auto &state: std::as_const(m_canDetectorStates)) {
+            if (networkId == can::NetworkIdAny || std::get<can::NetworkId>(state.key) == networkId)
+                messages += state.messages();
+        }
 
-        emit q()->canDetectorInfoReceived(std::move(infoList), Client::QPrivateSignal{});
-        emit q()->detectorInfoReceived(std::move(genericInfo), Client::QPrivateSignal{});
+        for (const auto &callback: callbacks) {
+            for (const auto &detectorMessages: std::as_const(messages))
+                callback(detectorMessages);
+        }
     }
 }
 
@@ -1574,7 +2386,7 @@ void Client::Private::parseBroadcasts(Message message)
 
     case 15:
         if (const auto info = parseRBusDetectorInfo(std::move(message)))
-            emit q()->rbusDetectorInfoReceived(info.value(), Client::QPrivateSignal{});
+            mergeRBusDetectorInfo(info.value());
 
         break;
 
@@ -1602,7 +2414,6 @@ Client::Client(QObject *parent)
     qRegisterMetaType<Client::CentralStatus>();
     qRegisterMetaType<Client::CentralStatusFlag>();
 
-    connect(this, &Client::rbusDetectorInfoReceived, this, &Client::detectorInfoReceived);
 }
 
 // attributes //
@@ -1702,6 +2513,59 @@ Client::LockState Client::lockState() const
     return d->lockState();
 }
 
+int Client::sendRateLimit() const
+{
+    return d->sendRateLimit();
+}
+
+void Client::setSendRateLimit(int datagramsPerSecond)
+{
+    d->setSendRateLimit(datagramsPerSecond);
+}
+
+std::chrono::microseconds Client::SendQueueStatistics::averageWaitTime() const noexcept
+{
+    if (sentCount == 0)
+        return {};
+
+    return totalWaitTime / static_cast<qint64>(sentCount);
+}
+
+Client::SendQueueStatistics Client::sendQueueStatistics(SendPriority priority) const
+{
+    return d->sendQueue(priority).statistics;
+}
+
+void Client::resetSendQueueStatistics()
+{
+    d->resetSendQueueStatistics();
+}
+
+const core::metrics::Registry &Client::metrics() const
+{
+    return d->metrics();
+}
+
+void Client::setTransport(QIODevice *transport)
+{
+    d->m_transport = transport;
+}
+
+QIODevice *Client::transport() const
+{
+    return d->m_transport;
+}
+
+void Client::setRecorder(core::TransportRecorder *recorder)
+{
+    d->m_recorder = recorder;
+}
+
+core::TransportRecorder *Client::recorder() const
+{
+    return d->m_recorder;
+}
+
 QString Client::hardwareName(HardwareType type)
 {
     switch (type) {
@@ -1738,7 +2602,9 @@ QString Client::hardwareName(HardwareType type)
 
 void Client::disableTrackPower(std::function<void(TrackStatus state)> callback)
 {
-    d->sendRequest("07 00 40 00 21 80 a1"_hex, [this, callback](auto message) {
+    d->cancelScheduledActivations();
+
+    d->sendRequest("07 00 40 00 21 80 a1"_hex, {XBusMessageId::BroadcastPowerOff}, [this, callback](auto message) {
         if (d->parseDisableTrackPowerResponse(std::move(message))) {
             callIfDefined(callback, trackStatus());
             return true;
@@ -1750,7 +2616,7 @@ void Client::disableTrackPower(std::function<void(TrackStatus state)> callback)
 
 void Client::enableTrackPower(std::function<void(TrackStatus state)> callback)
 {
-    d->sendRequest("07 00 40 00 21 81 a0"_hex, [this, callback](auto message) {
+    d->sendRequest("07 00 40 00 21 81 a0"_hex, {XBusMessageId::BroadcastPowerOn}, [this, callback](auto message) {
         if (d->parseEnableTrackPowerResponse(std::move(message))) {
             callIfDefined(callback, trackStatus());
             return true;
@@ -1762,7 +2628,9 @@ void Client::enableTrackPower(std::function<void(TrackStatus state)> callback)
 
 void Client::requestEmergencyStop(std::function<void (TrackStatus)> callback)
 {
-    d->sendRequest("06 00 40 00 80 80"_hex, [this, callback](auto message) {
+    d->cancelScheduledActivations();
+
+    d->sendRequest("06 00 40 00 80 80"_hex, {XBusMessageId::BroadcastEmergencyStop}, [this, callback](auto message) {
         if (d->parseRequestEmergencyStopResponse(std::move(message))) {
             callIfDefined(callback, trackStatus());
             return true;
@@ -1833,7 +2701,7 @@ void Client::setFunction(dcc::VehicleAddress address, dcc::Function function, Se
 void Client::setAccessoryState(dcc::AccessoryAddress address, quint8 state)
 {
     auto request = "0A 00 40 00 54 00 00 00 00 00"_hex;
-    qToBigEndian<quint16>((address - 1) & 0x07ff, request.data() + 5);
+    qToBigEndian<quint16>((address - 1) & AccessoryAddressMask, request.data() + 5);
     qToBigEndian<quint8>(state, request.data() + 7);
 
     updateChecksum(&request);
@@ -1842,15 +2710,7 @@ void Client::setAccessoryState(dcc::AccessoryAddress address, quint8 state)
 
 void Client::setTurnoutState(dcc::AccessoryAddress address, TurnoutDirection direction, bool enabled)
 {
-    const auto directionFlag = static_cast<quint8>(direction == Straight ? 1 : 0);
-    const auto enableFlag = static_cast<quint8>(enabled ? 8 : 0);
-
-    auto request = "09 00 40 00 53 00 00 00 00 00"_hex;
-    qToBigEndian<quint16>((address - 1) & 0x07ff, request.data() + 5);
-    qToBigEndian<quint8>(0xA0 | directionFlag | enableFlag, request.data() + 7);
-
-    updateChecksum(&request);
-    d->sendRequest(request, {});
+    d->sendRequest(turnoutRequest(address, direction, enabled), {});
 }
 
 void Client::setTurnoutState(dcc::AccessoryAddress address, TurnoutDirection direction, std::chrono::milliseconds duration)
@@ -1860,8 +2720,40 @@ void Client::setTurnoutState(dcc::AccessoryAddress address, TurnoutDirection dir
     setAccessoryState(address, directionFlag | dt);
 }
 
+void Client::setTurnoutStates(QList<TurnoutCommand> commands, std::chrono::milliseconds duration)
+{
+    d->scheduleTurnoutStates(std::move(commands), duration);
+}
+
+int Client::switchingGroupSize() const
+{
+    return d->switchingGroupSize();
+}
+
+void Client::setSwitchingGroupSize(int groupSize)
+{
+    d->setSwitchingGroupSize(groupSize);
+}
+
+std::chrono::milliseconds Client::switchingStagger() const
+{
+    return d->switchingStagger();
+}
+
+void Client::setSwitchingStagger(std::chrono::milliseconds stagger)
+{
+    d->setSwitchingStagger(stagger);
+}
+
+QList<QByteArray> Client::pendingTurnoutRequests() const
+{
+    return d->pendingTurnoutRequests();
+}
+
 void Client::requestAccessoryStop()
 {
+    d->cancelScheduledActivations();
+
     auto request = "0A 00 40 00 54 07 FF 00 00 00"_hex;
     updateChecksum(&request);
     d->sendRequest(request, {});
@@ -1871,7 +2763,7 @@ void Client::requestAccessoryStop()
 
 void Client::queryTrackStatus(std::function<void(TrackStatus)> callback)
 {
-    d->sendRequest("07 00 40 00 21 24 00"_hex, [this, callback](auto message) {
+    d->sendRequest("07 00 40 00 21 24 05"_hex, {XBusMessageId::StatusChanged}, [this, callback](auto message) {
         if (d->parseXStatusChanged(std::move(message))) {
             callIfDefined(callback, d->trackStatus());
             return true;
@@ -1883,7 +2775,7 @@ void Client::queryTrackStatus(std::function<void(TrackStatus)> callback)
 
 void Client::querySubscriptions(std::function<void(Subscriptions)> callback)
 {
-    d->sendRequest("04 00 51 00"_hex, [this, callback](auto message) {
+    d->sendRequest("04 00 51 00"_hex, {LanMessageId::GetBroadcastFlags}, [this, callback](auto message) {
         if (message.lanMessageId() == LanMessageId::GetBroadcastFlags && message.length() >= 8) {
             const auto subscriptions = Subscriptions{qFromLittleEndian<quint32>(message.lanData())};
 
@@ -1898,7 +2790,7 @@ void Client::querySubscriptions(std::function<void(Subscriptions)> callback)
 
 void Client::querySerialNumber(std::function<void(quint32)> callback)
 {
-    d->sendRequest("04 00 10 00"_hex, [this, callback](auto message) {
+    d->sendRequest("04 00 10 00"_hex, {LanMessageId::GetSerialNumber}, [this, callback](auto message) {
         if (message.lanMessageId() == LanMessageId::GetSerialNumber && message.length() >= 8) {
             const auto serialNumber = qFromLittleEndian<quint32>(message.lanData());
 
@@ -1913,7 +2805,7 @@ void Client::querySerialNumber(std::function<void(quint32)> callback)
 
 void Client::queryFirmwareVersion(std::function<void(QVersionNumber)> callback)
 {
-    d->sendRequest("07 00 40 00 f1 0a fb"_hex, [this, callback](auto message) {
+    d->sendRequest("07 00 40 00 f1 0a fb"_hex, {XBusMessageId::GetFirmwareVersionReply}, [this, callback](auto message) {
         if (message.xbusMessageId() == XBusMessageId::GetFirmwareVersionReply && message.length() >= 9) {
             const auto majorVersion = fromBCD(message.xbusData()[1]);
             const auto minorVersion = fromBCD(message.xbusData()[2]);
@@ -1930,7 +2822,7 @@ void Client::queryFirmwareVersion(std::function<void(QVersionNumber)> callback)
 
 void Client::queryXBusVersion(std::function<void(QVersionNumber, quint8)> callback)
 {
-    d->sendRequest("07 00 40 00 21 21 00"_hex, [this, callback](auto message) {
+    d->sendRequest("07 00 40 00 21 21 00"_hex, {XBusMessageId::GetVersionReply}, [this, callback](auto message) {
         if (message.xbusMessageId() == XBusMessageId::GetVersionReply && message.length() >= 9) {
             const auto rawVersion = message.xbusData()[1];
             const auto centralId = message.xbusData()[2];
@@ -1948,7 +2840,7 @@ void Client::queryXBusVersion(std::function<void(QVersionNumber, quint8)> callba
 
 void Client::queryCentralStatus(std::function<void()> callback)
 {
-    d->sendRequest("04 00 85 00"_hex, [this, callback](auto message) {
+    d->sendRequest("04 00 85 00"_hex, {LanMessageId::SystemStateDataChanged}, [this, callback](auto message) {
         if (d->parseSystemStateDataChanged(message)) {
             callIfDefined(callback);
             return true;
@@ -1960,7 +2852,7 @@ void Client::queryCentralStatus(std::function<void()> callback)
 
 void Client::queryHardwareInfo(std::function<void(HardwareType, QVersionNumber)> callback)
 {
-    d->sendRequest("04 00 1A 00"_hex, [this, callback](auto message) {
+    d->sendRequest("04 00 1A 00"_hex, {LanMessageId::GetHardwareInfo}, [this, callback](auto message) {
         if (message.lanMessageId() == LanMessageId::GetHardwareInfo && message.length() >= 12) {
             const auto hardwareType = static_cast<HardwareType>(qFromLittleEndian<quint32>(message.lanData()));
             d->setHardwareType(hardwareType);
@@ -1980,7 +2872,7 @@ void Client::queryHardwareInfo(std::function<void(HardwareType, QVersionNumber)>
 
 void Client::queryLockState(std::function<void(LockState)> callback)
 {
-    d->sendRequest("04 00 18 00"_hex, [this, callback](auto message) {
+    d->sendRequest("04 00 18 00"_hex, {LanMessageId::GetLockState}, [this, callback](auto message) {
         if (message.lanMessageId() == LanMessageId::GetLockState && message.length() >= 5) {
             const auto lockState = static_cast<LockState>(message.lanData()[0]);
 
@@ -2000,7 +2892,9 @@ void Client::queryVehicle(quint16 address, std::function<void(VehicleInfo)> call
     qToBigEndian<quint16>(address & 0x3fff, request.data() + 6);
     updateChecksum(&request);
 
-    d->sendRequest(std::move(request), [this, callback](auto message) {
+    const auto replyKey = DispatchKey{XBusMessageId::VehicleInfo, address & 0x3fff};
+
+    d->sendRequest(std::move(request), {replyKey}, [this, callback](auto message) {
         if (const auto info = d->parseVehicleInfo(std::move(message))) {
             callIfDefined(callback, info.value());
             emit vehicleInfoReceived(info.value(), QPrivateSignal{});
@@ -2019,10 +2913,12 @@ void Client::queryVehicleAny()
 void Client::queryAccessoryInfo(dcc::AccessoryAddress address, std::function<void (AccessoryInfo)> callback)
 {
     auto request = "09 00 40 00 44 00 00 00 00"_hex;
-    qToBigEndian<quint16>((address - 1) & 0x3fff, request.data() + 5);
+    qToBigEndian<quint16>((address - 1) & AccessoryAddressMask, request.data() + 5);
     updateChecksum(&request);
 
-    d->sendRequest(std::move(request), [this, address, callback](auto message) {
+    const auto replyKey = DispatchKey{XBusMessageId::AccessoryInfo, ((address - 1) & AccessoryAddressMask) + 1};
+
+    d->sendRequest(std::move(request), {replyKey}, [this, address, callback](auto message) {
         if (const auto info = d->parseAccessoryInfo(std::move(message))) {
             if (info->address() == address)
                 callIfDefined(callback, info.value());
@@ -2038,10 +2934,12 @@ void Client::queryAccessoryInfo(dcc::AccessoryAddress address, std::function<voi
 void Client::queryTurnoutInfo(dcc::AccessoryAddress address, std::function<void (TurnoutInfo)> callback)
 {
     auto request = "08 00 40 00 43 00 00 00"_hex;
-    qToBigEndian<quint16>((address - 1) & 0x3fff, request.data() + 5);
+    qToBigEndian<quint16>((address - 1) & AccessoryAddressMask, request.data() + 5);
     updateChecksum(&request);
 
-    d->sendRequest(std::move(request), [this, address, callback](auto message) {
+    const auto replyKey = DispatchKey{XBusMessageId::TurnoutInfo, ((address - 1) & AccessoryAddressMask) + 1};
+
+    d->sendRequest(std::move(request), {replyKey}, [this, address, callback](auto message) {
         if (const auto info = d->parseTurnoutInfo(std::move(message))) {
             if (info->address() == address)
                 callIfDefined(callback, info.value());
@@ -2103,7 +3001,9 @@ void Client::queryRBusDetectorInfo(rbus::GroupId group, std::function<void(RBusD
     qToBigEndian(static_cast<quint8>(group), request.data() + 4);
     // there is no checksum in this request
 
-    d->sendRequest(std::move(request), [this, group, callback](auto message) {
+    const auto replyKey = DispatchKey{LanMessageId::RBusDetectorDataChanged, static_cast<quint8>(group)};
+
+    d->sendRequest(std::move(request), {replyKey}, [this, group, callback](auto message) {
         if (const auto info = d->parseRBusDetectorInfo(std::move(message))) {
             if (info->group() == group) {
                 callIfDefined(callback, info.value());
@@ -2146,18 +3046,23 @@ void Client::queryCanDetectorInfo(can::NetworkId networkId, std::function<void(Q
 void Client::queryRailcom(quint16 address, std::function<void (RailcomInfo)> callback)
 {
     auto request = "07 00 89 00 01 00 00"_hex;
-    qToBigEndian<quint16>(address & 0x3fff, request.data() + 5);
+    qToLittleEndian<quint16>(address & 0x3fff, request.data() + 5);
     // there is no checksum in this request
 
-    d->sendRequest(std::move(request), [this, address, callback](auto message) {
+    const auto replyKey = DispatchKey{LanMessageId::RailcomDataChanged, address};
+    d->m_railcomQueries.append(address);
+
+    d->sendRequest(std::move(request), {replyKey}, [this, address, callback](auto message) {
         if (const auto info = d->parseRailcomInfo(std::move(message))) {
             if (info->address() == address) {
                 callIfDefined(callback, info.value());
                 emit railcomInfoReceived(info.value(), QPrivateSignal{});
-                return true;
-            } else if (!info->isValid()) {
-                return true; // FIXME: Seems we must better serialize these queries, as the empty no-railcom-message doesn't tell which request failed.
+            } else if (info->isValid()) {
+                return false;
             }
+
+            d->m_railcomQueries.removeOne(address);
+            return true;
         }
 
         return false;
@@ -2191,18 +3096,25 @@ void Client::readVariable(quint16 address, quint16 index, std::function<void(Err
         request = "09 00 40 00 23 11 00 00 00"_hex;
         qToBigEndian<quint16>(index - 1, request.data() + 6);
         updateChecksum(&request);
+        d->cancelTrackPowerRestore();
     }
 
     d->startProgrammingTimeout([this, address, index, callback] {
         qCWarning(d->logger()) << TimeoutError << "for reading CV" << index;
 
         if (address == 0)
-            enableTrackPower(); // FIXME: do not do this unconditionally: track power only should be restored if we had it before. also we should probably enable it at beginning if missing
+            d->restoreTrackPowerLater();
 
         callIfDefined(callback, TimeoutError, {});
     });
 
-    d->sendRequest(std::move(request), [this, address, index, callback](auto message) {
+    const auto replyKeys = QList<DispatchKey>{
+        XBusMessageId::ConfigResult,
+        XBusMessageId::ConfigErrorShortCircuit,
+        XBusMessageId::ConfigErrorValueRejected,
+    };
+
+    d->sendRequest(std::move(request), replyKeys, [this, address, index, callback](auto message) {
         const auto result = d->parseProgrammingResponse(message);
 
         if (std::holds_alternative<Error>(result)) {
@@ -2211,8 +3123,7 @@ void Client::readVariable(quint16 address, quint16 index, std::function<void(Err
             d->stopProgrammingTimeout();
 
             if (address == 0)
-                enableTrackPower();
-
+                d->restoreTrackPowerLater();
 
             callIfDefined(callback, std::get<Error>(result), {});
             return true;
@@ -2221,7 +3132,7 @@ void Client::readVariable(quint16 address, quint16 index, std::function<void(Err
 
             if (const auto cv = std::get<ConfigurationVariable>(result); cv.index == index) {
                 if (address == 0)
-                    enableTrackPower(); // FIXME: do not do this unconditionally: track power only should be restored if we had it before. also we should probably enable it at beginning if missing
+                    d->restoreTrackPowerLater();
 
                 callIfDefined(callback, NoError, cv.value);
                 return true;
@@ -2251,6 +3162,7 @@ void Client::writeVariable(quint16 address, quint16 index, quint8 value, std::fu
         qToBigEndian<quint16>(index - 1, request.data() + 6);
         qToBigEndian<quint8>(value, request.data() + 8);
         updateChecksum(&request);
+        d->cancelTrackPowerRestore();
     }
 
     d->sendRequest(std::move(request), {});
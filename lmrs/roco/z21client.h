@@ -2,13 +2,22 @@
 #define LMRS_ROCO_Z21_CLIENT_H
 
 #include <lmrs/core/detectors.h>
+#include <lmrs/core/metrics.h>
 #include <lmrs/core/quantities.h>
 
 #include <QObject>
 
+#include <bitset>
+#include <chrono>
+
 class QHostAddress;
+class QIODevice;
 class QVersionNumber;
 
+namespace lmrs::core {
+class TransportRecorder;
+}
+
 namespace lmrs::roco::z21 {
 
 Q_NAMESPACE
@@ -56,15 +65,17 @@ enum class XBusMessageId : quint16 {
 
 Q_ENUM_NS(XBusMessageId)
 
+// A non-owning view of a single message within a received datagram
 class Message
 {
 public:
-    Message(QByteArray data)
-        : m_data{std::move(data)}
+    constexpr Message(QByteArrayView data) noexcept
+        : m_data{data}
     {}
 
     [[nodiscard]] int length() const;
     [[nodiscard]] auto rawData() const { return m_data; }
+    [[nodiscard]] auto copyData(qsizetype offset = 0) const { return m_data.sliced(offset).toByteArray(); }
 
     // Z21 LAN protocol
     [[nodiscard]] LanMessageId lanMessageId() const;
@@ -77,7 +88,7 @@ public:
     [[nodiscard]] auto xbusData() const { return reinterpret_cast<const quint8 *>(m_data.constData() + 5); }
 
 private:
-    QByteArray m_data;
+    QByteArrayView m_data;
 };
 
 class VehicleInfo
@@ -216,12 +227,19 @@ struct RBusDetectorInfo
     Q_GADGET
 
 public:
+    /// One bit per port of the group, the first port of the group's first module is bit 0.
+    using Occupancy = std::bitset<accessory::rbus::PortsPerGroup>;
+
     explicit RBusDetectorInfo(QByteArray data = {});
 
     [[nodiscard]] bool isValid() const;
 
     [[nodiscard]] accessory::rbus::GroupId group() const;
     [[nodiscard]] QBitArray occupancy() const;
+    [[nodiscard]] Occupancy occupancyBits() const;
+
+    /// Builds detector info for each port of this group that is selected in `ports`.
+    [[nodiscard]] QList<accessory::DetectorInfo> detectorInfo(const Occupancy &ports) const;
 
     [[nodiscard]] operator QList<accessory::DetectorInfo>() const;
     [[nodiscard]] bool operator==(const RBusDetectorInfo &rhs) const noexcept = default;
@@ -495,6 +513,27 @@ public:
 
     Q_ENUM(Error)
 
+    /// Outgoing requests are queued in separate lanes, and lower lanes only get sent when all higher lanes are empty.
+    enum class SendPriority {
+        Safety,     ///< emergency stops and track power, never delayed by the rate limit
+        Control,    ///< vehicle and accessory commands
+        Normal,     ///< queries, polling and programming
+    };
+
+    Q_ENUM(SendPriority)
+
+    struct SendQueueStatistics
+    {
+        qsizetype depth = 0;
+        qsizetype peakDepth = 0;
+        quint64 sentCount = 0;
+        std::chrono::microseconds lastWaitTime = {};
+        std::chrono::microseconds peakWaitTime = {};
+        std::chrono::microseconds totalWaitTime = {};
+
+        [[nodiscard]] std::chrono::microseconds averageWaitTime() const noexcept;
+    };
+
     static constexpr quint16 DefaultPort = 21105;
 
     // lifetime
@@ -522,6 +561,27 @@ public:
     [[nodiscard]] HardwareType hardwareType() const;
     [[nodiscard]] LockState lockState() const;
 
+    /// The maximum number of datagrams sent per second, or 0 to disable rate limiting.
+    /// Requests queued while this limit is reached get merged into fewer, bigger datagrams.
+    [[nodiscard]] int sendRateLimit() const;
+    void setSendRateLimit(int datagramsPerSecond);
+
+    /// Queue depth and time-in-queue of the send lane for requests of the given priority.
+    [[nodiscard]] SendQueueStatistics sendQueueStatistics(SendPriority priority) const;
+    void resetSendQueueStatistics();
+
+    /// Total send queue depth, reply round-trip times and resends of starved requests.
+    [[nodiscard]] const core::metrics::Registry &metrics() const;
+
+    /// Uses `transport` instead of a UDP socket for the next connection, like a core::TransportReplay.
+    /// Datagram boundaries are not preserved, which is fine since each message carries its length.
+    void setTransport(QIODevice *transport);
+    [[nodiscard]] QIODevice *transport() const;
+
+    /// Records all datagrams exchanged with the command station.
+    void setRecorder(core::TransportRecorder *recorder);
+    [[nodiscard]] core::TransportRecorder *recorder() const;
+
     [[nodiscard]] static QString hardwareName(Client::HardwareType type);
 
     // operations
@@ -531,6 +591,9 @@ public:
     void subscribe(Subscriptions subscriptions);
     void logoff();
 
+    /// Speed and function commands still waiting in the send queue get replaced by newer commands
+    /// for the same vehicle, or the same function. The newer command takes the queue slot of the
+    /// replaced one, so it is sent before commands for other vehicles that were queued in between.
     void setSpeed14(dcc::VehicleAddress address, dcc::Speed14 speed, dcc::Direction direction);
     void setSpeed28(dcc::VehicleAddress address, dcc::Speed28 speed, dcc::Direction direction);
     void setSpeed126(dcc::VehicleAddress address, dcc::Speed126 speed, dcc::Direction direction);
@@ -546,6 +609,31 @@ public:
     void setAccessoryState(dcc::AccessoryAddress address, quint8 state);
     void setTurnoutState(dcc::AccessoryAddress address, TurnoutDirection direction, bool enabled); // FIXME: use proper state type
     void setTurnoutState(dcc::AccessoryAddress address, TurnoutDirection direction, std::chrono::milliseconds duration); // FIXME: use proper state type
+
+    struct TurnoutCommand
+    {
+        dcc::AccessoryAddress address;
+        TurnoutDirection direction;
+    };
+
+    /// Switches a route: the turnouts get activated in groups of switchingGroupSize(), one group
+    /// each switchingStagger(), and each group gets deactivated again once `duration` has passed.
+    /// The next group waits for that deactivation when `duration` exceeds the stagger. Pending
+    /// activations are dropped on track power off and emergency stops. Requests scheduled for
+    /// the same moment share datagrams.
+    void setTurnoutStates(QList<TurnoutCommand> commands, std::chrono::milliseconds duration);
+
+    /// The number of turnouts switched at the same time by setTurnoutStates(), or 0 for no limit.
+    [[nodiscard]] int switchingGroupSize() const;
+    void setSwitchingGroupSize(int groupSize);
+
+    /// The delay between activating two groups of turnouts in setTurnoutStates().
+    [[nodiscard]] std::chrono::milliseconds switchingStagger() const;
+    void setSwitchingStagger(std::chrono::milliseconds stagger);
+
+    /// The requests setTurnoutStates() has not sent yet, in the order they are due.
+    [[nodiscard]] QList<QByteArray> pendingTurnoutRequests() const;
+
     void requestAccessoryStop();
 
     void readVariable(quint16 address, quint16 index,
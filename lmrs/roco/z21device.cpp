@@ -1,6 +1,7 @@
 #include "z21device.h"
 
 #include "z21client.h"
+#include "z21vehiclepolling.h"
 
 #include <lmrs/core/accessories.h>
 #include <lmrs/core/algorithms.h>
@@ -8,6 +9,7 @@
 #include <lmrs/core/memory.h>
 #include <lmrs/core/parameters.h>
 #include <lmrs/core/propertyguard.h>
+#include <lmrs/core/railcomstatisticsmodel.h>
 #include <lmrs/core/typetraits.h>
 #include <lmrs/core/userliterals.h>
 #include <lmrs/core/validatingvariantmap.h>
@@ -47,6 +49,7 @@ public:
     void setAccessoryState(dcc::AccessoryAddress address, quint8 state) override;
     void setTurnoutState(dcc::AccessoryAddress address, dcc::TurnoutState state, bool enabled = true) override;
     void setTurnoutState(dcc::AccessoryAddress address, dcc::TurnoutState state, milliseconds duration) override;
+    void setTurnoutStates(QList<TurnoutCommand> commands, milliseconds duration) override;
     void requestEmergencyStop() override;
 
     void requestAccessoryInfo(dcc::AccessoryAddress address, AccessoryInfoCallback callback) override;
@@ -159,15 +162,17 @@ private:
 
     void onVehicleInqueryInterval();
 
+    void onDisconnected();
     void onLibraryInfoReceived(z21::LibraryInfo info);
     void onRailcomInfoReceived(z21::RailcomInfo info);
     void onVehicleInfoReceived(z21::VehicleInfo info);
 
     QList<dcc::VehicleAddress> m_subscriptions;
     dcc::VehicleAddress m_currentVehicle;
-    qsizetype m_inqueryPointer = 0;
+    VehiclePollingPlanner m_pollingPlanner;
 
     QSet<dcc::VehicleAddress> m_knownVehicles;
+    QHash<dcc::VehicleAddress, core::VehicleInfo> m_vehicleInfo; // as last reported, to drop repeated broadcasts
     core::ConstPointer<QTimer> m_vehicleInqueryTimer{this};
 };
 
@@ -207,7 +212,7 @@ AccessoryControl::AccessoryControl(Client *parent)
 
 AccessoryControl::Features AccessoryControl::features() const
 {
-    return Feature::Turnouts | Feature::Signals | Feature::Durations | Feature::EmergencyStop;
+    return Feature::Turnouts | Feature::Signals | Feature::Durations | Feature::EmergencyStop | Feature::StateQueries;
 }
 
 void AccessoryControl::setAccessoryState(dcc::AccessoryAddress address, quint8 state)
@@ -249,6 +254,32 @@ void AccessoryControl::setTurnoutState(dcc::AccessoryAddress address, dcc::Turno
     }
 }
 
+void AccessoryControl::setTurnoutStates(QList<TurnoutCommand> commands, milliseconds duration)
+{
+    auto clientCommands = QList<Client::TurnoutCommand>{};
+    clientCommands.reserve(commands.size());
+
+    for (const auto &command: commands) {
+        switch (command.state) {
+        case dcc::TurnoutState::Straight:
+            clientCommands.append({command.address, z21::Client::Straight});
+            break;
+
+        case dcc::TurnoutState::Branched:
+            clientCommands.append({command.address, z21::Client::Branching});
+            break;
+
+        case dcc::TurnoutState::Unknown:
+        case dcc::TurnoutState::Invalid:
+            qCWarning(logger(this), "Ignoring %s state for turnout %d",
+                      core::key(command.state), command.address.value);
+            break;
+        }
+    }
+
+    client()->setTurnoutStates(std::move(clientCommands), duration);
+}
+
 void AccessoryControl::requestEmergencyStop()
 {
     client()->requestAccessoryStop();
@@ -301,7 +332,7 @@ void DebugControl::sendNativeFrame(QByteArray nativeFrame) const
 QList<QPair<QString, QByteArray>> DebugControl::nativeExampleFrames() const noexcept
 {
     return {
-        {tr("Query Railcom information for DCC#2280"), "07 00 89 00 01 08 e8 e0"_hex},
+        {tr("Query Railcom information for DCC#2280"), "07 00 89 00 01 e8 08"_hex},
     };
 }
 
@@ -408,6 +439,8 @@ void VariableControl::writeVariable(dcc::VehicleAddress address, dcc::VariableIn
     // FIXME: use lmrs types for z21::Client
     client()->writeVariable(address, variable, value, [=, this](auto error, auto verifiedValue) {
         const auto genericError = static_cast<core::Error>(error); // FIXME: do proper conversion, not just a cast
+        invalidatePageCache(address, variable);
+
         switch (core::callIfDefined(core::Continuation::Proceed, callback, {genericError, verifiedValue})) {
         case core::Continuation::Retry:
             if (const auto next = callback.retry()) {
@@ -430,13 +463,12 @@ void VariableControl::writeVariable(dcc::VehicleAddress address, dcc::VariableIn
 VehicleControl::VehicleControl(Client *parent)
     : core::VehicleControl{parent}
 {
-    m_vehicleInqueryTimer->setInterval(2s);
-//    m_vehicleInqueryTimer->setInterval(200ms);
+    m_vehicleInqueryTimer->setInterval(m_pollingPlanner.interval());
 
     connect(m_vehicleInqueryTimer, &QTimer::timeout, this, &VehicleControl::onVehicleInqueryInterval);
 
     connect(client(), &Client::connected, m_vehicleInqueryTimer.get(), qOverload<>(&QTimer::start));
-    connect(client(), &Client::disconnected, m_vehicleInqueryTimer.get(), &QTimer::stop);
+    connect(client(), &Client::disconnected, this, &VehicleControl::onDisconnected);
 
     connect(client(), &Client::libraryInfoReceived, this, &VehicleControl::onLibraryInfoReceived);
     connect(client(), &Client::railcomInfoReceived, this, &VehicleControl::onRailcomInfoReceived);
@@ -478,31 +510,15 @@ void VehicleControl::setFunction(dcc::VehicleAddress address, dcc::Function func
 
 void VehicleControl::onVehicleInqueryInterval()
 {
-    QList<dcc::VehicleAddress> nextQueries;
-
-    // always query the prioritized current vehicle
-    if (m_currentVehicle)
-        nextQueries.append(m_currentVehicle);
-
-    // now add up to five vehicles we didn't query recently
-    if (!m_subscriptions.isEmpty()) {
-        for (const auto n = m_subscriptions.size(), end = m_inqueryPointer + n;
-             m_inqueryPointer < end && nextQueries.size() < 5; ++m_inqueryPointer) {
-            if (const auto address = m_subscriptions[m_inqueryPointer % n]; !nextQueries.contains(address))
-                nextQueries.append(address);
-        }
-
-        m_inqueryPointer %= m_subscriptions.size();
-    }
-
-    // now query the vehicles the app is interested in
-    for (const auto address: nextQueries) {
-        client()->queryVehicle(address);
-        client()->queryRailcom(address);
-    }
+    const auto now = VehiclePollingPlanner::clock::now();
+    m_vehicleInqueryTimer->setInterval(m_pollingPlanner.poll(client(), m_currentVehicle, m_subscriptions, now));
+}
 
-    client()->queryVehicleAny();  // FIXME: this doesn't seem to work
-    client()->queryRailcomAny();
+void VehicleControl::onDisconnected()
+{
+    m_vehicleInqueryTimer->stop();
+    m_pollingPlanner.reset();
+    m_vehicleInfo.clear();
 }
 
 void VehicleControl::onLibraryInfoReceived(LibraryInfo info)
@@ -517,6 +533,15 @@ void VehicleControl::onRailcomInfoReceived(RailcomInfo info)
 {
     qDebug(logger(this)) << info;
 
+    auto sample = core::RailcomSample{info.address(), info.receiveCounter(), info.errorCounter()};
+
+    if (info.options().testAnyFlags({RailcomInfo::Option::Speed1, RailcomInfo::Option::Speed2}))
+        sample.speed = info.speed();
+    if (info.options().testFlag(RailcomInfo::Option::QoS))
+        sample.qos = info.qos();
+
+    emit railcomSampleReceived(std::move(sample), core::VehicleControl::QProtectedSignal{});
+
     if (!m_knownVehicles.contains(info.address())) {
         m_knownVehicles.insert(info.address());
         emit vehicleInfoChanged(core::VehicleInfo{info.address(), {}, {}}, core::VehicleControl::QProtectedSignal{});
@@ -527,6 +552,7 @@ void lmrs::roco::z21::VehicleControl::onVehicleInfoReceived(z21::VehicleInfo inf
 {
     qDebug(logger(this)) << info;
     m_knownVehicles.insert(info.address());
+    m_pollingPlanner.vehicleInfoReceived(info.address(), VehiclePollingPlanner::clock::now());
 
     dcc::FunctionState functionState; // FIXME: All this conversion quite a mess: We should replace z21::VehicleInfo by core::VehicleInfo
     core::VehicleInfo::Flags flags;
@@ -535,6 +561,11 @@ void lmrs::roco::z21::VehicleControl::onVehicleInfoReceived(z21::VehicleInfo inf
         functionState[static_cast<size_t>(fn.index())] = info.functions() & fn.value();
 
     auto vehicleInfo = core::VehicleInfo{info.address(), info.direction(), info.speed(), std::move(functionState), flags};
+
+    if (const auto it = m_vehicleInfo.find(info.address()); it != m_vehicleInfo.end() && *it == vehicleInfo)
+        return;
+
+    m_vehicleInfo.insert(info.address(), vehicleInfo);
     emit vehicleInfoChanged(std::move(vehicleInfo), core::VehicleControl::QProtectedSignal{});
 }
 
@@ -781,6 +812,11 @@ void Device::updateDeviceInfo()
     d->updateDeviceInfo();
 }
 
+QList<const core::metrics::Registry *> Device::metrics() const
+{
+    return core::Device::metrics() << &d->client->metrics();
+}
+
 void Device::setDeviceInfo(core::DeviceInfo id, QVariant value)
 {
     if (auto it = d->deviceInfo.find(id); it == d->deviceInfo.end()) {
@@ -48,6 +48,8 @@ public: // Device interface
     QVariant deviceInfo(core::DeviceInfo id, int role = Qt::EditRole) const override;
     void updateDeviceInfo() override;
 
+    QList<const core::metrics::Registry *> metrics() const override;
+
 protected:
     void setDeviceInfo(core::DeviceInfo id, QVariant value) override;
 
@@ -0,0 +1,113 @@
+#include "z21vehiclepolling.h"
+
+#include "z21client.h"
+
+#include <algorithm>
+
+namespace lmrs::roco::z21 {
+
+namespace {
+
+// requests waiting longer than this in the send queue indicate a busy link
+constexpr auto BusyWaitTime = std::chrono::milliseconds{100};
+
+} // namespace
+
+bool VehiclePollingPlanner::isPushed(dcc::VehicleAddress address) const
+{
+    return m_pushingAnyVehicle || m_pushedVehicles.contains(address);
+}
+
+bool VehiclePollingPlanner::needsQuery(dcc::VehicleAddress address, clock::time_point now) const
+{
+    if (!isPushed(address))
+        return true;
+
+    // the Z21 only pushes changes, so refresh vehicles we haven't heard about for a while
+    const auto state = m_vehicles.value(address);
+    return now - std::max(state.lastReceived, state.lastQueried) >= RefreshInterval;
+}
+
+QList<dcc::VehicleAddress> VehiclePollingPlanner::plan(dcc::VehicleAddress current, const QList<dcc::VehicleAddress> &vehicles,
+                                                       clock::time_point now)
+{
+    auto queries = QList<dcc::VehicleAddress>{};
+
+    if (current && needsQuery(current, now))
+        queries.append(current);
+
+    if (const auto count = vehicles.size(); count > 0) {
+        auto examined = qsizetype{0};
+
+        for (; examined < count && queries.size() < MaximumQueriesPerInterval; ++examined) {
+            const auto address = vehicles[(m_nextVehicle + examined) % count];
+
+            if (!queries.contains(address) && needsQuery(address, now))
+                queries.append(address);
+        }
+
+        m_nextVehicle = (m_nextVehicle + examined) % count;
+    }
+
+    for (const auto address: std::as_const(queries))
+        vehicleQueried(address, now);
+
+    return queries;
+}
+
+void VehiclePollingPlanner::vehicleQueried(dcc::VehicleAddress address, clock::time_point now)
+{
+    m_vehicles[address].lastQueried = now;
+
+    // the Z21 forgets the oldest subscription of a client when it gets queried for another vehicle
+    m_pushedVehicles.removeOne(address);
+    m_pushedVehicles.append(address);
+
+    if (m_pushedVehicles.size() > MaximumPushedVehicles)
+        m_pushedVehicles.removeFirst();
+}
+
+void VehiclePollingPlanner::vehicleInfoReceived(dcc::VehicleAddress address, clock::time_point now)
+{
+    m_vehicles[address].lastReceived = now;
+}
+
+std::chrono::milliseconds VehiclePollingPlanner::updateInterval(qsizetype queueDepth, std::chrono::microseconds queueWaitTime)
+{
+    if (queueDepth > 0 || queueWaitTime >= BusyWaitTime)
+        m_interval = std::min(m_interval * 2, MaximumInterval);
+    else
+        m_interval = std::max(m_interval / 2, MinimumInterval);
+
+    return m_interval;
+}
+
+std::chrono::milliseconds VehiclePollingPlanner::poll(Client *client, dcc::VehicleAddress current,
+                                                      const QList<dcc::VehicleAddress> &vehicles, clock::time_point now)
+{
+    // sample the queue before adding this poll's queries, which otherwise always would look busy
+    const auto queue = client->sendQueueStatistics(Client::SendPriority::Normal);
+
+    setPushingAnyVehicle(client->subscriptions().testFlag(Client::Subscription::AnyVehicle));
+
+    // only query vehicles the Z21 doesn't tell us about by itself, prioritizing the current vehicle
+    for (const auto address: plan(current, vehicles, now)) {
+        client->queryVehicle(address);
+        client->queryRailcom(address);
+    }
+
+    client->queryVehicleAny();  // FIXME: this doesn't seem to work
+    client->queryRailcomAny();
+
+    return updateInterval(queue.depth, queue.lastWaitTime);
+}
+
+void VehiclePollingPlanner::reset()
+{
+    m_vehicles.clear();
+    m_pushedVehicles.clear();
+    m_nextVehicle = 0;
+    m_interval = DefaultInterval;
+}
+
+} // namespace lmrs::roco::z21
@@ -0,0 +1,74 @@
+#ifndef LMRS_ROCO_Z21_VEHICLEPOLLING_H
+#define LMRS_ROCO_Z21_VEHICLEPOLLING_H
+
+#include <lmrs/core/dccconstants.h>
+
+#include <QHash>
+
+#include <chrono>
+
+namespace lmrs::roco::z21 {
+
+namespace dcc = core::dcc;
+
+class Client;
+
+/// Decides which vehicles must be queried explicitly. The Z21 pushes vehicle info on its own,
+/// either for any vehicle, or for the most recent vehicles a client has queried. Only vehicles
+/// it doesn't push, and vehicles we haven't heard about for a while, need to be polled.
+class VehiclePollingPlanner
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr auto MaximumPushedVehicles = 16; // per client, according to the Z21 LAN protocol
+    static constexpr auto MaximumQueriesPerInterval = 5;
+
+    static constexpr auto RefreshInterval = std::chrono::milliseconds{30'000};
+    static constexpr auto MinimumInterval = std::chrono::milliseconds{500};
+    static constexpr auto DefaultInterval = std::chrono::milliseconds{2'000};
+    static constexpr auto MaximumInterval = std::chrono::milliseconds{8'000};
+
+    /// Set when the client has subscribed to the info of any vehicle.
+    void setPushingAnyVehicle(bool enabled) { m_pushingAnyVehicle = enabled; }
+    [[nodiscard]] bool isPushingAnyVehicle() const { return m_pushingAnyVehicle; }
+
+    [[nodiscard]] bool isPushed(dcc::VehicleAddress address) const;
+    [[nodiscard]] bool needsQuery(dcc::VehicleAddress address, clock::time_point now) const;
+
+    /// Picks the vehicles to query now, starting with `current`, followed by `vehicles` in round-robin
+    /// order. The picked vehicles are considered queried.
+    [[nodiscard]] QList<dcc::VehicleAddress> plan(dcc::VehicleAddress current, const QList<dcc::VehicleAddress> &vehicles,
+                                                  clock::time_point now);
+
+    void vehicleQueried(dcc::VehicleAddress address, clock::time_point now);
+    void vehicleInfoReceived(dcc::VehicleAddress address, clock::time_point now);
+
+    /// Polls less often while requests are waiting in the client's send queue, and more often while it is idle.
+    std::chrono::milliseconds updateInterval(qsizetype queueDepth, std::chrono::microseconds queueWaitTime);
+
+    /// Queries the vehicles planned for now through `client`, and updates the interval
+    /// from the requests still waiting since the previous poll. Returns the new interval.
+    std::chrono::milliseconds poll(Client *client, dcc::VehicleAddress current,
+                                   const QList<dcc::VehicleAddress> &vehicles, clock::time_point now);
+    [[nodiscard]] std::chrono::milliseconds interval() const { return m_interval; }
+
+    void reset();
+
+private:
+    struct VehicleState
+    {
+        clock::time_point lastReceived = {};
+        clock::time_point lastQueried = {};
+    };
+
+    QHash<dcc::VehicleAddress, VehicleState> m_vehicles;
+    QList<dcc::VehicleAddress> m_pushedVehicles; // oldest subscription first
+    qsizetype m_nextVehicle = 0;
+    std::chrono::milliseconds m_interval = DefaultInterval;
+    bool m_pushingAnyVehicle = false;
+};
+
+} // namespace lmrs::roco::z21
+
+#endif // LMRS_ROCO_Z21_VEHICLEPOLLING_H
@@ -6,12 +6,16 @@
 #include <lmrs/core/logging.h>
 #include <lmrs/core/parameters.h>
 #include <lmrs/core/propertyguard.h>
+#include <lmrs/core/tracing.h>
+#include <lmrs/core/transport.h>
 #include <lmrs/core/userliterals.h>
 #include <lmrs/core/validatingvariantmap.h>
 #include <lmrs/core/vehicleinfomodel.h>
 
 #include <lmrs/serial/serialportmodel.h>
 
+#include <QBuffer>
+#include <QPointer>
 #include <QSerialPort>
 #include <QTimerEvent>
 
@@ -22,6 +26,8 @@ using std::chrono::milliseconds;
 
 namespace {
 
+auto &lcStream() { struct Stream {}; return core::logger<Device, Stream>(); }
+
 // =====================================================================================================================
 
 constexpr auto s_parameter_portName = "port"_BV;
@@ -73,6 +79,91 @@ inline size_t qHash(RequestKey key, size_t seed = 0)
     return qHashMulti(seed, key.sequence, core::value(key.code));
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Responses are matched by the sequence number of their request, but the sequence numbers written during
+// replay differ from the recorded ones. Therefore recorded responses get the actual sequence numbers,
+// which also requires a new checksum.
+class ReplayAdapter : public core::TransportReplay::Adapter
+{
+public:
+    qsizetype frameLength(QByteArrayView data) const override
+    {
+        return FrameFormat::frameLength(data);
+    }
+
+    bool sent(QByteArrayView recorded, QByteArrayView actual) override
+    {
+        const auto recordedMessage = Message::fromFrame(unescaped(recorded));
+        const auto actualMessage = Message::fromFrame(unescaped(actual));
+
+        if (!recordedMessage.isValid() || !actualMessage.isValid())
+            return recordedMessage.toFrame() == actualMessage.toFrame();
+
+        m_sequences.insert(recordedMessage.sequence().value, actualMessage.sequence().value);
+        return recordedMessage.toData() == actualMessage.toData();
+    }
+
+    QByteArray received(QByteArray recorded) override
+    {
+        m_responses.addData(recorded);
+
+        while (m_responses.readNext())
+            m_writer.addFrame(adaptedResponse(m_responses.frame()));
+
+        auto buffer = QBuffer{};
+        buffer.open(QBuffer::WriteOnly);
+        m_writer.setDevice(&buffer);
+        m_writer.flush();
+        m_writer.setDevice(nullptr);
+
+        return buffer.data();
+    }
+
+private:
+    static QByteArray unescaped(QByteArrayView data)
+    {
+        auto reader = StreamReader{data};
+        return reader.readNext() ? reader.frame() : data.toByteArray();
+    }
+
+    // position of the request's sequence number within the data of a response
+    static qsizetype requestSequenceOffset(Message::Format format)
+    {
+        switch (format) {
+        case Message::Format::Short:
+            return 2;
+
+        case Message::Format::Long:
+            return 3;
+        }
+
+        return 0;
+    }
+
+    QByteArray adaptedResponse(QByteArray frame) const
+    {
+        const auto message = Message::fromFrame(frame);
+
+        if (!message.isValid() || message.type() == Message::Type::Request)
+            return frame;
+
+        auto data = message.toData();
+
+        if (const auto offset = requestSequenceOffset(message.format()); offset < data.size()) {
+            const auto recordedSequence = static_cast<quint8>(data[offset]);
+            data[offset] = static_cast<char>(m_sequences.value(recordedSequence, recordedSequence));
+        }
+
+        return Message::fromData(std::move(data), message.sequence()).toFrame();
+    }
+
+    StreamReader m_responses;
+    StreamWriter m_writer;
+
+    QHash<quint8, quint8> m_sequences;
+};
+
 // =====================================================================================================================
 
 } // namespace
@@ -201,6 +292,7 @@ public:
     StreamWriter streamWriter;
 
     core::ConstPointer<QSerialPort> serialPort;
+    QPointer<QIODevice> transport;
     core::ConstPointer<DeviceFactory> factory;
 
     core::ConstPointer<AccessoryControl> accessoryControl{this};
@@ -224,6 +316,15 @@ public:
 
     QList<PendingRequest> requestQueue;
     QHash<RequestKey, ObserverCallback> observers;
+    core::TraceChannel trace{lcStream().categoryName()};
+
+    // only the first request of the queue is in flight, waiting for its primary response
+    core::metrics::Clock::time_point requestSent;
+    core::metrics::Gauge queueDepth{"queueDepth"};
+    core::metrics::Histogram responseTime{"responseTime"};
+    core::metrics::Counter sentRequests{"sentRequests"};
+    core::metrics::Counter writeErrors{"writeErrors"};
+    core::metrics::Registry metrics{"mx1.Device", {&queueDepth, &responseTime, &sentRequests, &writeErrors}};
 
     const int speed;
     int connectTimeoutId = 0;
@@ -409,6 +510,7 @@ void Device::Private::cancelConnectTimeout()
 void Device::Private::queueRequest(Request request, ObserverCallback observer)
 {
     requestQueue.emplaceBack(std::move(request), std::move(observer));
+    queueDepth.set(requestQueue.size());
 
     if (requestQueue.size() == 1)
         flushQueue();
@@ -422,15 +524,21 @@ void Device::Private::flushQueue()
     auto [request, observer] = requestQueue.first();
     auto frame = request.toFrame();
 
-    qCInfo(logger()).verbosity(QDebug::MinimumVerbosity)
-            << "SEND:" << frame.toHex(' ') << request << request.hasValidChecksum()
+    qCDebug(lcStream).verbosity(QDebug::MinimumVerbosity)
+            << "SEND:" << request << request.hasValidChecksum()
             << Qt::hex << request.actualChecksum() << request.expectedChecksum();
 
+    trace.recordSent(frame);
+
     if (!streamWriter.writeFrame(std::move(frame))) {
         qCWarning(logger(), "Could not send frame: %ls", qUtf16Printable(streamWriter.errorString()));
+        writeErrors.increment();
         return;
     }
 
+    requestSent = core::metrics::startTime();
+    sentRequests.increment();
+
     if (observer)
         observers.insert(std::move(request), std::move(observer));
 
@@ -438,12 +546,17 @@ void Device::Private::flushQueue()
 
 void Device::Private::onReadyRead()
 {
-    if (streamReader.readNext()) {
-        auto frame = streamReader.frame();
+    // decode all frames buffered so far, otherwise the remaining ones
+    // would have to wait until the next byte arrives from the serial port
+    auto frameCount = 0;
+
+    while (streamReader.readNext()) {
+        const auto frame = streamReader.frame();
         const auto message = Message::fromFrame(frame);
+        ++frameCount;
 
-        qCInfo(logger()).verbosity(QDebug::MinimumVerbosity)
-                << "RECV:" << frame.toHex(' ') << message;
+        trace.recordReceived(frame);
+        qCDebug(lcStream).verbosity(QDebug::MinimumVerbosity) << "RECV:" << message;
 
         if (message.isValid()) {
             switch (message.type()) {
@@ -460,20 +573,25 @@ void Device::Private::onReadyRead()
             }
         }
     }
+
+    if (frameCount > 1)
+        qCDebug(lcStream, "decoded %d frames at once", frameCount);
 }
 
 void Device::Private::handleResponse(Response response)
 {
     if (response.type() == Message::Type::PrimaryResponse
             && !requestQueue.isEmpty()) {
+        responseTime.recordSince(std::exchange(requestSent, {}));
         requestQueue.removeFirst();
+        queueDepth.set(requestQueue.size());
         flushQueue();
     }
 
     if (const auto it = observers.find(response); it != observers.end()) {
-        qInfo().nospace() << "Calling observer for sequence="
-                          << it.key().sequence << ", code="
-                          << it.key().code;
+        qCDebug(lcStream).nospace() << "Calling observer for sequence="
+                                    << it.key().sequence << ", code="
+                                    << it.key().code;
 
         switch (std::invoke(*it, std::move(response))) {
         case core::Continuation::Abort:
@@ -592,7 +710,10 @@ void Device::VariableControl::writeVariable(dcc::VehicleAddress address,
 {
     // FIXME: power control
     d()->queueRequest(Request::writeVariable(address, variable, value),
-                      [callback](VariableControlResponse response) {
+                      [this, address, variable, callback](VariableControlResponse response) {
+        // the decoder might have received the write already, no matter which status gets reported
+        invalidatePageCache(address, variable);
+
         if (response.status() == Response::Status::Unknown) {
             callback({core::Error::NoError, response.value()});
             return core::Continuation::Done;
@@ -670,11 +791,37 @@ Device::Device(QString portName, int portSpeed, DeviceFactory *factory, QObject
     observe(core::DeviceInfo::TrackStatus,
             static_cast<core::PowerControl *>(d->powerControl.get()),
             &core::PowerControl::state, &core::PowerControl::stateChanged);
+
+    setTransport(nullptr);
+}
+
+void Device::setTransport(QIODevice *transport)
+{
+    if (!transport)
+        transport = d->serialPort;
+
+    if (d->transport)
+        d->transport->disconnect(d);
+
+    d->transport = transport;
+    connect(d->transport, &QIODevice::readyRead, d, &Private::onReadyRead);
+
+    // fall back to the serial port if the transport's owner deletes it
+    if (transport != d->serialPort.get())
+        connect(transport, &QObject::destroyed, d, [this] { setTransport(nullptr); });
+
+    if (const auto replay = qobject_cast<core::TransportReplay *>(transport); replay && !replay->adapter())
+        replay->setAdapter(std::make_unique<ReplayAdapter>());
+}
+
+QIODevice *Device::transport() const
+{
+    return d->transport;
 }
 
 Device::State Device::state() const
 {
-    if (!d->serialPort->isOpen())
+    if (!d->transport || !d->transport->isOpen())
         return State::Disconnected;
     if (d->deviceInfo.isEmpty())
         return State::Connecting;
@@ -725,17 +872,15 @@ bool Device::Private::connectToDevice()
     }
 
 
-    if (!serialPort->open(QSerialPort::ReadWrite)) {
-        reportError(serialPort->errorString());
+    if (!transport->open(QIODevice::ReadWrite)) {
+        reportError(transport->errorString());
         return false;
     }
 
     connectTimeoutId = startTimer(5s);
 
-    connect(serialPort, &QSerialPort::readyRead, this, &Private::onReadyRead);
-
-    streamReader.setDevice(serialPort);
-    streamWriter.setDevice(serialPort);
+    streamReader.setDevice(transport);
+    streamWriter.setDevice(transport);
 
     startCommunication();
 
@@ -752,10 +897,11 @@ void Device::disconnectFromDevice()
     const auto guard = core::propertyGuard(this, &Device::state, &Device::stateChanged, Device::QProtectedSignal{});
 
     d->cancelConnectTimeout();
-    d->serialPort->disconnect(this);
     d->streamReader.setDevice(nullptr);
     d->streamWriter.setDevice(nullptr);
-    d->serialPort->close();
+
+    if (d->transport)
+        d->transport->close();
 }
 
 QVariant Device::deviceInfo(core::DeviceInfo id, int role) const
@@ -795,6 +941,11 @@ void Device::updateDeviceInfo()
     d->updateDeviceInfo();
 }
 
+QList<const core::metrics::Registry *> Device::metrics() const
+{
+    return core::Device::metrics() << &d->metrics;
+}
+
 core::DeviceFactory *Device::factory() { return d->factory; }
 core::AccessoryControl *Device::accessoryControl() { return d->accessoryControl; }
 core::DebugControl *Device::debugControl() { return d->debugControl; }
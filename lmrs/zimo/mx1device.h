@@ -4,6 +4,8 @@
 #include <lmrs/core/device.h>
 #include <lmrs/core/memory.h>
 
+class QIODevice;
+
 namespace lmrs::zimo::mx1 {
 
 class DeviceFactory : public core::DeviceFactory
@@ -25,6 +27,10 @@ class Device : public lmrs::core::Device
 public:
     explicit Device(QString portName, int portSpeed, DeviceFactory *factory, QObject *parent = {});
 
+    /// Replaces the serial port by another transport, see lp2::Device::setTransport().
+    void setTransport(QIODevice *transport);
+    [[nodiscard]] QIODevice *transport() const;
+
     [[nodiscard]] State state() const override;
     [[nodiscard]] QString name() const override;
     [[nodiscard]] QString uniqueId() const override;
@@ -35,6 +41,8 @@ public:
     [[nodiscard]] QVariant deviceInfo(core::DeviceInfo id, int role = Qt::EditRole) const override;
     void updateDeviceInfo() override;
 
+    [[nodiscard]] QList<const core::metrics::Registry *> metrics() const override;
+
     [[nodiscard]] core::DeviceFactory *factory() override;
 
     [[nodiscard]] core::AccessoryControl *accessoryControl() override;
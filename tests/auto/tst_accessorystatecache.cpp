@@ -0,0 +1,195 @@
+#include <lmrs/core/accessorystatecache.h>
+
+#include <QtTest>
+
+namespace lmrs::core::tests {
+
+using namespace accessory;
+using namespace std::chrono_literals;
+using std::chrono::milliseconds;
+
+class MockAccessoryControl : public AccessoryControl
+{
+    Q_OBJECT
+
+public:
+    explicit MockAccessoryControl()
+        : AccessoryControl{nullptr}
+    {}
+
+    Device *device() const override { return nullptr; }
+    Features features() const override { return supportedFeatures; }
+
+    void setAccessoryState(dcc::AccessoryAddress, quint8) override {}
+    void setTurnoutState(dcc::AccessoryAddress, dcc::TurnoutState, bool) override {}
+    void setTurnoutState(dcc::AccessoryAddress, dcc::TurnoutState, milliseconds) override {}
+    void requestEmergencyStop() override {}
+
+    void requestAccessoryInfo(dcc::AccessoryAddress address, AccessoryInfoCallback callback) override
+    {
+        QTimer::singleShot(0, this, [address, callback] {
+            callIfDefined(callback, AccessoryInfo{address, 0});
+        });
+    }
+
+    void requestTurnoutInfo(dcc::AccessoryAddress address, TurnoutInfoCallback callback) override
+    {
+        requestedTurnouts.append(address);
+
+        QTimer::singleShot(0, this, [this, address, callback] {
+            const auto state = unknownTurnouts.contains(address) ? dcc::TurnoutState::Unknown
+                             : address % 2 ? dcc::TurnoutState::Straight : dcc::TurnoutState::Branched;
+            callIfDefined(callback, TurnoutInfo{address, state});
+        });
+    }
+
+    void reportTurnoutInfo(TurnoutInfo info)
+    {
+        emit turnoutInfoChanged(std::move(info), QProtectedSignal{});
+    }
+
+    Features supportedFeatures = Feature::Turnouts | Feature::StateQueries;
+    QList<dcc::AccessoryAddress> requestedTurnouts;
+    QList<dcc::AccessoryAddress> unknownTurnouts; // like queries that timed out
+};
+
+class AccessoryStateCacheTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testWarmUp()
+    {
+        auto control = MockAccessoryControl{};
+        const auto cache = control.stateCache();
+
+        QVERIFY(cache);
+        QCOMPARE(control.stateCache(), cache);
+        QVERIFY(!cache->isWarmingUp());
+
+        cache->setWarmUpAddresses({1, 2, 3});
+        cache->setWarmUpRate(100);
+        cache->startWarmUp();
+
+        QVERIFY(cache->isWarmingUp());
+        QVERIFY(control.requestedTurnouts.isEmpty());
+
+        QVERIFY(QTest::qWaitFor([cache] {
+            return cache->turnouts().size() == 3;
+        }, milliseconds(1s).count()));
+
+        QVERIFY(!cache->isWarmingUp());
+        QCOMPARE(control.requestedTurnouts, (QList<dcc::AccessoryAddress>{1, 2, 3}));
+        QCOMPARE(cache->turnoutState(1).value_or(dcc::TurnoutState::Invalid), dcc::TurnoutState::Straight);
+        QCOMPARE(cache->turnoutState(2).value_or(dcc::TurnoutState::Invalid), dcc::TurnoutState::Branched);
+        QVERIFY(!cache->turnoutState(4).has_value());
+
+        // confirmed states are reported from memory
+        auto reportedState = dcc::TurnoutState::Invalid;
+
+        cache->requestTurnoutInfo(2, [&reportedState](TurnoutInfo info) {
+            reportedState = info.state();
+        });
+
+        QCOMPARE(reportedState, dcc::TurnoutState::Branched);
+        QCOMPARE(control.requestedTurnouts.size(), 3);
+
+        // unknown states get queried
+        cache->requestTurnoutInfo(5, [&reportedState](TurnoutInfo info) {
+            reportedState = info.state();
+        });
+
+        QCOMPARE(control.requestedTurnouts.size(), 4);
+        QVERIFY(QTest::qWaitFor([&reportedState] {
+            return reportedState == dcc::TurnoutState::Straight;
+        }, milliseconds(1s).count()));
+
+        QCOMPARE(cache->turnoutState(5).value_or(dcc::TurnoutState::Invalid), dcc::TurnoutState::Straight);
+    }
+
+    void testBroadcasts()
+    {
+        auto control = MockAccessoryControl{};
+        const auto cache = control.stateCache();
+        auto turnoutInfoChanged = QSignalSpy{cache, &AccessoryStateCache::turnoutInfoChanged};
+
+        control.reportTurnoutInfo({7, dcc::TurnoutState::Straight});
+        control.reportTurnoutInfo({7, dcc::TurnoutState::Straight});
+        QCOMPARE(turnoutInfoChanged.count(), 1);
+
+        control.reportTurnoutInfo({7, dcc::TurnoutState::Branched});
+        QCOMPARE(turnoutInfoChanged.count(), 2);
+        QCOMPARE(cache->turnoutState(7).value_or(dcc::TurnoutState::Invalid), dcc::TurnoutState::Branched);
+
+        // addresses confirmed by broadcasts are not queried again while warming up
+        cache->setWarmUpAddresses({6});
+        cache->setWarmUpRate(100);
+        cache->startWarmUp();
+
+        QVERIFY(QTest::qWaitFor([cache] {
+            return !cache->isWarmingUp();
+        }, milliseconds(1s).count()));
+
+        QCOMPARE(control.requestedTurnouts, QList<dcc::AccessoryAddress>{6});
+    }
+
+    void testUnknownStates()
+    {
+        auto control = MockAccessoryControl{};
+        control.unknownTurnouts = {9};
+
+        const auto cache = control.stateCache();
+        auto reportedState = dcc::TurnoutState::Invalid;
+
+        cache->requestTurnoutInfo(9, [&reportedState](TurnoutInfo info) {
+            reportedState = info.state();
+        });
+
+        QVERIFY(QTest::qWaitFor([&reportedState] {
+            return reportedState == dcc::TurnoutState::Unknown;
+        }, milliseconds(1s).count()));
+
+        // unknown states are not cached, so the next request asks the device again
+        QVERIFY(!cache->turnoutState(9).has_value());
+        QVERIFY(cache->turnouts().isEmpty());
+
+        cache->requestTurnoutInfo(9, {});
+        QCOMPARE(control.requestedTurnouts, (QList<dcc::AccessoryAddress>{9, 9}));
+    }
+
+    void testWithoutStateQueries()
+    {
+        auto control = MockAccessoryControl{};
+        control.supportedFeatures = AccessoryControl::Feature::Turnouts;
+
+        const auto cache = control.stateCache();
+
+        cache->setWarmUpAddresses({1, 2, 3});
+        cache->startWarmUp();
+
+        QVERIFY(!cache->isWarmingUp());
+
+        // only broadcasts feed the cache, unknown states are not queried
+        control.reportTurnoutInfo({2, dcc::TurnoutState::Branched});
+
+        auto reportedStates = QList<dcc::TurnoutState>{};
+
+        for (const auto address: {2, 5}) {
+            cache->requestTurnoutInfo(static_cast<quint16>(address), [&reportedStates](TurnoutInfo info) {
+                reportedStates.append(info.state());
+            });
+        }
+
+        QCOMPARE(reportedStates, (QList<dcc::TurnoutState>{dcc::TurnoutState::Branched, dcc::TurnoutState::Unknown}));
+        QVERIFY(control.requestedTurnouts.isEmpty());
+    }
+};
+
+} // namespace lmrs::core::tests
+
+QTEST_GUILESS_MAIN(lmrs::core::tests::AccessoryStateCacheTest)
+
+#include "tst_accessorystatecache.moc"
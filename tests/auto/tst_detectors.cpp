@@ -0,0 +1,101 @@
+#include <lmrs/core/detectors.h>
+
+#include <QtTest>
+
+namespace lmrs::core::accessory::tests {
+
+class DetectorsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testAddressKey()
+    {
+        const auto addresses = QList{
+            DetectorAddress{},
+            DetectorAddress::forCanNetwork(0x1234),
+            DetectorAddress::forCanModule(0x1234, 256),
+            DetectorAddress::forCanPort(0x1234, 256, 0),
+            DetectorAddress::forCanPort(0x1234, 256, 1),
+            DetectorAddress::forCanPort(0x1234, 257, 0),
+            DetectorAddress::forLissyModule(23),
+            DetectorAddress::forLoconetSIC(),
+            DetectorAddress::forLoconetModule(23),
+            DetectorAddress::forRBusGroup(1),
+            DetectorAddress::forRBusModule(1),
+            DetectorAddress::forRBusModule(11),
+            DetectorAddress::forRBusPort(1, 1),
+            DetectorAddress::forRBusPort(1, 8),
+        };
+
+        for (auto i = 0; i < addresses.size(); ++i) {
+            for (auto j = 0; j < addresses.size(); ++j) {
+                QCOMPARE(std::make_tuple(i, j, addresses[i] == addresses[j]), std::make_tuple(i, j, i == j));
+                QCOMPARE(std::make_tuple(i, j, addresses[i].key() == addresses[j].key()), std::make_tuple(i, j, i == j));
+            }
+        }
+
+        QCOMPARE(qHash(DetectorAddress::forCanPort(0x1234, 256, 1)),
+                 qHash(DetectorAddress::forCanPort(0x1234, 256, 1)));
+    }
+
+    void testVehicles()
+    {
+        auto info = DetectorInfo{DetectorAddress::forCanPort(0x1234, 256, 1),
+                                 DetectorInfo::Occupancy::Occupied, DetectorInfo::PowerState::On};
+
+        QCOMPARE(info.vehicleCount(), 0);
+        QVERIFY(info.vehicles().isEmpty());
+
+        info.addVehicle(1770, dcc::Direction::Forward);
+        info.addVehicle(2280, dcc::Direction::Reverse);
+        info.addVehicle(2330);
+
+        QCOMPARE(info.vehicleCount(), 3);
+        QCOMPARE(info.vehicle(1), dcc::VehicleAddress{2280});
+        QCOMPARE(info.direction(1), dcc::Direction::Reverse);
+        QCOMPARE(info.vehicles(), (QList<dcc::VehicleAddress>{1770, 2280, 2330}));
+        QCOMPARE(info.directions(), (QList{dcc::Direction::Forward, dcc::Direction::Reverse, dcc::Direction::Unknown}));
+
+        const auto copy = info;
+        QCOMPARE(copy, info);
+
+        info.addVehicle(800);
+        info.addVehicle(801, dcc::Direction::Reverse); // more vehicles than inline storage
+        info.addVehicle(802);
+
+        QCOMPARE(info.vehicleCount(), DetectorInfo::InlineVehicleCount + 2);
+        QCOMPARE(info.vehicle(4), dcc::VehicleAddress{801});
+        QCOMPARE(info.direction(4), dcc::Direction::Reverse);
+        QCOMPARE(info.vehicles(), (QList<dcc::VehicleAddress>{1770, 2280, 2330, 800, 801, 802}));
+        QCOMPARE(info.directions().size(), 6);
+        QVERIFY(copy != info);
+
+        const auto overflowCopy = info;
+        QCOMPARE(overflowCopy, info);
+
+        // slots that are not in use don't matter when comparing
+        info.clearVehicles();
+        QCOMPARE(info, (DetectorInfo{DetectorAddress::forCanPort(0x1234, 256, 1),
+                                     DetectorInfo::Occupancy::Occupied, DetectorInfo::PowerState::On}));
+    }
+
+    void testListConstructor()
+    {
+        const auto info = DetectorInfo{DetectorAddress::forLissyModule(23),
+                                       DetectorInfo::Occupancy::Occupied, DetectorInfo::PowerState::Unknown,
+                                       {3, 4}, {dcc::Direction::Forward}};
+
+        QCOMPARE(info.vehicles(), (QList<dcc::VehicleAddress>{3, 4}));
+        QCOMPARE(info.directions(), (QList{dcc::Direction::Forward, dcc::Direction::Unknown}));
+    }
+};
+
+} // namespace lmrs::core::accessory::tests
+
+QTEST_GUILESS_MAIN(lmrs::core::accessory::tests::DetectorsTest)
+
+#include "tst_detectors.moc"
@@ -0,0 +1,89 @@
+#include <lmrs/core/framekernels.h>
+#include <lmrs/esu/lp2stream.h>
+
+#include <QRandomGenerator>
+#include <QtTest>
+
+namespace lmrs::core::framekernels::tests {
+
+namespace {
+
+const char *kernelName(Kernel kernel)
+{
+    switch (kernel) {
+    case Kernel::Scalar:
+        return "scalar";
+    case Kernel::SSE2:
+        return "sse2";
+    case Kernel::AVX2:
+        return "avx2";
+    }
+
+    return "unknown";
+}
+
+QByteArray randomPayload(qsizetype size)
+{
+    auto payload = QByteArray{size, Qt::Uninitialized};
+    auto random = QRandomGenerator{static_cast<quint32>(size)};
+    random.fillRange(reinterpret_cast<quint32 *>(payload.data()), size / 4);
+
+    for (auto i = size & ~qsizetype{3}; i < size; ++i)
+        payload[i] = static_cast<char>(random.bounded(256));
+
+    return payload;
+}
+
+} // namespace
+
+class FrameKernelsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testKernels_data()
+    {
+        QTest::addColumn<Kernel>("kernel");
+        QTest::addColumn<QByteArray>("payload");
+
+        for (const auto kernel: {Kernel::Scalar, Kernel::SSE2, Kernel::AVX2}) {
+            for (const auto size: {8, 64, 512, 4 * 1024, 64 * 1024})
+                QTest::addRow("%s/%d", kernelName(kernel), size) << kernel << randomPayload(size);
+        }
+    }
+
+    void testKernels()
+    {
+        QFETCH(Kernel, kernel);
+        QFETCH(QByteArray, payload);
+
+        if (!isSupported(kernel))
+            QSKIP("This kernel is not supported on this machine");
+
+        const auto &format = esu::lp2::FrameFormat::instance();
+        const auto expectedCount = format.countIfEscapeNeeded(payload);
+
+        QCOMPARE(countEscapes(kernel, format, payload), expectedCount);
+
+        auto escaped = QByteArray{2 * payload.size(), Qt::Uninitialized};
+        escaped.truncate(escape(kernel, format, payload, escaped.data()));
+        QCOMPARE(escaped.size(), payload.size() + expectedCount);
+
+        auto expectedEscaped = QByteArray{2 * payload.size(), Qt::Uninitialized};
+        expectedEscaped.truncate(escape(Kernel::Scalar, format, payload, expectedEscaped.data()));
+        QCOMPARE(escaped, expectedEscaped);
+
+        auto unescaped = escaped;
+        unescaped.truncate(unescape(kernel, format, unescaped.data(), unescaped.size()));
+        QCOMPARE(unescaped, payload);
+    }
+};
+
+} // namespace lmrs::core::framekernels::tests
+
+QTEST_GUILESS_MAIN(lmrs::core::framekernels::tests::FrameKernelsTest)
+
+#include "tst_framekernels.moc"
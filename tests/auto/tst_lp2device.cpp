@@ -0,0 +1,76 @@
+#include <lmrs/core/transport.h>
+#include <lmrs/esu/lp2device.h>
+#include <lmrs/esu/lp2message.h>
+
+#include <QtTest>
+
+namespace lmrs::esu::lp2::tests {
+
+namespace {
+
+// responses of a LokProgrammer taken from read-programmer-info.txt,
+// requests arranged like the driver sends them when connecting
+constexpr auto s_connectTrace =
+        ">W 7f 7f 01 00 00 81\n"
+        "<R 7f 7f 02 00 01 00 81\n"
+        ">W 7f 7f 01 01 02 00 81 7f 7f 01 02 02 01 81 7f 7f 01 03 02 02 81"
+        "   7f 7f 01 04 02 03 81 7f 7f 01 05 02 04 81 7f 7f 01 06 02 05 81"
+        "   7f 7f 01 07 02 06 81 7f 7f 01 08 02 07 81 7f 7f 01 09 02 08 81\n"
+        "<R 7f 7f 02 01 05 00 97 00 00 00 81 7f 7f 02 02 05 00 57 00 00 01 81"
+        "   7f 7f 02 03 05 00 ff ff ff ff 81 7f 7f 02 04 05 00 ff ff ff ff 81"
+        "   7f 7f 02 05 05 00 5c 00 01 00 81 7f 7f 02 06 05 00 9b 3a e7 18 81"
+        "   7f 7f 02 07 05 00 86 00 01 00 81 7f 7f 02 08 05 00 f8 0c 48 20 81"
+        "   7f 7f 02 09 05 00 00 00 00 00 81\n";
+
+} // namespace
+
+class DeviceTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testReplayConnect()
+    {
+        auto buffer = QBuffer{};
+        buffer.setData(s_connectTrace);
+
+        QVERIFY(buffer.open(QBuffer::ReadOnly | QBuffer::Text));
+
+        auto recording = core::TransportRecording::read(&buffer);
+        QVERIFY(recording.has_value());
+
+        // the sequence counter is global, so restore it for the tests running after this one
+        const auto savedSequence = Request::nextSequence();
+        const auto sequenceGuard = qScopeGuard([savedSequence] {
+            while (Request::nextSequence() != static_cast<Request::Sequence>(savedSequence - 1)) {}
+        });
+
+        // the driver's sequence numbers now differ from the recorded ones, and
+        // some of them must be escaped, which changes the length of their frames
+        while (Request::nextSequence() != 0x7d) {}
+
+        auto device = Device{{}, nullptr};
+        const auto replay = new core::TransportReplay{std::move(recording).value(),
+                core::TransportReplay::Speed::Unlimited, &device};
+
+        device.setTransport(replay);
+
+        auto finished = QSignalSpy{replay, &core::TransportReplay::finished};
+
+        QVERIFY(device.connectToDevice());
+        QTRY_COMPARE(finished.count(), 1);
+        QTRY_COMPARE(device.state(), core::Device::State::Connected);
+
+        QCOMPARE(replay->mismatchCount(), 0);
+        QVERIFY(device.deviceInfo(core::DeviceInfo::ManufacturerId).isValid());
+    }
+};
+
+} // namespace lmrs::esu::lp2::tests
+
+QTEST_GUILESS_MAIN(lmrs::esu::lp2::tests::DeviceTest)
+
+#include "tst_lp2device.moc"
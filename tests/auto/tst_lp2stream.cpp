@@ -82,6 +82,52 @@ private slots:
         QCOMPARE(reader.frame(), "07 08 09"_hex);
     }
 
+    void testStreamReaderTruncatedFrame()
+    {
+        auto reader = StreamReader{{}};
+
+        reader.addData("7f 7f 01 02 7f 7f 03 80 81 04 81"_hex);
+
+        QVERIFY(reader.readNext());
+        QVERIFY(reader.isAtEnd());
+
+        QCOMPARE(reader.frameView().toByteArray(), "03 81 04"_hex);
+
+        reader.addData("7f 7f 05 06 80"_hex);
+
+        QVERIFY(!reader.readNext());
+        QVERIFY(!reader.isAtEnd());
+        QVERIFY(reader.frameView().isEmpty());
+
+        reader.addData("7f 81"_hex);
+
+        QVERIFY(reader.readNext());
+        QVERIFY(reader.isAtEnd());
+
+        QCOMPARE(reader.frame(), "05 06 7f"_hex);
+    }
+
+    void testFrameLength_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+        QTest::addColumn<qsizetype>("expectedLength");
+
+        QTest::newRow("empty") << ""_hex << qsizetype{0};
+        QTest::newRow("incomplete") << "7f 7f 01 02"_hex << qsizetype{0};
+        QTest::newRow("simple") << "7f 7f 01 02 81"_hex << qsizetype{5};
+        QTest::newRow("followed") << "7f 7f 01 02 81 7f 7f 03 81"_hex << qsizetype{5};
+        QTest::newRow("escaped") << "7f 7f 01 80 81 02 81"_hex << qsizetype{7};
+        QTest::newRow("escape-pending") << "7f 7f 01 80 81"_hex << qsizetype{0};
+    }
+
+    void testFrameLength()
+    {
+        QFETCH(QByteArray, data);
+        QFETCH(qsizetype, expectedLength);
+
+        QCOMPARE(FrameFormat::frameLength(data), expectedLength);
+    }
+
     void testStreamWriter_data()
     {
         QTest::addColumn<QByteArray>("frame");
@@ -105,6 +151,33 @@ private slots:
 
         QCOMPARE(buffer.data(), expectedStream);
     }
+
+    void testStreamWriterBatch()
+    {
+        auto buffer = QBuffer{};
+        auto writer = StreamWriter{&buffer};
+
+        writer.addFrame("01 02 03"_hex);
+        writer.addFrame("7f 80"_hex);
+
+        QCOMPARE(writer.pendingFrames(), 2);
+        QCOMPARE(writer.flush(), 0); // buffer not opened yet
+        QCOMPARE(writer.pendingFrames(), 0);
+        QVERIFY(!writer.errorString().isEmpty());
+
+        QVERIFY2(buffer.open(QBuffer::WriteOnly), qUtf8Printable(buffer.errorString()));
+
+        writer.addFrame("01 02 03"_hex);
+        writer.addFrame("7f 80"_hex);
+        writer.addFrame(""_hex);
+
+        QCOMPARE(writer.flush(), 3);
+        QCOMPARE(buffer.data(), "7f 7f 01 02 03 81 7f 7f 80 7f 80 80 81 7f 7f 81"_hex);
+
+        QCOMPARE(writer.flush(), 0);
+        QVERIFY(writer.writeFrame("04"_hex));
+        QCOMPARE(buffer.data(), "7f 7f 01 02 03 81 7f 7f 80 7f 80 80 81 7f 7f 81 7f 7f 04 81"_hex);
+    }
 };
 
 } // namespace lmrs::esu::lp2::tests
@@ -0,0 +1,134 @@
+#include <lmrs/core/metrics.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QtTest>
+
+namespace lmrs::core::metrics::tests {
+
+using namespace std::chrono_literals;
+
+class MetricsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void init()
+    {
+        setEnabled(true);
+    }
+
+    void cleanup()
+    {
+        setEnabled(false);
+    }
+
+    void testDisabled()
+    {
+        setEnabled(false);
+
+        auto counter = Counter{"counter"};
+        auto gauge = Gauge{"gauge"};
+        auto histogram = Histogram{"histogram"};
+
+        counter.increment();
+        gauge.set(7);
+        histogram.record(5ms);
+        histogram.recordSince(startTime());
+
+        QCOMPARE(startTime(), Clock::time_point{});
+        QCOMPARE(counter.value(), quint64{0});
+        QCOMPARE(gauge.value(), 0);
+        QCOMPARE(histogram.count(), quint64{0});
+    }
+
+    void testCounter()
+    {
+        auto counter = Counter{"counter"};
+
+        counter.increment();
+        counter.increment(4);
+        QCOMPARE(counter.value(), quint64{5});
+        QCOMPARE(counter.toString(), "5"_L1);
+
+        counter.reset();
+        QCOMPARE(counter.value(), quint64{0});
+    }
+
+    void testGauge()
+    {
+        auto gauge = Gauge{"gauge"};
+
+        gauge.set(3);
+        gauge.set(9);
+        gauge.set(2);
+        QCOMPARE(gauge.value(), 2);
+        QCOMPARE(gauge.peak(), 9);
+
+        gauge.reset();
+        QCOMPARE(gauge.value(), 2);
+        QCOMPARE(gauge.peak(), 2);
+    }
+
+    void testHistogram()
+    {
+        auto histogram = Histogram{"histogram"};
+
+        QCOMPARE(histogram.percentile(0.5), 0us);
+
+        for (auto i = 0; i < 98; ++i)
+            histogram.record(100us);
+
+        histogram.record(3ms);
+        histogram.record(1h); // far beyond the last bucket
+
+        QCOMPARE(histogram.count(), quint64{100});
+        QCOMPARE(histogram.bucket(7), quint64{98});      // 64us <= 100us < 128us
+        QCOMPARE(histogram.bucket(12), quint64{1});      // 2048us <= 3ms < 4096us
+        QCOMPARE(histogram.bucket(Histogram::BucketCount - 1), quint64{1});
+        QCOMPARE(histogram.maximum(), std::chrono::microseconds{1h});
+
+        QCOMPARE(histogram.percentile(0.5), 128us);
+        QCOMPARE(histogram.percentile(0.99), 4096us);
+        QCOMPARE(histogram.percentile(1.0), std::chrono::microseconds{1h});
+
+        histogram.reset();
+        QCOMPARE(histogram.count(), quint64{0});
+        QCOMPARE(histogram.maximum(), 0us);
+    }
+
+    void testSnapshot()
+    {
+        auto counter = Counter{"requests"};
+        auto histogram = Histogram{"responseTime"};
+        const auto first = Registry{"test.Device", {&counter, &histogram}};
+        const auto second = Registry{"test.Device"};
+
+        QVERIFY(Registry::registries().contains(&first));
+        QVERIFY(Registry::registries().contains(&second));
+
+        counter.increment(3);
+        histogram.record(10us);
+
+        const auto json = snapshot();
+        const auto registries = json["registries"_L1].toObject();
+
+        QCOMPARE(json["enabled"_L1].toBool(), true);
+        QVERIFY(registries.contains("test.Device"_L1));
+        QVERIFY(registries.contains("test.Device#2"_L1));
+
+        const auto device = registries["test.Device"_L1].toObject();
+        QCOMPARE(device["requests"_L1].toObject()["value"_L1].toInteger(), 3);
+        QCOMPARE(device["responseTime"_L1].toObject()["count"_L1].toInteger(), 1);
+        QCOMPARE(device["responseTime"_L1].toObject()["maxUs"_L1].toInteger(), 10);
+        QCOMPARE(device["responseTime"_L1].toObject()["buckets"_L1].toArray().size(), 5);
+    }
+};
+
+} // namespace lmrs::core::metrics::tests
+
+QTEST_GUILESS_MAIN(lmrs::core::metrics::tests::MetricsTest)
+
+#include "tst_metrics.moc"
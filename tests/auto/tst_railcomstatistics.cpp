@@ -0,0 +1,129 @@
+#include <lmrs/core/device.h>
+#include <lmrs/core/railcomstatisticsmodel.h>
+
+#include <QtTest>
+
+namespace lmrs::core::tests {
+
+class MockVehicleControl : public VehicleControl
+{
+    Q_OBJECT
+
+public:
+    using VehicleControl::VehicleControl;
+
+    Device *device() const override { return nullptr; }
+
+    void subscribe(dcc::VehicleAddress, SubscriptionType) override {}
+    void setSpeed(dcc::VehicleAddress, dcc::Speed, dcc::Direction) override {}
+    void setFunction(dcc::VehicleAddress, dcc::Function, bool) override {}
+
+    void reportRailcomSample(RailcomSample sample)
+    {
+        emit railcomSampleReceived(std::move(sample), QProtectedSignal{});
+    }
+};
+
+class RailcomStatisticsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testStatistics()
+    {
+        auto statistics = RailcomStatistics{};
+        QCOMPARE(statistics.errorRate(), 0.0);
+        QVERIFY(!statistics.qosPercentile(50).has_value());
+
+        for (auto i = 0; i < 100; ++i) {
+            const auto qos = static_cast<quint8>(i + 1);
+            const auto speed = static_cast<quint8>(i < 50 ? 20 : 40);
+            statistics.addSample({3, static_cast<quint32>(i * 90), static_cast<quint16>(i * 10), qos, speed});
+        }
+
+        QCOMPARE(statistics.sampleCount(), 100);
+        QCOMPARE(statistics.errorRate(), 0.1);
+        QCOMPARE(statistics.qosPercentile(10), 10);
+        QCOMPARE(statistics.qosPercentile(50), 50);
+        QCOMPARE(statistics.qosPercentile(100), 100);
+        QCOMPARE(statistics.speedPercentile(50), 20);
+        QCOMPARE(statistics.speedPercentile(51), 40);
+
+        const auto histogram = statistics.speedHistogram();
+        QCOMPARE(histogram[20 / RailcomStatistics::SpeedBinWidth], 50);
+        QCOMPARE(histogram[40 / RailcomStatistics::SpeedBinWidth], 50);
+    }
+
+    void testRollingWindow()
+    {
+        auto statistics = RailcomStatistics{};
+
+        for (auto i = 0; i < RailcomStatistics::Capacity; ++i)
+            statistics.addSample({3, static_cast<quint32>(i), 0, 10, {}});
+
+        // older samples drop out of the window, the newer ones report worse quality
+        for (auto i = 0; i < RailcomStatistics::Capacity / 2; ++i)
+            statistics.addSample({3, static_cast<quint32>(RailcomStatistics::Capacity + i), 0, 90, {}});
+
+        QCOMPARE(statistics.sampleCount(), RailcomStatistics::Capacity);
+        QCOMPARE(statistics.qosPercentile(50), 10);
+        QCOMPARE(statistics.qosPercentile(51), 90);
+        QVERIFY(!statistics.speedPercentile(50).has_value());
+
+        // counters going backwards restart the window
+        statistics.addSample({3, 5, 0, 50, {}});
+        QCOMPARE(statistics.sampleCount(), 1);
+        QCOMPARE(statistics.qosPercentile(10), 50);
+    }
+
+    void testModel()
+    {
+        auto model = RailcomStatisticsModel{};
+        QCOMPARE(model.rowCount(), 0);
+
+        QCOMPARE(model.addSample({7, 100, 0, 42, 20}), 0);
+        QCOMPARE(model.addSample({3, 100, 0, 17, {}}), 0);
+        QCOMPARE(model.addSample({7, 200, 0, 44, 25}), 1);
+        QCOMPARE(model.rowCount(), 2);
+
+        const auto row = model.findVehicle(7).row();
+        const auto column = [](auto column) { return static_cast<int>(column); };
+
+        QCOMPARE(row, 1);
+        QCOMPARE(model.index(row, column(RailcomStatisticsModel::Column::Samples)).data().toInt(), 2);
+        QCOMPARE(model.index(row, column(RailcomStatisticsModel::Column::QosMedian))
+                 .data(RailcomStatisticsModel::DataRole).toInt(), 42);
+
+        const auto histogram = model.index(row, 0).data(RailcomStatisticsModel::SpeedHistogramRole).value<QList<int>>();
+        QCOMPARE(histogram.size(), RailcomStatistics::SpeedBinCount);
+        QCOMPARE(histogram[20 / RailcomStatistics::SpeedBinWidth], 2);
+
+        QVERIFY(model.statistics(3));
+        QVERIFY(!model.statistics(4));
+    }
+
+    void testVehicleControl()
+    {
+        auto control = MockVehicleControl{};
+        const auto model = control.railcomStatistics();
+
+        QVERIFY(model);
+        QCOMPARE(model->rowCount(), 0);
+
+        control.reportRailcomSample({3, 100, 10, 80, 20});
+        control.reportRailcomSample({3, 200, 20, 90, 20});
+
+        QCOMPARE(model->rowCount(), 1);
+        QVERIFY(model->statistics(3));
+        QCOMPARE(model->statistics(3)->sampleCount(), 2);
+    }
+};
+
+} // namespace lmrs::core::tests
+
+QTEST_GUILESS_MAIN(lmrs::core::tests::RailcomStatisticsTest)
+
+#include "tst_railcomstatistics.moc"
@@ -0,0 +1,105 @@
+#include <lmrs/core/tracing.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QtTest>
+
+namespace lmrs::core::tests {
+
+class TracingTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testRecording()
+    {
+        const auto directory = QTemporaryDir{};
+        QVERIFY(directory.isValid());
+
+        auto z21 = TraceChannel{"lmrs.roco.z21.Client.stream"};
+        auto lp2 = TraceChannel{"lmrs.esu.lp2.Device"};
+
+        z21.recordSent("04 00 10 00"_hex); // nobody is recording yet
+
+        auto recorder = TraceRecorder{};
+        QVERIFY2(recorder.start(directory.filePath("trace.bin"_L1)), qPrintable(recorder.errorString()));
+        QCOMPARE(TraceRecorder::active(), &recorder);
+
+        lp2.recordSent("7f 7f 01 0b 00 81"_hex);
+        z21.recordSent("04 00 10 00"_hex);
+        lp2.recordReceived("7f 7f 02 0b 01 00 81"_hex);
+        z21.recordReceived("08 00 10 00 78 56 34 12"_hex);
+
+        recorder.stop();
+        QCOMPARE(TraceRecorder::active(), nullptr);
+        QCOMPARE(recorder.recordedFrames(), quint64{4});
+        QCOMPARE(recorder.droppedFrames(), quint64{0});
+
+        z21.recordSent("04 00 10 00"_hex); // the recorder is stopped
+
+        auto file = QFile{recorder.fileName()};
+        QVERIFY(file.open(QFile::ReadOnly));
+
+        auto reader = TraceReader{&file};
+        auto records = QList<TraceRecord>{};
+
+        while (reader.readNext())
+            records.append(reader.record());
+
+        QVERIFY2(!reader.hasError(), qPrintable(reader.errorString()));
+        QVERIFY(reader.startTime().isValid());
+        QCOMPARE(records.size(), 4);
+
+        QCOMPARE(records[0].channel, "lmrs.esu.lp2.Device"_L1);
+        QCOMPARE(records[0].direction, TransportEvent::Direction::Sent);
+        QCOMPARE(records[0].data, "7f 7f 01 0b 00 81"_hex);
+        QCOMPARE(records[1].channel, "lmrs.roco.z21.Client.stream"_L1);
+        QCOMPARE(records[2].direction, TransportEvent::Direction::Received);
+        QCOMPARE(records[3].channel, "lmrs.roco.z21.Client.stream"_L1);
+        QCOMPARE(records[3].data, "08 00 10 00 78 56 34 12"_hex);
+        QVERIFY(records[0].timestamp <= records[3].timestamp);
+
+        auto text = TraceReader::toText(records[2]);
+        QVERIFY2(text.endsWith(" [lmrs.esu.lp2.Device] <R 7f 7f 02 0b 01 00 81"), text.constData());
+
+        text = TransportRecording::toText(records[0].toTransportEvent());
+        QVERIFY2(text.endsWith(" >W 7f 7f 01 0b 00 81"), text.constData());
+    }
+
+    void testOverflow()
+    {
+        const auto directory = QTemporaryDir{};
+        QVERIFY(directory.isValid());
+
+        auto channel = TraceChannel{"test"};
+        auto recorder = TraceRecorder{};
+        QVERIFY2(recorder.start(directory.filePath("trace.bin"_L1), 0), qPrintable(recorder.errorString()));
+
+        // frames that don't fit into the ring buffer are dropped, instead of blocking the caller
+        channel.recordSent(QByteArray(64 * 1024, '\x55'));
+        channel.recordSent("01 02 03"_hex);
+
+        recorder.stop();
+        QCOMPARE(recorder.recordedFrames(), quint64{1});
+        QCOMPARE(recorder.droppedFrames(), quint64{1});
+    }
+
+    void testInvalidTrace()
+    {
+        auto buffer = QBuffer{};
+        buffer.setData("# ESU programmer trace\n>W 7f 7f 01 0b 00 81\n");
+        QVERIFY(buffer.open(QBuffer::ReadOnly));
+
+        auto reader = TraceReader{&buffer};
+        QVERIFY(!reader.readNext());
+        QVERIFY(reader.hasError());
+    }
+};
+
+} // namespace lmrs::core::tests
+
+QTEST_GUILESS_MAIN(lmrs::core::tests::TracingTest)
+
+#include "tst_tracing.moc"
@@ -0,0 +1,166 @@
+#include <lmrs/core/transport.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QtTest>
+
+namespace lmrs::core::tests {
+
+class TransportTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testRecordingText()
+    {
+        auto buffer = QBuffer{};
+        buffer.setData("# ESU programmer trace\n"
+                       ">W 7f 7f 01 0b 00 81\n"
+                       "<R 7f 7f 02 0b 01 00 81\n"
+                       "\n"
+                       "1500 >W 01 02\n"
+                       "  2750 <R 03\n");
+
+        QVERIFY(buffer.open(QBuffer::ReadOnly | QBuffer::Text));
+
+        const auto recording = TransportRecording::read(&buffer);
+
+        QVERIFY(recording.has_value());
+        QCOMPARE(recording->events.size(), 4);
+
+        QCOMPARE(recording->events[0].timestamp.count(), 0);
+        QCOMPARE(recording->events[0].direction, TransportEvent::Direction::Sent);
+        QCOMPARE(recording->events[0].data, "7f 7f 01 0b 00 81"_hex);
+        QCOMPARE(recording->events[1].direction, TransportEvent::Direction::Received);
+        QCOMPARE(recording->events[1].data, "7f 7f 02 0b 01 00 81"_hex);
+        QCOMPARE(recording->events[3].timestamp.count(), 2750);
+        QCOMPARE(recording->events[3].data, "03"_hex);
+
+        QCOMPARE(TransportRecording::toText(recording->events[2]), "1500 >W 01 02"_qba);
+        QVERIFY(!TransportRecording::fromText("1500 ?? 01 02").has_value());
+        QVERIFY(!TransportRecording::fromText("1500 >W xy").has_value());
+    }
+
+    void testRecorder()
+    {
+        auto device = QBuffer{};
+        device.setData("03 04"_hex);
+
+        auto recorder = TransportRecorder{&device};
+
+        QVERIFY(recorder.open(QIODevice::ReadWrite));
+        QVERIFY(device.isOpen());
+
+        QCOMPARE(recorder.write("01 02"_hex), 2);
+        QVERIFY(device.seek(0));
+        QCOMPARE(recorder.readAll(), "01 02"_hex);
+
+        const auto events = recorder.recording().events;
+
+        QCOMPARE(events.size(), 2);
+        QCOMPARE(events[0].direction, TransportEvent::Direction::Sent);
+        QCOMPARE(events[0].data, "01 02"_hex);
+        QCOMPARE(events[1].direction, TransportEvent::Direction::Received);
+        QCOMPARE(events[1].data, "01 02"_hex);
+        QVERIFY(events[0].timestamp <= events[1].timestamp);
+
+        recorder.close();
+        QVERIFY(!device.isOpen());
+    }
+
+    void testReplay_data()
+    {
+        QTest::addColumn<TransportReplay::Speed>("speed");
+
+        QTest::newRow("original") << TransportReplay::Speed::Original;
+        QTest::newRow("unlimited") << TransportReplay::Speed::Unlimited;
+    }
+
+    void testReplay()
+    {
+        QFETCH(TransportReplay::Speed, speed);
+
+        using Direction = TransportEvent::Direction;
+        using namespace std::chrono_literals;
+
+        auto replay = TransportReplay{{{
+            {0us, Direction::Sent, "01 02"_hex},
+            {1000us, Direction::Received, "81"_hex},
+            {2000us, Direction::Received, "82"_hex},
+            {3000us, Direction::Sent, "03"_hex},
+            {40000us, Direction::Received, "83"_hex},
+        }}, speed};
+
+        auto finished = QSignalSpy{&replay, &TransportReplay::finished};
+
+        QVERIFY(replay.open(QIODevice::ReadWrite));
+
+        // nothing is received before the recorded request is written
+        QTest::qWait(10);
+        QCOMPARE(replay.bytesAvailable(), 0);
+
+        QCOMPARE(replay.write("01"_hex), 1);
+        QCOMPARE(replay.write("02"_hex), 1);
+        QTRY_COMPARE(replay.bytesAvailable(), 2);
+        QCOMPARE(replay.readAll(), "81 82"_hex);
+
+        auto timer = QElapsedTimer{};
+        timer.start();
+
+        QCOMPARE(replay.write("04"_hex), 1);
+        QTRY_COMPARE(replay.bytesAvailable(), 1);
+        QCOMPARE(replay.readAll(), "83"_hex);
+
+        if (speed == TransportReplay::Speed::Original)
+            QVERIFY(timer.elapsed() >= 35);
+
+        QCOMPARE(replay.mismatchCount(), 1);
+        QVERIFY(replay.isFinished());
+        QCOMPARE(finished.count(), 1);
+    }
+
+    void testReplayAdapter()
+    {
+        class SequenceAdapter : public TransportReplay::Adapter
+        {
+        public:
+            qsizetype frameLength(QByteArrayView data) const override { return data.size() >= 2 ? 2 : 0; }
+            bool sent(QByteArrayView recorded, QByteArrayView actual) override
+            {
+                sequence = actual.front();
+                return recorded.back() == actual.back();
+            }
+
+            QByteArray received(QByteArray recorded) override { recorded[0] = sequence; return recorded; }
+
+            char sequence = 0;
+        };
+
+        using Direction = TransportEvent::Direction;
+        using namespace std::chrono_literals;
+
+        auto replay = TransportReplay{{{
+            {0us, Direction::Sent, "01 aa 02 cc"_hex},
+            {0us, Direction::Received, "01 bb"_hex},
+        }}, TransportReplay::Speed::Unlimited};
+
+        replay.setAdapter(std::make_unique<SequenceAdapter>());
+
+        QVERIFY(replay.open(QIODevice::ReadWrite));
+        QCOMPARE(replay.write("07"_hex), 1);
+        QCOMPARE(replay.write("aa 08"_hex), 2);
+        QCOMPARE(replay.write("cc"_hex), 1);
+        QTRY_COMPARE(replay.bytesAvailable(), 2);
+        QCOMPARE(replay.readAll(), "08 bb"_hex);
+        QCOMPARE(replay.mismatchCount(), 0);
+        QVERIFY(replay.isFinished());
+    }
+};
+
+} // namespace lmrs::core::tests
+
+QTEST_GUILESS_MAIN(lmrs::core::tests::TransportTest)
+
+#include "tst_transport.moc"
@@ -63,6 +63,7 @@ public:
     {
         QTimer::singleShot(0, this, [this, address, variable, value, callback] {
             m_variables[{address, variable}] = {Error::NoError, value};
+            invalidatePageCache(address, variable);
 
             switch (callIfDefined(Continuation::Proceed, callback, m_variables[{address, variable}])) {
             case core::Continuation::Retry:
@@ -173,6 +174,117 @@ private slots:
         QCOMPARE(actualSingleCallResults, expectedSingleCallResults);
     }
 
+    void testReadExtendedVariablesByPage()
+    {
+        const auto railcomPage = dcc::ExtendedPageIndex{255};
+        const auto vendorPage = dcc::ExtendedPageIndex{256};
+        const auto susiPage = dcc::SusiPageIndex{1};
+
+        const auto requestedVariables = MockVariableControl::ExtendedVariableList{
+            dcc::extendedVariable(257, railcomPage),
+            dcc::susiVariable(900, susiPage),
+            dcc::extendedVariable(257, vendorPage),
+            1,
+            dcc::extendedVariable(258, railcomPage),
+            dcc::susiVariable(901, susiPage),
+        };
+
+        const auto expectedVariables = MockVariableControl::ExtendedVariableList{
+            1,
+            dcc::extendedVariable(257, railcomPage),
+            dcc::extendedVariable(258, railcomPage),
+            dcc::extendedVariable(257, vendorPage),
+            dcc::susiVariable(900, susiPage),
+            dcc::susiVariable(901, susiPage),
+        };
+
+        const auto makeWrite = [](dcc::VariableIndex variable, dcc::VariableValue value) {
+            return QVariantList{QVariant::fromValue(dcc::VehicleAddress{0}),
+                        QVariant::fromValue(variable), QVariant::fromValue(value)};
+        };
+
+        const auto expectedWrites = QList<QVariantList>{
+            makeWrite(31, dcc::cv31(railcomPage)),
+            makeWrite(32, dcc::cv32(railcomPage)),
+            makeWrite(31, dcc::cv31(vendorPage)),
+            makeWrite(32, dcc::cv32(vendorPage)),
+            makeWrite(1021, susiPage.value),
+        };
+
+        auto control = MockVariableControl{};
+        auto actualReads = QSignalSpy{&control, &MockVariableControl::readVariableCalled};
+        auto actualWrites = QSignalSpy{&control, &MockVariableControl::writeVariableCalled};
+        auto actualVariables = MockVariableControl::ExtendedVariableList{};
+
+        control.readExtendedVariables(0, requestedVariables, [&](auto variable, auto) {
+            actualVariables.append(variable);
+            return Continuation::Proceed;
+        });
+
+        while (actualReads.size() != expectedVariables.size())
+            QVERIFY(actualReads.wait());
+
+        QCOMPARE(actualVariables, expectedVariables);
+        QCOMPARE(QList{actualWrites}, expectedWrites);
+    }
+
+    void testPageCache()
+    {
+        const auto railcomPage = dcc::ExtendedPageIndex{255};
+        const auto variable = dcc::extendedVariable(257, railcomPage);
+
+        auto control = MockVariableControl{};
+        auto actualReads = QSignalSpy{&control, &MockVariableControl::readVariableCalled};
+        auto actualWrites = QSignalSpy{&control, &MockVariableControl::writeVariableCalled};
+
+        const auto readVariable = [&control, &actualReads, variable] {
+            const auto expectedReadCount = actualReads.size() + 1;
+
+            control.readExtendedVariable(0, variable, [](auto) {
+                return Continuation::Proceed;
+            });
+
+            while (actualReads.size() != expectedReadCount)
+                QVERIFY(actualReads.wait());
+        };
+
+        // the first access selects the page
+        readVariable();
+        QCOMPARE(actualWrites.size(), 2);
+
+        // consecutive accesses on the same page skip selecting it
+        readVariable();
+        readVariable();
+        QCOMPARE(actualWrites.size(), 2);
+
+        // changing the address invalidates the cache
+        control.writeExtendedVariable(0, 1, 4, [](auto) {
+            return Continuation::Proceed;
+        });
+
+        QVERIFY(actualWrites.wait());
+        QCOMPARE(actualWrites.size(), 3);
+
+        readVariable();
+        QCOMPARE(actualWrites.size(), 5);
+
+        // the cache also can be reset explicitly
+        control.resetPageCache(0);
+        readVariable();
+        QCOMPARE(actualWrites.size(), 7);
+
+        // writing CV31 directly also selects a different page
+        control.writeVariable(0, variableIndex(dcc::VehicleVariable::ExtendedPageIndexHigh), 0, [](auto) {
+            return Continuation::Proceed;
+        });
+
+        QVERIFY(actualWrites.wait());
+        QCOMPARE(actualWrites.size(), 8);
+
+        readVariable();
+        QCOMPARE(actualWrites.size(), 10);
+    }
+
     void testContinuationHandling()
     {
         QSKIP("This test is not implemented yet"); // FIXME: implement this test
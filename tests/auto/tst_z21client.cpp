@@ -1,9 +1,11 @@
 #include <lmrs/core/logging.h>
 #include <lmrs/core/userliterals.h>
 #include <lmrs/roco/z21client.h>
+#include <lmrs/roco/z21vehiclepolling.h>
 
 #include <QNetworkDatagram>
 #include <QUdpSocket>
+#include <QtEndian>
 
 #include <QtTest>
 
@@ -30,7 +32,16 @@ const auto s_prefix_queryDetectorInfo_lissy         = "07 00 | a4 00 | 82 | 00 1
 const auto s_prefix_queryDetectorInfo_loconet_rm    = "07 00 | a4 00 | 81 | 03 f8"_hex;
 const auto s_prefix_queryDetectorInfo_loconet_sic   = "07 00 | a4 00 | 80 | 00 00"_hex;
 const auto s_prefix_queryDetectorInfo_rbus          = "05 00 | 81 00 | 01"_hex;
-const auto s_prefix_queryTrackStatus                = "07 00 | 40 00 | 21 24 | 00"_hex;
+const auto s_prefix_queryRailcom                    = "07 00 | 89 00 | 01"_hex;
+const auto s_prefix_queryVehicle                    = "09 00 | 40 00 | e3 f0"_hex;
+const auto s_prefix_requestEmergencyStop            = "06 00 | 40 00 | 80 80"_hex;
+const auto s_prefix_stopVehicle                     = "08 00 | 40 00 | 92"_hex;
+const auto s_prefix_queryTrackStatus                = "07 00 | 40 00 | 21 24 | 05"_hex;
+const auto s_prefix_setFunction                     = "0a 00 | 40 00 | e4 f8"_hex;
+const auto s_prefix_setSpeed126                     = "0a 00 | 40 00 | e4 13"_hex;
+const auto s_prefix_setTurnoutState                 = "09 00 | 40 00 | 53"_hex;
+const auto s_prefix_queryTurnoutInfo_5              = "08 00 | 40 00 | 43 | 00 04"_hex;
+const auto s_prefix_queryTurnoutInfo_7              = "08 00 | 40 00 | 43 | 00 06"_hex;
 const auto s_prefix_subscribe                       = "08 00 | 50 00"_hex;
 
 const auto s_response_detectorInfo_canOne           = "0e 00 | c4 00 | 34 12 | 00 01 | 00 | 01 | 00 01 | 00 00"
@@ -43,6 +54,8 @@ const auto s_response_queryDetectorInfo_loconet_sic = "08 00 | a4 00 | 01 | 00 4
                                                       "08 00 | a4 00 | 01 | 00 41 | 01"_hex;
 const auto s_response_detectorInfo_rbus             = "0f 00 | 80 00 | 01 | 01 02 04 08 10 20 40 80 11 22"_hex;
 const auto s_response_trackStatus_powerOn           = "08 00 | 40 00 | 62 22 | 00 | 08"_hex;
+const auto s_response_turnoutInfo_5                 = "09 00 | 40 00 | 43 | 00 04 | 01 | 46"_hex;
+const auto s_response_turnoutInfo_7                 = "09 00 | 40 00 | 43 | 00 06 | 02 | 47"_hex;
 
 template<typename T>
 auto iota(int count)
@@ -105,6 +118,34 @@ QList<T> flatten(QList<QList<T>> input)
     return result;
 }
 
+// the addresses of the drive commands in each datagram, skipping datagrams without drive commands
+QList<QList<int>> speedCommands(const QList<QVariantList> &datagrams)
+{
+    const auto prefix = "0a 00 | 40 00 | e4 13"_hex;
+    auto commands = QList<QList<int>>{};
+
+    for (const auto &arguments: datagrams) {
+        const auto datagram = arguments.first().toByteArray();
+        auto addresses = QList<int>{};
+
+        for (auto view = QByteArrayView{datagram}; view.size() >= 4; ) {
+            const auto length = qFromLittleEndian<quint16>(view.data());
+
+            if (length < 4 || length > view.size())
+                break;
+            if (view.first(length).startsWith(prefix))
+                addresses += qFromBigEndian<quint16>(view.data() + 6);
+
+            view = view.sliced(length);
+        }
+
+        if (!addresses.isEmpty())
+            commands += std::move(addresses);
+    }
+
+    return commands;
+}
+
 class FakeSocket : public QUdpSocket
 {
     Q_OBJECT
@@ -118,6 +159,7 @@ public:
     }
 
 signals:
+    void datagramReceived(QByteArray datagram);
     void messageReceived(QByteArray message);
 
 private:
@@ -128,6 +170,7 @@ private:
             auto buffer = datagram.data();
 
             qCDebug(core::logger(this), "received: %s", buffer.toHex(' ').constData());
+            emit datagramReceived(buffer);
 
             while (!buffer.isEmpty()) {
                 auto message = QByteArray{};
@@ -227,6 +270,562 @@ private slots:
         QCOMPARE(client->trackStatus(), Client::TrackStatus::PowerOn);
     }
 
+    void testSendImmediately()
+    {
+        auto client = createMockClient({
+            {"0a 00 | 40 00 | e4 13"_hex, 4, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        // let the requests sent while connecting drain first
+        auto datagramReceived = QSignalSpy{socket, &FakeSocket::datagramReceived};
+        while (datagramReceived.wait(milliseconds{200ms}.count())) {}
+        datagramReceived.clear();
+
+        // requests of the same event loop iteration share a datagram, which is sent
+        // by the next event loop iteration, instead of waiting for some timer tick
+        client->setSpeed126(3, dcc::Speed126{20}, dcc::Direction::Forward);
+        client->setSpeed126(4, dcc::Speed126{20}, dcc::Direction::Forward);
+
+        QCoreApplication::processEvents();
+        QVERIFY(!datagramReceived.isEmpty() || socket->waitForReadyRead(milliseconds{1s}.count()));
+        QCOMPARE(speedCommands(datagramReceived), (QList<QList<int>>{{3, 4}}));
+    }
+
+    void testSendRateLimit()
+    {
+        auto client = createMockClient({
+            {"0a 00 | 40 00 | e4 13"_hex, 4, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        // let the requests sent while connecting drain first
+        auto datagramReceived = QSignalSpy{socket, &FakeSocket::datagramReceived};
+        while (datagramReceived.wait(milliseconds{200ms}.count())) {}
+        datagramReceived.clear();
+
+        // with one datagram per second the test finishes long before the limit allows a fifth datagram
+        client->setSendRateLimit(1);
+        QCOMPARE(client->sendRateLimit(), 1);
+
+        // a burst of four datagrams is sent right away
+        for (auto address = 1; address <= 4; ++address) {
+            client->setSpeed126(static_cast<quint16>(address), dcc::Speed126{20}, dcc::Direction::Forward);
+
+            QVERIFY(QTest::qWaitFor([&datagramReceived, address] {
+                return speedCommands(datagramReceived).size() == address;
+            }, milliseconds(1s).count()));
+        }
+
+        // then requests accumulate until the rate limit allows the next datagram
+        for (auto address = 5; address <= 8; ++address)
+            client->setSpeed126(static_cast<quint16>(address), dcc::Speed126{20}, dcc::Direction::Forward);
+
+        QCoreApplication::processEvents();
+        QCOMPARE(client->sendQueueStatistics(Client::SendPriority::Control).depth, 4);
+        QCOMPARE(speedCommands(datagramReceived), (QList<QList<int>>{{1}, {2}, {3}, {4}}));
+
+        // lifting the limit sends them at once, merged into one datagram
+        client->setSendRateLimit(0);
+
+        QVERIFY(QTest::qWaitFor([&datagramReceived] {
+            return speedCommands(datagramReceived).size() == 5;
+        }, milliseconds(1s).count()));
+
+        QCOMPARE(speedCommands(datagramReceived), (QList<QList<int>>{{1}, {2}, {3}, {4}, {5, 6, 7, 8}}));
+    }
+
+    void testQueryTurnoutInfo()
+    {
+        // the reply for turnout 5 arrives first, it must not be consumed by the query for turnout 7
+        auto client = createMockClient({
+            {s_prefix_queryTurnoutInfo_7, 1, s_response_turnoutInfo_5 + s_response_turnoutInfo_7},
+            {s_prefix_queryTurnoutInfo_5, 1, s_response_turnoutInfo_5},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        auto actualStates = QMap<int, dcc::TurnoutState>{};
+
+        const auto storeState = [&actualStates](auto info) {
+            QVERIFY(!actualStates.contains(info.address()));
+            actualStates.insert(info.address(), info.state());
+        };
+
+        client->queryTurnoutInfo(7, storeState);
+        client->queryTurnoutInfo(5, storeState);
+
+        QVERIFY(QTest::qWaitFor([&actualStates] {
+            return actualStates.size() == 2;
+        }, milliseconds(1s).count()));
+
+        QCOMPARE(actualStates.value(5), dcc::TurnoutState::Branched);
+        QCOMPARE(actualStates.value(7), dcc::TurnoutState::Straight);
+    }
+
+    void testCoalesceVehicleCommands()
+    {
+        auto client = createMockClient({
+            {s_prefix_setSpeed126, 4, {}},
+            {s_prefix_setFunction, 4, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        auto messageReceived = QSignalSpy{socket, &FakeSocket::messageReceived};
+
+        for (auto speed = 1; speed <= 10; ++speed)
+            client->setSpeed126(3, dcc::Speed126{static_cast<quint8>(speed)}, dcc::Direction::Forward);
+
+        client->setSpeed126(4, dcc::Speed126{20}, dcc::Direction::Reverse);
+        client->enableFunction(3, 1);
+        client->disableFunction(3, 1);
+        client->toggleFunction(3, 2);
+        client->toggleFunction(3, 2);
+
+        QVERIFY(QTest::qWaitFor([&messageReceived] {
+            return messageReceived.count() >= 5;
+        }, milliseconds(1s).count()));
+
+        QTest::qWait(milliseconds(100ms).count());
+
+        const auto actualMessages = flatten<QByteArray>(messageReceived);
+        const auto expectedMessages = QList<QByteArray>{
+            "0a 00 | 40 00 | e4 13 | 00 03 | 8a | 7e"_hex,
+            "0a 00 | 40 00 | e4 13 | 00 04 | 14 | e7"_hex,
+            "0a 00 | 40 00 | e4 f8 | 00 03 | 01 | 1e"_hex,
+            "0a 00 | 40 00 | e4 f8 | 00 03 | 82 | 9d"_hex,
+            "0a 00 | 40 00 | e4 f8 | 00 03 | 82 | 9d"_hex,
+        };
+
+        QCOMPARE(actualMessages, expectedMessages);
+    }
+
+    void testVehiclePollingInterval()
+    {
+        auto client = createMockClient();
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        // let the requests sent while connecting drain first
+        QVERIFY(QTest::qWaitFor([&client] {
+            return client->sendQueueStatistics(Client::SendPriority::Normal).depth == 0;
+        }, milliseconds(1s).count()));
+
+        QTest::qWait(milliseconds(100ms).count());
+        client->resetSendQueueStatistics();
+
+        auto planner = VehiclePollingPlanner{};
+        const auto now = VehiclePollingPlanner::clock::time_point{} + 1h;
+
+        // the queries of a poll itself don't make the queue look busy
+        QCOMPARE(planner.poll(client.get(), {}, {}, now), VehiclePollingPlanner::DefaultInterval / 2);
+        QVERIFY(client->sendQueueStatistics(Client::SendPriority::Normal).depth > 0);
+
+        // polling slows down while the previous queries are still waiting
+        QCOMPARE(planner.poll(client.get(), {}, {}, now), VehiclePollingPlanner::DefaultInterval);
+
+        // and speeds up again once the queue has drained
+        QVERIFY(QTest::qWaitFor([&client] {
+            return client->sendQueueStatistics(Client::SendPriority::Normal).depth == 0;
+        }, milliseconds(1s).count()));
+
+        QCOMPARE(planner.poll(client.get(), {}, {}, now), VehiclePollingPlanner::DefaultInterval / 2);
+    }
+
+    void testSendPriorities()
+    {
+        auto client = createMockClient({
+            {s_prefix_queryVehicle, 3, {}},
+            {s_prefix_requestEmergencyStop, 0, {}},
+            {s_prefix_setSpeed126, 4, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        // let the requests sent while connecting drain first
+        QVERIFY(QTest::qWaitFor([&client] {
+            return client->sendQueueStatistics(Client::SendPriority::Normal).depth == 0;
+        }, milliseconds(1s).count()));
+
+        QTest::qWait(milliseconds(100ms).count());
+        client->resetSendQueueStatistics();
+        auto messageReceived = QSignalSpy{socket, &FakeSocket::messageReceived};
+
+        for (auto address = 1; address <= 20; ++address)
+            client->queryVehicle(static_cast<quint16>(address), {});
+
+        client->setSpeed126(3, dcc::Speed126{20}, dcc::Direction::Forward);
+        client->enableFunction(4, 1);
+        client->requestEmergencyStop();
+
+        // the emergency stop drops the drive commands queued before it, instead of restarting the vehicles
+        QCOMPARE(client->sendQueueStatistics(Client::SendPriority::Safety).depth, 1);
+        QCOMPARE(client->sendQueueStatistics(Client::SendPriority::Control).depth, 0);
+        QCOMPARE(client->sendQueueStatistics(Client::SendPriority::Normal).depth, 20);
+
+        QVERIFY(QTest::qWaitFor([&messageReceived] {
+            return messageReceived.count() >= 21;
+        }, milliseconds(1s).count()));
+
+        QTest::qWait(milliseconds(100ms).count());
+
+        const auto actualMessages = flatten<QByteArray>(messageReceived);
+
+        QCOMPARE(actualMessages.count(), 21);
+        QCOMPARE(actualMessages[0], "06 00 | 40 00 | 80 80"_hex);
+
+        for (auto i = 1; i < 21; ++i)
+            QVERIFY(actualMessages[i].startsWith(s_prefix_queryVehicle));
+
+        const auto safetyStatistics = client->sendQueueStatistics(Client::SendPriority::Safety);
+
+        QCOMPARE(safetyStatistics.depth, 0);
+        QCOMPARE(safetyStatistics.peakDepth, 1);
+        QCOMPARE(safetyStatistics.sentCount, 1U);
+
+        const auto controlStatistics = client->sendQueueStatistics(Client::SendPriority::Control);
+
+        QCOMPARE(controlStatistics.depth, 0);
+        QCOMPARE(controlStatistics.peakDepth, 2);
+        QCOMPARE(controlStatistics.sentCount, 0U);
+
+        const auto statistics = client->sendQueueStatistics(Client::SendPriority::Normal);
+
+        QCOMPARE(statistics.depth, 0);
+        QCOMPARE(statistics.peakDepth, 20);
+        QCOMPARE(statistics.sentCount, 20U);
+        QVERIFY(statistics.peakWaitTime >= statistics.averageWaitTime());
+    }
+
+    void testQueryRailcom()
+    {
+        auto client = createMockClient({
+            {s_prefix_queryRailcom, 2, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        auto messageReceived = QSignalSpy{socket, &FakeSocket::messageReceived};
+
+        // LAN_RAILCOM_GETDATA carries the vehicle address in little endian
+        client->queryRailcom(2280, {});
+
+        QVERIFY(QTest::qWaitFor([&messageReceived] {
+            return flatten<QByteArray>(messageReceived).contains("07 00 | 89 00 | 01 | e8 08"_hex);
+        }, milliseconds(1s).count()));
+    }
+
+    void testQueryRailcomWithoutData()
+    {
+        // the reply for a vehicle without RailCom data carries no address
+        auto client = createMockClient({
+            {"07 00 | 89 00 | 01 | e8 08"_hex, 0, "04 00 | 88 00"_hex},
+            {"07 00 | 89 00 | 01 | 03 00"_hex, 0, "11 00 | 88 00 | 03 00 | 01 00 00 00 | 00 00 | 00 | 00 | 00 | 00 | 00"_hex},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        auto firstQueryCalled = false;
+        auto secondQueryCalled = false;
+
+        client->queryRailcom(2280, [&firstQueryCalled](auto) { firstQueryCalled = true; });
+        client->queryRailcom(3, [&secondQueryCalled](auto) { secondQueryCalled = true; });
+
+        QTRY_VERIFY(secondQueryCalled);
+        QVERIFY(!firstQueryCalled);
+    }
+
+    void testSetTurnoutState()
+    {
+        auto client = createMockClient({
+            {s_prefix_setTurnoutState, 4, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        auto messageReceived = QSignalSpy{socket, &FakeSocket::messageReceived};
+
+        // LAN_X_SET_TURNOUT has nine bytes, which must match its length field
+        client->setTurnoutState(5, Client::Straight, true);
+
+        auto actualMessage = QByteArray{};
+
+        QVERIFY(QTest::qWaitFor([&messageReceived, &actualMessage] {
+            for (const auto &message: flatten<QByteArray>(messageReceived)) {
+                if (message.startsWith(s_prefix_setTurnoutState))
+                    actualMessage = message;
+            }
+
+            return !actualMessage.isEmpty();
+        }, milliseconds(1s).count()));
+
+        QCOMPARE(actualMessage, "09 00 | 40 00 | 53 | 00 04 | a9 | fe"_hex);
+    }
+
+    void testSetTurnoutStates()
+    {
+        auto client = createMockClient({
+            {s_prefix_setTurnoutState, 4, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        auto messageReceived = QSignalSpy{socket, &FakeSocket::messageReceived};
+
+        client->setSwitchingGroupSize(2);
+        client->setSwitchingStagger(100ms);
+
+        QCOMPARE(client->switchingGroupSize(), 2);
+        QCOMPARE(client->switchingStagger(), 100ms);
+
+        // the activation duration exceeds the stagger, so it also spaces the groups
+        client->setTurnoutStates({
+            {1, Client::Straight},
+            {2, Client::Branching},
+            {3, Client::Straight},
+            {4, Client::Branching},
+            {5, Client::Straight},
+        }, 300ms);
+
+        // each group gets deactivated before the next group gets activated
+        const auto expectedMessages = QList<QByteArray>{
+            "09 00 | 40 00 | 53 | 00 00 | a9 | fa"_hex,
+            "09 00 | 40 00 | 53 | 00 01 | a8 | fa"_hex,
+            "09 00 | 40 00 | 53 | 00 00 | a1 | f2"_hex,
+            "09 00 | 40 00 | 53 | 00 01 | a0 | f2"_hex,
+            "09 00 | 40 00 | 53 | 00 02 | a9 | f8"_hex,
+            "09 00 | 40 00 | 53 | 00 03 | a8 | f8"_hex,
+            "09 00 | 40 00 | 53 | 00 02 | a1 | f0"_hex,
+            "09 00 | 40 00 | 53 | 00 03 | a0 | f0"_hex,
+            "09 00 | 40 00 | 53 | 00 04 | a9 | fe"_hex,
+            "09 00 | 40 00 | 53 | 00 04 | a1 | f6"_hex,
+        };
+
+        // the first group is activated right away, everything else waits in the schedule
+        QCOMPARE(client->pendingTurnoutRequests(), expectedMessages.mid(2));
+
+        const auto turnoutMessages = [&messageReceived] {
+            auto messages = flatten<QByteArray>(messageReceived);
+            messages.removeIf([](const auto &message) { return !message.startsWith(s_prefix_setTurnoutState); });
+            return messages;
+        };
+
+        // the schedule is sent in exactly this order
+        QTRY_VERIFY(client->pendingTurnoutRequests().isEmpty());
+        QTRY_COMPARE(turnoutMessages(), expectedMessages);
+    }
+
+    void testSetTurnoutStatesEmergencyStop()
+    {
+        auto client = createMockClient({
+            {s_prefix_setTurnoutState, 4, {}},
+            {s_prefix_requestEmergencyStop, 0, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        auto messageReceived = QSignalSpy{socket, &FakeSocket::messageReceived};
+
+        client->setSwitchingGroupSize(1);
+        client->setSwitchingStagger(200ms);
+        client->setTurnoutStates({{1, Client::Straight}, {2, Client::Branching}, {3, Client::Straight}}, 100ms);
+        client->requestEmergencyStop();
+
+        // the first turnout already was activated, but still gets deactivated
+        QCOMPARE(client->pendingTurnoutRequests(), QList<QByteArray>{"09 00 | 40 00 | 53 | 00 00 | a1 | f2"_hex});
+        QTRY_VERIFY(client->pendingTurnoutRequests().isEmpty());
+
+        const auto turnoutMessages = [&messageReceived] {
+            auto messages = flatten<QByteArray>(messageReceived);
+            messages.removeIf([](const auto &message) { return !message.startsWith(s_prefix_setTurnoutState); });
+            return messages;
+        };
+
+        QTRY_COMPARE(turnoutMessages(), (QList<QByteArray>{
+            "09 00 | 40 00 | 53 | 00 00 | a9 | fa"_hex,
+            "09 00 | 40 00 | 53 | 00 00 | a1 | f2"_hex,
+        }));
+    }
+
+    void testStopVehicle()
+    {
+        auto client = createMockClient({
+            {s_prefix_stopVehicle, 3, {}},
+            {s_prefix_setSpeed126, 4, {}},
+            {s_prefix_setFunction, 4, {}},
+        });
+
+        QVERIFY(client);
+        QVERIFY(client->isConnected());
+
+        const auto socket = client->findChild<FakeSocket *>();
+        QVERIFY(socket);
+
+        auto messageReceived = QSignalSpy{socket, &FakeSocket::messageReceived};
+
+        client->setSpeed126(3, dcc::Speed126{20}, dcc::Direction::Forward);
+        client->enableFunction(3, 1);
+        client->setSpeed126(4, dcc::Speed126{30}, dcc::Direction::Forward);
+        client->sendRequest("08 00 | 40 00 | 92 | 00 03 | 91"_hex); // LAN_X_SET_LOCO_E_STOP
+
+        // only the commands for the stopped vehicle get dropped
+        QCOMPARE(client->sendQueueStatistics(Client::SendPriority::Control).depth, 1);
+
+        const auto vehicleMessages = [&messageReceived] {
+            auto messages = flatten<QByteArray>(messageReceived);
+            messages.removeIf([](const auto &message) {
+                return !message.startsWith(s_prefix_stopVehicle)
+                        && !message.startsWith(s_prefix_setSpeed126)
+                        && !message.startsWith(s_prefix_setFunction);
+            });
+            return messages;
+        };
+
+        QVERIFY(QTest::qWaitFor([&vehicleMessages] {
+            return vehicleMessages().count() >= 2;
+        }, milliseconds(1s).count()));
+
+        QTest::qWait(milliseconds(100ms).count());
+
+        const auto actualMessages = vehicleMessages();
+
+        QCOMPARE(actualMessages.count(), 2);
+        QCOMPARE(actualMessages[0], "08 00 | 40 00 | 92 | 00 03 | 91"_hex);
+        QCOMPARE(actualMessages[1], "0a 00 | 40 00 | e4 13 | 00 04 | 9e | 6d"_hex);
+    }
+
+    void testRBusDetectorInfo()
+    {
+        const auto info = RBusDetectorInfo{"01 | 01 02 04 08 10 20 40 80 11 22"_hex};
+        QVERIFY(info.isValid());
+
+        const auto occupancy = info.occupancyBits();
+        QCOMPARE(occupancy.count(), info.occupancy().count(true));
+
+        for (auto i = 0; i < rbus::PortsPerGroup; ++i)
+            QCOMPARE(std::make_tuple(i, occupancy.test(static_cast<size_t>(i))), std::make_tuple(i, info.occupancy().testBit(i)));
+
+        auto changedPorts = RBusDetectorInfo::Occupancy{};
+        QVERIFY(info.detectorInfo(changedPorts).isEmpty());
+
+        changedPorts.set(9).set(10).set(79);
+
+        QCOMPARE(info.detectorInfo(changedPorts), (QList<DetectorInfo>{
+                     {DetectorAddress::forRBusPort(12, 2), DetectorInfo::Occupancy::Occupied, DetectorInfo::PowerState::Unknown},
+                     {DetectorAddress::forRBusPort(12, 3), DetectorInfo::Occupancy::Free, DetectorInfo::PowerState::Unknown},
+                     {DetectorAddress::forRBusPort(20, 8), DetectorInfo::Occupancy::Free, DetectorInfo::PowerState::Unknown},
+                 }));
+    }
+
+    void testCanDetectorChanges()
+    {
+        auto client = createMockClient();
+        QVERIFY(client);
+
+        auto canDetectorInfoReceived = QSignalSpy{client.get(), &Client::canDetectorInfoReceived};
+        auto detectorInfoReceived = QSignalSpy{client.get(), &Client::detectorInfoReceived};
+        auto callbackCount = 0;
+
+        const auto callback = [&callbackCount](QList<CanDetectorInfo>) { ++callbackCount; };
+
+        client->queryCanDetectorInfo(0x5678, callback);
+        QTRY_COMPARE(callbackCount, 1);
+        QCOMPARE(canDetectorInfoReceived.count(), 1);
+        QCOMPARE(detectorInfoReceived.count(), 1);
+
+        // repeated broadcasts of an unchanged detector still answer queries, but don't report changes
+        client->queryCanDetectorInfo(0x5678, callback);
+        client->queryCanDetectorInfo(0x1234, callback);
+        QTRY_COMPARE(callbackCount, 4);
+        QCOMPARE(canDetectorInfoReceived.count(), 3);
+        QCOMPARE(detectorInfoReceived.count(), 3);
+
+        const auto lastInfo = qvariant_cast<QList<DetectorInfo>>(detectorInfoReceived.last().first());
+        QCOMPARE(lastInfo.count(), 1);
+        QCOMPARE(lastInfo.first().address(), DetectorAddress::forCanPort(0x1234, 0x100, 1));
+        QCOMPARE(lastInfo.first().vehicles(), (QList<dcc::VehicleAddress>{1770, 2280, 2330}));
+    }
+
+    void testCanDetectorReoccupied()
+    {
+        // network ids with identical bytes, so that the prefixes don't depend on byte order
+        auto client = createMockClient({
+            {"07 00 | c4 00 | 00 | 11 11"_hex, 0, s_response_detectorInfo_canOne},
+            {"07 00 | c4 00 | 00 | 22 22"_hex, 0, "0e 00 | c4 00 | 34 12 | 00 01 | 01 | 01 | 00 01 | 00 00"_hex},
+            {"07 00 | c4 00 | 00 | 33 33"_hex, 0, "0e 00 | c4 00 | 34 12 | 00 01 | 01 | 01 | 00 11 | 00 00"_hex},
+            {"07 00 | c4 00 | 00 | 44 44"_hex, 0, "0e 00 | c4 00 | 34 12 | 00 01 | 01 | 01 | 00 11 | 00 00"
+                                                  "0e 00 | c4 00 | 34 12 | 00 01 | 01 | 11 | 20 03 | 00 00"_hex},
+        });
+
+        QVERIFY(client);
+
+        auto detectorInfoReceived = QSignalSpy{client.get(), &Client::detectorInfoReceived};
+
+        const auto lastInfo = [&detectorInfoReceived] {
+            return qvariant_cast<QList<DetectorInfo>>(detectorInfoReceived.last().first()).first();
+        };
+
+        client->queryCanDetectorInfo(0x1111);
+        QTRY_COMPARE(detectorInfoReceived.count(), 2);
+        QCOMPARE(lastInfo().address(), DetectorAddress::forCanPort(0x1234, 0x100, 1));
+        QCOMPARE(lastInfo().occupancy(), DetectorInfo::Occupancy::Occupied);
+        QCOMPARE(lastInfo().vehicles(), (QList<dcc::VehicleAddress>{1770, 2280, 2330}));
+
+        // the vehicles are gone with the detector getting free
+        client->queryCanDetectorInfo(0x2222);
+        QTRY_COMPARE(detectorInfoReceived.count(), 3);
+        QCOMPARE(lastInfo().occupancy(), DetectorInfo::Occupancy::Free);
+        QCOMPARE(lastInfo().vehicles(), QList<dcc::VehicleAddress>{});
+
+        // once occupied again, the detector is only reported with its new vehicles
+        client->queryCanDetectorInfo(0x3333);
+        client->queryCanDetectorInfo(0x4444);
+        QTRY_COMPARE(detectorInfoReceived.count(), 4);
+        QCOMPARE(lastInfo().occupancy(), DetectorInfo::Occupancy::Occupied);
+        QCOMPARE(lastInfo().vehicles(), QList<dcc::VehicleAddress>{800});
+
+        QTest::qWait(milliseconds(100ms).count());
+        QCOMPARE(detectorInfoReceived.count(), 4);
+    }
+
     void testQueryDetectorInfo_data()
     {
         using dcc::Direction;
@@ -243,9 +842,16 @@ private slots:
         QTest::addColumn<QList<QList<VehicleAddress>>>("expectedVehicles");
         QTest::addColumn<QList<QList<Direction>>>("expectedDirections");
 
+        auto rbusPorts = QList<DetectorAddress>{};
+
+        for (auto module = 11; module <= 20; ++module) {
+            for (auto port = 1; port <= rbus::PortsPerModule; ++port)
+                rbusPorts += DetectorAddress::forRBusPort(static_cast<quint8>(module), static_cast<quint8>(port));
+        }
+
         QTest::newRow("rbus:group")
                 << DetectorAddress::forRBusGroup(1)
-                << QList{rbus::PortsPerGroup, DetectorAddress::forRBusGroup(1)}
+                << rbusPorts
                 << iota<int>(rbus::PortsPerGroup)
                 << (QList{rbus::PortsPerGroup, Occupancy::Free}
                     | Patch{0, Occupancy::Occupied}
@@ -365,7 +971,8 @@ private slots:
             QVERIFY(QTest::qWaitFor([&actualCanInfo] {
                 return !actualCanInfo.isEmpty();
             }, milliseconds(1s).count()));
-        } else if (genericAddress.type() == DetectorAddress::Type::RBusModule) {
+        } else if (genericAddress.type() == DetectorAddress::Type::RBusGroup
+                   || genericAddress.type() == DetectorAddress::Type::RBusModule) {
             client->queryRBusDetectorInfo(genericAddress.rbusGroup(), [&actualDetectorInfo, &actualRBusInfo](auto info) {
                 actualDetectorInfo += info;
                 actualRBusInfo += std::move(info);
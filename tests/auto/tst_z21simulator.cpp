@@ -0,0 +1,229 @@
+#include <lmrs/core/userliterals.h>
+#include <lmrs/roco/z21client.h>
+
+#include <z21simulator/simulator.h>
+
+#include <QtTest>
+
+namespace lmrs::roco::z21::tests {
+
+class SimulatorTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void init()
+    {
+        m_simulator = std::make_unique<Simulator>();
+        m_simulator->setActivity(0); // keep the state predictable
+        QVERIFY2(m_simulator->listen(QHostAddress::LocalHost, 0), qPrintable(m_simulator->errorString()));
+        QVERIFY(m_simulator->port() != 0);
+
+        m_client = std::make_unique<Client>();
+        m_client->connectToHost(Client::Subscription::Generic, QHostAddress{QHostAddress::LocalHost}, m_simulator->port());
+        QTRY_VERIFY(m_client->isConnected());
+        QCOMPARE(m_simulator->clientCount(), 1);
+    }
+
+    void cleanup()
+    {
+        m_client.reset();
+        m_simulator.reset();
+    }
+
+    void testConnection()
+    {
+        auto serialNumber = quint32{};
+        m_client->querySerialNumber([&serialNumber](quint32 value) { serialNumber = value; });
+        QTRY_COMPARE(serialNumber, m_simulator->serialNumber());
+
+        auto clientDisconnected = QSignalSpy{m_simulator.get(), &Simulator::clientDisconnected};
+        m_client->logoff();
+        QTRY_COMPARE(clientDisconnected.count(), 1);
+        QCOMPARE(m_simulator->clientCount(), 0);
+    }
+
+    void testTrackPower()
+    {
+        auto trackStatus = std::optional<Client::TrackStatus>{};
+
+        m_client->disableTrackPower([&trackStatus](auto status) { trackStatus = status; });
+        QTRY_COMPARE(trackStatus, Client::TrackStatus::PowerOff);
+        QCOMPARE(m_simulator->trackStatus(), Client::TrackStatus::PowerOff);
+
+        m_client->enableTrackPower([&trackStatus](auto status) { trackStatus = status; });
+        QTRY_COMPARE(trackStatus, Client::TrackStatus::PowerOn);
+        QCOMPARE(m_simulator->trackStatus(), Client::TrackStatus::PowerOn);
+
+        // changes made by the command station itself get broadcast
+        m_simulator->setTrackStatus(Client::TrackStatus::EmergencyStop);
+        QTRY_COMPARE(m_client->trackStatus(), Client::TrackStatus::EmergencyStop);
+    }
+
+    void testVehicle()
+    {
+        m_client->setSpeed126(1234, dcc::Speed126{42}, dcc::Direction::Reverse);
+        m_client->enableFunction(1234, 0);
+        m_client->enableFunction(1234, 13);
+
+        auto info = std::optional<VehicleInfo>{};
+        m_client->queryVehicle(1234, [&info](VehicleInfo value) { info = std::move(value); });
+        QTRY_VERIFY(info.has_value());
+
+        QCOMPARE(info->address(), dcc::VehicleAddress{1234});
+        QCOMPARE(info->protocol(), VehicleInfo::DCC126);
+        QVERIFY(std::holds_alternative<dcc::Speed126>(info->speed()));
+        QCOMPARE(std::get<dcc::Speed126>(info->speed()).count(), 42);
+        QCOMPARE(info->direction(), dcc::Direction::Reverse);
+        QCOMPARE(info->functions(), (VehicleInfo::Functions{VehicleInfo::F0, VehicleInfo::F13}));
+    }
+
+    void testTurnout()
+    {
+        m_client->setTurnoutState(7, Client::Straight, true);
+        m_client->setTurnoutState(7, Client::Straight, false);
+
+        auto info = std::optional<TurnoutInfo>{};
+        m_client->queryTurnoutInfo(7, [&info](TurnoutInfo value) { info = std::move(value); });
+        QTRY_VERIFY(info.has_value());
+
+        QCOMPARE(info->address(), dcc::AccessoryAddress{7});
+        QCOMPARE(info->state(), dcc::TurnoutState::Straight);
+    }
+
+    void testVariables()
+    {
+        auto result = std::optional<std::pair<Client::Error, quint8>>{};
+        const auto callback = [&result](Client::Error error, quint8 value) { result = {error, value}; };
+
+        m_client->readVariable(0, 8, callback);
+        QTRY_VERIFY(result.has_value());
+        QCOMPARE(result->first, Client::NoError);
+        QCOMPARE(result->second, 13);
+
+        result.reset();
+        m_client->writeVariable(3, 5, 200);
+        m_client->readVariable(3, 5, callback);
+        QTRY_VERIFY(result.has_value());
+        QCOMPARE(result->first, Client::NoError);
+        QCOMPARE(result->second, 200);
+    }
+
+    void testDetectors()
+    {
+        m_simulator->setRBusGroupCount(1);
+        m_simulator->setCanModuleCount(4);
+
+        auto detectorInfo = QSignalSpy{m_client.get(), &Client::detectorInfoReceived};
+        auto rbusInfo = std::optional<RBusDetectorInfo>{};
+        m_client->queryRBusDetectorInfo(accessory::rbus::GroupId{0}, [&rbusInfo](RBusDetectorInfo info) { rbusInfo = std::move(info); });
+        QTRY_VERIFY(rbusInfo.has_value());
+        QCOMPARE(rbusInfo->occupancy().size(), 80);
+        QTRY_COMPARE(detectorInfo.count(), 1);
+        QCOMPARE(qvariant_cast<QList<accessory::DetectorInfo>>(detectorInfo[0][0]).size(), 80);
+
+        // without any activity the next broadcast of this group doesn't report any port again
+        rbusInfo.reset();
+        m_client->queryRBusDetectorInfo(accessory::rbus::GroupId{0}, [&rbusInfo](RBusDetectorInfo info) { rbusInfo = std::move(info); });
+        QTRY_VERIFY(rbusInfo.has_value());
+        QCOMPARE(detectorInfo.count(), 1);
+
+        auto canInfo = QSignalSpy{m_client.get(), &Client::canDetectorInfoReceived};
+        m_client->queryCanDetectorInfo(accessory::can::NetworkIdAny);
+        QTRY_VERIFY(!canInfo.isEmpty());
+    }
+
+    void testPacketLoss()
+    {
+        m_simulator->resetStatistics();
+        m_simulator->setPacketLoss(1);
+
+        auto serialNumber = std::optional<quint32>{};
+        m_client->querySerialNumber([&serialNumber](quint32 value) { serialNumber = value; });
+        QTRY_VERIFY(m_simulator->statistics().droppedDatagrams > 0);
+        QVERIFY(!serialNumber.has_value());
+        QCOMPARE(m_simulator->statistics().sentDatagrams, quint64{0});
+    }
+
+    void testReconnection()
+    {
+        m_simulator->resetStatistics();
+        m_simulator->setSuspended(true);
+
+        // requests sent while the command station doesn't listen are resent later
+        auto serialNumber = std::optional<quint32>{};
+        m_client->querySerialNumber([&serialNumber](quint32 value) { serialNumber = value; });
+        QTRY_VERIFY(m_simulator->statistics().droppedDatagrams > 0);
+        QVERIFY(!serialNumber.has_value());
+
+        m_simulator->setSuspended(false);
+        QTRY_VERIFY_WITH_TIMEOUT(serialNumber.has_value(), 10000);
+        QCOMPARE(*serialNumber, m_simulator->serialNumber());
+
+        // after a power cycle the command station forgot the client and its subscriptions
+        auto clientDisconnected = QSignalSpy{m_simulator.get(), &Simulator::clientDisconnected};
+        m_simulator->restart();
+        QCOMPARE(clientDisconnected.count(), 1);
+        QCOMPARE(m_simulator->clientCount(), 0);
+
+        auto connected = QSignalSpy{m_client.get(), &Client::connected};
+        m_client->connectToHost(Client::Subscription::Generic, QHostAddress{QHostAddress::LocalHost}, m_simulator->port());
+        QTRY_COMPARE(connected.count(), 1);
+        QCOMPARE(m_simulator->clientCount(), 1);
+
+        // broadcasts reach the client again
+        m_simulator->setTrackStatus(Client::TrackStatus::EmergencyStop);
+        QTRY_COMPARE(m_client->trackStatus(), Client::TrackStatus::EmergencyStop);
+    }
+
+    void testManyVehicles()
+    {
+        constexpr auto VehicleCount = quint16{200};
+
+        const auto speed = [](quint16 address) { return dcc::Speed126{static_cast<quint8>(address % 100 + 10)}; };
+        const auto direction = [](quint16 address) { return address % 2 ? dcc::Direction::Forward : dcc::Direction::Reverse; };
+
+        m_simulator->resetStatistics();
+
+        for (auto address = quint16{1}; address <= VehicleCount; ++address)
+            m_client->setSpeed126(address, speed(address), direction(address));
+
+        // requests queued behind the rate limit get merged into fewer datagrams, but none gets lost
+        auto infos = QHash<quint16, VehicleInfo>{};
+
+        for (auto address = quint16{1}; address <= VehicleCount; ++address) {
+            m_client->queryVehicle(address, [&infos](VehicleInfo info) {
+                infos.insert(info.address().value, std::move(info));
+            });
+        }
+
+        QTRY_COMPARE_WITH_TIMEOUT(infos.size(), qsizetype{VehicleCount}, 20000);
+
+        for (auto address = quint16{1}; address <= VehicleCount; ++address) {
+            const auto info = infos.constFind(address);
+            QVERIFY(info != infos.constEnd());
+
+            QVERIFY(std::holds_alternative<dcc::Speed126>(info->speed()));
+            QCOMPARE(std::get<dcc::Speed126>(info->speed()).count(), speed(address).count());
+            QCOMPARE(info->direction(), direction(address));
+        }
+
+        const auto statistics = m_simulator->statistics();
+        QVERIFY(statistics.receivedDatagrams < statistics.receivedMessages);
+        QCOMPARE(statistics.unknownMessages, quint64{0});
+        QCOMPARE(statistics.checksumErrors, quint64{0});
+    }
+
+private:
+    std::unique_ptr<Simulator> m_simulator;
+    std::unique_ptr<Client> m_client;
+};
+
+} // namespace lmrs::roco::z21::tests
+
+QTEST_GUILESS_MAIN(lmrs::roco::z21::tests::SimulatorTest)
+
+#include "tst_z21simulator.moc"
@@ -0,0 +1,80 @@
+#include <lmrs/roco/z21vehiclepolling.h>
+
+#include <QtTest>
+
+namespace lmrs::roco::z21::tests {
+
+using namespace std::chrono_literals;
+
+class VehiclePollingTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void testPlan()
+    {
+        auto planner = VehiclePollingPlanner{};
+        auto now = VehiclePollingPlanner::clock::time_point{} + 1h;
+
+        const auto vehicles = QList<dcc::VehicleAddress>{3, 4, 5, 6, 7, 8, 9};
+
+        // vehicles the Z21 doesn't push yet get queried, starting with the current one
+        QCOMPARE(planner.plan(9, vehicles, now), (QList<dcc::VehicleAddress>{9, 3, 4, 5, 6}));
+        QCOMPARE(planner.plan(9, vehicles, now += 2s), (QList<dcc::VehicleAddress>{7, 8}));
+
+        // now that all of them got queried, the Z21 pushes changes by itself
+        QVERIFY(planner.isPushed(3));
+        QVERIFY(planner.plan(9, vehicles, now += 2s).isEmpty());
+
+        // vehicles nobody heard about for a while get refreshed
+        now += VehiclePollingPlanner::RefreshInterval;
+        planner.vehicleInfoReceived(4, now - 1s);
+        QCOMPARE(planner.plan(9, vehicles, now), (QList<dcc::VehicleAddress>{9, 7, 8, 3, 5}));
+    }
+
+    void testPushedVehicles()
+    {
+        auto planner = VehiclePollingPlanner{};
+        const auto now = VehiclePollingPlanner::clock::time_point{} + 1h;
+
+        for (quint16 address = 1; address <= VehiclePollingPlanner::MaximumPushedVehicles + 1; ++address)
+            planner.vehicleQueried(address, now);
+
+        // the Z21 forgets the oldest subscription
+        QVERIFY(!planner.isPushed(1));
+        QVERIFY(planner.isPushed(2));
+        QVERIFY(planner.needsQuery(1, now));
+        QVERIFY(!planner.needsQuery(2, now));
+
+        planner.setPushingAnyVehicle(true);
+        QVERIFY(planner.isPushed(1));
+        QVERIFY(!planner.needsQuery(1, now));
+    }
+
+    void testInterval()
+    {
+        auto planner = VehiclePollingPlanner{};
+        QCOMPARE(planner.interval(), VehiclePollingPlanner::DefaultInterval);
+
+        QCOMPARE(planner.updateInterval(3, 0us), 4000ms);
+        QCOMPARE(planner.updateInterval(0, 250ms), 8000ms);
+        QCOMPARE(planner.updateInterval(0, 250ms), VehiclePollingPlanner::MaximumInterval);
+
+        for (auto i = 0; i < 10; ++i)
+            planner.updateInterval(0, 5ms);
+
+        QCOMPARE(planner.interval(), VehiclePollingPlanner::MinimumInterval);
+
+        planner.reset();
+        QCOMPARE(planner.interval(), VehiclePollingPlanner::DefaultInterval);
+    }
+};
+
+} // namespace lmrs::roco::z21::tests
+
+QTEST_GUILESS_MAIN(lmrs::roco::z21::tests::VehiclePollingTest)
+
+#include "tst_z21vehiclepolling.moc"
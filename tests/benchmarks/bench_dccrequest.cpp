@@ -0,0 +1,127 @@
+#include <lmrs/core/dccrequest.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QtTest>
+
+#include <array>
+
+namespace lmrs::core::dcc::benchmarks {
+
+class RequestBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void benchmarkSetSpeed_data()
+    {
+        QTest::addColumn<int>("speedSteps");
+        QTest::addColumn<quint16>("address");
+
+        for (const auto speedSteps: {14, 28, 126}) {
+            QTest::addRow("%d/basic", speedSteps) << speedSteps << quint16{3};
+            QTest::addRow("%d/extended", speedSteps) << speedSteps << quint16{830};
+        }
+    }
+
+    void benchmarkSetSpeed()
+    {
+        const QFETCH(int, speedSteps);
+        const QFETCH(quint16, address);
+
+        auto request = Request{};
+
+        switch (speedSteps) {
+        case 14:
+            QBENCHMARK {
+                request = Request::setSpeed14(address, 7, Direction::Forward, true);
+            }
+
+            break;
+
+        case 28:
+            QBENCHMARK {
+                request = Request::setSpeed28(address, 14, Direction::Forward);
+            }
+
+            break;
+
+        case 126:
+            QBENCHMARK {
+                request = Request::setSpeed126(address, 63, Direction::Reverse);
+            }
+
+            break;
+        }
+
+        QCOMPARE(request.address(), address);
+    }
+
+    void benchmarkSetFunctions_data()
+    {
+        QTest::addColumn<FunctionGroup>("group");
+
+        QTest::newRow("group1") << FunctionGroup::Group1;
+        QTest::newRow("group3") << FunctionGroup::Group3;
+        QTest::newRow("group5") << FunctionGroup::Group5;
+    }
+
+    void benchmarkSetFunctions()
+    {
+        const QFETCH(FunctionGroup, group);
+
+        auto request = Request{};
+
+        QBENCHMARK {
+            request = Request::setFunctions(830, group, 0x15);
+        }
+
+        QVERIFY(request.hasExtendedAddress());
+    }
+
+    void benchmarkProgramming()
+    {
+        auto requests = std::array<Request, 3>{};
+
+        QBENCHMARK {
+            requests[0] = Request::verifyBit(29, true, 5);
+            requests[1] = Request::verifyByte(1, 3);
+            requests[2] = Request::writeByte(1, 3);
+        }
+
+        for (const auto &request: requests)
+            QVERIFY(!request.toByteArray().isEmpty());
+    }
+
+    void benchmarkParsing_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+        QTest::addColumn<int>("expectedAddress");
+
+        QTest::newRow("basic") << "03 68 6B"_hex << 3;
+        QTest::newRow("extended") << "C3 3E 78 85"_hex << 830;
+    }
+
+    void benchmarkParsing()
+    {
+        const QFETCH(QByteArray, data);
+        const QFETCH(int, expectedAddress);
+
+        const auto request = Request{data};
+        auto address = quint16{};
+
+        QBENCHMARK {
+            address = request.address();
+        }
+
+        QCOMPARE(address, expectedAddress);
+    }
+};
+
+} // namespace lmrs::core::dcc::benchmarks
+
+QTEST_GUILESS_MAIN(lmrs::core::dcc::benchmarks::RequestBenchmark)
+
+#include "bench_dccrequest.moc"
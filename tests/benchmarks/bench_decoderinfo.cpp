@@ -0,0 +1,80 @@
+#include <lmrs/core/decoderinfo.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QtTest>
+
+namespace lmrs::core::dcc::benchmarks {
+
+class DecoderInfoBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(DecoderInfo{DecoderInfo::Vehicle}.isValid());
+    }
+
+    void benchmarkVariable_data()
+    {
+        QTest::addColumn<QString>("decoderId");
+        QTest::addColumn<quint32>("variable");
+        QTest::addColumn<int>("filters");
+        QTest::addColumn<bool>("expectValid");
+
+        const auto vehicle = DecoderInfo::id(DecoderInfo::Vehicle);
+        const auto railcom = extendedVariable(257, 0, 255);
+
+        // NMRA:Vehicle defines CV2 itself, but inherits CV1 via three parents
+        QTest::newRow("vehicle/direct") << vehicle << 2U << 0 << true;
+        QTest::newRow("vehicle/inherited") << vehicle << 1U << 0 << true;
+        QTest::newRow("vehicle/no-parent") << vehicle << 1U << int{DecoderInfo::NoParent} << false;
+        QTest::newRow("vehicle/railcom") << vehicle << railcom.value << 0 << true;
+        QTest::newRow("vehicle/missing") << vehicle << 1000U << 0 << false;
+
+        // vendor decoders, extending other vendor decoders, or marking variables as unsupported
+        QTest::newRow("vendor/inherited") << QString{"99:Gold1"_L1} << 1U << 0 << true;
+        QTest::newRow("vendor/supported") << QString{"85:8"_L1} << 15U << 0 << true;
+        QTest::newRow("vendor/unsupported") << QString{"85:8"_L1} << 15U << int{DecoderInfo::NoUnsupported} << false;
+    }
+
+    void benchmarkVariable()
+    {
+        const QFETCH(QString, decoderId);
+        const QFETCH(quint32, variable);
+        const QFETCH(int, filters);
+        const QFETCH(bool, expectValid);
+
+        const auto info = DecoderInfo{decoderId};
+        QVERIFY(info.isValid());
+
+        auto result = DecoderVariable{};
+
+        QBENCHMARK {
+            result = info.variable(variable, DecoderInfo::VariableFilters::fromInt(filters));
+        }
+
+        QCOMPARE(result.isValid(), expectValid);
+    }
+
+    void benchmarkVariableIds()
+    {
+        const auto info = DecoderInfo{DecoderInfo::Vehicle};
+        auto variableIds = QList<ExtendedVariableIndex>{};
+
+        QBENCHMARK {
+            variableIds = info.variableIds();
+        }
+
+        QVERIFY(!variableIds.isEmpty());
+    }
+};
+
+} // namespace lmrs::core::dcc::benchmarks
+
+QTEST_GUILESS_MAIN(lmrs::core::dcc::benchmarks::DecoderInfoBenchmark)
+
+#include "bench_decoderinfo.moc"
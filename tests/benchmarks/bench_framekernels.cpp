@@ -0,0 +1,122 @@
+#include <lmrs/core/framekernels.h>
+#include <lmrs/esu/lp2stream.h>
+
+#include <QRandomGenerator>
+#include <QtTest>
+
+#include <cstring>
+
+namespace lmrs::core::framekernels::benchmarks {
+
+namespace {
+
+const char *kernelName(Kernel kernel)
+{
+    switch (kernel) {
+    case Kernel::Scalar:
+        return "scalar";
+    case Kernel::SSE2:
+        return "sse2";
+    case Kernel::AVX2:
+        return "avx2";
+    }
+
+    return "unknown";
+}
+
+QByteArray randomPayload(qsizetype size)
+{
+    auto payload = QByteArray{size, Qt::Uninitialized};
+    auto random = QRandomGenerator{static_cast<quint32>(size)};
+    random.fillRange(reinterpret_cast<quint32 *>(payload.data()), size / 4);
+
+    for (auto i = size & ~qsizetype{3}; i < size; ++i)
+        payload[i] = static_cast<char>(random.bounded(256));
+
+    return payload;
+}
+
+} // namespace
+
+class FrameKernelsBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void benchmarkCountEscapes_data()
+    {
+        QTest::addColumn<Kernel>("kernel");
+        QTest::addColumn<QByteArray>("payload");
+
+        for (const auto kernel: {Kernel::Scalar, Kernel::SSE2, Kernel::AVX2}) {
+            for (const auto size: {8, 64, 512, 4 * 1024, 64 * 1024})
+                QTest::addRow("%s/%d", kernelName(kernel), size) << kernel << randomPayload(size);
+        }
+    }
+
+    void benchmarkCountEscapes()
+    {
+        QFETCH(Kernel, kernel);
+        QFETCH(QByteArray, payload);
+
+        if (!isSupported(kernel))
+            QSKIP("This kernel is not supported on this machine");
+
+        const auto &format = esu::lp2::FrameFormat::instance();
+        auto count = qsizetype{};
+
+        QBENCHMARK {
+            count = countEscapes(kernel, format, payload);
+        }
+
+        QCOMPARE(count, format.countIfEscapeNeeded(payload));
+    }
+
+    void benchmarkEscape_data() { benchmarkCountEscapes_data(); }
+    void benchmarkEscape()
+    {
+        QFETCH(Kernel, kernel);
+        QFETCH(QByteArray, payload);
+
+        if (!isSupported(kernel))
+            QSKIP("This kernel is not supported on this machine");
+
+        const auto &format = esu::lp2::FrameFormat::instance();
+        auto output = QByteArray{2 * payload.size(), Qt::Uninitialized};
+
+        QBENCHMARK {
+            escape(kernel, format, payload, output.data());
+        }
+    }
+
+    void benchmarkUnescape_data() { benchmarkCountEscapes_data(); }
+    void benchmarkUnescape()
+    {
+        QFETCH(Kernel, kernel);
+        QFETCH(QByteArray, payload);
+
+        if (!isSupported(kernel))
+            QSKIP("This kernel is not supported on this machine");
+
+        const auto &format = esu::lp2::FrameFormat::instance();
+
+        auto escaped = QByteArray{2 * payload.size(), Qt::Uninitialized};
+        escaped.truncate(escape(Kernel::Scalar, format, payload, escaped.data()));
+
+        auto buffer = QByteArray{escaped.size(), Qt::Uninitialized};
+
+        QBENCHMARK {
+            std::memcpy(buffer.data(), escaped.constData(), static_cast<size_t>(escaped.size()));
+            unescape(kernel, format, buffer.data(), buffer.size());
+        }
+    }
+};
+
+} // namespace lmrs::core::framekernels::benchmarks
+
+QTEST_GUILESS_MAIN(lmrs::core::framekernels::benchmarks::FrameKernelsBenchmark)
+
+#include "bench_framekernels.moc"
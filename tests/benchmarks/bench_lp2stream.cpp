@@ -0,0 +1,114 @@
+#include <lmrs/core/userliterals.h>
+#include <lmrs/esu/lp2stream.h>
+
+#include <QBuffer>
+#include <QRandomGenerator>
+#include <QtTest>
+
+namespace lmrs::esu::lp2::benchmarks {
+
+namespace {
+
+// payloads of random bytes, which also contain frame markers that need escaping
+QList<QByteArray> randomPayloads(int count, int size)
+{
+    auto random = QRandomGenerator{static_cast<quint32>(count * size)};
+    auto payloads = QList<QByteArray>{};
+
+    for (auto i = 0; i < count; ++i) {
+        auto payload = QByteArray{size, Qt::Uninitialized};
+
+        for (auto &byte: payload)
+            byte = static_cast<char>(random.bounded(256));
+
+        payloads += std::move(payload);
+    }
+
+    return payloads;
+}
+
+QByteArray encodedStream(const QList<QByteArray> &payloads)
+{
+    auto buffer = QBuffer{};
+    buffer.open(QBuffer::WriteOnly);
+
+    auto writer = StreamWriter{&buffer};
+
+    for (auto sequence = Message::Sequence{0}; const auto &payload: payloads)
+        writer.addFrame(Message{Message::Type::Request, sequence++, 0x0b, payload}.toByteArray());
+
+    writer.flush();
+    return buffer.data();
+}
+
+} // namespace
+
+class Lp2StreamBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void benchmarkEncode_data()
+    {
+        QTest::addColumn<QList<QByteArray>>("payloads");
+
+        QTest::newRow("dcc request") << QList{"02 00 3f 80 bf"_hex};
+        QTest::newRow("1x64") << randomPayloads(1, 64);
+        QTest::newRow("1x256") << randomPayloads(1, 256);
+        QTest::newRow("32x8") << randomPayloads(32, 8);
+        QTest::newRow("32x64") << randomPayloads(32, 64);
+    }
+
+    void benchmarkEncode()
+    {
+        QFETCH(QList<QByteArray>, payloads);
+
+        auto buffer = QBuffer{};
+        QVERIFY(buffer.open(QBuffer::WriteOnly));
+
+        auto writer = StreamWriter{&buffer};
+
+        QBENCHMARK {
+            buffer.reset();
+
+            for (auto sequence = Message::Sequence{0}; const auto &payload: payloads)
+                writer.addFrame(Message{Message::Type::Request, sequence++, 0x0b, payload}.toByteArray());
+
+            writer.flush();
+        }
+
+        QCOMPARE(writer.pendingFrames(), 0);
+        QCOMPARE(buffer.data(), encodedStream(payloads));
+    }
+
+    void benchmarkDecode_data() { benchmarkEncode_data(); }
+    void benchmarkDecode()
+    {
+        QFETCH(QList<QByteArray>, payloads);
+
+        const auto stream = encodedStream(payloads);
+        auto reader = StreamReader{};
+        auto frameCount = 0;
+
+        QBENCHMARK {
+            frameCount = 0;
+            reader.addData(stream);
+
+            while (reader.readNext()) {
+                if (Message{reader.frame()}.isValid())
+                    ++frameCount;
+            }
+        }
+
+        QCOMPARE(frameCount, payloads.size());
+    }
+};
+
+} // namespace lmrs::esu::lp2::benchmarks
+
+QTEST_GUILESS_MAIN(lmrs::esu::lp2::benchmarks::Lp2StreamBenchmark)
+
+#include "bench_lp2stream.moc"
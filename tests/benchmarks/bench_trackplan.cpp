@@ -0,0 +1,107 @@
+#include <lmrs/core/detectors.h>
+#include <lmrs/core/symbolictrackplanmodel.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QLoggingCategory>
+#include <QtTest>
+
+namespace lmrs::core::benchmarks {
+
+namespace {
+
+TrackSymbol trackSymbol(TrackSymbol::Type type)
+{
+    return {type, {}, {}, {}};
+}
+
+// Fills the plan with straight tracks, with turnouts and detectors on every fourth cell.
+void populate(SymbolicTrackPlanModel *model, int size)
+{
+    model->resize(size, size);
+
+    for (auto row = 0, count = 0; row < size; ++row) {
+        for (auto column = 0; column < size; ++column, ++count) {
+            const auto index = model->index(row, column);
+            const auto address = count / 4 + 1;
+
+            if (count % 4 == 1) {
+                const auto symbol = trackSymbol(TrackSymbol::Type::LeftHandPoint);
+                model->setData(index, TrackSymbolInstance{symbol, address});
+            } else if (count % 4 == 3) {
+                const auto symbol = trackSymbol(TrackSymbol::Type::Detector);
+                const auto module = address / accessory::rbus::PortsPerModule + 1;
+                const auto port = address % accessory::rbus::PortsPerModule + 1;
+                model->setData(index, TrackSymbolInstance{symbol, QVariant::fromValue(QList{module, port})});
+            } else {
+                model->setData(index, TrackSymbolInstance{trackSymbol(TrackSymbol::Type::Straight)});
+            }
+        }
+    }
+}
+
+} // namespace
+
+class TrackPlanBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void initTestCase()
+    {
+        // findAccessories() logs the detail of every cell that doesn't match
+        QLoggingCategory::setFilterRules("lmrs.*.info=false"_L1);
+    }
+
+    void benchmarkFindAccessories_data()
+    {
+        QTest::addColumn<int>("size");
+
+        QTest::newRow("16x16") << 16;
+        QTest::newRow("64x64") << 64;
+    }
+
+    void benchmarkFindAccessories()
+    {
+        const QFETCH(int, size);
+
+        auto model = SymbolicTrackPlanModel{};
+        populate(&model, size);
+
+        const auto address = dcc::AccessoryAddress{static_cast<quint16>(size * size / 8)};
+        auto indices = QModelIndexList{};
+
+        QBENCHMARK {
+            indices = model.findAccessories(address);
+        }
+
+        QCOMPARE(indices.size(), 1);
+    }
+
+    void benchmarkFindDetectors_data() { benchmarkFindAccessories_data(); }
+    void benchmarkFindDetectors()
+    {
+        const QFETCH(int, size);
+
+        auto model = SymbolicTrackPlanModel{};
+        populate(&model, size);
+
+        // the detector of turnout 10
+        const auto address = accessory::DetectorAddress::forRBusPort(2, 3);
+        auto indices = QModelIndexList{};
+
+        QBENCHMARK {
+            indices = model.findDetectors(address);
+        }
+
+        QCOMPARE(indices.size(), 1);
+    }
+};
+
+} // namespace lmrs::core::benchmarks
+
+QTEST_GUILESS_MAIN(lmrs::core::benchmarks::TrackPlanBenchmark)
+
+#include "bench_trackplan.moc"
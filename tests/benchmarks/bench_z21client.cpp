@@ -0,0 +1,180 @@
+#include <lmrs/core/detectors.h>
+#include <lmrs/core/userliterals.h>
+#include <lmrs/roco/z21client.h>
+
+#include <QHostAddress>
+#include <QLoggingCategory>
+#include <QtEndian>
+#include <QtTest>
+
+#include <cstring>
+
+namespace lmrs::roco::z21::benchmarks {
+
+namespace {
+
+const auto s_response_trackStatus_powerOn   = "08 00 | 40 00 | 62 22 | 00 | 08"_hex;
+const auto s_response_detectorInfo_rbus     = "0f 00 | 80 00 | 01 | 01 02 04 08 10 20 40 80 11 22"_hex;
+const auto s_response_detectorInfo_canOne   = "0e 00 | c4 00 | 34 12 | 00 01 | 00 | 01 | 00 01 | 00 00"
+                                              "0e 00 | c4 00 | 34 12 | 00 01 | 01 | 12 | 1a 09 | 00 00"_hex;
+const auto s_response_turnoutInfo_5         = "09 00 | 40 00 | 43 | 00 04 | 01 | 46"_hex;
+
+// Feeds datagrams into the client without any sockets involved, and discards what the client sends.
+class DatagramFeed : public QIODevice
+{
+public:
+    using QIODevice::QIODevice;
+
+    void feed(QByteArrayView datagram)
+    {
+        m_pending = datagram;
+        emit readyRead();
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_pending.size() + QIODevice::bytesAvailable(); }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        const auto size = std::min(maxSize, qint64{m_pending.size()});
+        std::memcpy(data, m_pending.constData(), static_cast<size_t>(size));
+        m_pending = m_pending.sliced(size);
+        return size;
+    }
+
+    qint64 writeData(const char *, qint64 maxSize) override { return maxSize; }
+
+private:
+    QByteArrayView m_pending;
+};
+
+CanDetectorInfo canDetectorInfo(quint16 module, quint8 port, CanDetectorInfo::Type type, quint16 value1, quint16 value2 = 0)
+{
+    auto data = QByteArray{10, Qt::Uninitialized};
+
+    qToLittleEndian<quint16>(0x1234, data.data());
+    qToLittleEndian<quint16>(module, data.data() + 2);
+    data[4] = static_cast<char>(port);
+    data[5] = static_cast<char>(type);
+    qToLittleEndian<quint16>(value1, data.data() + 6);
+    qToLittleEndian<quint16>(value2, data.data() + 8);
+
+    return CanDetectorInfo{std::move(data)};
+}
+
+} // namespace
+
+class Z21ClientBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+private slots:
+    void initTestCase()
+    {
+        // the client reports detector changes at info level, which would dominate the measurements
+        QLoggingCategory::setFilterRules("lmrs.*.info=false"_L1);
+    }
+
+    void benchmarkMessageParsing_data()
+    {
+        QTest::addColumn<QByteArray>("datagram");
+
+        QTest::newRow("track status") << s_response_trackStatus_powerOn;
+        QTest::newRow("can detector") << s_response_detectorInfo_canOne;
+        QTest::newRow("batch") << (s_response_trackStatus_powerOn
+                                   + s_response_detectorInfo_rbus
+                                   + s_response_detectorInfo_canOne
+                                   + s_response_turnoutInfo_5).repeated(16);
+    }
+
+    void benchmarkMessageParsing()
+    {
+        QFETCH(QByteArray, datagram);
+
+        auto messageCount = 0;
+        auto xbusMessageCount = 0;
+
+        QBENCHMARK {
+            messageCount = xbusMessageCount = 0;
+
+            for (auto data = QByteArrayView{datagram}; data.size() >= 4; ++messageCount) {
+                const auto message = Message{data};
+
+                if (message.lanMessageId() == LanMessageId::XNetMessage
+                        && message.xbusMessageId() != XBusMessageId{})
+                    ++xbusMessageCount;
+
+                data = data.sliced(message.length());
+            }
+        }
+
+        QVERIFY(messageCount > 0);
+        QVERIFY(xbusMessageCount <= messageCount);
+    }
+
+    void benchmarkDispatch_data() { benchmarkMessageParsing_data(); }
+    void benchmarkDispatch()
+    {
+        QFETCH(QByteArray, datagram);
+
+        auto feed = DatagramFeed{};
+        auto client = Client{};
+
+        QVERIFY(feed.open(QIODevice::ReadWrite | QIODevice::Unbuffered));
+
+        client.setTransport(&feed);
+        client.connectToHost({}, QHostAddress{QHostAddress::LocalHost});
+        QVERIFY(client.isConnected());
+
+        QBENCHMARK {
+            feed.feed(datagram);
+        }
+
+        QCOMPARE(feed.bytesAvailable(), 0);
+    }
+
+    void benchmarkMergeCanDetectorInfo_data()
+    {
+        QTest::addColumn<QList<CanDetectorInfo>>("infoList");
+
+        for (const auto moduleCount: {1, 4, 16, 64}) {
+            auto infoList = QList<CanDetectorInfo>{};
+
+            for (auto module = 0; module < moduleCount; ++module) {
+                for (auto port = 0; port < 8; ++port) {
+                    const auto m = static_cast<quint16>(module);
+                    const auto p = static_cast<quint8>(port);
+
+                    infoList += canDetectorInfo(m, p, CanDetectorInfo::Type::Occupancy, 0x1100);
+                    infoList += canDetectorInfo(m, p, CanDetectorInfo::Type::VehicleSet1, 0x0003, 0x8004);
+                    infoList += canDetectorInfo(m, p, CanDetectorInfo::Type::VehicleSet2, 0x0005, 0x0000);
+                }
+            }
+
+            QTest::addRow("%d modules", moduleCount) << infoList;
+        }
+    }
+
+    void benchmarkMergeCanDetectorInfo()
+    {
+        QFETCH(QList<CanDetectorInfo>, infoList);
+
+        auto merged = QList<accessory::DetectorInfo>{};
+
+        QBENCHMARK {
+            merged = CanDetectorInfo::merge(infoList);
+        }
+
+        QCOMPARE(merged.size(), infoList.size() / 3);
+    }
+};
+
+} // namespace lmrs::roco::z21::benchmarks
+
+QTEST_GUILESS_MAIN(lmrs::roco::z21::benchmarks::Z21ClientBenchmark)
+
+#include "bench_z21client.moc"
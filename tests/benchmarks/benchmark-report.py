@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# encoding=utf8
+
+from argparse import ArgumentParser
+from datetime import datetime, timezone
+from xml.etree import ElementTree
+
+import json
+import os.path
+import platform
+import sys
+
+def read_results(filename):
+    """
+    Collect the benchmark results from the XML report of a QtTest executable.
+    """
+
+    benchmark = os.path.splitext(os.path.basename(filename))[0]
+    root = ElementTree.parse(filename).getroot()
+
+    for function in root.iter('TestFunction'):
+        for result in function.iter('BenchmarkResult'):
+            iterations = int(result.get('iterations', '1'))
+            value = float(result.get('value'))
+
+            yield {
+                'benchmark': benchmark,
+                'function': function.get('name'),
+                'tag': result.get('tag', ''),
+                'metric': result.get('metric'),
+                'value': value,
+                'iterations': iterations,
+            }
+
+
+def result_key(result):
+    return result['benchmark'], result['function'], result['tag'], result['metric']
+
+
+def compare_results(baseline, report, threshold):
+    """
+    Print the results that got slower than the baseline by more than threshold percent.
+    """
+
+    baseline = {result_key(result): result['value'] for result in baseline['results']}
+    regressions = 0
+
+    for result in report['results']:
+        previous = baseline.get(result_key(result))
+
+        if not previous:
+            continue
+
+        change = 100 * (result['value'] - previous) / previous
+
+        if change > threshold:
+            print(f'REGRESSION: {result["benchmark"]}::{result["function"]}({result["tag"]}): '
+                  f'{previous:g} -> {result["value"]:g} {result["metric"]} ({change:+.1f}%)', file=sys.stderr)
+            regressions += 1
+
+    return regressions
+
+
+def main():
+    parser = ArgumentParser(description='Convert QtTest benchmark results into JSON.')
+    parser.add_argument('--output', help='where to write the JSON report, instead of stdout')
+    parser.add_argument('--version', default='', help='the version of the benchmarked build')
+    parser.add_argument('--baseline', help='a previous JSON report to compare with')
+    parser.add_argument('--threshold', type=float, default=10, help='tolerated slowdown in percent')
+    parser.add_argument('results', nargs='+', help='XML reports written by the benchmarks')
+    args = parser.parse_args()
+
+    report = {
+        'version': args.version,
+        'timestamp': datetime.now(timezone.utc).isoformat(timespec='seconds'),
+        'machine': platform.machine(),
+        'system': platform.platform(),
+        'results': [result for filename in args.results for result in read_results(filename)],
+    }
+
+    if args.output:
+        with open(args.output, 'w') as output:
+            json.dump(report, output, indent=2)
+
+        print(f'Wrote {len(report["results"])} benchmark results to {args.output}')
+    else:
+        json.dump(report, sys.stdout, indent=2)
+
+    if args.baseline:
+        with open(args.baseline) as baseline:
+            if compare_results(json.load(baseline), report, args.threshold):
+                raise SystemExit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,93 @@
+#include <lmrs/core/logging.h>
+#include <lmrs/core/staticinit.h>
+#include <lmrs/core/tracing.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+
+namespace lmrs::tracedump {
+
+class Application : public core::StaticInit<Application, core::logging::StaticInit<QCoreApplication>>
+{
+public:
+    using StaticInit::StaticInit;
+    static void staticConstructor();
+
+    int run();
+};
+
+void Application::staticConstructor()
+{
+    setApplicationName("Trace Dump"_L1);
+    setApplicationVersion(LMRS_VERSION_STRING);
+    setOrganizationDomain("taschenorakel.de"_L1);
+}
+
+int Application::run()
+{
+    const auto channelOption = QCommandLineOption{{"c"_L1, "channel"_L1}, tr("Only print the frames of <channel>, "
+                                                                            "as recording that can be replayed."), tr("channel")};
+    const auto listOption = QCommandLineOption{{"l"_L1, "list-channels"_L1}, tr("List the channels of the trace.")};
+
+    auto parser = QCommandLineParser{};
+    parser.setApplicationDescription(tr("Renders the binary protocol traces written when LMRS_TRACE is set."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOptions({channelOption, listOption});
+    parser.addPositionalArgument("trace"_L1, tr("The trace file to read."));
+    parser.process(*this);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(EXIT_FAILURE);
+
+    auto input = QFile{parser.positionalArguments().constFirst()};
+
+    if (!input.open(QFile::ReadOnly)) {
+        qCCritical(logger(this), "Could not read %ls: %ls", qUtf16Printable(input.fileName()), qUtf16Printable(input.errorString()));
+        return EXIT_FAILURE;
+    }
+
+    auto output = QFile{};
+
+    if (!output.open(stdout, QFile::WriteOnly | QFile::Text)) {
+        qCCritical(logger(this), "Could not write to standard output: %ls", qUtf16Printable(output.errorString()));
+        return EXIT_FAILURE;
+    }
+
+    const auto channel = parser.value(channelOption);
+    auto reader = core::TraceReader{&input};
+
+    while (reader.readNext()) {
+        const auto &record = reader.record();
+
+        if (parser.isSet(listOption))
+            continue;
+
+        if (channel.isEmpty())
+            output.write(core::TraceReader::toText(record) + '\n');
+        else if (record.channel == channel)
+            output.write(core::TransportRecording::toText(record.toTransportEvent()) + '\n');
+    }
+
+    if (parser.isSet(listOption)) {
+        for (const auto &name: reader.channels())
+            output.write(name.toUtf8() + '\n');
+    }
+
+    if (reader.hasError()) {
+        qCCritical(logger(this), "Could not decode %ls: %ls", qUtf16Printable(input.fileName()), qUtf16Printable(reader.errorString()));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace lmrs::tracedump
+
+int main(int argc, char *argv[]); // actually qMain() on Windows
+int main(int argc, char *argv[])
+{
+    return lmrs::tracedump::Application{argc, argv}.run();
+}
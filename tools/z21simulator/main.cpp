@@ -0,0 +1,118 @@
+#include "simulator.h"
+
+#include <lmrs/core/logging.h>
+#include <lmrs/core/staticinit.h>
+#include <lmrs/core/userliterals.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTimer>
+
+namespace lmrs::roco::z21 {
+
+using namespace std::chrono_literals;
+
+class Application : public core::StaticInit<Application, core::logging::StaticInit<QCoreApplication>>
+{
+public:
+    using StaticInit::StaticInit;
+    static void staticConstructor();
+
+    int run();
+
+private:
+    void reportStatistics();
+
+    Simulator m_simulator;
+    Simulator::Statistics m_previousStatistics;
+};
+
+void Application::staticConstructor()
+{
+    setApplicationName("Z21 Simulator"_L1);
+    setApplicationVersion(LMRS_VERSION_STRING);
+    setOrganizationDomain("taschenorakel.de"_L1);
+}
+
+int Application::run()
+{
+    const auto addressOption = QCommandLineOption{{"a"_L1, "address"_L1}, tr("Listen on <address>."), tr("address"), "127.0.0.1"_L1};
+    const auto portOption = QCommandLineOption{{"p"_L1, "port"_L1}, tr("Listen on UDP <port>."), tr("port"), QString::number(Client::DefaultPort)};
+    const auto vehiclesOption = QCommandLineOption{"vehicles"_L1, tr("Simulate <count> driving vehicles."), tr("count"), "100"_L1};
+    const auto rbusOption = QCommandLineOption{"rbus-groups"_L1, tr("Simulate <count> RBus groups, up to two."), tr("count"), "2"_L1};
+    const auto canOption = QCommandLineOption{"can-modules"_L1, tr("Simulate <count> CAN occupancy detectors."), tr("count"), "16"_L1};
+    const auto loconetOption = QCommandLineOption{"loconet-reports"_L1, tr("Simulate <count> LocoNet report addresses."), tr("count"), "64"_L1};
+    const auto intervalOption = QCommandLineOption{"interval"_L1, tr("Change simulated state every <ms> milliseconds."), tr("ms"), "1000"_L1};
+    const auto activityOption = QCommandLineOption{"activity"_L1, tr("Change this <share> of vehicles and detectors per interval."), tr("share"), "0.01"_L1};
+    const auto lossOption = QCommandLineOption{"loss"_L1, tr("Lose datagrams with this <probability>."), tr("probability"), "0"_L1};
+    const auto latencyOption = QCommandLineOption{"latency"_L1, tr("Delay sent datagrams by <ms> milliseconds."), tr("ms"), "0"_L1};
+    const auto jitterOption = QCommandLineOption{"jitter"_L1, tr("Delay sent datagrams by up to <ms> additional milliseconds."), tr("ms"), "0"_L1};
+    const auto seedOption = QCommandLineOption{"seed"_L1, tr("Initialize the random generator with <seed>."), tr("seed"), "1"_L1};
+    const auto statisticsOption = QCommandLineOption{"statistics"_L1, tr("Report traffic every <seconds>, or never if zero."), tr("seconds"), "10"_L1};
+
+    auto parser = QCommandLineParser{};
+    parser.setApplicationDescription(tr("A Z21 command station on the local network, for testing without hardware."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOptions({addressOption, portOption, vehiclesOption, rbusOption, canOption, loconetOption,
+                       intervalOption, activityOption, lossOption, latencyOption, jitterOption,
+                       seedOption, statisticsOption});
+    parser.process(*this);
+
+    const auto address = QHostAddress{parser.value(addressOption)};
+
+    if (address.isNull()) {
+        qCCritical(logger(this), "Invalid address: %ls", qUtf16Printable(parser.value(addressOption)));
+        return EXIT_FAILURE;
+    }
+
+    m_simulator.setVehicleCount(parser.value(vehiclesOption).toInt());
+    m_simulator.setRBusGroupCount(parser.value(rbusOption).toInt());
+    m_simulator.setCanModuleCount(parser.value(canOption).toInt());
+    m_simulator.setLoconetReportCount(parser.value(loconetOption).toInt());
+    m_simulator.setActivityInterval(std::chrono::milliseconds{parser.value(intervalOption).toInt()});
+    m_simulator.setActivity(parser.value(activityOption).toDouble());
+    m_simulator.setPacketLoss(parser.value(lossOption).toDouble());
+    m_simulator.setLatency(std::chrono::milliseconds{parser.value(latencyOption).toInt()},
+                           std::chrono::milliseconds{parser.value(jitterOption).toInt()});
+    m_simulator.setRandomSeed(parser.value(seedOption).toUInt());
+
+    if (!m_simulator.listen(address, parser.value(portOption).toUShort())) {
+        qCCritical(logger(this), "Cannot listen on %ls: %ls", qUtf16Printable(address.toString()),
+                   qUtf16Printable(m_simulator.errorString()));
+        return EXIT_FAILURE;
+    }
+
+    auto statisticsTimer = QTimer{};
+
+    if (const auto interval = parser.value(statisticsOption).toInt(); interval > 0) {
+        connect(&statisticsTimer, &QTimer::timeout, this, &Application::reportStatistics);
+        statisticsTimer.start(std::chrono::seconds{interval});
+    }
+
+    return exec();
+}
+
+void Application::reportStatistics()
+{
+    const auto current = m_simulator.statistics();
+    const auto previous = std::exchange(m_previousStatistics, current);
+
+    qCInfo(logger(this), "%lld clients; received %llu datagrams with %llu messages (%llu unknown); "
+                         "sent %llu datagrams with %llu messages; dropped %llu datagrams",
+           static_cast<qint64>(m_simulator.clientCount()),
+           current.receivedDatagrams - previous.receivedDatagrams,
+           current.receivedMessages - previous.receivedMessages,
+           current.unknownMessages - previous.unknownMessages,
+           current.sentDatagrams - previous.sentDatagrams,
+           current.sentMessages - previous.sentMessages,
+           current.droppedDatagrams - previous.droppedDatagrams);
+}
+
+} // namespace lmrs::roco::z21
+
+int main(int argc, char *argv[]); // actually qMain() on Windows
+int main(int argc, char *argv[])
+{
+    return lmrs::roco::z21::Application{argc, argv}.run();
+}
@@ -0,0 +1,1171 @@
+#include "simulator.h"
+
+#include <lmrs/core/logging.h>
+#include <lmrs/core/typetraits.h>
+
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QtEndian>
+
+#include <algorithm>
+#include <array>
+#include <map>
+
+namespace lmrs::roco::z21 {
+
+namespace {
+
+using namespace std::chrono_literals;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto MaximumDatagramSize = qsizetype{1472};   // what fits into an ethernet frame
+constexpr auto MaximumVehicleSubscriptions = 16;        // per client, like real hardware
+constexpr auto RBusGroupSize = 10;                      // bytes per group, eight ports per byte
+constexpr auto MaximumRBusGroups = 2;
+constexpr auto CanPortsPerModule = 8;
+constexpr auto CanNetworkId = quint16{0x1234};
+
+// LAN requests handled by the simulator; some of them share their id with a reply
+enum class LanRequest : quint16 {
+    GetSerialNumber = 0x10,
+    GetLockState = 0x18,
+    GetHardwareInfo = 0x1a,
+    Logoff = 0x30,
+    XNetMessage = 0x40,
+    SetBroadcastFlags = 0x50,
+    GetBroadcastFlags = 0x51,
+    GetRBusData = 0x81,
+    ProgramRBusModule = 0x82,
+    GetSystemState = 0x85,
+    GetRailcomData = 0x89,
+    GetLoconetDetector = 0xa4,
+    GetCanDetector = 0xc4,
+};
+
+struct Endpoint
+{
+    QHostAddress address;
+    quint16 port = 0;
+
+    [[nodiscard]] bool operator==(const Endpoint &) const noexcept = default;
+};
+
+[[nodiscard]] size_t qHash(const Endpoint &endpoint, size_t seed = 0) noexcept
+{
+    return qHashMulti(seed, endpoint.address, endpoint.port);
+}
+
+struct ClientState
+{
+    Client::Subscriptions subscriptions = {};
+    QList<quint16> vehicles = {};       // vehicles recently queried, their changes get reported
+    Clock::time_point lastSeen = {};
+    QByteArray outbox = {};             // messages waiting for the next datagram
+
+    [[nodiscard]] bool isSubscribed(quint16 address) const { return vehicles.contains(address); }
+};
+
+struct VehicleState
+{
+    quint8 speedSteps = VehicleInfo::DCC126;
+    quint8 speed = 0x80;                // like DB3 of LAN_X_LOCO_INFO: direction flag and speed
+    quint32 functions = 0;              // bit n is the state of function Fn
+    quint32 railcomReceiveCount = 0;
+    quint16 railcomErrorCount = 0;
+    QHash<quint16, quint8> variables = {};
+};
+
+struct CanPortState
+{
+    bool occupied = false;
+    quint16 vehicle = 0;                // including the direction flags of VehicleSet1
+};
+
+[[nodiscard]] QByteArray lanMessage(quint16 id, QByteArrayView data = {})
+{
+    auto message = QByteArray{4 + data.size(), Qt::Uninitialized};
+    qToLittleEndian(static_cast<quint16>(message.size()), message.data());
+    qToLittleEndian(id, message.data() + 2);
+    std::copy(data.begin(), data.end(), message.begin() + 4);
+    return message;
+}
+
+[[nodiscard]] QByteArray lanMessage(LanMessageId id, QByteArrayView data = {})
+{
+    return lanMessage(core::value(id), data);
+}
+
+// wraps the XBus header and data into a LAN_X message, and adds the checksum
+[[nodiscard]] QByteArray xbusMessage(std::initializer_list<quint8> data)
+{
+    auto checksum = quint8{0};
+    auto payload = QByteArray{};
+    payload.reserve(static_cast<qsizetype>(data.size()) + 1);
+
+    for (const auto byte: data) {
+        payload += static_cast<char>(byte);
+        checksum = static_cast<quint8>(checksum ^ byte);
+    }
+
+    payload += static_cast<char>(checksum);
+    return lanMessage(LanMessageId::XNetMessage, payload);
+}
+
+[[nodiscard]] quint8 highByte(quint16 value) { return static_cast<quint8>(value >> 8); }
+[[nodiscard]] quint8 lowByte(quint16 value) { return static_cast<quint8>(value & 0xff); }
+
+[[nodiscard]] quint8 bcd(int value)
+{
+    return static_cast<quint8>(((value / 10) << 4) | (value % 10));
+}
+
+[[nodiscard]] quint8 defaultVariable(quint16 variable)
+{
+    switch (variable) {
+    case 1: return 3;       // primary address
+    case 7: return 10;      // version
+    case 8: return 13;      // manufacturer: public domain and do-it-yourself decoders
+    case 29: return 6;      // 28 speed steps, analog operation
+    }
+
+    return 0;
+}
+
+} // namespace
+
+class Simulator::Private : public core::PrivateObject<Simulator>
+{
+public:
+    using PrivateObject::PrivateObject;
+
+    void readDatagrams();
+    void processDatagram(const Endpoint &sender, QByteArrayView datagram);
+    bool processMessage(const Endpoint &sender, ClientState &client, Message message);
+    bool processXBusMessage(ClientState &client, Message message);
+
+    void reply(ClientState &client, QByteArray message);
+    template<typename Predicate> void broadcast(const QByteArray &message, Predicate &&accepts,
+                                                const ClientState *requester = nullptr);
+    void broadcastGeneric(const QByteArray &message, const ClientState *requester = nullptr);
+    void broadcastVehicle(quint16 address, const ClientState *requester = nullptr);
+    void broadcastRailcom(quint16 address);
+
+    void flush();
+    void sendDatagram(const Endpoint &receiver, QByteArray datagram);
+    void sendDelayedDatagrams();
+
+    void updateTrackStatus(Client::TrackStatus status, ClientState *requester = nullptr);
+    void subscribeVehicle(ClientState &client, quint16 address);
+    void disconnectClient(const Endpoint &endpoint);
+
+    void simulateActivity();
+    void checkClients();
+
+    [[nodiscard]] bool dropDatagram();
+    [[nodiscard]] int changeCount(qsizetype count) const;
+
+    [[nodiscard]] QByteArray statusChangedMessage() const;
+    [[nodiscard]] QByteArray trackStatusBroadcast() const;
+    [[nodiscard]] QByteArray systemStateMessage() const;
+    [[nodiscard]] QByteArray vehicleInfoMessage(quint16 address) const;
+    [[nodiscard]] QByteArray railcomMessage(quint16 address) const;
+    [[nodiscard]] QByteArray rbusMessage(int group) const;
+    [[nodiscard]] QByteArray canDetectorMessages(qsizetype index) const;
+    [[nodiscard]] QByteArray loconetDetectorMessage(qsizetype index) const;
+
+    QUdpSocket socket;
+    QTimer activityTimer;
+    QTimer housekeepingTimer;
+    QTimer latencyTimer;
+    QRandomGenerator random;
+
+    QHash<Endpoint, ClientState> clients;
+    std::multimap<Clock::time_point, std::pair<Endpoint, QByteArray>> delayedDatagrams;
+
+    QHash<quint16, VehicleState> vehicles;
+    QHash<quint16, quint8> turnouts;
+    QHash<quint16, quint8> accessories;
+    QHash<quint16, quint8> programmingTrack;
+    std::array<std::array<quint8, RBusGroupSize>, MaximumRBusGroups> rbus = {};
+    QList<CanPortState> canPorts;
+    QList<bool> loconetReports;
+
+    int vehicleCount = 0;
+    int rbusGroupCount = 0;
+    double activity = 0.01;
+    double packetLoss = 0;
+    std::chrono::milliseconds latency = 0ms;
+    std::chrono::milliseconds jitter = 0ms;
+    std::chrono::milliseconds clientTimeout = 60s;
+    Client::TrackStatus trackStatus = Client::TrackStatus::PowerOn;
+    quint32 serialNumber = 123456;
+    quint16 nextRailcomVehicle = 1;
+    bool suspended = false;
+
+    Statistics statistics;
+};
+
+void Simulator::Private::readDatagrams()
+{
+    while (socket.hasPendingDatagrams()) {
+        const auto datagram = socket.receiveDatagram();
+
+        if (suspended) {
+            ++statistics.droppedDatagrams;
+            continue;
+        }
+
+        ++statistics.receivedDatagrams;
+
+        if (dropDatagram()) {
+            ++statistics.droppedDatagrams;
+            continue;
+        }
+
+        processDatagram({datagram.senderAddress(), static_cast<quint16>(datagram.senderPort())}, datagram.data());
+    }
+
+    flush();
+}
+
+void Simulator::Private::processDatagram(const Endpoint &sender, QByteArrayView datagram)
+{
+    auto client = clients.find(sender);
+
+    if (client == clients.end()) {
+        qCInfo(logger(), "Client %ls:%d connected", qUtf16Printable(sender.address.toString()), sender.port);
+        client = clients.insert(sender, {});
+        emit q()->clientConnected(sender.address, sender.port);
+    }
+
+    client->lastSeen = Clock::now();
+
+    while (datagram.size() >= 4) {
+        const auto message = Message{datagram};
+        const auto length = message.length();
+
+        if (length < 4 || length > datagram.size()) {
+            qCWarning(logger(), "Ignoring malformed message: %s", datagram.toByteArray().toHex(' ').constData());
+            break;
+        }
+
+        ++statistics.receivedMessages;
+
+        if (!processMessage(sender, client.value(), Message{datagram.first(length)}))
+            ++statistics.unknownMessages;
+
+        if (!clients.contains(sender))
+            break; // logged off
+
+        datagram = datagram.sliced(length);
+    }
+}
+
+bool Simulator::Private::processMessage(const Endpoint &sender, ClientState &client, Message message)
+{
+    const auto data = message.lanData();
+    const auto dataLength = message.lanMessageLength();
+
+    switch (static_cast<LanRequest>(message.lanMessageId())) {
+    case LanRequest::GetSerialNumber: {
+        auto serial = std::array<char, 4>{};
+        qToLittleEndian(serialNumber, serial.data());
+        reply(client, lanMessage(LanMessageId::GetSerialNumber, serial));
+        return true;
+    }
+
+    case LanRequest::GetLockState:
+        reply(client, lanMessage(LanMessageId::GetLockState, std::array<char, 1>{}));
+        return true;
+
+    case LanRequest::GetHardwareInfo: {
+        auto info = std::array<char, 8>{};
+        qToLittleEndian<quint32>(core::value(Client::HardwareType::Z21Start), info.data());
+        info[4] = static_cast<char>(bcd(43)); // firmware 1.43
+        info[5] = static_cast<char>(bcd(1));
+        reply(client, lanMessage(LanMessageId::GetHardwareInfo, info));
+        return true;
+    }
+
+    case LanRequest::Logoff:
+        disconnectClient(sender);
+        return true;
+
+    case LanRequest::XNetMessage:
+        return processXBusMessage(client, message);
+
+    case LanRequest::SetBroadcastFlags:
+        if (dataLength < 4)
+            break;
+
+        client.subscriptions = Client::Subscriptions::fromInt(qFromLittleEndian<qint32>(data));
+        return true;
+
+    case LanRequest::GetBroadcastFlags: {
+        auto flags = std::array<char, 4>{};
+        qToLittleEndian(client.subscriptions.toInt(), flags.data());
+        reply(client, lanMessage(LanMessageId::GetBroadcastFlags, flags));
+        return true;
+    }
+
+    case LanRequest::GetRBusData:
+        if (dataLength < 1)
+            break;
+
+        if (data[0] < rbusGroupCount)
+            reply(client, rbusMessage(data[0]));
+
+        return true;
+
+    case LanRequest::ProgramRBusModule:
+        return true; // nothing to program, and no reply
+
+    case LanRequest::GetSystemState:
+        reply(client, systemStateMessage());
+        return true;
+
+    case LanRequest::GetRailcomData:
+        if (dataLength >= 3) {
+            reply(client, railcomMessage(qFromLittleEndian<quint16>(data + 1)));
+        } else if (vehicleCount > 0) {
+            // without address the vehicles are reported one after the other
+            reply(client, railcomMessage(nextRailcomVehicle));
+            nextRailcomVehicle = static_cast<quint16>(nextRailcomVehicle % vehicleCount + 1);
+        } else {
+            reply(client, lanMessage(LanMessageId::RailcomDataChanged));
+        }
+
+        return true;
+
+    case LanRequest::GetLoconetDetector:
+        if (dataLength < 3)
+            break;
+
+        if (static_cast<LoconetDetectorInfo::Query>(data[0]) == LoconetDetectorInfo::Query::SIC) {
+            for (auto i = qsizetype{0}; i < loconetReports.size(); ++i)
+                reply(client, loconetDetectorMessage(i));
+        } else if (static_cast<LoconetDetectorInfo::Query>(data[0]) == LoconetDetectorInfo::Query::Report) {
+            if (const auto address = qFromLittleEndian<quint16>(data + 1); address > 0 && address <= loconetReports.size())
+                reply(client, loconetDetectorMessage(address - 1));
+        }
+
+        return true;
+
+    case LanRequest::GetCanDetector:
+        if (dataLength < 3)
+            break;
+
+        if (const auto networkId = qFromLittleEndian<quint16>(data + 1);
+                networkId == CanNetworkId || networkId == core::value(accessory::can::NetworkIdAny)) {
+            for (auto i = qsizetype{0}; i < canPorts.size(); ++i)
+                reply(client, canDetectorMessages(i));
+        }
+
+        return true;
+    }
+
+    qCDebug(logger(), "Unknown message: %s", message.rawData().toByteArray().toHex(' ').constData());
+    return false;
+}
+
+bool Simulator::Private::processXBusMessage(ClientState &client, Message message)
+{
+    const auto length = message.xbusMessageLength();
+
+    if (length < 1)
+        return false;
+
+    // the checksum covers the X-header and the data, so all of them together must XOR to zero
+    auto checksum = quint8{0};
+
+    for (const auto byte: message.rawData().sliced(4))
+        checksum ^= static_cast<quint8>(byte);
+
+    if (checksum != 0) {
+        qCWarning(logger(), "Ignoring XBus message with bad checksum: %s",
+                  message.rawData().toByteArray().toHex(' ').constData());
+        ++statistics.checksumErrors;
+        return true;
+    }
+
+    const auto header = static_cast<quint8>(message.rawData()[4]);
+    const auto data = message.xbusData();
+
+    switch (header) {
+    case 0x21:                                          // LAN_X_GET_VERSION and friends
+        switch (data[0]) {
+        case 0x21:
+            reply(client, xbusMessage({0x63, 0x21, 0x30, 0x12}));
+            return true;
+
+        case 0x24:
+            reply(client, statusChangedMessage());
+            return true;
+
+        case 0x80:
+            updateTrackStatus(Client::TrackStatus::PowerOff, &client);
+            return true;
+
+        case 0x81:
+            updateTrackStatus(Client::TrackStatus::PowerOn, &client);
+            return true;
+        }
+
+        break;
+
+    case 0x23:                                          // LAN_X_CV_READ
+        if (length >= 4 && data[0] == 0x11) {
+            const auto variable = static_cast<quint16>((qFromBigEndian<quint16>(data + 1) & 0x3ff) + 1);
+            const auto value = programmingTrack.value(variable, defaultVariable(variable));
+            reply(client, xbusMessage({0x64, 0x14, data[1], data[2], value}));
+            return true;
+        }
+
+        break;
+
+    case 0x24:                                          // LAN_X_CV_WRITE
+        if (length >= 5 && data[0] == 0x12) {
+            const auto variable = static_cast<quint16>((qFromBigEndian<quint16>(data + 1) & 0x3ff) + 1);
+            programmingTrack.insert(variable, data[3]);
+            return true; // like firmware 1.42 there is no reply
+        }
+
+        break;
+
+    case 0x43:                                          // LAN_X_GET_TURNOUT_INFO
+        if (length >= 3) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data) & 0x7ff);
+            reply(client, xbusMessage({0x43, highByte(address), lowByte(address), turnouts.value(address)}));
+            return true;
+        }
+
+        break;
+
+    case 0x44:                                          // LAN_X_GET_EXT_ACCESSORY_INFO
+        if (length >= 3) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data) & 0x7ff);
+            reply(client, xbusMessage({0x44, highByte(address), lowByte(address), accessories.value(address), 0x00}));
+            return true;
+        }
+
+        break;
+
+    case 0x53:                                          // LAN_X_SET_TURNOUT
+        if (length >= 4) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data) & 0x7ff);
+
+            if (data[2] & 0x08) { // only activation changes the state
+                const auto state = static_cast<quint8>((data[2] & 0x01) ? 2 : 1);
+                turnouts.insert(address, state);
+                broadcastGeneric(xbusMessage({0x43, highByte(address), lowByte(address), state}), &client);
+                reply(client, xbusMessage({0x43, highByte(address), lowByte(address), state}));
+            }
+
+            return true;
+        }
+
+        break;
+
+    case 0x54:                                          // LAN_X_SET_EXT_ACCESSORY
+        if (length >= 4) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data) & 0x7ff);
+            const auto message = xbusMessage({0x44, highByte(address), lowByte(address), data[2], 0x00});
+
+            accessories.insert(address, data[2]);
+            broadcastGeneric(message, &client);
+            reply(client, message);
+            return true;
+        }
+
+        break;
+
+    case 0x80:                                          // LAN_X_SET_STOP
+        updateTrackStatus(Client::TrackStatus::EmergencyStop, &client);
+        return true;
+
+    case 0x92:                                          // LAN_X_SET_LOCO_E_STOP
+        if (length >= 3) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data) & 0x3fff);
+            auto &vehicle = vehicles[address];
+            vehicle.speed = static_cast<quint8>((vehicle.speed & 0x80) | 0x01);
+            subscribeVehicle(client, address);
+            broadcastVehicle(address);
+            return true;
+        }
+
+        break;
+
+    case 0xe3:                                          // LAN_X_GET_LOCO_INFO
+        if (length >= 4 && data[0] == 0xf0) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data + 1) & 0x3fff);
+            subscribeVehicle(client, address);
+            reply(client, vehicleInfoMessage(address));
+            return true;
+        }
+
+        break;
+
+    case 0xe4:                                          // LAN_X_SET_LOCO_DRIVE and LAN_X_SET_LOCO_FUNCTION
+        if (length >= 5 && (data[0] & 0xfc) == 0x10) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data + 1) & 0x3fff);
+            auto &vehicle = vehicles[address];
+
+            switch (data[0] & 0x03) {
+            case 0:
+            case 1:
+                vehicle.speedSteps = VehicleInfo::DCC14;
+                break;
+
+            case 2:
+                vehicle.speedSteps = VehicleInfo::DCC28;
+                break;
+
+            case 3:
+                vehicle.speedSteps = VehicleInfo::DCC126;
+                break;
+            }
+
+            vehicle.speed = data[3];
+            subscribeVehicle(client, address);
+            broadcastVehicle(address);
+            return true;
+        } else if (length >= 5 && data[0] == 0xf8) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data + 1) & 0x3fff);
+            const auto function = data[3] & 0x3f;
+            auto &vehicle = vehicles[address];
+
+            if (function < 32) {
+                const auto mask = quint32{1} << function;
+
+                switch (data[3] >> 6) {
+                case 0:
+                    vehicle.functions &= ~mask;
+                    break;
+
+                case 1:
+                    vehicle.functions |= mask;
+                    break;
+
+                case 2:
+                    vehicle.functions ^= mask;
+                    break;
+                }
+            }
+
+            subscribeVehicle(client, address);
+            broadcastVehicle(address);
+            return true;
+        }
+
+        break;
+
+    case 0xe6:                                          // LAN_X_CV_POM_WRITE_BYTE and LAN_X_CV_POM_READ_BYTE
+        if (length >= 7 && data[0] == 0x30) {
+            const auto address = static_cast<quint16>(qFromBigEndian<quint16>(data + 1) & 0x3fff);
+            const auto option = data[3] & 0xfc;
+            const auto variable = static_cast<quint16>((((data[3] & 0x03) << 8) | data[4]) + 1);
+            auto &vehicle = vehicles[address];
+
+            if (option == 0xec) {
+                vehicle.variables.insert(variable, data[5]);
+                return true;
+            } else if (option == 0xe4) {
+                const auto value = vehicle.variables.value(variable, defaultVariable(variable));
+                reply(client, xbusMessage({0x64, 0x14, static_cast<quint8>(data[3] & 0x03), data[4], value}));
+                return true;
+            }
+        }
+
+        break;
+
+    case 0xf1:                                          // LAN_X_GET_FIRMWARE_VERSION
+        if (data[0] == 0x0a) {
+            reply(client, xbusMessage({0xf3, 0x0a, bcd(1), bcd(43)}));
+            return true;
+        }
+
+        break;
+    }
+
+    qCDebug(logger(), "Unknown XBus message: %s", message.rawData().toByteArray().toHex(' ').constData());
+    reply(client, xbusMessage({0x61, 0x82}));
+    return false;
+}
+
+void Simulator::Private::reply(ClientState &client, QByteArray message)
+{
+    ++statistics.sentMessages;
+    client.outbox += std::move(message);
+}
+
+template<typename Predicate>
+void Simulator::Private::broadcast(const QByteArray &message, Predicate &&accepts, const ClientState *requester)
+{
+    for (auto &client: clients) {
+        if (&client != requester && accepts(client))
+            reply(client, message);
+    }
+}
+
+void Simulator::Private::broadcastGeneric(const QByteArray &message, const ClientState *requester)
+{
+    broadcast(message, [](const ClientState &client) {
+        return client.subscriptions.testFlag(Client::Subscription::Generic);
+    }, requester);
+}
+
+void Simulator::Private::broadcastVehicle(quint16 address, const ClientState *requester)
+{
+    broadcast(vehicleInfoMessage(address), [address](const ClientState &client) {
+        return client.subscriptions.testFlag(Client::Subscription::AnyVehicle)
+                || (client.subscriptions.testFlag(Client::Subscription::Generic) && client.isSubscribed(address));
+    }, requester);
+}
+
+void Simulator::Private::broadcastRailcom(quint16 address)
+{
+    broadcast(railcomMessage(address), [address](const ClientState &client) {
+        return client.subscriptions.testFlag(Client::Subscription::RailcomAny)
+                || (client.subscriptions.testFlag(Client::Subscription::Railcom) && client.isSubscribed(address));
+    });
+}
+
+void Simulator::Private::flush()
+{
+    for (auto it = clients.begin(); it != clients.end(); ++it) {
+        const auto outbox = std::exchange(it->outbox, {});
+        auto pending = QByteArrayView{outbox};
+
+        while (!pending.isEmpty()) {
+            // split at message boundaries, but never leave a single message behind
+            auto size = qsizetype{0};
+
+            while (size < pending.size()) {
+                const auto length = Message{pending.sliced(size)}.length();
+
+                if (size > 0 && size + length > MaximumDatagramSize)
+                    break;
+
+                size += length;
+            }
+
+            sendDatagram(it.key(), pending.first(size).toByteArray());
+            pending = pending.sliced(size);
+        }
+    }
+}
+
+void Simulator::Private::sendDatagram(const Endpoint &receiver, QByteArray datagram)
+{
+    if (dropDatagram()) {
+        ++statistics.droppedDatagrams;
+        return;
+    }
+
+    if (latency > 0ms || jitter > 0ms) {
+        const auto delay = latency + std::chrono::milliseconds{jitter > 0ms ? random.bounded(jitter.count() + 1) : 0};
+        const auto due = Clock::now() + delay;
+
+        delayedDatagrams.emplace(due, std::make_pair(receiver, std::move(datagram)));
+
+        if (delayedDatagrams.begin()->first == due)
+            latencyTimer.start(delay);
+
+        return;
+    }
+
+    ++statistics.sentDatagrams;
+    socket.writeDatagram(datagram, receiver.address, receiver.port);
+}
+
+void Simulator::Private::sendDelayedDatagrams()
+{
+    const auto now = Clock::now();
+
+    while (!delayedDatagrams.empty() && delayedDatagrams.begin()->first <= now) {
+        const auto node = delayedDatagrams.extract(delayedDatagrams.begin());
+        const auto &[receiver, datagram] = node.mapped();
+
+        ++statistics.sentDatagrams;
+        socket.writeDatagram(datagram, receiver.address, receiver.port);
+    }
+
+    if (!delayedDatagrams.empty()) {
+        const auto delay = std::chrono::ceil<std::chrono::milliseconds>(delayedDatagrams.begin()->first - now);
+        latencyTimer.start(delay);
+    }
+}
+
+void Simulator::Private::updateTrackStatus(Client::TrackStatus status, ClientState *requester)
+{
+    const auto changed = std::exchange(trackStatus, status) != status;
+
+    if (requester)
+        reply(*requester, trackStatusBroadcast());
+
+    broadcastGeneric(trackStatusBroadcast(), requester);
+
+    if (changed)
+        emit q()->trackStatusChanged(status);
+}
+
+void Simulator::Private::subscribeVehicle(ClientState &client, quint16 address)
+{
+    if (client.vehicles.removeOne(address)) {
+        client.vehicles.append(address);
+        return;
+    }
+
+    if (client.vehicles.size() >= MaximumVehicleSubscriptions)
+        client.vehicles.removeFirst();
+
+    client.vehicles.append(address);
+}
+
+void Simulator::Private::disconnectClient(const Endpoint &endpoint)
+{
+    if (clients.remove(endpoint)) {
+        qCInfo(logger(), "Client %ls:%d disconnected", qUtf16Printable(endpoint.address.toString()), endpoint.port);
+        emit q()->clientDisconnected(endpoint.address, endpoint.port);
+    }
+}
+
+void Simulator::Private::simulateActivity()
+{
+    if (suspended)
+        return;
+
+    for (auto i = changeCount(vehicleCount); i > 0; --i) {
+        const auto address = static_cast<quint16>(random.bounded(vehicleCount) + 1);
+        auto &vehicle = vehicles[address];
+
+        auto speed = random.bounded(vehicle.speedSteps == VehicleInfo::DCC126 ? 128 : 32);
+        if (speed == 1)
+            speed = 0; // no accidental emergency stops
+
+        if (random.bounded(8) == 0)
+            vehicle.speed = static_cast<quint8>(vehicle.speed ^ 0x80);
+
+        vehicle.speed = static_cast<quint8>((vehicle.speed & 0x80) | speed);
+        vehicle.railcomReceiveCount += static_cast<quint32>(random.bounded(50, 100));
+        vehicle.railcomErrorCount = static_cast<quint16>(vehicle.railcomErrorCount + random.bounded(3));
+
+        broadcastVehicle(address);
+        broadcastRailcom(address);
+    }
+
+    for (auto i = changeCount(rbusGroupCount * RBusGroupSize * 8); i > 0; --i) {
+        const auto group = random.bounded(rbusGroupCount);
+        const auto port = random.bounded(RBusGroupSize * 8);
+        auto &ports = rbus[static_cast<size_t>(group)][static_cast<size_t>(port / 8)];
+        ports = static_cast<quint8>(ports ^ (1 << (port % 8)));
+
+        broadcast(rbusMessage(group), [](const ClientState &client) {
+            return client.subscriptions.testFlag(Client::Subscription::RBus);
+        });
+    }
+
+    for (auto i = changeCount(canPorts.size()); i > 0; --i) {
+        const auto index = random.bounded(canPorts.size());
+        auto &port = canPorts[index];
+
+        port.occupied = !port.occupied;
+
+        if (port.occupied && vehicleCount > 0)
+            port.vehicle = static_cast<quint16>((random.bounded(vehicleCount) + 1) | (random.bounded(2) ? 0x8000 : 0xc000));
+        else
+            port.vehicle = 0;
+
+        broadcast(canDetectorMessages(index), [](const ClientState &client) {
+            return client.subscriptions.testFlag(Client::Subscription::CanDetector);
+        });
+    }
+
+    for (auto i = changeCount(loconetReports.size()); i > 0; --i) {
+        const auto index = random.bounded(loconetReports.size());
+        loconetReports[index] = !loconetReports[index];
+
+        broadcast(loconetDetectorMessage(index), [](const ClientState &client) {
+            return client.subscriptions.testFlag(Client::Subscription::LoconetDetector);
+        });
+    }
+
+    flush();
+}
+
+void Simulator::Private::checkClients()
+{
+    const auto deadline = Clock::now() - clientTimeout;
+
+    for (const auto &endpoint: clients.keys()) {
+        if (clients[endpoint].lastSeen < deadline)
+            disconnectClient(endpoint);
+    }
+
+    if (!suspended) {
+        broadcast(systemStateMessage(), [](const ClientState &client) {
+            return client.subscriptions.testFlag(Client::Subscription::SystemState);
+        });
+
+        flush();
+    }
+}
+
+bool Simulator::Private::dropDatagram()
+{
+    return packetLoss > 0 && random.generateDouble() < packetLoss;
+}
+
+int Simulator::Private::changeCount(qsizetype count) const
+{
+    if (count <= 0 || activity <= 0)
+        return 0;
+
+    return std::max(1, qRound(static_cast<double>(count) * activity));
+}
+
+QByteArray Simulator::Private::statusChangedMessage() const
+{
+    return xbusMessage({0x62, 0x22, static_cast<quint8>(core::value(trackStatus))});
+}
+
+QByteArray Simulator::Private::trackStatusBroadcast() const
+{
+    switch (trackStatus) {
+    case Client::TrackStatus::PowerOn:
+        return xbusMessage({0x61, 0x01});
+    case Client::TrackStatus::PowerOff:
+        return xbusMessage({0x61, 0x00});
+    case Client::TrackStatus::EmergencyStop:
+        return xbusMessage({0x81, 0x00});
+    case Client::TrackStatus::ShortCircuit:
+        return xbusMessage({0x61, 0x08});
+    case Client::TrackStatus::ProgrammingMode:
+        return xbusMessage({0x61, 0x02});
+    }
+
+    return statusChangedMessage();
+}
+
+QByteArray Simulator::Private::systemStateMessage() const
+{
+    const auto poweredOn = (trackStatus == Client::TrackStatus::PowerOn);
+    const auto capabilities = Client::Capabilities{Client::Capability::DCC, Client::Capability::Railcom,
+                                                   Client::Capability::VehicleControl,
+                                                   Client::Capability::AccessoryControl,
+                                                   Client::Capability::DetectorControl};
+
+    auto data = std::array<char, 16>{};
+    qToLittleEndian<qint16>(poweredOn ? 250 : 0, data.data());                     // main current
+    qToLittleEndian<qint16>(0, data.data() + 2);                                    // programming current
+    qToLittleEndian<qint16>(poweredOn ? 250 : 0, data.data() + 4);                 // filtered main current
+    qToLittleEndian<qint16>(35, data.data() + 6);                                   // temperature
+    qToLittleEndian<quint16>(18000, data.data() + 8);                               // supply voltage
+    qToLittleEndian<quint16>(poweredOn ? 16000 : 0, data.data() + 10);             // track voltage
+    data[12] = static_cast<char>(core::value(trackStatus));                         // central state
+    data[15] = static_cast<char>(capabilities.toInt());
+
+    return lanMessage(LanMessageId::SystemStateDataChanged, data);
+}
+
+QByteArray Simulator::Private::vehicleInfoMessage(quint16 address) const
+{
+    const auto vehicle = vehicles.value(address);
+    const auto functions = vehicle.functions;
+    const auto msb = static_cast<quint8>(highByte(address) | (address >= 128 ? 0xc0 : 0x00));
+
+    return xbusMessage({0xef, msb, lowByte(address), vehicle.speedSteps, vehicle.speed,
+                        static_cast<quint8>(((functions & 1) << 4) | ((functions >> 1) & 0x0f)), // F0, F4-F1
+                        static_cast<quint8>(functions >> 5),                                     // F5-F12
+                        static_cast<quint8>(functions >> 13),                                    // F13-F20
+                        static_cast<quint8>(functions >> 21),                                    // F21-F28
+                        static_cast<quint8>((functions >> 29) & 0x07)});                         // F29-F31
+}
+
+QByteArray Simulator::Private::railcomMessage(quint16 address) const
+{
+    const auto vehicle = vehicles.find(address);
+
+    if (vehicle == vehicles.end())
+        return lanMessage(LanMessageId::RailcomDataChanged);
+
+    const auto errorRate = vehicle->railcomReceiveCount > 0
+            ? 100 * vehicle->railcomErrorCount / vehicle->railcomReceiveCount : 0;
+    const auto options = RailcomInfo::Options{RailcomInfo::Option::Speed1, RailcomInfo::Option::QoS};
+
+    auto data = std::array<char, 13>{};
+    qToLittleEndian(address, data.data());
+    qToLittleEndian(vehicle->railcomReceiveCount, data.data() + 2);
+    qToLittleEndian(vehicle->railcomErrorCount, data.data() + 6);
+    data[9] = static_cast<char>(options.toInt());
+    data[10] = static_cast<char>(vehicle->speed & 0x7f);
+    data[11] = static_cast<char>(100 - std::min(errorRate, 100U));
+
+    return lanMessage(LanMessageId::RailcomDataChanged, data);
+}
+
+QByteArray Simulator::Private::rbusMessage(int group) const
+{
+    auto data = std::array<char, 1 + RBusGroupSize>{};
+    const auto &ports = rbus[static_cast<size_t>(group)];
+
+    data[0] = static_cast<char>(group);
+    std::copy(ports.begin(), ports.end(), data.begin() + 1);
+
+    return lanMessage(LanMessageId::RBusDetectorDataChanged, data);
+}
+
+// an occupancy message, followed by the vehicle set that terminates with an empty entry
+QByteArray Simulator::Private::canDetectorMessages(qsizetype index) const
+{
+    const auto &port = canPorts[index];
+    const auto module = static_cast<quint16>(index / CanPortsPerModule + 1);
+
+    const auto message = [module, index](CanDetectorInfo::Type type, quint16 value1, quint16 value2) {
+        auto data = std::array<char, 10>{};
+        qToLittleEndian(CanNetworkId, data.data());
+        qToLittleEndian(module, data.data() + 2);
+        data[4] = static_cast<char>(index % CanPortsPerModule);
+        data[5] = static_cast<char>(core::value(type));
+        qToLittleEndian(value1, data.data() + 6);
+        qToLittleEndian(value2, data.data() + 8);
+        return lanMessage(LanMessageId::CanDetectorDataChanged, data);
+    };
+
+    return message(CanDetectorInfo::Type::Occupancy, static_cast<quint16>(port.occupied ? 0x1100 : 0x0100), 0)
+            + message(CanDetectorInfo::Type::VehicleSet1, port.vehicle, 0);
+}
+
+QByteArray Simulator::Private::loconetDetectorMessage(qsizetype index) const
+{
+    auto data = std::array<char, 4>{};
+    data[0] = static_cast<char>(core::value(LoconetDetectorInfo::Type::Occupancy));
+    qToLittleEndian(static_cast<quint16>(index + 1), data.data() + 1);
+    data[3] = loconetReports[index] ? 1 : 0;
+
+    return lanMessage(LanMessageId::LoconetDetectorDataChanged, data);
+}
+
+Simulator::Simulator(QObject *parent)
+    : QObject{parent}
+    , d{new Private{this}}
+{
+    d->activityTimer.setInterval(1s);
+    d->housekeepingTimer.setInterval(1s);
+    d->latencyTimer.setSingleShot(true);
+    d->latencyTimer.setTimerType(Qt::PreciseTimer);
+
+    connect(&d->socket, &QUdpSocket::readyRead, d, &Private::readDatagrams);
+    connect(&d->activityTimer, &QTimer::timeout, d, &Private::simulateActivity);
+    connect(&d->housekeepingTimer, &QTimer::timeout, d, &Private::checkClients);
+    connect(&d->latencyTimer, &QTimer::timeout, d, &Private::sendDelayedDatagrams);
+}
+
+bool Simulator::listen(const QHostAddress &address, quint16 port)
+{
+    close();
+
+    if (!d->socket.bind(address, port))
+        return false;
+
+    qCInfo(logger(this), "Listening on %ls:%d", qUtf16Printable(d->socket.localAddress().toString()),
+           d->socket.localPort());
+
+    d->activityTimer.start();
+    d->housekeepingTimer.start();
+    return true;
+}
+
+void Simulator::close()
+{
+    d->activityTimer.stop();
+    d->housekeepingTimer.stop();
+    d->latencyTimer.stop();
+    d->delayedDatagrams.clear();
+    d->socket.close();
+    restart();
+}
+
+bool Simulator::isListening() const
+{
+    return d->socket.state() == QUdpSocket::BoundState;
+}
+
+QHostAddress Simulator::address() const
+{
+    return d->socket.localAddress();
+}
+
+quint16 Simulator::port() const
+{
+    return d->socket.localPort();
+}
+
+QString Simulator::errorString() const
+{
+    return d->socket.errorString();
+}
+
+void Simulator::setVehicleCount(int count)
+{
+    d->vehicleCount = std::max(count, 0);
+
+    for (auto address = 1; address <= d->vehicleCount; ++address)
+        d->vehicles.try_emplace(static_cast<quint16>(address));
+
+    d->nextRailcomVehicle = 1;
+}
+
+int Simulator::vehicleCount() const
+{
+    return d->vehicleCount;
+}
+
+void Simulator::setRBusGroupCount(int count)
+{
+    d->rbusGroupCount = std::clamp(count, 0, MaximumRBusGroups);
+}
+
+int Simulator::rbusGroupCount() const
+{
+    return d->rbusGroupCount;
+}
+
+void Simulator::setCanModuleCount(int count)
+{
+    d->canPorts.resize(std::max(count, 0) * CanPortsPerModule);
+}
+
+int Simulator::canModuleCount() const
+{
+    return static_cast<int>(d->canPorts.size() / CanPortsPerModule);
+}
+
+void Simulator::setLoconetReportCount(int count)
+{
+    d->loconetReports.resize(std::max(count, 0));
+}
+
+int Simulator::loconetReportCount() const
+{
+    return static_cast<int>(d->loconetReports.size());
+}
+
+void Simulator::setActivityInterval(std::chrono::milliseconds interval)
+{
+    d->activityTimer.setInterval(interval);
+}
+
+std::chrono::milliseconds Simulator::activityInterval() const
+{
+    return d->activityTimer.intervalAsDuration();
+}
+
+void Simulator::setActivity(double share)
+{
+    d->activity = std::clamp(share, 0.0, 1.0);
+}
+
+double Simulator::activity() const
+{
+    return d->activity;
+}
+
+void Simulator::setPacketLoss(double probability)
+{
+    d->packetLoss = std::clamp(probability, 0.0, 1.0);
+}
+
+double Simulator::packetLoss() const
+{
+    return d->packetLoss;
+}
+
+void Simulator::setLatency(std::chrono::milliseconds latency, std::chrono::milliseconds jitter)
+{
+    d->latency = std::max(latency, 0ms);
+    d->jitter = std::max(jitter, 0ms);
+}
+
+std::chrono::milliseconds Simulator::latency() const
+{
+    return d->latency;
+}
+
+std::chrono::milliseconds Simulator::jitter() const
+{
+    return d->jitter;
+}
+
+void Simulator::setRandomSeed(quint32 seed)
+{
+    d->random.seed(seed);
+}
+
+void Simulator::setClientTimeout(std::chrono::milliseconds timeout)
+{
+    d->clientTimeout = timeout;
+}
+
+std::chrono::milliseconds Simulator::clientTimeout() const
+{
+    return d->clientTimeout;
+}
+
+qsizetype Simulator::clientCount() const
+{
+    return d->clients.size();
+}
+
+void Simulator::setTrackStatus(Client::TrackStatus status)
+{
+    d->updateTrackStatus(status);
+    d->flush();
+}
+
+Client::TrackStatus Simulator::trackStatus() const
+{
+    return d->trackStatus;
+}
+
+void Simulator::setSerialNumber(quint32 serialNumber)
+{
+    d->serialNumber = serialNumber;
+}
+
+quint32 Simulator::serialNumber() const
+{
+    return d->serialNumber;
+}
+
+void Simulator::setSuspended(bool suspended)
+{
+    d->suspended = suspended;
+}
+
+bool Simulator::isSuspended() const
+{
+    return d->suspended;
+}
+
+void Simulator::restart()
+{
+    for (const auto &endpoint: d->clients.keys())
+        d->disconnectClient(endpoint);
+
+    d->trackStatus = Client::TrackStatus::PowerOn;
+}
+
+Simulator::Statistics Simulator::statistics() const
+{
+    return d->statistics;
+}
+
+void Simulator::resetStatistics()
+{
+    d->statistics = {};
+}
+
+} // namespace lmrs::roco::z21
@@ -0,0 +1,104 @@
+#ifndef LMRS_TOOLS_Z21SIMULATOR_SIMULATOR_H
+#define LMRS_TOOLS_Z21SIMULATOR_SIMULATOR_H
+
+#include <lmrs/roco/z21client.h>
+
+#include <QHostAddress>
+
+namespace lmrs::roco::z21 {
+
+/// A command station speaking the Z21 LAN protocol on a local UDP port, for
+/// load testing Client without hardware. Vehicles, turnouts, accessories and
+/// variables are kept in memory, detectors and vehicles can be simulated in
+/// large numbers, and network conditions can be made worse on purpose.
+class Simulator : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Statistics
+    {
+        quint64 receivedDatagrams = 0;
+        quint64 receivedMessages = 0;
+        quint64 unknownMessages = 0;
+        quint64 checksumErrors = 0;     ///< XBus messages ignored for their bad checksum
+        quint64 sentDatagrams = 0;
+        quint64 sentMessages = 0;
+        quint64 droppedDatagrams = 0;   ///< datagrams lost on purpose, in either direction, or while suspended
+    };
+
+    explicit Simulator(QObject *parent = nullptr);
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = Client::DefaultPort);
+    void close();
+
+    [[nodiscard]] bool isListening() const;
+    [[nodiscard]] QHostAddress address() const;
+    [[nodiscard]] quint16 port() const;
+    [[nodiscard]] QString errorString() const;
+
+    /// Vehicles with the addresses 1 to `count` drive on their own, and report RailCom data.
+    void setVehicleCount(int count);
+    [[nodiscard]] int vehicleCount() const;
+
+    void setRBusGroupCount(int count);
+    [[nodiscard]] int rbusGroupCount() const;
+
+    /// Each CAN occupancy detector has eight ports.
+    void setCanModuleCount(int count);
+    [[nodiscard]] int canModuleCount() const;
+
+    void setLoconetReportCount(int count);
+    [[nodiscard]] int loconetReportCount() const;
+
+    /// Every `interval` the given share of simulated vehicles and detectors changes its state.
+    void setActivityInterval(std::chrono::milliseconds interval);
+    [[nodiscard]] std::chrono::milliseconds activityInterval() const;
+    void setActivity(double share);
+    [[nodiscard]] double activity() const;
+
+    /// The probability of losing a datagram, both when receiving and when sending.
+    void setPacketLoss(double probability);
+    [[nodiscard]] double packetLoss() const;
+
+    /// Delays sent datagrams by `latency`, plus up to `jitter`, which might reorder them.
+    void setLatency(std::chrono::milliseconds latency, std::chrono::milliseconds jitter = {});
+    [[nodiscard]] std::chrono::milliseconds latency() const;
+    [[nodiscard]] std::chrono::milliseconds jitter() const;
+
+    void setRandomSeed(quint32 seed);
+
+    /// Clients are forgotten when not sending anything for this long, 60 seconds for real hardware.
+    void setClientTimeout(std::chrono::milliseconds timeout);
+    [[nodiscard]] std::chrono::milliseconds clientTimeout() const;
+    [[nodiscard]] qsizetype clientCount() const;
+
+    void setTrackStatus(Client::TrackStatus status);
+    [[nodiscard]] Client::TrackStatus trackStatus() const;
+
+    void setSerialNumber(quint32 serialNumber);
+    [[nodiscard]] quint32 serialNumber() const;
+
+    /// Ignores all datagrams while suspended, like a command station with unplugged network cable.
+    void setSuspended(bool suspended);
+    [[nodiscard]] bool isSuspended() const;
+
+    /// Forgets all clients and their subscriptions, like a command station after a power cycle.
+    void restart();
+
+    [[nodiscard]] Statistics statistics() const;
+    void resetStatistics();
+
+signals:
+    void clientConnected(QHostAddress address, quint16 port);
+    void clientDisconnected(QHostAddress address, quint16 port);
+    void trackStatusChanged(lmrs::roco::z21::Client::TrackStatus trackStatus);
+
+private:
+    class Private;
+    Private *const d;
+};
+
+} // namespace lmrs::roco::z21
+
+#endif // LMRS_TOOLS_Z21SIMULATOR_SIMULATOR_H